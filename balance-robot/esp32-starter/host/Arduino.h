@@ -0,0 +1,69 @@
+//Minimal Arduino API for building the firmware headers on a host PC.
+//Pin writes are recorded so tests can count pulses and check the direction pin.
+//The cycle counter advances by one on every read, so busy-waits end and pulse widths can be measured in cycles
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <cstdint>
+#include <cmath>
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+#define LOW     0
+#define HIGH    1
+#define INPUT   0x01
+#define OUTPUT  0x03
+
+#define IRAM_ATTR
+
+const int HOST_NUM_PINS = 40;
+
+//Current level and number of rising edges of every pin
+struct host_pin {
+    uint8_t mode;
+    uint8_t level;
+    uint32_t rising;
+    uint32_t riseCycle;         //cycle count at the last rising edge
+    uint32_t highCycles;        //length of the last high pulse (cycles)
+};
+
+//Subset of the ESP32 Arduino ESP object
+struct host_esp {
+    uint32_t cycles;
+    uint32_t getCycleCount() { return ++cycles; }
+};
+
+extern host_pin hostPins[HOST_NUM_PINS];
+extern host_esp ESP;
+
+inline uint32_t getCpuFrequencyMhz() {
+    return 240;
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+    hostPins[pin].mode = mode;
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t val) {
+    host_pin &p = hostPins[pin];
+    if (val && !p.level) {
+        p.rising++;
+        p.riseCycle = ESP.cycles;
+    }
+    else if (!val && p.level) {
+        p.highCycles = ESP.cycles - p.riseCycle;
+    }
+    p.level = val ? HIGH : LOW;
+}
+
+inline int digitalRead(uint8_t pin) {
+    return hostPins[pin].level;
+}
+
+//Define the pin array and cycle counter in exactly one translation unit
+#define HOST_ARDUINO_PINS host_pin hostPins[HOST_NUM_PINS]; host_esp ESP;
+
+#endif
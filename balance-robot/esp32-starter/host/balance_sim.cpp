@@ -0,0 +1,171 @@
+//Hardware-in-the-loop simulation of the balancing robot (robot_sim.h), for tuning gains and control rates on the
+//host before trying them on the robot.
+//
+//A single run starts the robot at a tilt, optionally drives it at a target speed, and prints how well it
+//balanced, with a CSV trace of every control period on request. -s sweeps a scale on all the controller gains
+//against the control rate and prints a table of the RMS tilt, or the time of the fall. -m finds the lowest
+//control rate at which the robot balances for several noise seeds. The run time is reported against the
+//simulated time. Two stepper ticks every 20 μs dominate the run time; -i 40 halves it, at the cost of coarser
+//step timing. step.h steps at most once per tick, which limits the interval to 50 μs at 10000 microsteps/s.
+//-x simulates the esp32-adaptive-microsteps build, with 4 times the wheel speed limit and the interval below 50 μs.
+
+#include <Arduino.h>
+#include "robot_sim.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+HOST_ARDUINO_PINS
+
+static int usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-t seconds] [-r control Hz] [-i stepper interval us] [-g gain scale] [-a initial tilt deg]\n"
+            "          [-v speed m/s] [-b gyro bias LSB] [-n seed] [-c] [-s] [-m] [-x]\n"
+            "  -i  up to 50 us, 49 with -x; longer than the firmware's 20 us runs faster with coarser step timing\n"
+            "  -c  CSV trace of every control period: time,tilt,estimate,position,speed,command\n"
+            "  -s  sweep gain scale against control rate\n"
+            "  -m  find the lowest control rate that balances\n"
+            "  -x  adaptive microstepping, as the esp32-adaptive-microsteps build\n",
+            name);
+    return 1;
+}
+
+static sim_config scaled(sim_config c, double gain) {
+    c.tiltKp *= gain;
+    c.tiltKi *= gain;
+    c.tiltKd *= gain;
+    c.speedKp *= gain;
+    c.speedKi *= gain;
+    return c;
+}
+
+//Run from the initial tilt, then at the target speed for the rest of the time
+static sim_result simulate(const sim_config& c, double tilt, double speed, double seconds,
+                           robot_sim::trace_handler trace = nullptr) {
+    robot_sim sim(c);
+    sim.body.angle = tilt;
+    sim.setTrace(trace);
+    if (sim.run(seconds / 2)) {
+        sim.setTarget(speed);
+        sim.run(seconds / 2);
+    }
+    return sim.getResult();
+}
+
+//Balances for every seed
+static bool balancesAll(sim_config c, double tilt, double speed, double seconds, int seeds) {
+    for (int s = 1; s <= seeds; s++) {
+        c.seed = s;
+        if (!simulate(c, tilt, speed, seconds).balanced)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    sim_config config;
+    double seconds = 10, gain = 1, tilt = 0.1, speed = 0;
+    bool csv = false, sweep = false, minimum = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:r:i:g:a:v:b:n:csmx")) != -1) {
+        switch (opt) {
+            case 't': seconds = atof(optarg); break;
+            case 'r': config.controlHz = atoi(optarg); break;
+            case 'i':
+                config.stepperIntervalUs = atoi(optarg);
+                config.physicsTicks = config.stepperIntervalUs >= 50 ? 1 : 100 / config.stepperIntervalUs;
+                break;
+            case 'g': gain = atof(optarg); break;
+            case 'a': tilt = atof(optarg) * M_PI / 180; break;
+            case 'v': speed = atof(optarg); break;
+            case 'b': config.gyroBias = atof(optarg); break;
+            case 'n': config.seed = atoi(optarg); break;
+            case 'c': csv = true; break;
+            case 's': sweep = true; break;
+            case 'm': minimum = true; break;
+            case 'x': config.speedRange = 4; break;
+            default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc || config.controlHz <= 0 || config.stepperIntervalUs <= 0 ||
+        config.stepperIntervalUs > (config.speedRange > 1 ? 49 : 50) ||
+        1000000 % (config.controlHz * config.stepperIntervalUs) != 0)
+        return usage(argv[0]);
+
+    auto t0 = std::chrono::steady_clock::now();
+    double simulated = 0;
+
+    if (sweep) {
+        const int rates[] = {1000, 500, 250, 200, 125, 100, 50};
+        const double gains[] = {0.5, 0.75, 1.0, 1.25, 1.5, 2.0};
+        printf("rms tilt (mrad), or fall time (s) as F<t>\ngain  ");
+        for (int r : rates)
+            printf("%8d Hz", r);
+        printf("\n");
+        for (double g : gains) {
+            printf("%4.2f  ", g);
+            for (int r : rates) {
+                sim_config c = scaled(config, g);
+                c.controlHz = r;
+                sim_result result = simulate(c, tilt, speed, seconds);
+                simulated += seconds;
+                if (result.balanced)
+                    printf("%11.2f", result.rmsTilt * 1000);
+                else
+                    printf("     F%5.2f", result.fallTime);
+            }
+            printf("\n");
+        }
+    }
+    else if (minimum) {
+        //Bisect on the control periods that are whole numbers of stepper ticks, down to 5 Hz
+        const int SEEDS = 5;
+        sim_config c = scaled(config, gain);
+        int ticksPerSecond = 1000000 / c.stepperIntervalUs;
+        std::vector<int> rates;
+        for (int ticks = ticksPerSecond / c.controlHz; ticks <= ticksPerSecond / 5; ticks++)
+            if (ticksPerSecond % ticks == 0)
+                rates.push_back(ticksPerSecond / ticks);
+        size_t good = 0, bad = rates.size();
+        simulated += seconds * SEEDS;
+        if (!balancesAll(c, tilt, speed, seconds, SEEDS)) {
+            printf("does not balance at %d Hz\n", c.controlHz);
+            return 1;
+        }
+        while (bad - good > 1) {
+            size_t mid = (good + bad) / 2;
+            c.controlHz = rates[mid];
+            simulated += seconds * SEEDS;
+            if (balancesAll(c, tilt, speed, seconds, SEEDS))
+                good = mid;
+            else
+                bad = mid;
+        }
+        printf("lowest control rate that balances for %d seeds: %d Hz\n", SEEDS, rates[good]);
+    }
+    else {
+        robot_sim::trace_handler trace = nullptr;
+        if (csv) {
+            printf("time,tilt,estimate,position,speed,command\n");
+            trace = [](double t, double angle, double estimate, double position, double v, int32_t command) {
+                printf("%.3f,%.5f,%.5f,%.4f,%.4f,%d\n", t, angle, estimate, position, v, command);
+            };
+        }
+        sim_result r = simulate(scaled(config, gain), tilt, speed, seconds, trace);
+        simulated = seconds;
+        FILE *out = csv ? stderr : stdout;
+        if (r.balanced)
+            fprintf(out, "balanced: rms tilt %.2f mrad, max %.2f mrad, position %.3f m, speed %.3f m/s\n",
+                    r.rmsTilt * 1000, r.maxTilt * 1000, r.position, r.speed);
+        else
+            fprintf(out, "%s at %.3f s (%u slips)\n", r.slips > 0 ? "stalled" : "fell", r.fallTime, r.slips);
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    fprintf(csv ? stderr : stdout, "%.0f s simulated in %.2f s, %.0fx real time\n", simulated, elapsed,
+            simulated / elapsed);
+    return 0;
+}
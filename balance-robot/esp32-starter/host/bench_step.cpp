@@ -0,0 +1,86 @@
+//Host benchmark of step::runStepper() in PERIOD_MODE and DDA_MODE
+//
+//Each run replays the same command sequence: a new target speed every 10 ms, as from the control loop,
+//sweeping forwards and backwards through the speed range. The time per call is measured with the TSC on
+//x86 (cycles) and with steady_clock (ns). A second run holds a constant target for 100 s and compares the
+//number of steps output with the ideal count, showing the rate error of each algorithm.
+
+#include <Arduino.h>
+#include <cycle_count.h>
+#include <step.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+
+HOST_ARDUINO_PINS
+
+const int INTERVAL_US = 20;
+const int STEP_PIN = 17;
+const int DIR_PIN = 16;
+const int TICKS_PER_COMMAND = 500;  //10 ms control loop
+
+struct result {
+    double cyclesPerCall;
+    double nsPerCall;
+    int32_t position;
+};
+
+static result sweep(step::stepMode mode, long ticks) {
+    step s(INTERVAL_US, STEP_PIN, DIR_PIN, mode);
+    s.setAccelerationRad(50.0);
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    for (long t = 0; t < ticks; t++) {
+        if (t % TICKS_PER_COMMAND == 0) {
+            //Triangle wave of target speed between +-MAX_SPEED
+            long phase = (t / TICKS_PER_COMMAND) % 400;
+            int32_t target = (phase < 200 ? phase - 100 : 300 - phase) * (s.MAX_SPEED / 100) * s.SPEED_SCALE;
+            s.setTargetSpeed(target);
+        }
+        s.runStepper();
+    }
+    uint64_t c1 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+
+    result r;
+    r.cyclesPerCall = static_cast<double>(c1 - c0) / ticks;
+    r.nsPerCall = std::chrono::duration<double, std::nano>(t1 - t0).count() / ticks;
+    r.position = s.getPosition();
+    return r;
+}
+
+//Run at a constant speed and return the step count
+static int32_t constantSpeed(step::stepMode mode, int32_t speed, long ticks) {
+    step s(INTERVAL_US, STEP_PIN, DIR_PIN, mode);
+    s.setAcceleration(1000000);
+    s.setTargetSpeed(speed);
+    for (long t = 0; t < ticks; t++)
+        s.runStepper();
+    return s.getPosition();
+}
+
+int main(int argc, char *argv[]) {
+    long ticks = argc > 1 ? atol(argv[1]) : 50000000;
+
+    printf("%ld ticks of %d us\n", ticks, INTERVAL_US);
+    for (step::stepMode mode : {step::PERIOD_MODE, step::DDA_MODE}) {
+        result r = sweep(mode, ticks);
+        printf("%-7s %7.1f cycles/call %6.2f ns/call (position %d)\n",
+               mode == step::PERIOD_MODE ? "period" : "dda", r.cyclesPerCall, r.nsPerCall, r.position);
+    }
+
+    //Ideal steps in 100 s for a selection of speeds in steps/s
+    const long seconds = 100;
+    printf("\nSteps in %ld s at constant speed\n%8s %10s %10s %10s\n", seconds, "steps/s", "ideal", "period", "dda");
+    for (int rate : {37, 333, 1234, 3000, 7777}) {
+        step ref(INTERVAL_US, STEP_PIN, DIR_PIN);
+        int32_t speed = rate * ref.SPEED_SCALE;
+        long n = seconds * 1000000 / INTERVAL_US;
+        printf("%8d %10ld %10d %10d\n", rate, rate * seconds,
+               constantSpeed(step::PERIOD_MODE, speed, n), constantSpeed(step::DDA_MODE, speed, n));
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef CYCLE_COUNT_H
+#define CYCLE_COUNT_H
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+//Timing for the host tests and benchmarks. cycles() reads the x86 time stamp counter; on other hosts it returns 0
+//and the tests skip their time limits
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t cycles() { return __rdtsc(); }
+#else
+inline uint64_t cycles() { return 0; }
+#endif
+
+//Distribution of the cycles taken by each call
+struct cycle_summary {
+    double mean;
+    uint32_t p999;              //99.9th percentile
+    uint32_t max;
+};
+
+//Summarise the cycles taken by each call, and describe them in msg as "name: mean, 99.9%, max cycles". Sorts
+//the samples
+inline cycle_summary summariseCycles(std::vector<uint32_t>& samples, const char *name, char *msg, size_t size) {
+    cycle_summary s = {0, 0, 0};
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        uint64_t total = 0;
+        for (uint32_t c : samples)
+            total += c;
+        s.mean = static_cast<double>(total) / samples.size();
+        s.p999 = samples[samples.size() * 999 / 1000];
+        s.max = samples.back();
+    }
+    snprintf(msg, size, "%s: mean %.1f, 99.9%% %u, max %u cycles", name, s.mean, s.p999, s.max);
+    return s;
+}
+
+#endif
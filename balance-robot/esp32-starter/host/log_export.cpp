@@ -0,0 +1,85 @@
+//Exports the sensor log of the firmware (src/sensor_log.h) as CSV, one line per control period:
+//  time_us,accel_x,accel_y,accel_z,gyro_x,gyro_y,gyro_z,speed1,speed2,position1,position2,output
+//Accelerations and rates are raw sensor readings, speeds and the controller output in microsteps/s and positions
+//in microsteps. With -u they are converted with the scales in the log header: time in s, accelerations in g,
+//rates in rad/s, and wheel speeds, positions and output in rad/s and rad. The second motor faces the other way,
+//so its speed and position are negative going forwards, as in the telemetry.
+//Gaps in the timestamps, where records were dropped because the flash fell behind, are reported on stderr with
+//the number of records.
+//
+//Usage: log_export [-u] log.bin > log.csv
+//where log.bin is a copy of the log partition, read from the ESP32 with the offset and size in partitions.csv:
+//  esptool.py read_flash 0x150000 0x2a0000 log.bin
+//The CSV loads directly into pandas or similar tools, which can convert it to Parquet
+
+#include <log_records.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+static int usage(const char *name) {
+    fprintf(stderr, "usage: %s [-u] log.bin\n", name);
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    bool units = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "u")) != -1) {
+        if (opt == 'u')
+            units = true;
+        else
+            return usage(argv[0]);
+    }
+    if (optind != argc - 1)
+        return usage(argv[0]);
+
+    FILE *in = fopen(argv[optind], "rb");
+    if (in == nullptr) {
+        perror(argv[optind]);
+        return 1;
+    }
+    log_header h;
+    if (fread(&h, sizeof(h), 1, in) != 1 || !logHeaderValid(h)) {
+        fprintf(stderr, "%s: no sensor log, or a different version\n", argv[optind]);
+        return 1;
+    }
+
+    if (units)
+        printf("time_s,accel_x_g,accel_y_g,accel_z_g,gyro_x_rad_s,gyro_y_rad_s,gyro_z_rad_s,speed1_rad_s,"
+               "speed2_rad_s,position1_rad,position2_rad,output_rad_s\n");
+    else
+        printf("time_us,accel_x,accel_y,accel_z,gyro_x,gyro_y,gyro_z,speed1,speed2,position1,position2,output\n");
+
+    double speedRad = h.stepAngle / h.speedScale;
+    unsigned long records = 0, gaps = 0, missing = 0;
+    uint32_t last = h.start;
+    log_record r;
+    while (fread(&r, sizeof(r), 1, in) == 1 && !logRecordErased(r)) {
+        //Count periods skipped, allowing for jitter of up to half a period
+        uint32_t skipped = (r.time - last + h.period / 2) / h.period;
+        if (records > 0 && skipped > 1) {
+            gaps++;
+            missing += skipped - 1;
+        }
+        last = r.time;
+        records++;
+
+        if (units)
+            printf("%.6f,%.5f,%.5f,%.5f,%.5f,%.5f,%.5f,%.4f,%.4f,%.5f,%.5f,%.4f\n",
+                   static_cast<uint32_t>(r.time - h.start) * 1e-6, r.accel[0] * h.accelScale,
+                   r.accel[1] * h.accelScale, r.accel[2] * h.accelScale, r.gyro[0] * h.gyroScale,
+                   r.gyro[1] * h.gyroScale, r.gyro[2] * h.gyroScale, r.speed[0] * speedRad, r.speed[1] * speedRad,
+                   r.position[0] * h.stepAngle, r.position[1] * h.stepAngle, r.output * h.stepAngle);
+        else
+            printf("%u,%d,%d,%d,%d,%d,%d,%.1f,%.1f,%d,%d,%d\n", r.time, r.accel[0], r.accel[1], r.accel[2],
+                   r.gyro[0], r.gyro[1], r.gyro[2], static_cast<double>(r.speed[0]) / h.speedScale,
+                   static_cast<double>(r.speed[1]) / h.speedScale, r.position[0], r.position[1], r.output);
+    }
+    fclose(in);
+
+    fprintf(stderr, "%lu records, %.3f s at %u us; %lu gaps, %lu records missing\n", records,
+            records * h.period * 1e-6, h.period, gaps, missing);
+    return 0;
+}
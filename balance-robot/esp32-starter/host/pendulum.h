@@ -0,0 +1,35 @@
+//Planar model of the balancing robot for host tests: a rigid body pivoting on the wheel axle, with the axle
+//moving at the wheel speed. The steppers do not slip, so the wheels are a kinematic input to the model
+
+#ifndef HOST_PENDULUM_H
+#define HOST_PENDULUM_H
+
+#include <cmath>
+
+struct pendulum {
+    double length = 0.1;            //axle to centre of mass (m)
+    double inertia = 4.0 / 3;       //moment of inertia about the axle / (mass * length^2), 4/3 for a uniform rod
+    double gravity = 9.80665;       //m/s/s
+
+    double angle = 0;               //tilt, positive leaning forward (rad)
+    double rate = 0;                //rad/s
+    double position = 0;            //axle position (m)
+    double speed = 0;               //axle speed (m/s)
+    double angular = 0;             //angular acceleration in the last update (rad/s/s)
+
+    //Advance by dt seconds with the axle accelerating at accel (m/s/s)
+    void update(double accel, double dt) {
+        angular = (gravity * sin(angle) - accel * cos(angle)) / (inertia * length);
+        rate += angular * dt;
+        angle += rate * dt;
+        speed += accel * dt;
+        position += speed * dt;
+    }
+
+    //Fallen over
+    bool fallen() const {
+        return fabs(angle) > 1.2;
+    }
+};
+
+#endif
@@ -0,0 +1,154 @@
+//Sends one command to the ESP32 (src/command.h) and reports its acknowledgement and the round-trip time
+//
+//Usage: robot_command [-b baud] [-t seconds] device command [arguments]
+//  stop
+//  heartbeat
+//  velocity linear_m_s angular_rad_s
+//  move distance_m angle_rad max_speed_m_s max_accel_m_s2
+//  gains tilt_kp tilt_ki tilt_kd speed_kp speed_ki
+//  profile
+//  log erase|start|stop
+//With -t, heartbeats keep the command running for that long, then the robot is stopped. Without it the ESP32
+//watchdog stops the robot shortly after a velocity command. A command that is not acknowledged within 100 ms is
+//sent again with the same sequence number, up to 5 times.
+//The round trip includes waiting for the next telemetry flush on the ESP32, so it is up to 10 ms longer than the
+//time taken for the command to reach the control loop.
+//profile prints the cycle counts of each profiled section of the firmware since the previous request.
+//log erase erases the log partition, which takes several seconds and is rejected with "bad value" while the robot
+//is balancing, since it would stop the control loop. log start then logs every control period to flash until
+//log stop or the partition is full, and can be sent while balancing; it is rejected unless the partition has been
+//erased since the last log. The progress appears as text messages in the telemetry. See host/log_export. Both
+//are rejected if the firmware has no log partition or is not the esp32-mcpwm build
+
+#include "robot_link.h"
+#include "serial_port.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+const int ACK_TIMEOUT_MS = 100;
+const int RETRIES = 5;
+const int HEARTBEAT_INTERVAL_MS = 100;
+const int PROFILE_WAIT_MS = 100;        //for the profile records after the acknowledgement
+
+static const char *RESULTS[] = {"ok", "duplicate", "bad type", "bad length", "bad value"};
+
+//Send a command, resending until it is acknowledged. Returns false if it never was
+static bool sendAcknowledged(robot_link& link, int sequence) {
+    for (int attempt = 0; attempt <= RETRIES; attempt++) {
+        auto start = std::chrono::steady_clock::now();
+        if (attempt > 0)
+            sequence = link.resend();
+        telemetry_ack ack;
+        if (sequence >= 0 && link.waitAck(sequence, ack, ACK_TIMEOUT_MS)) {
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            printf("sequence %u: %s, round trip %.2f ms\n", ack.sequence,
+                   ack.result < sizeof(RESULTS) / sizeof(RESULTS[0]) ? RESULTS[ack.result] : "unknown", ms);
+            return ack.result == COMMAND_OK || ack.result == COMMAND_DUPLICATE;
+        }
+    }
+    fprintf(stderr, "no acknowledgement\n");
+    return false;
+}
+
+//Print the statistics of a profiled section and its histogram
+static void printProfile(const telemetry_profile& r) {
+    double us = 1.0 / (r.cpuMhz > 0 ? r.cpuMhz : 1);
+    printf("%-8.*s %9u runs in %u ms, %u over %u cycles; min %.2f avg %.2f max %.2f us; load %.2f%%\n",
+           static_cast<int>(strnlen(r.name, sizeof(r.name))), r.name, r.count, r.window, r.overruns, r.budget,
+           r.min * us, r.avg * us, r.max * us, r.load * 100.0 / 65536);
+    printf("        ");
+    for (int i = 0; i < 16; i++) {
+        if (r.histogram[i] > 0)
+            printf(" %s%u:%u", i == 15 ? ">=" : "<", 1u << (i == 15 ? 19 : i + 5), r.histogram[i]);
+    }
+    printf(" (cycles:runs)\n");
+}
+
+static int usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-b baud] [-t seconds] device stop|heartbeat|velocity|move|gains|profile|log [arguments]\n",
+            name);
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    long baud = 921600;
+    double hold = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:t:")) != -1) {
+        if (opt == 'b')
+            baud = strtol(optarg, nullptr, 10);
+        else if (opt == 't')
+            hold = strtod(optarg, nullptr);
+        else
+            return usage(argv[0]);
+    }
+    if (argc - optind < 2)
+        return usage(argv[0]);
+
+    const char *name = argv[optind + 1];
+    int count = argc - optind - 2;
+    double a[5] = {};
+    for (int i = 0; i < count && i < 5; i++)
+        a[i] = strtod(argv[optind + 2 + i], nullptr);
+
+    int fd = openPort(argv[optind], baud, O_RDWR);
+    if (fd < 0)
+        return 1;
+    robot_link link(fd);
+
+    int sequence;
+    if (!strcmp(name, "stop") && count == 0)
+        sequence = link.stop();
+    else if (!strcmp(name, "heartbeat") && count == 0)
+        sequence = link.heartbeat();
+    else if (!strcmp(name, "velocity") && count == 2)
+        sequence = link.velocity(a[0], a[1]);
+    else if (!strcmp(name, "move") && count == 4)
+        sequence = link.move(a[0], a[1], a[2], a[3]);
+    else if (!strcmp(name, "gains") && count == 5)
+        sequence = link.gains(a[0], a[1], a[2], a[3], a[4]);
+    else if (!strcmp(name, "profile") && count == 0) {
+        link.setHandler([](uint8_t type, const uint8_t *record, size_t length) {
+            telemetry_profile r;
+            if (type == TELEMETRY_PROFILE && length == sizeof(r)) {
+                memcpy(&r, record, sizeof(r));
+                printProfile(r);
+            }
+        });
+        sequence = link.profile();
+    }
+    else if (!strcmp(name, "log") && count == 1 && !strcmp(argv[optind + 2], "erase"))
+        sequence = link.log(LOG_ERASE);
+    else if (!strcmp(name, "log") && count == 1 && !strcmp(argv[optind + 2], "start"))
+        sequence = link.log(LOG_START);
+    else if (!strcmp(name, "log") && count == 1 && !strcmp(argv[optind + 2], "stop"))
+        sequence = link.log(LOG_STOP);
+    else
+        return usage(argv[0]);
+
+    if (!sendAcknowledged(link, sequence))
+        return 1;
+
+    //Read the telemetry for the profile records
+    telemetry_ack ack;
+    if (!strcmp(name, "profile"))
+        while (link.readAck(ack, PROFILE_WAIT_MS)) {}
+
+    //Keep the watchdog from stopping the robot, then stop it
+    if (hold > 0) {
+        auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(hold);
+        while (std::chrono::steady_clock::now() < end) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(HEARTBEAT_INTERVAL_MS));
+            link.heartbeat();
+        }
+        if (!sendAcknowledged(link, link.stop()))
+            return 1;
+    }
+    close(fd);
+    return 0;
+}
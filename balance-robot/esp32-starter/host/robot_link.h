@@ -0,0 +1,168 @@
+//Raspberry Pi side of the command protocol (src/command.h): sends commands to the ESP32 on the serial port and
+//picks their acknowledgements out of the telemetry stream.
+//
+//Each command gets the next sequence number. send() returns it so the caller can match the acknowledgement, and
+//resend() sends a command again with the same number, which the ESP32 acknowledges but does not apply twice.
+//The ESP32 stops the robot if no command arrives for its watchdog timeout, so call heartbeat() more often than
+//that while the robot is driving. Other telemetry records are passed to an optional handler.
+
+#ifndef HOST_ROBOT_LINK_H
+#define HOST_ROBOT_LINK_H
+
+#include <command.h>
+#include <frame.h>
+#include <telemetry_records.h>
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <poll.h>
+#include <unistd.h>
+
+class robot_link {
+
+public:
+
+    //Called with the type and record of each telemetry frame that is not an acknowledgement
+    using record_handler = std::function<void(uint8_t type, const uint8_t *record, size_t length)>;
+
+    //Use an open file descriptor, such as from openPort() in serial_port.h with O_RDWR
+    explicit robot_link(int fd) : port(fd) {}
+
+    void setHandler(record_handler h) {
+        handler = h;
+    }
+
+    //Drive at a linear speed (m/s, forwards positive) and turn rate (rad/s, anticlockwise positive)
+    int velocity(double linear, double angular) {
+        command c = make(COMMAND_VELOCITY);
+        c.velocity.speed = toFixed(linear);
+        c.velocity.turn = toFixed(angular);
+        return send(c);
+    }
+
+    //Drive a distance (m) while turning through an angle (rad), limiting the speed (m/s) and acceleration
+    //(m/s/s) of the faster wheel, then hold position
+    int move(double distance, double angle, double maxSpeed, double maxAccel) {
+        command c = make(COMMAND_MOVE);
+        c.move.distance = toFixed(distance);
+        c.move.angle = toFixed(angle);
+        c.move.maxSpeed = toFixed(maxSpeed);
+        c.move.maxAccel = toFixed(maxAccel);
+        return send(c);
+    }
+
+    //Set the balance controller gains, in the units of the constants in main.cpp
+    int gains(float tiltKp, float tiltKi, float tiltKd, float speedKp, float speedKi) {
+        command c = make(COMMAND_GAINS);
+        c.gains = {tiltKp, tiltKi, tiltKd, speedKp, speedKi};
+        return send(c);
+    }
+
+    int stop() {
+        return send(make(COMMAND_STOP));
+    }
+
+    int heartbeat() {
+        return send(make(COMMAND_HEARTBEAT));
+    }
+
+    //Ask for the profiler statistics, which arrive as TELEMETRY_PROFILE records shortly after the acknowledgement
+    int profile() {
+        return send(make(COMMAND_PROFILE));
+    }
+
+    //Erase the log partition, start logging every control period to flash or stop the log. See host/log_export
+    int log(log_action action) {
+        command c = make(COMMAND_LOG);
+        c.log.action = action;
+        return send(c);
+    }
+
+    //Send a new command, giving it the next sequence number. Returns the sequence number, or -1 on a write error
+    int send(command c) {
+        c.sequence = ++sequence;
+        last = c;
+        return write(c) ? c.sequence : -1;
+    }
+
+    //Send the last command again with the same sequence number
+    int resend() {
+        return write(last) ? last.sequence : -1;
+    }
+
+    //Read telemetry until an acknowledgement arrives or the timeout (ms) passes. Returns false on timeout
+    bool readAck(telemetry_ack& ack, int timeoutMs) {
+        pollfd p = {port, POLLIN, 0};
+        while (true) {
+            while (available < received) {
+                if (decode(buffer[available++], ack))
+                    return true;
+            }
+            if (poll(&p, 1, timeoutMs) <= 0)
+                return false;
+            ssize_t n = read(port, buffer, sizeof(buffer));
+            if (n <= 0)
+                return false;
+            available = 0;
+            received = n;
+        }
+    }
+
+    //Wait for the acknowledgement of a sequence number, skipping older ones. Returns false on timeout
+    bool waitAck(int sequenceNumber, telemetry_ack& ack, int timeoutMs) {
+        while (readAck(ack, timeoutMs)) {
+            if (ack.sequence == static_cast<uint16_t>(sequenceNumber))
+                return true;
+        }
+        return false;
+    }
+
+    //Telemetry frames rejected because of a bad CRC or encoding
+    uint32_t getErrors() const {
+        return decoder.getErrors();
+    }
+
+    private:
+
+    int port;
+    uint16_t sequence = 0;
+    command last = {};
+    record_handler handler;
+    frame_decoder decoder;
+    uint8_t buffer[1024];
+    ssize_t available = 0, received = 0;    //next unread byte and bytes in the buffer
+
+    static command make(command_type type) {
+        command c = {};
+        c.type = type;
+        return c;
+    }
+
+    static int32_t toFixed(double value) {
+        return static_cast<int32_t>(lround(value * (1 << COMMAND_SHIFT)));
+    }
+
+    bool write(const command& c) {
+        uint8_t frame[FRAME_MAX_ENCODED];
+        size_t length = encodeCommand(c, frame);
+        return length > 0 && ::write(port, frame, length) == static_cast<ssize_t>(length);
+    }
+
+    //Add a telemetry byte. Returns true when it completes an acknowledgement
+    bool decode(uint8_t b, telemetry_ack& ack) {
+        if (!decoder.push(b) || decoder.length() < TELEMETRY_HEADER)
+            return false;
+        const uint8_t *payload = decoder.data();
+        size_t length = decoder.length() - TELEMETRY_HEADER;
+        if (payload[0] == TELEMETRY_ACK && length == sizeof(ack)) {
+            memcpy(&ack, payload + TELEMETRY_HEADER, sizeof(ack));
+            return true;
+        }
+        if (handler)
+            handler(payload[0], payload + TELEMETRY_HEADER, length);
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,305 @@
+//Simulation of the balancing robot running the firmware's own stepping, tilt estimation and control code.
+//
+//Each control period the firmware side drains the simulated MPU6050 samples into tilt_estimator, runs
+//balance_controller on the tilt and the step counts, and commands differential_drive, whose steppers run every
+//stepper interval as in the timer ISR. On the physical side, each wheel's rotor is pulled towards the commanded
+//microstep position by the motor's magnetic field. The torque is the holding torque, falling linearly with speed,
+//times the sine of the electrical angle between rotor and field, with damping against the step rate. A lag of
+//more than two full steps slips a pole: the motor has stalled and the step count no longer matches the wheel.
+//The rotor carries its own inertia and half the robot's mass at the wheel radius; the body is the pendulum of
+//pendulum.h driven by the axle acceleration. The sensor readings are calculated from the body motion, with noise
+//and gyro bias, in the raw units of the MPU6050 as main.cpp configures it.
+//
+//The robot is simulated in the plane, so both wheels follow the same path. Gains are in the units of main.cpp.
+//The translation unit that includes this must expand HOST_ARDUINO_PINS once
+
+#ifndef HOST_ROBOT_SIM_H
+#define HOST_ROBOT_SIM_H
+
+#include <Arduino.h>
+#include <controller.h>
+#include <differential_drive.h>
+#include <step.h>
+#include <tilt.h>
+#include "pendulum.h"
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+struct sim_config {
+    //Firmware, as main.cpp
+    int controlHz = 1000;
+    int imuHz = 1000;
+    int stepperIntervalUs = 20;
+    float tiltKp = 650, tiltKi = 100, tiltKd = 55;  //wheel rad/s/s per rad, per rad s, per rad/s
+    float speedKp = 0.0054, speedKi = 0.0014;      //rad of tilt per wheel rad/s, per wheel rad
+    float maxTiltSetpoint = 0.3;                   //rad
+    float wheelAccel = 300;                        //rad/s/s
+    float wheelSpeed = 19;                         //rad/s
+    float fallenTilt = 0.8;                        //motors stop beyond this tilt (rad)
+    bool schedule = true;                          //tilt gains scaled 1, 1.15, 1.4 at 0, 10, 19 wheel rad/s
+    int speedRange = 1;                            //4 with ADAPTIVE_MICROSTEPS: the mode pins switch to 8 and 4
+                                                   //microsteps, and the speed limit and schedule are scaled by 4
+
+    //Robot
+    double wheelRadius = 0.045;                    //m
+    double trackWidth = 0.16;                      //m
+    double length = 0.1;                           //axle to centre of mass (m)
+    double inertia = 4.0 / 3;                      //body inertia about the axle / (mass * length^2)
+    double mass = 1.0;                             //whole robot (kg)
+
+    //Each motor
+    double holdingTorque = 0.4;                    //N m
+    double zeroTorqueSpeed = 100;                  //rotor speed at which the torque falls to zero (rad/s)
+    double rotorInertia = 5.7e-6;                  //kg m^2
+    double dampingRatio = 0.3;                     //of the rotor oscillation about the field
+
+    //Sensors, in raw units: ±2 g and ±250 °/s
+    double accelLsbPerG = 16384;
+    double gyroLsbPerRad = 131 * 180 / M_PI;
+    double accelNoise = 40;                        //standard deviation (LSB)
+    double gyroNoise = 5;                          //standard deviation (LSB)
+    double gyroBias = 0;                           //LSB
+    double sensorHeight = 0;                       //above the axle (m)
+
+    int physicsTicks = 5;                          //stepper ticks per physics update
+    uint32_t seed = 1;
+};
+
+//Summary of a run
+struct sim_result {
+    bool balanced = true;           //did not fall or stall
+    double fallTime = 0;            //s, if it fell or stalled
+    unsigned slips = 0;             //poles slipped by a motor
+    double maxTilt = 0;             //after the first second (rad)
+    double rmsTilt = 0;             //after the first second (rad)
+    double position = 0;            //m
+    double speed = 0;               //m/s
+};
+
+class robot_sim {
+
+public:
+
+    //One trace line per control period: time (s), true tilt, estimated tilt (rad), axle position (m) and speed
+    //(m/s), and commanded wheel speed (microsteps/s)
+    using trace_handler = std::function<void(double, double, double, double, double, int32_t)>;
+
+    pendulum body;
+    double time = 0;                //s
+
+    explicit robot_sim(const sim_config& c) :
+        config(c),
+        left(makeStep(c, LEFT_MODE_PINS)), right(makeStep(c, RIGHT_MODE_PINS)),
+        drive(left, right, c.wheelRadius, c.trackWidth),
+        tilt(1.0 / c.imuHz, 1 / c.gyroLsbPerRad),
+        balance(1.0 / c.controlHz, c.maxTiltSetpoint, c.wheelAccel / left.STEP_ANGLE,
+                c.wheelSpeed * c.speedRange / left.STEP_ANGLE),
+        noise(c.seed) {
+        body.length = c.length;
+        body.inertia = c.inertia;
+        drive.setAcceleration(c.wheelAccel * c.wheelRadius, 2 * c.wheelAccel * c.wheelRadius / c.trackWidth);
+        balance.setTiltGains(c.tiltKp / left.STEP_ANGLE, c.tiltKi / left.STEP_ANGLE, c.tiltKd / left.STEP_ANGLE);
+        balance.setSpeedGains(c.speedKp * left.STEP_ANGLE, c.speedKi * left.STEP_ANGLE);
+        if (c.schedule) {
+            const float speeds[] = {0.0, 10.0, 19.0};
+            const float factors[] = {1.0, 1.15, 1.4};
+            int32_t scheduleSpeed[3];
+            for (int i = 0; i < 3; i++)
+                scheduleSpeed[i] = speeds[i] * c.speedRange / left.STEP_ANGLE;
+            balance.setSchedule(scheduleSpeed, factors, 3);
+        }
+
+        fullStep = left.STEP_ANGLE * left.MICROSTEPS;
+        load = c.rotorInertia + c.mass / 2 * c.wheelRadius * c.wheelRadius;
+        double stiffness = c.holdingTorque * M_PI / 2 / fullStep;      //N m/rad at small lag
+        damping = 2 * c.dampingRatio * sqrt(stiffness * load);
+        imuTicks = lround(1e6 / c.imuHz / c.stepperIntervalUs);
+        controlTicks = lround(1e6 / c.controlHz / c.stepperIntervalUs);
+    }
+
+    void setTrace(trace_handler h) {
+        trace = h;
+    }
+
+    //Target speed of the robot (m/s)
+    void setTarget(double speed) {
+        balance.setTarget(lround(speed / config.wheelRadius / left.STEP_ANGLE));
+    }
+
+    //Run for a time. Returns false once the robot has fallen or a motor has stalled
+    bool run(double seconds) {
+        //Count down to each event, rather than dividing the tick count every tick
+        double dt = config.stepperIntervalUs * 1e-6;
+        for (long n = lround(seconds / dt); n > 0 && result.balanced; n--) {
+            if (--toSample <= 0) {
+                sample();
+                toSample = imuTicks;
+            }
+            if (--toControl <= 0) {
+                control();
+                toControl = controlTicks;
+            }
+            drive.runSteppers();
+            if (--toPhysics <= 0) {
+                physics(dt * config.physicsTicks);
+                toPhysics = config.physicsTicks;
+            }
+        }
+        result.rmsTilt = tiltSamples > 0 ? sqrt(tiltSquares / tiltSamples) : 0;
+        result.position = body.position;
+        result.speed = body.speed;
+        return result.balanced;
+    }
+
+    const sim_result& getResult() const {
+        return result;
+    }
+
+    //Tilt estimate (rad)
+    double getTiltEstimate() const {
+        return tilt.getAngleRad();
+    }
+
+    private:
+
+    static const int MAX_SAMPLES = 64;
+    static constexpr step::microstep_pins LEFT_MODE_PINS = {{25, -1, 26}, {0b111, 0b011, 0b010}};    //as main.cpp
+    static constexpr step::microstep_pins RIGHT_MODE_PINS = {{27, -1, 33}, {0b111, 0b011, 0b010}};
+
+    //Stepper for the firmware build, with mode pins for adaptive microstepping
+    static step makeStep(const sim_config& c, const step::microstep_pins& pins) {
+        if (c.speedRange > 1)
+            return step(c.stepperIntervalUs, pins);
+        return step(c.stepperIntervalUs);
+    }
+
+    sim_config config;
+    step left, right;
+    differential_drive drive;
+    tilt_estimator tilt;
+    balance_controller balance;
+    trace_handler trace;
+    sim_result result;
+
+    //Motor
+    double fullStep;                //wheel angle per full step (rad)
+    double load;                    //inertia on each rotor (kg m^2)
+    double damping;                 //N m per rad/s
+    double rotor = 0;               //wheel angle (rad)
+    double rotorSpeed = 0;          //rad/s
+    double previousRotorSpeed = 0;  //before the last physics update (rad/s)
+
+    //Firmware
+    long imuTicks, controlTicks;    //stepper ticks per IMU sample and control period
+    long toSample = 1, toControl = 1, toPhysics = 1;
+    int16_t samples[MAX_SAMPLES][3];    //accelForward, accelUp, gyro waiting for the control task
+    int sampleCount = 0;
+    bool tiltValid = false;
+    bool balancing = false;
+
+    double tiltSquares = 0;
+    long tiltSamples = 0;
+    uint32_t noise;
+
+    //Deterministic Gaussian noise
+    double gaussian() {
+        auto uniform = [this] {
+            noise = noise * 1664525u + 1013904223u;
+            return (noise >> 8) * (1.0 / 16777216.0) + 1e-9;
+        };
+        return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+    }
+
+    static int16_t toRaw(double v) {
+        return static_cast<int16_t>(lround(fmax(-32768, fmin(32767, v))));
+    }
+
+    void fail() {
+        result.balanced = false;
+        result.fallTime = time;
+    }
+
+    //MPU6050 sample of the body motion, queued for the control task as the FIFO does
+    void sample() {
+        double h = config.sensorHeight, a = body.angle, w = body.rate;
+        double axle = (rotorSpeed - previousRotorSpeed) / (config.physicsTicks * config.stepperIntervalUs * 1e-6) *
+                      config.wheelRadius;
+        double forward = axle + h * (body.angular * cos(a) - w * w * sin(a));
+        double up = -h * (body.angular * sin(a) + w * w * cos(a));
+        double g = body.gravity + up;
+        double scale = config.accelLsbPerG / body.gravity;
+        if (sampleCount < MAX_SAMPLES) {
+            int16_t *s = samples[sampleCount++];
+            s[0] = toRaw((g * sin(a) + forward * cos(a)) * scale + config.accelNoise * gaussian());
+            s[1] = toRaw((g * cos(a) - forward * sin(a)) * scale + config.accelNoise * gaussian());
+            s[2] = toRaw(w * config.gyroLsbPerRad + config.gyroBias + config.gyroNoise * gaussian());
+        }
+    }
+
+    //Control task, as controlUpdate() in main.cpp
+    void control() {
+        for (int i = 0; i < sampleCount; i++) {
+            if (!tiltValid) {
+                tilt.reset(samples[i][0], samples[i][1]);
+                tiltValid = true;
+            }
+            tilt.update(samples[i][0], samples[i][1], samples[i][2]);
+        }
+        sampleCount = 0;
+
+        int32_t leftPosition = left.getPosition();
+        int32_t rightPosition = -right.getPosition();
+        int32_t position = (leftPosition + rightPosition) / 2;
+        int32_t speed = 0;
+        if (fabs(tilt.getAngleRad()) < config.fallenTilt) {
+            if (!balancing) {
+                balance.reset(position, 0);
+                balancing = true;
+            }
+            speed = balance.update(tilt.getAngle(), tilt.getRate(), position);
+        }
+        else {
+            balancing = false;
+        }
+        drive.setVelocitySteps(speed, 0);
+        if (trace)
+            trace(time, body.angle, tilt.getAngleRad(), body.position, body.speed, speed);
+    }
+
+    //Advance the motors and the body
+    void physics(double dt) {
+        double field = left.getPosition() * left.STEP_ANGLE;
+        double electrical = (field - rotor) / fullStep * (M_PI / 2);
+        if (fabs(electrical) > M_PI) {
+            //The rotor falls back to the next stable position of the field
+            double slipped = copysign(4 * fullStep, electrical);
+            rotor += slipped;
+            result.slips++;
+            fail();
+            electrical = (field - rotor) / fullStep * (M_PI / 2);
+        }
+        double available = config.holdingTorque * fmax(0.0, 1 - fabs(rotorSpeed) / config.zeroTorqueSpeed);
+        double torque = available * sin(electrical) + damping * (left.getSpeedRad() - rotorSpeed);
+        double accel = torque / load;
+
+        previousRotorSpeed = rotorSpeed;
+        rotorSpeed += accel * dt;
+        rotor += rotorSpeed * dt;
+        body.update(accel * config.wheelRadius, dt);
+        body.speed = rotorSpeed * config.wheelRadius;
+        body.position = rotor * config.wheelRadius;
+        time += dt;
+
+        if (fabs(body.angle) > config.fallenTilt)
+            fail();
+        if (time > 1) {
+            result.maxTilt = fmax(result.maxTilt, fabs(body.angle));
+            tiltSquares += body.angle * body.angle;
+            tiltSamples++;
+        }
+    }
+};
+
+#endif
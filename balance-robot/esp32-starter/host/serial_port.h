@@ -0,0 +1,42 @@
+//Serial port setup shared by the host tools
+
+#ifndef HOST_SERIAL_PORT_H
+#define HOST_SERIAL_PORT_H
+
+#include <cstdio>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+//Open a serial port in raw mode at the given baud rate, read-only or with O_RDWR to send as well.
+//Returns -1 on failure
+inline int openPort(const char *path, long baud, int mode = O_RDONLY) {
+    speed_t speed;
+    switch (baud) {
+    case 115200: speed = B115200; break;
+    case 230400: speed = B230400; break;
+    case 460800: speed = B460800; break;
+    case 921600: speed = B921600; break;
+    default:
+        fprintf(stderr, "unsupported baud rate %ld\n", baud);
+        return -1;
+    }
+
+    int fd = open(path, mode | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+#endif
@@ -0,0 +1,25 @@
+//GPIO output set and clear registers of the ESP32 for building the firmware headers on a host PC.
+//Register writes change the levels in hostPins, as digitalWrite() does
+
+#ifndef HOST_SOC_GPIO_REG_H
+#define HOST_SOC_GPIO_REG_H
+
+#include <Arduino.h>
+
+#define GPIO_OUT_W1TS_REG   0x3FF44008      //set GPIO 0-31
+#define GPIO_OUT_W1TC_REG   0x3FF4400C      //clear GPIO 0-31
+#define GPIO_OUT1_W1TS_REG  0x3FF44014      //set GPIO 32-39
+#define GPIO_OUT1_W1TC_REG  0x3FF44018      //clear GPIO 32-39
+
+inline void hostRegWrite(uint32_t reg, uint32_t value) {
+    bool set = reg == GPIO_OUT_W1TS_REG || reg == GPIO_OUT1_W1TS_REG;
+    int base = reg == GPIO_OUT1_W1TS_REG || reg == GPIO_OUT1_W1TC_REG ? 32 : 0;
+    for (int bit = 0; bit < 32 && base + bit < HOST_NUM_PINS; bit++) {
+        if (value & (1u << bit))
+            digitalWrite(base + bit, set ? HIGH : LOW);
+    }
+}
+
+#define REG_WRITE(reg, value) hostRegWrite(reg, value)
+
+#endif
@@ -0,0 +1,158 @@
+//Decoder for the binary telemetry stream of the firmware (src/telemetry.h)
+//
+//Reads frames from a serial port or a capture file and prints one CSV line per record:
+//  control,time_us,tilt_rad,tilt_rate_rad_s,tilt_setpoint_rad,speed1,speed2,position1,position2,gyro_x,gyro_y,gyro_z,adc_v
+//  task,name,runs,overruns,exec_min_us,exec_avg_us,exec_max_us,latency_max_us,jitter_max_us
+//  text,message
+//  adc,time_us,v0,v1,v2,v3,v4,v5,v6,v7
+//  pose,time_us,x_m,y_m,heading_rad,distance_m
+//  ack,time_us,sequence,type,result
+//  battery,time_us,voltage_v,current_a,power_w,charge_mah,energy_j,soc_percent,remaining_j,present
+//  profile,name,count,overruns,budget_cycles,min_cycles,avg_cycles,max_cycles,load_percent,window_ms,cpu_mhz,h0..h15
+//ADC readings are in volts, speeds are in microsteps/s, positions in microsteps and gyro rates in raw sensor units.
+//Frame errors and frames lost in transmission are reported on stderr at the end.
+//
+//Usage: telemetry_decode [-b baud] [device]
+//Reads standard input when no device is given, e.g. a capture made with: cat /dev/ttyUSB0 > capture.bin
+
+#include <frame.h>
+#include <telemetry_records.h>
+#include "serial_port.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+const double ANGLE_ONE = 1 << 24;
+const double SPEED_SCALE = 2000;        //step::SPEED_SCALE
+const double ADC_VOLTS = 4.096 / (4095 * 16);  //ADC reference over full scale, values have 4 fractional bits
+const double POSE_METRES = 1.0 / 65536;
+const double BAM_RADIANS = M_PI / 2147483648.0;     //binary angle to rad
+
+static void printControl(const telemetry_control &r) {
+    printf("control,%u,%.6f,%.5f,%.6f,%.1f,%.1f,%d,%d,%d,%d,%d,%.4f\n", r.time, r.tilt / ANGLE_ONE,
+           r.tiltRate / ANGLE_ONE, r.tiltSetpoint / ANGLE_ONE, r.speed[0] / SPEED_SCALE, r.speed[1] / SPEED_SCALE,
+           r.position[0], r.position[1], r.gyro[0], r.gyro[1], r.gyro[2], r.adc * ADC_VOLTS);
+}
+
+static void printTask(const telemetry_task &r) {
+    printf("task,%.*s,%u,%u,%u,%u,%u,%u,%u\n", static_cast<int>(strnlen(r.name, sizeof(r.name))), r.name,
+           r.runs, r.overruns, r.execMin, r.execAvg, r.execMax, r.latencyMax, r.jitterMax);
+}
+
+static void printAdc(const telemetry_adc &r) {
+    printf("adc,%u", r.time);
+    for (uint16_t v : r.value)
+        printf(",%.4f", v * ADC_VOLTS);
+    printf("\n");
+}
+
+static void printPose(const telemetry_pose &r) {
+    printf("pose,%u,%.5f,%.5f,%.5f,%.5f\n", r.time, r.x * POSE_METRES, r.y * POSE_METRES,
+           static_cast<int32_t>(r.heading) * BAM_RADIANS, r.distance * POSE_METRES);
+}
+
+static void printAck(const telemetry_ack &r) {
+    printf("ack,%u,%u,%u,%u\n", r.time, r.sequence, r.type, r.result);
+}
+
+static void printBattery(const telemetry_battery &r) {
+    printf("battery,%u,%.3f,%.4f,%.3f,%.3f,%.3f,%.2f,%.1f,%u\n", r.time, r.voltage / 1000.0, r.current / 1e6,
+           r.power / 1000.0, r.charge / 1000.0, r.energy / 1000.0, r.stateOfCharge * 100.0 / 65536,
+           r.remainingEnergy / 1000.0, r.flags & BATTERY_PRESENT);
+}
+
+static void printProfile(const telemetry_profile &r) {
+    printf("profile,%.*s,%u,%u,%u,%u,%u,%u,%.3f,%u,%u", static_cast<int>(strnlen(r.name, sizeof(r.name))), r.name,
+           r.count, r.overruns, r.budget, r.min, r.avg, r.max, r.load * 100.0 / 65536, r.window, r.cpuMhz);
+    for (uint32_t h : r.histogram)
+        printf(",%u", h);
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    long baud = 921600;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        if (opt == 'b') {
+            baud = strtol(optarg, nullptr, 10);
+        }
+        else {
+            fprintf(stderr, "usage: %s [-b baud] [device]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int fd = 0;
+    if (optind < argc && (fd = openPort(argv[optind], baud)) < 0)
+        return 1;
+
+    frame_decoder decoder;
+    unsigned long frames = 0, lost = 0, unknown = 0;
+    int lastSequence = -1;
+    uint8_t buffer[4096];
+    ssize_t n;
+
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (!decoder.push(buffer[i]) || decoder.length() < TELEMETRY_HEADER)
+                continue;
+
+            const uint8_t *payload = decoder.data();
+            size_t length = decoder.length() - TELEMETRY_HEADER;
+            const uint8_t *record = payload + TELEMETRY_HEADER;
+            frames++;
+            if (lastSequence >= 0)
+                lost += static_cast<uint8_t>(payload[1] - lastSequence - 1);
+            lastSequence = payload[1];
+
+            if (payload[0] == TELEMETRY_CONTROL && length == sizeof(telemetry_control)) {
+                telemetry_control r;
+                memcpy(&r, record, sizeof(r));
+                printControl(r);
+            }
+            else if (payload[0] == TELEMETRY_TASK && length == sizeof(telemetry_task)) {
+                telemetry_task r;
+                memcpy(&r, record, sizeof(r));
+                printTask(r);
+            }
+            else if (payload[0] == TELEMETRY_ADC && length == sizeof(telemetry_adc)) {
+                telemetry_adc r;
+                memcpy(&r, record, sizeof(r));
+                printAdc(r);
+            }
+            else if (payload[0] == TELEMETRY_POSE && length == sizeof(telemetry_pose)) {
+                telemetry_pose r;
+                memcpy(&r, record, sizeof(r));
+                printPose(r);
+            }
+            else if (payload[0] == TELEMETRY_ACK && length == sizeof(telemetry_ack)) {
+                telemetry_ack r;
+                memcpy(&r, record, sizeof(r));
+                printAck(r);
+            }
+            else if (payload[0] == TELEMETRY_BATTERY && length == sizeof(telemetry_battery)) {
+                telemetry_battery r;
+                memcpy(&r, record, sizeof(r));
+                printBattery(r);
+            }
+            else if (payload[0] == TELEMETRY_PROFILE && length == sizeof(telemetry_profile)) {
+                telemetry_profile r;
+                memcpy(&r, record, sizeof(r));
+                printProfile(r);
+            }
+            else if (payload[0] == TELEMETRY_TEXT) {
+                printf("text,%.*s\n", static_cast<int>(length), reinterpret_cast<const char *>(record));
+            }
+            else {
+                unknown++;
+            }
+        }
+        fflush(stdout);
+    }
+
+    fprintf(stderr, "%lu frames, %u bad, %lu lost, %lu unknown\n", frames, decoder.getErrors(), lost, unknown);
+    return 0;
+}
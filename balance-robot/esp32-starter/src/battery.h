@@ -0,0 +1,237 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <math.h>
+#include <stdint.h>
+#include <seqlock.h>
+
+//Charge and energy counters, saved across resets so they follow the battery rather than the firmware
+struct battery_counters {
+    int64_t charge;             //charge drawn since the counters were reset (pC, μA μs)
+    int64_t energy;             //energy drawn since the counters were reset (pJ, μW μs)
+    int64_t remaining;          //estimated charge left in the battery (pC)
+};
+
+//Latest battery readings and estimates
+struct battery_status {
+    uint32_t time;              //time of the ADC readings (μs)
+    uint32_t sequence;          //increments with every update
+    int32_t voltage;            //mV
+    int32_t current;            //drawn from the battery, discharging positive (μA)
+    int32_t power;              //mW
+    uint32_t stateOfCharge;     //remaining charge over capacity (2^-16)
+    int32_t remainingEnergy;    //energy the remaining charge delivers at the model voltage (mJ)
+    bool present;               //battery voltage is above the minimum, so the counters are running
+    battery_counters counters;
+};
+
+//Typical open-circuit voltage of a NiMH cell from empty to full at 10% intervals (V)
+const float NIMH_CELL_VOLTS[] = {1.15, 1.22, 1.25, 1.27, 1.28, 1.29, 1.30, 1.31, 1.33, 1.36, 1.40};
+const float NIMH_MIN_CELL_VOLTS = 0.8;      //below this the battery is absent, e.g. on the bypass PSU
+
+//Coulomb and energy counter for the NiMH battery, run on every averaged block of the MCP3208 readings.
+//
+//The battery voltage and current are read from ADC channels through the interface circuits on the J2 power
+//monitoring connector. Each block is the mean of the scans since the previous one, so multiplying it by the time
+//between blocks integrates every scan: nothing is lost to aliasing between slow snapshots. Current can be summed
+//from several channels; a channel that measures the output of a converter, such as the 5 V supply, is converted
+//to battery current from the power it delivers.
+//
+//The charge left is counted down from the current, and a NiMH discharge model corrects it slowly towards the
+//charge given by the open-circuit voltage, estimated as the terminal voltage plus the drop across the internal
+//resistance. Over short times the count is exact; over long times the voltage removes the drift of the count
+//and an error in the starting charge. The NiMH curve is flat in the middle, where a small voltage error is a
+//large charge error, so the time constant should be many minutes and the count does most of the work. When a
+//battery is connected, or at the first reading after the counters were restored from flash, a charge that
+//disagrees with the voltage by more than SWAP_THRESHOLD is taken to be a different battery and the counters
+//start again.
+//
+//update() uses integer arithmetic only and publishes the status through a seqlock, so it can be read from any
+//task
+class battery_meter {
+
+public:
+
+    static const int MAX_CURRENTS = 2;
+    static const int MODEL_POINTS = 11;                 //open-circuit voltage at every 10% state of charge
+    static const uint32_t SOC_ONE = 1 << 16;
+    static const uint32_t SWAP_THRESHOLD = SOC_ONE * 2 / 5;    //state of charge disagreement for a new battery
+
+    //Set the ADC volts per unit of the readings, the battery capacity (Ah), the number of cells in series and the
+    //internal resistance of the battery and wiring (Ω)
+    battery_meter(float adcVoltsPerUnit, float capacityAh, int cells, float resistance) : adcVolts(adcVoltsPerUnit) {
+        capacity = llround(capacityAh * 3.6e15);
+        resistanceMilliohms = lround(resistance * 1000);
+        minVoltage = lround(NIMH_MIN_CELL_VOLTS * cells * 1000);
+        double energy = 0;
+        for (int i = 0; i < MODEL_POINTS; i++) {
+            modelVoltage[i] = lround(NIMH_CELL_VOLTS[i] * cells * 1000);
+            if (i > 0) {
+                float volts = (NIMH_CELL_VOLTS[i - 1] + NIMH_CELL_VOLTS[i]) / 2 * cells;
+                energy += capacityAh * 3600 / (MODEL_POINTS - 1) * volts;
+            }
+            modelEnergy[i] = lround(energy * 1000);
+        }
+    }
+
+    //Read the battery voltage on an ADC channel through a divider of ratio divider (battery over ADC volts)
+    void setVoltage(int channel, float divider) {
+        voltageChannel = channel;
+        voltageScale = llround(adcVolts * divider * 1000 * 65536);
+    }
+
+    //Add a current measurement on an ADC channel, with the amplifier output in V/A and its output at zero
+    //current. For a converter output, give its voltage and efficiency to convert to battery current; 0 for
+    //current drawn directly from the battery. Call before the first update(). Returns false if there are
+    //already MAX_CURRENTS
+    bool addCurrent(int channel, float voltsPerAmp, float zeroVolts, float supplyVolts = 0, float efficiency = 1) {
+        if (currents == MAX_CURRENTS)
+            return false;
+        current_input& c = current[currents++];
+        c.channel = channel;
+        c.scale = llround(adcVolts / voltsPerAmp * 1e6 * 65536);
+        c.zero = lround(zeroVolts / adcVolts);
+        c.supply = lround(supplyVolts / efficiency * 1000);
+        return true;
+    }
+
+    //Time constant (s) of the correction from the voltage model. 0 counts charge alone
+    void setModelTimeConstant(float seconds) {
+        timeConstant = llround(seconds * 1e6);
+    }
+
+    //Continue from saved counters. Call before the first update()
+    void restore(const battery_counters& saved) {
+        counters = saved;
+        restored = true;
+    }
+
+    //Start the counters again, with the remaining charge from the voltage at the next update. Call from the task
+    //that calls update(), or before the first update()
+    void reset() {
+        restored = false;
+        started = false;
+    }
+
+    //Add a block of ADC readings taken at time (μs), in units of adcVoltsPerUnit
+    void update(uint32_t time, const uint16_t *values) {
+        int32_t voltage = static_cast<int32_t>((values[voltageChannel] * voltageScale) >> 16);
+        int64_t amps = 0;
+        for (int i = 0; i < currents; i++) {
+            const current_input& c = current[i];
+            int64_t a = ((values[c.channel] - c.zero) * c.scale) >> 16;
+            if (c.supply != 0)
+                a = voltage > 0 ? a * c.supply / voltage : 0;
+            amps += a;
+        }
+
+        status.time = time;
+        status.sequence++;
+        status.voltage = voltage;
+        status.current = static_cast<int32_t>(amps);
+        status.power = static_cast<int32_t>(amps * voltage / 1000000);
+        status.present = voltage >= minVoltage;
+
+        if (!status.present) {
+            started = false;
+        }
+        else if (!started) {
+            //New battery, or the first reading: check the counters against the voltage
+            int64_t fromVoltage = modelCharge(voltage, amps);
+            if (!restored || abs64(fromVoltage - counters.remaining) > (capacity >> 16) * SWAP_THRESHOLD) {
+                counters.charge = counters.energy = 0;
+                counters.remaining = fromVoltage;
+            }
+            restored = true;
+            started = true;
+        }
+        else {
+            int64_t dt = static_cast<uint32_t>(time - lastTime);
+            counters.charge += amps * dt;
+            counters.energy += amps * voltage / 1000 * dt;
+            counters.remaining -= amps * dt;
+            if (timeConstant > 0)
+                counters.remaining += (modelCharge(voltage, amps) - counters.remaining) / timeConstant * dt;
+            if (counters.remaining < 0)
+                counters.remaining = 0;
+            if (counters.remaining > capacity)
+                counters.remaining = capacity;
+        }
+        lastTime = time;
+
+        status.stateOfCharge = static_cast<uint32_t>(counters.remaining / (capacity >> 16));
+        status.remainingEnergy = interpolate(modelEnergy, status.stateOfCharge);
+        status.counters = counters;
+        block.write(status);
+    }
+
+    //Latest status. Safe from any task, do not call from ISR
+    battery_status read() const {
+        return block.read();
+    }
+
+    //Sequence number of the status, which changes with every update
+    uint32_t version() const {
+        return block.version();
+    }
+
+    private:
+
+    struct current_input {
+        int channel;
+        int64_t scale;          //μA per ADC unit (2^-16)
+        int32_t zero;           //ADC units at zero current
+        int32_t supply;         //converter output voltage over efficiency (mV), 0 for battery current
+    };
+
+    float adcVolts;
+    int64_t capacity;                   //pC
+    int32_t resistanceMilliohms;
+    int32_t minVoltage;                 //mV
+    int32_t modelVoltage[MODEL_POINTS]; //mV
+    int32_t modelEnergy[MODEL_POINTS];  //energy delivered from empty to each point (mJ)
+    int voltageChannel = 0;
+    int64_t voltageScale = 0;           //mV per ADC unit (2^-16)
+    current_input current[MAX_CURRENTS] = {};
+    int currents = 0;
+    int64_t timeConstant = 0;           //μs
+
+    battery_counters counters = {};
+    bool restored = false;              //counters hold a saved or running count
+    bool started = false;               //the battery is present and lastTime is valid
+    uint32_t lastTime = 0;
+    battery_status status = {};
+    seqlock<battery_status> block;
+
+    static int64_t abs64(int64_t x) {
+        return x < 0 ? -x : x;
+    }
+
+    //Value of a model table at a state of charge
+    static int32_t interpolate(const int32_t *table, uint32_t soc) {
+        uint32_t position = soc * (MODEL_POINTS - 1);      //table index (2^-16)
+        uint32_t i = position >> 16;
+        if (i >= MODEL_POINTS - 1)
+            return table[MODEL_POINTS - 1];
+        int64_t fraction = position & 0xFFFF;
+        return table[i] + static_cast<int32_t>((static_cast<int64_t>(table[i + 1] - table[i]) * fraction) >> 16);
+    }
+
+    //Remaining charge (pC) from the terminal voltage (mV) and current (μA)
+    int64_t modelCharge(int32_t voltage, int64_t amps) const {
+        int32_t open = voltage + static_cast<int32_t>(amps * resistanceMilliohms / 1000000);
+        if (open <= modelVoltage[0])
+            return 0;
+        for (int i = 1; i < MODEL_POINTS; i++) {
+            if (open < modelVoltage[i]) {
+                int64_t fraction = (static_cast<int64_t>(open - modelVoltage[i - 1]) << 16) /
+                                   (modelVoltage[i] - modelVoltage[i - 1]);
+                int64_t soc = ((static_cast<int64_t>(i - 1) << 16) + fraction) / (MODEL_POINTS - 1);
+                return soc * (capacity >> 16);
+            }
+        }
+        return capacity;
+    }
+};
+
+#endif
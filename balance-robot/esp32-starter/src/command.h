@@ -0,0 +1,223 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <frame.h>
+
+//Binary commands from the Raspberry Pi to the ESP32, shared by the firmware and the host library.
+//Each command is one frame (frame.h) whose payload is the command type, a 16-bit sequence number and a fixed-size
+//record for that type. The sequence number increments with every new command; a command sent again with the same
+//number, such as a retry after a lost acknowledgement, is not applied twice. The ESP32 acknowledges each command
+//in the telemetry stream with a telemetry_ack record. Records are little-endian with no padding, and quantities
+//are fixed point so both ends agree exactly on the values
+
+enum command_type : uint8_t {
+    COMMAND_STOP = 1,           //no record. Stop moving and hold position
+    COMMAND_HEARTBEAT = 2,      //no record. Keep the command watchdog from stopping the robot
+    COMMAND_VELOCITY = 3,       //command_velocity
+    COMMAND_MOVE = 4,           //command_move
+    COMMAND_GAINS = 5,          //command_gains
+    COMMAND_PROFILE = 6,        //no record. Send the profiler statistics since the last request and start again
+    COMMAND_LOG = 7,            //command_log
+};
+
+//Actions of COMMAND_LOG
+enum log_action : uint8_t {
+    LOG_STOP = 0,               //finish the log
+    LOG_START = 1,              //log every control period into the erased partition, see sensor_log.h. Rejected
+                                //with COMMAND_BAD_VALUE unless LOG_ERASE has finished since the last log
+    LOG_ERASE = 2,              //erase the log partition, discarding the last log. Rejected with COMMAND_BAD_VALUE
+                                //while balancing or logging.
+                                //Both are rejected without a log partition or in builds without STEP_MCPWM
+};
+
+//Result of a command, returned by command_parser and in telemetry_ack
+enum command_result : uint8_t {
+    COMMAND_OK = 0,             //applied
+    COMMAND_DUPLICATE = 1,      //same sequence number as the previous command, ignored
+    COMMAND_BAD_TYPE = 2,       //unknown type, ignored
+    COMMAND_BAD_LENGTH = 3,     //record does not match the type, ignored
+    COMMAND_BAD_VALUE = 4,      //record out of range, such as a move with no speed limit, ignored
+};
+
+const int COMMAND_HEADER = 3;           //type and sequence number
+const int COMMAND_SHIFT = 16;           //fixed-point values are in units of 2^-16
+
+//Drive at a linear speed and turn rate until the next command
+struct command_velocity {
+    int32_t speed;              //forwards positive (2^-16 m/s)
+    int32_t turn;               //anticlockwise positive (2^-16 rad/s)
+};
+static_assert(sizeof(command_velocity) == 8, "command_velocity must not be padded");
+
+//Drive a distance while turning through an angle, then hold position
+struct command_move {
+    int32_t distance;           //forwards positive (2^-16 m)
+    int32_t angle;              //anticlockwise positive (2^-16 rad)
+    int32_t maxSpeed;           //of the faster wheel (2^-16 m/s)
+    int32_t maxAccel;           //of the faster wheel (2^-16 m/s/s)
+};
+static_assert(sizeof(command_move) == 16, "command_move must not be padded");
+
+//Balance controller gains, in the units of the constants in main.cpp
+struct command_gains {
+    float tiltKp;               //wheel rad/s/s per rad of tilt
+    float tiltKi;               //per rad s
+    float tiltKd;               //per rad/s
+    float speedKp;              //rad of tilt per wheel rad/s
+    float speedKi;              //per wheel rad
+};
+static_assert(sizeof(command_gains) == 20, "command_gains must not be padded");
+
+//Smallest nonzero gains of each balance controller loop. The firmware's fixed-point PID (controller.h) would need
+//more fractional bits than fit beside its output range in 64 bits for smaller ones. The limit applies to the
+//largest gain of the loop, with the integral gain multiplied by the control period and the derivative gain divided
+//by it
+const float COMMAND_GAIN_PERIOD = 0.001f;       //firmware control period (s)
+const float COMMAND_MIN_TILT_GAIN = 4.0f;       //wheel rad/s/s per rad of tilt
+const float COMMAND_MIN_SPEED_GAIN = 1e-6f;     //rad of tilt per wheel rad/s
+
+//Start or stop the sensor log in flash
+struct command_log {
+    uint8_t action;             //log_action
+};
+static_assert(sizeof(command_log) == 1, "command_log must not be padded");
+
+//A decoded command of any type
+struct command {
+    command_type type;
+    uint16_t sequence;
+    union {
+        command_velocity velocity;
+        command_move move;
+        command_gains gains;
+        command_log log;
+    };
+};
+
+//Record length for a command type, or -1 for an unknown type
+inline int commandLength(uint8_t type) {
+    switch (type) {
+    case COMMAND_STOP:
+    case COMMAND_HEARTBEAT:
+    case COMMAND_PROFILE:
+        return 0;
+    case COMMAND_VELOCITY:
+        return sizeof(command_velocity);
+    case COMMAND_MOVE:
+        return sizeof(command_move);
+    case COMMAND_GAINS:
+        return sizeof(command_gains);
+    case COMMAND_LOG:
+        return sizeof(command_log);
+    default:
+        return -1;
+    }
+}
+
+//True if the record of a command is in range
+inline bool commandValid(const command& c) {
+    switch (c.type) {
+    case COMMAND_MOVE:
+        return c.move.maxSpeed > 0 && c.move.maxAccel > 0;
+    case COMMAND_GAINS:
+    {
+        const float gains[] = {c.gains.tiltKp, c.gains.tiltKi, c.gains.tiltKd, c.gains.speedKp, c.gains.speedKi};
+        for (float g : gains)
+            if (!isfinite(g) || g < 0)
+                return false;
+        const command_gains& g = c.gains;
+        float tilt = fmaxf(g.tiltKp, fmaxf(g.tiltKi * COMMAND_GAIN_PERIOD, g.tiltKd / COMMAND_GAIN_PERIOD));
+        float speed = fmaxf(g.speedKp, g.speedKi * COMMAND_GAIN_PERIOD);
+        return (tilt == 0 || tilt >= COMMAND_MIN_TILT_GAIN) && (speed == 0 || speed >= COMMAND_MIN_SPEED_GAIN);
+    }
+    case COMMAND_LOG:
+        return c.log.action == LOG_STOP || c.log.action == LOG_START || c.log.action == LOG_ERASE;
+    default:
+        return true;
+    }
+}
+
+//Encode a command into out, which must hold FRAME_MAX_ENCODED bytes. Returns the frame length
+inline size_t encodeCommand(const command& c, uint8_t *out) {
+    uint8_t payload[COMMAND_HEADER + sizeof(command_gains)];
+    int length = commandLength(c.type);
+    if (length < 0)
+        return 0;
+    payload[0] = c.type;
+    payload[1] = static_cast<uint8_t>(c.sequence);
+    payload[2] = static_cast<uint8_t>(c.sequence >> 8);
+    memcpy(payload + COMMAND_HEADER, &c.velocity, length);
+    return encodeFrame(payload, COMMAND_HEADER + length, out);
+}
+
+//Incremental command decoder. Each byte costs a few operations, plus a CRC over the frame when its delimiter
+//arrives, so it can be fed from a receive loop without blocking. Commands are validated before they are returned
+class command_parser {
+
+public:
+
+    //Add a received byte. Returns true when it completes a frame with a valid header, which is then available
+    //from get() and result() until the next call
+    bool push(uint8_t b) {
+        if (!decoder.push(b) || decoder.length() < COMMAND_HEADER)
+            return false;
+
+        const uint8_t *payload = decoder.data();
+        current.type = static_cast<command_type>(payload[0]);
+        current.sequence = static_cast<uint16_t>(payload[1] | (payload[2] << 8));
+        int length = commandLength(payload[0]);
+        if (length < 0) {
+            status = COMMAND_BAD_TYPE;
+        }
+        else if (static_cast<size_t>(length) != decoder.length() - COMMAND_HEADER) {
+            status = COMMAND_BAD_LENGTH;
+        }
+        else if (started && current.sequence == lastSequence) {
+            status = COMMAND_DUPLICATE;
+        }
+        else {
+            //A command that is out of range still takes its sequence number, so a retry is a duplicate
+            if (started)
+                lost += static_cast<uint16_t>(current.sequence - lastSequence - 1);
+            memcpy(&current.velocity, payload + COMMAND_HEADER, length);
+            lastSequence = current.sequence;
+            started = true;
+            status = commandValid(current) ? COMMAND_OK : COMMAND_BAD_VALUE;
+        }
+        return true;
+    }
+
+    //Last command. Only the header is valid unless result() is COMMAND_OK
+    const command& get() const {
+        return current;
+    }
+
+    command_result result() const {
+        return status;
+    }
+
+    //Frames rejected because of a bad CRC or encoding
+    uint32_t getErrors() const {
+        return decoder.getErrors();
+    }
+
+    //Commands missed, from gaps in the sequence numbers
+    uint32_t getLost() const {
+        return lost;
+    }
+
+    private:
+
+    frame_decoder decoder;
+    command current = {};
+    command_result status = COMMAND_OK;
+    uint16_t lastSequence = 0;
+    bool started = false;           //lastSequence is valid
+    uint32_t lost = 0;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef COMMAND_LINK_H
+#define COMMAND_LINK_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <driver/uart.h>
+#include <command.h>
+#include <spsc_queue.h>
+#include <telemetry_records.h>
+
+//Receives commands (command.h) on the UART that carries the telemetry.
+//The UART driver interrupt copies received bytes into its ring buffer as soon as the line has been idle for a
+//few bit times, which wakes a receive task that feeds them to command_parser. Commands are passed to the control
+//task through a lock-free queue, so a command reaches the control loop at its next period. The control task
+//returns the result of each command through a second queue for the telemetry task to acknowledge.
+//The watchdog expires when no valid command, including a heartbeat, has arrived for the timeout, so the
+//control loop can stop the robot if the Raspberry Pi or the link fails
+class command_link {
+
+public:
+
+    static const uint32_t QUEUE_SIZE = 16;         //commands buffered between control periods
+    static const int RX_TIMEOUT_SYMBOLS = 2;       //idle time before the UART interrupt passes on bytes
+
+    command_link(uart_port_t p = UART_NUM_0) : port(p) {}
+
+    //Start receiving with a watchdog timeout (ms). The UART driver must already be installed, see
+    //telemetry::begin(). Call once from setup()
+    bool begin(uint32_t timeoutMs, int core = 0, UBaseType_t priority = configMAX_PRIORITIES - 2) {
+        timeout = timeoutMs * 1000;
+        if (uart_set_rx_timeout(port, RX_TIMEOUT_SYMBOLS) != ESP_OK)
+            return false;
+        return xTaskCreatePinnedToCore(taskEntry, "command", 4096, this, priority, &task, core) == pdPASS;
+    }
+
+    //Next valid command. Returns false if there are none. Commands that were rejected are acknowledged and
+    //skipped. Call from the control task
+    bool read(command& c) {
+        received r;
+        while (commands.pop(r)) {
+            if (r.result == COMMAND_OK) {
+                c = r.cmd;
+                return true;
+            }
+            acknowledge(r.cmd, r.result);
+        }
+        return false;
+    }
+
+    //Report the result of a command for acknowledgement. Call from the control task
+    void acknowledge(const command& c, command_result result) {
+        telemetry_ack ack;
+        ack.time = micros();
+        ack.sequence = c.sequence;
+        ack.type = c.type;
+        ack.result = result;
+        if (!acks.push(ack))
+            droppedAcks++;
+    }
+
+    //Next acknowledgement to send. Call from the telemetry task
+    bool readAck(telemetry_ack& ack) {
+        return acks.pop(ack);
+    }
+
+    //True if no valid command has arrived for the timeout, or none since begin()
+    bool expired() const {
+        return !started.load(std::memory_order_acquire) ||
+               micros() - lastReceived.load(std::memory_order_relaxed) > timeout;
+    }
+
+    //Frames rejected because of a bad CRC or encoding
+    uint32_t getErrors() const {
+        return errors;
+    }
+
+    //Commands missed, from gaps in the sequence numbers
+    uint32_t getLost() const {
+        return lost;
+    }
+
+    //Commands and acknowledgements lost because a queue was full
+    uint32_t getDropped() const {
+        return droppedCommands + droppedAcks;
+    }
+
+    private:
+
+    uart_port_t port;
+    TaskHandle_t task = nullptr;
+    uint32_t timeout = 0;                   //μs
+    std::atomic<uint32_t> lastReceived{0};  //time of the last valid command (μs)
+    std::atomic<bool> started{false};       //a valid command has arrived
+    volatile uint32_t errors = 0;
+    volatile uint32_t lost = 0;
+    volatile uint32_t droppedCommands = 0;     //written by the receive task
+    volatile uint32_t droppedAcks = 0;         //written by the control task
+
+    //A command and the parser's verdict on it
+    struct received {
+        command cmd;
+        command_result result;
+    };
+
+    spsc_queue<received, QUEUE_SIZE> commands;     //receive task -> control task
+    spsc_queue<telemetry_ack, QUEUE_SIZE> acks;    //control task -> telemetry task
+
+    static void taskEntry(void *arg) {
+        static_cast<command_link *>(arg)->run();
+    }
+
+    void run() {
+        command_parser parser;
+        uint8_t buffer[64];
+        while (true) {
+            //Block for the first byte, then take whatever else has arrived
+            int n = uart_read_bytes(port, buffer, 1, portMAX_DELAY);
+            size_t waiting = 0;
+            if (n > 0 && uart_get_buffered_data_len(port, &waiting) == ESP_OK && waiting > 0) {
+                size_t more = waiting < sizeof(buffer) - 1 ? waiting : sizeof(buffer) - 1;
+                int m = uart_read_bytes(port, buffer + 1, more, 0);
+                if (m > 0)
+                    n += m;
+            }
+
+            for (int i = 0; i < n; i++) {
+                if (!parser.push(buffer[i]))
+                    continue;
+                if (parser.result() == COMMAND_OK) {
+                    lastReceived.store(micros(), std::memory_order_relaxed);
+                    started.store(true, std::memory_order_release);
+                }
+
+                //Rejected commands are passed on too, so that they are acknowledged in order. A duplicate is
+                //acknowledged so the sender knows its retry arrived
+                if (!commands.push({parser.get(), parser.result()}))
+                    droppedCommands++;
+            }
+            errors = parser.getErrors();
+            lost = parser.getLost();
+        }
+    }
+};
+
+#endif
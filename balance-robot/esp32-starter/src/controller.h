@@ -0,0 +1,321 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <math.h>
+#include <stdint.h>
+
+//Fixed-point PID controller.
+//Gains are given in floating point per unit of the integer input and output, and stored as integers with a
+//shift chosen to keep the most precision that fits, so update() uses only integer multiplies and shifts.
+//The derivative is either calculated from the error and low-pass filtered, or supplied by the caller (such as a
+//gyro rate). The integrator stops when the output is saturated in the direction of the error and is clamped to
+//the output range, so it cannot wind up
+class pid {
+
+public:
+
+    static const int SCALE_SHIFT = 16;      //gain scale factors are in units of 2^-16
+
+    //Set the update period (s), output range and derivative filter time constant (s)
+    pid(float samplePeriod, int32_t minOutput, int32_t maxOutput, float derivativeTimeConstant = 0) :
+        dt(samplePeriod), outMin(minOutput), outMax(maxOutput) {
+        alpha = static_cast<int32_t>(lround(samplePeriod / (derivativeTimeConstant + samplePeriod) * 65536));
+    }
+
+    //Set gains: kp in output units per input unit, ki per input unit second, kd per input unit per second.
+    //Can be called between updates. Do not call from ISR
+    void setGains(float kp, float ki, float kd) {
+        kpSet = kp;
+        kiSet = ki;
+        kdSet = kd;
+
+        //Use the largest shift that keeps every stored gain within 30 bits, and the shifted output range within
+        //63 bits
+        double kiDt = ki * dt;
+        double kdDt = kd / dt;
+        double largest = fmax(fabs(kp), fmax(fabs(kiDt), fabs(kdDt)));
+        int oldShift = shift;
+        shift = largest > 0 ? 30 - static_cast<int>(ceil(log2(largest))) : 30;
+        int limit = maxShift(outMin, outMax);
+        if (shift > 48) shift = 48;
+        if (shift > limit) shift = limit;
+        if (shift < 0) shift = 0;
+
+        //Keep the integrator output the same, so gains can be changed while running. It is clamped to the output
+        //range before it is scaled up, so it cannot overflow
+        if (shift < oldShift)
+            integral >>= oldShift - shift;
+        else
+            integral = clampIntegral(integral, oldShift) * (int64_t(1) << (shift - oldShift));
+        integral = clampIntegral(integral, shift);
+
+        p = static_cast<int32_t>(llround(ldexp(kp, shift)));
+        i = static_cast<int32_t>(llround(ldexp(kiDt, shift)));
+        d = static_cast<int32_t>(llround(ldexp(kdDt, shift)));
+        rateGain = static_cast<int32_t>(llround(ldexp(kd, shift)));
+        if (i == 0)
+            integral = 0;
+    }
+
+    //Update with a new error and return the output. The derivative is taken from the filtered change in error.
+    //scale multiplies the proportional and derivative terms, in units of 2^-16, for gain scheduling
+    int32_t update(int32_t error, int32_t scale = 1 << SCALE_SHIFT) {
+        int64_t change = static_cast<int64_t>(error - lastError) << DERIVATIVE_SHIFT;
+        lastError = error;
+        if (!primed) {
+            change = 0;
+            primed = true;
+        }
+        derivative += ((change - derivative) * alpha) >> 16;
+        int64_t dTerm = (derivative * d) >> DERIVATIVE_SHIFT;
+        return output(error, dTerm, scale);
+    }
+
+    //Update with a new error and its rate of change in input units per second, such as a gyro rate
+    int32_t update(int32_t error, int32_t errorRate, int32_t scale) {
+        lastError = error;
+        primed = true;
+        return output(error, static_cast<int64_t>(errorRate) * rateGain, scale);
+    }
+
+    //Clear the integrator and derivative state
+    void reset() {
+        integral = 0;
+        derivative = 0;
+        primed = false;
+    }
+
+    //Change the output range. The gains are set again, because a wider range leaves room for a smaller shift,
+    //and the integrator is clamped to the new range
+    void setLimits(int32_t minOutput, int32_t maxOutput) {
+        outMin = minOutput;
+        outMax = maxOutput;
+        setGains(kpSet, kiSet, kdSet);
+    }
+
+    //Integrator contribution to the output, in output units
+    int32_t getIntegral() const {
+        return static_cast<int32_t>(integral >> shift);
+    }
+
+    private:
+
+    static const int DERIVATIVE_SHIFT = 8;  //extra precision of the filtered derivative
+
+    float dt;                   //update period (s)
+    int32_t outMin, outMax;     //output range
+    int32_t alpha;              //derivative filter coefficient (2^-16)
+    int shift = 30;             //gains are in units of 2^-shift
+    float kpSet = 0, kiSet = 0, kdSet = 0;      //gains from setGains()
+    int32_t p = 0, i = 0, d = 0;    //proportional, integral per update and derivative per update gains
+    int32_t rateGain = 0;       //derivative gain for an external rate
+    int64_t integral = 0;       //integrator (2^-shift output units)
+    int64_t derivative = 0;     //filtered change in error per update (2^-DERIVATIVE_SHIFT input units)
+    int32_t lastError = 0;
+    bool primed = false;        //lastError is valid
+
+    //Largest shift that keeps the output range, in units of 2^-shift, within 63 bits
+    static int maxShift(int32_t minOutput, int32_t maxOutput) {
+        int64_t lo = -static_cast<int64_t>(minOutput), hi = maxOutput;
+        int64_t largest = lo > hi ? lo : hi;
+        int bits = 0;
+        while (bits < 63 && (largest >> bits) != 0)
+            bits++;
+        return 62 - bits;
+    }
+
+    //Clamp an integrator value in units of 2^-atShift to the output range
+    int64_t clampIntegral(int64_t value, int atShift) const {
+        int64_t lo = static_cast<int64_t>(outMin) * (int64_t(1) << atShift);
+        int64_t hi = static_cast<int64_t>(outMax) * (int64_t(1) << atShift);
+        return value > hi ? hi : value < lo ? lo : value;
+    }
+
+    int32_t output(int32_t error, int64_t dTerm, int32_t scale) {
+        int64_t pTerm = static_cast<int64_t>(error) * p;
+        int64_t pd = ((pTerm + dTerm) >> SCALE_SHIFT) * scale;
+        int64_t lo = static_cast<int64_t>(outMin) * (int64_t(1) << shift);
+        int64_t hi = static_cast<int64_t>(outMax) * (int64_t(1) << shift);
+
+        //Integrate unless the output is already saturated in the direction the error would push it
+        int64_t total = pd + integral;
+        int64_t step = static_cast<int64_t>(error) * i;
+        if ((total < hi || step < 0) && (total > lo || step > 0))
+            integral += step;
+        if (integral > hi) integral = hi;
+        if (integral < lo) integral = lo;
+
+        total = (pd + integral) >> shift;
+        if (total > outMax) return outMax;
+        if (total < outMin) return outMin;
+        return static_cast<int32_t>(total);
+    }
+};
+
+//Cascaded balance controller for a two-wheeled inverted pendulum.
+//The outer loop is a PI controller on wheel speed, with an optional proportional position hold, and its output is
+//the tilt angle setpoint. Wheel speed is measured by differentiating the step position and low-pass filtering it. The inner loop is a PID controller on tilt angle, with the derivative taken from the
+//gyro rate, and its output is wheel acceleration. The acceleration is integrated into the wheel speed command.
+//Inner loop gains are scaled with wheel speed from a table, because the motor torque and the dynamics change
+//with speed.
+//Units: angles in 2^-24 rad and rates in 2^-24 rad/s (as tilt_estimator), positions in microsteps, speeds in
+//microsteps/s and accelerations in microsteps/s/s. Positive tilt is leaning in the positive wheel direction
+class balance_controller {
+
+public:
+
+    static const int ANGLE_SHIFT = 24;
+    static const int MAX_SCHEDULE = 8;      //maximum gain schedule points
+
+    //Set the update period (s), the largest tilt setpoint (rad), acceleration and speed (microsteps/s/s, /s)
+    //and the time constant of the speed measurement filter (s)
+    balance_controller(float samplePeriod, float maxTilt, int32_t maxAccel, int32_t maxSpeed,
+                       float speedTimeConstant = 0.02) :
+        tiltLoop(samplePeriod, -maxAccel, maxAccel),
+        speedLoop(samplePeriod, -static_cast<int32_t>(maxTilt * (1 << ANGLE_SHIFT)),
+                  static_cast<int32_t>(maxTilt * (1 << ANGLE_SHIFT))),
+        speedLimit(maxSpeed) {
+        dtQ = static_cast<int32_t>(lround(samplePeriod * 65536));
+        updateRate = static_cast<int32_t>(lround(1.0 / samplePeriod));
+        speedAlpha = static_cast<int32_t>(lround(samplePeriod / (speedTimeConstant + samplePeriod) * 65536));
+    }
+
+    //Inner loop gains: microsteps/s/s per rad, per rad s, and per rad/s
+    void setTiltGains(float kp, float ki, float kd) {
+        const float perRad = 1.0f / (1 << ANGLE_SHIFT);
+        tiltLoop.setGains(kp * perRad, ki * perRad, kd * perRad);
+    }
+
+    //Outer loop gains: rad of tilt per microstep/s of speed error, and per microstep of accumulated error
+    void setSpeedGains(float kp, float ki) {
+        speedLoop.setGains(kp * (1 << ANGLE_SHIFT), ki * (1 << ANGLE_SHIFT), 0);
+    }
+
+    //Position hold gain: microsteps/s of speed correction per microstep of position error. 0 disables
+    void setPositionGain(float kp) {
+        positionGain = static_cast<int32_t>(lround(kp * 65536));
+    }
+
+    //Scale the inner loop gains by factors[i] at wheel speeds[i] (microsteps/s, ascending), interpolating
+    //linearly between points. n = 0 disables scheduling
+    void setSchedule(const int32_t *speeds, const float *factors, int n) {
+        scheduleSize = n < MAX_SCHEDULE ? n : MAX_SCHEDULE;
+        for (int k = 0; k < scheduleSize; k++) {
+            scheduleSpeed[k] = speeds[k];
+            scheduleScale[k] = static_cast<int32_t>(lround(factors[k] * (1 << pid::SCALE_SHIFT)));
+        }
+    }
+
+    //Set the target wheel speed (microsteps/s) and the tilt angle at which the robot balances (2^-24 rad)
+    void setTarget(int32_t speed, int32_t balanceAngle = 0) {
+        targetSpeed = speed;
+        balanceTilt = balanceAngle;
+    }
+
+    //Run one update from the tilt angle and rate and the wheel position (microsteps).
+    //Returns the wheel speed command (microsteps/s)
+    int32_t update(int32_t tilt, int32_t tiltRate, int32_t position) {
+
+        //Measure the wheel speed from the change in position
+        int32_t rawSpeed = (position - lastPosition) * updateRate;
+        lastPosition = position;
+        speedQ += ((static_cast<int64_t>(rawSpeed) << 8) - speedQ) * speedAlpha >> 16;
+        int32_t speed = static_cast<int32_t>(speedQ >> 8);
+
+        //Position hold: the reference position moves at the target speed and its error corrects the speed
+        int32_t speedSetpoint = targetSpeed;
+        if (positionGain != 0) {
+            referenceQ += static_cast<int64_t>(targetSpeed) * dtQ;
+            int32_t positionError = static_cast<int32_t>(referenceQ >> 16) - position;
+            speedSetpoint += static_cast<int32_t>((static_cast<int64_t>(positionError) * positionGain) >> 16);
+        }
+        else {
+            referenceQ = static_cast<int64_t>(position) << 16;
+        }
+
+        //Outer loop: speed error to tilt setpoint
+        tiltSetpoint = balanceTilt + speedLoop.update(speedSetpoint - speed);
+
+        //Inner loop: tilt error to acceleration, with the gyro rate as the derivative
+        scale = scheduleFactor(speed < 0 ? -speed : speed);
+        acceleration = tiltLoop.update(tilt - tiltSetpoint, tiltRate, scale);
+
+        //Integrate acceleration into the speed command
+        commandQ += static_cast<int64_t>(acceleration) * dtQ;
+        int64_t limit = static_cast<int64_t>(speedLimit) << 16;
+        if (commandQ > limit) commandQ = limit;
+        if (commandQ < -limit) commandQ = -limit;
+        return static_cast<int32_t>(commandQ >> 16);
+    }
+
+    //Clear all controller state, for example before standing up or after the robot is picked up.
+    //The position reference moves to position and the speed command restarts at speed
+    void reset(int32_t position, int32_t speed) {
+        tiltLoop.reset();
+        speedLoop.reset();
+        lastPosition = position;
+        referenceQ = static_cast<int64_t>(position) << 16;
+        speedQ = static_cast<int64_t>(speed) << 8;
+        commandQ = static_cast<int64_t>(speed) << 16;
+    }
+
+    //Measured wheel speed (microsteps/s)
+    int32_t getSpeed() const {
+        return static_cast<int32_t>(speedQ >> 8);
+    }
+
+    //Tilt setpoint from the outer loop (2^-24 rad)
+    int32_t getTiltSetpoint() const {
+        return tiltSetpoint;
+    }
+
+    //Acceleration from the inner loop (microsteps/s/s)
+    int32_t getAcceleration() const {
+        return acceleration;
+    }
+
+    //Inner loop gain scale from the schedule (2^-16)
+    int32_t getGainScale() const {
+        return scale;
+    }
+
+    private:
+
+    pid tiltLoop;
+    pid speedLoop;
+    int32_t speedLimit;
+    int32_t dtQ;                    //update period (2^-16 s)
+    int32_t updateRate;             //updates per second
+    int32_t speedAlpha;             //speed filter coefficient (2^-16)
+    int32_t lastPosition = 0;
+    int64_t speedQ = 0;             //measured speed (2^-8 microsteps/s)
+    int32_t positionGain = 0;       //(2^-16 /s)
+    int32_t targetSpeed = 0;
+    int32_t balanceTilt = 0;
+    int32_t tiltSetpoint = 0;
+    int32_t acceleration = 0;
+    int32_t scale = 1 << pid::SCALE_SHIFT;
+    int64_t referenceQ = 0;         //position reference (2^-16 microsteps)
+    int64_t commandQ = 0;           //speed command (2^-16 microsteps/s)
+    int scheduleSize = 0;
+    int32_t scheduleSpeed[MAX_SCHEDULE];
+    int32_t scheduleScale[MAX_SCHEDULE];
+
+    //Gain scale for a wheel speed, interpolated from the schedule (2^-16)
+    int32_t scheduleFactor(int32_t speed) const {
+        if (scheduleSize == 0)
+            return 1 << pid::SCALE_SHIFT;
+        if (speed <= scheduleSpeed[0])
+            return scheduleScale[0];
+        for (int k = 1; k < scheduleSize; k++) {
+            if (speed < scheduleSpeed[k]) {
+                int64_t span = scheduleSpeed[k] - scheduleSpeed[k - 1];
+                int64_t offset = speed - scheduleSpeed[k - 1];
+                return scheduleScale[k - 1] + static_cast<int32_t>((scheduleScale[k] - scheduleScale[k - 1]) * offset / span);
+            }
+        }
+        return scheduleScale[scheduleSize - 1];
+    }
+};
+
+#endif
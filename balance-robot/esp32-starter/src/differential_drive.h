@@ -0,0 +1,227 @@
+#ifndef DIFFERENTIAL_DRIVE_H
+#define DIFFERENTIAL_DRIVE_H
+
+#include <atomic>
+#include <math.h>
+#include <step.h>
+#include <seqlock.h>
+#include <motion_profile.h>
+
+//Two-wheeled differential drive that owns both steppers, which must be in DDA_MODE.
+//Motion is commanded as a linear speed and a turn rate. The ISR ramps these two velocities, each with its own
+//acceleration, in one shared pair of accumulators and derives both wheel velocities from them on every tick,
+//so the wheels always change speed together and the ratio between them - the path curvature - only changes
+//when the commanded turn rate does. Driving straight, both wheels get identical velocities and their DDA phases
+//stay in step to within a tick, so the heading cannot drift.
+//Position moves ("drive 50 cm", "turn 90°") are planned with motion_profile.h and finish on the same tick.
+//The most recent of a velocity command or a move takes effect. See pose.h for odometry from the wheel positions
+class differential_drive {
+
+public:
+
+    //Set the wheel radius and the distance between the wheels (m). The right motor is mounted facing the other
+    //way, so its positive direction is reversed unless rightReversed is false
+    differential_drive(step& l, step& r, float wheelRadius, float trackWidth, bool rightReversed = true) :
+        left(l), right(r), rightSign(rightReversed ? -1 : 1) {
+        metresPerMicrostep = wheelRadius * l.STEP_ANGLE;
+        turnPerRad = trackWidth / 2 / metresPerMicrostep;
+        ticksPerSecond = 1e6 / l.getInterval();
+        maxVelocity = toVelocity(l.getMaxSpeed());
+        linearAccel = turnAccel = maxVelocity;
+
+        //With both phases centred, a reversed wheel's phase is the exact negative of the other's, so at equal and
+        //opposite velocities they step on the same tick
+        left.centrePhase();
+        right.centrePhase();
+    }
+
+    //Set the acceleration limits for velocity commands: linear in m/s/s and angular in rad/s/s. Takes effect
+    //with the next command. Without limits, velocity commands take effect immediately. Do not call from ISR
+    void setAcceleration(float linear, float angular) {
+        linearAccel = toAccel(linear / metresPerMicrostep);
+        turnAccel = toAccel(angular * turnPerRad);
+    }
+
+    //Command a linear speed (m/s, forwards positive) and turn rate (rad/s, anticlockwise positive).
+    //Do not call from ISR
+    void setVelocity(float linear, float angular) {
+        setVelocitySteps(linear / metresPerMicrostep, angular * turnPerRad);
+    }
+
+    //Command the mean wheel speed and half the difference between the wheel speeds (right minus left), both in
+    //microsteps/s. Do not call from ISR
+    void setVelocitySteps(float speed, float turn) {
+        int32_t v = toVelocity(speed);
+        int32_t w = toVelocity(turn);
+
+        //Scale both down together if a wheel would exceed its maximum speed, so the curvature is kept
+        int64_t fastest = static_cast<int64_t>(v < 0 ? -v : v) + (w < 0 ? -w : w);
+        if (fastest > maxVelocity) {
+            v = static_cast<int32_t>(static_cast<int64_t>(v) * maxVelocity / fastest);
+            w = static_cast<int32_t>(static_cast<int64_t>(w) * maxVelocity / fastest);
+        }
+        commands.write({v, w, linearAccel, turnAccel, ++order});
+    }
+
+    //Drive a distance (m) while turning through an angle (rad, anticlockwise positive), starting from rest.
+    //The wheel with the longer path moves at up to maxSpeed (m/s), maxAccel (m/s/s) and maxJerk (m/s/s/s,
+    //0 for a trapezoidal profile). Do not call from ISR
+    void move(float distance, float angle, float maxSpeed, float maxAccel, float maxJerk = 0) {
+        int32_t centre = lround(distance / metresPerMicrostep);
+        int32_t turn = lround(angle * turnPerRad);
+        const int32_t distances[2] = {centre - turn, centre + turn};
+        move_pair m;
+        plan_moves(m.profiles, distances, 2, maxSpeed / metresPerMicrostep, maxAccel / metresPerMicrostep,
+                   maxJerk / metresPerMicrostep, left.getInterval());
+        m.order = ++order;
+        lastMoveOrder = m.order;
+        moves.write(m);
+    }
+
+    //True from a call to move() until the move finishes or is cancelled
+    bool isMoving() const {
+        return settledOrder.load(std::memory_order_acquire) < lastMoveOrder;
+    }
+
+    //Apply the latest command or move and update both wheels. Call every interval μs from the ISR
+    void runSteppers() {
+        uint32_t version = commands.version();
+        if (version != appliedVersion) {
+            command c;
+            if (commands.tryRead(c)) {
+                appliedVersion = version;
+                if (c.order > appliedOrder) {
+                    active = c;
+                    appliedOrder = c.order;
+                    cancelMove();
+                }
+            }
+        }
+
+        version = moves.version();
+        if (version != appliedMoveVersion && moves.tryRead(nextMove)) {
+            appliedMoveVersion = version;
+            if (nextMove.order > appliedOrder) {
+                appliedOrder = nextMove.order;
+                active.speed = active.turn = 0;
+                left.centrePhase();
+                right.centrePhase();
+                leftMove.start(nextMove.profiles[0]);
+                rightMove.start(nextMove.profiles[1]);
+            }
+        }
+
+        int32_t l, r;
+        if (leftMove.running()) {
+            l = leftMove.next();
+            r = rightMove.next();
+            speed = (l + r) / 2;
+            turn = (r - l) / 2;
+            if (!leftMove.running()) {
+                settledOrder.store(appliedOrder, std::memory_order_release);
+            }
+        }
+        else {
+            speed = ramp(speed, active.speed, active.linearAccel);
+            turn = ramp(turn, active.turn, active.turnAccel);
+            l = speed - turn;
+            r = speed + turn;
+        }
+        //A wheel spends a tick setting its direction pin when it reverses. Hold the other wheel for that tick, so
+        //the wheels stay in step
+        r *= rightSign;
+        bool hold = left.reverses(l) || right.reverses(r);
+        left.runStepperAt(l, hold);
+        right.runStepperAt(r, hold);
+    }
+
+    //Wheel positions in microsteps, forwards positive. Do not call from ISR
+    int32_t getLeftPosition() {
+        return left.getPosition();
+    }
+
+    int32_t getRightPosition() {
+        return rightSign * right.getPosition();
+    }
+
+    //Wheel travel per microstep (m)
+    float getMetresPerMicrostep() const {
+        return metresPerMicrostep;
+    }
+
+    private:
+
+    //Velocity command in DDA units (2^-30 microsteps per tick)
+    struct command {
+        int32_t speed;          //mean wheel velocity
+        int32_t turn;           //half the difference, right minus left
+        int32_t linearAccel;    //velocity change per tick
+        int32_t turnAccel;
+        uint32_t order;         //publish order of commands and moves
+    };
+
+    struct move_pair {
+        motion_profile profiles[2];
+        uint32_t order;
+    };
+
+    step& left;
+    step& right;
+    int32_t rightSign;
+    float metresPerMicrostep;
+    float turnPerRad;               //half the wheel speed difference per rad/s of turn (microsteps/s)
+    float ticksPerSecond;
+    int32_t maxVelocity;
+    int32_t linearAccel = 0;
+    int32_t turnAccel = 0;
+
+    //Control task side
+    uint32_t order = 0;
+    uint32_t lastMoveOrder = 0;
+
+    //ISR side
+    seqlock<command> commands;
+    seqlock<move_pair> moves;
+    uint32_t appliedVersion = 0;
+    uint32_t appliedMoveVersion = 0;
+    uint32_t appliedOrder = 0;
+    command active = {};
+    move_pair nextMove;
+    profile_runner leftMove, rightMove;
+    int32_t speed = 0;              //current mean wheel velocity, also tracked during moves
+    int32_t turn = 0;               //current half difference
+    std::atomic<uint32_t> settledOrder{0};
+
+    //Speed in microsteps/s to a DDA velocity
+    int32_t toVelocity(float s) const {
+        return static_cast<int32_t>(lround(s / ticksPerSecond * step::VELOCITY_ONE));
+    }
+
+    //Acceleration in microsteps/s/s to a DDA velocity change per tick, at least one unit
+    int32_t toAccel(float a) const {
+        double v = fabs(a) / ticksPerSecond / ticksPerSecond * step::VELOCITY_ONE;
+        return static_cast<int32_t>(v < 1 ? 1 : v > maxVelocity ? maxVelocity : v);
+    }
+
+    static int32_t ramp(int32_t v, int32_t target, int32_t accel) {
+        if (v < target) {
+            v += accel;
+            if (v > target) v = target;
+        }
+        else if (v > target) {
+            v -= accel;
+            if (v < target) v = target;
+        }
+        return v;
+    }
+
+    //Abandon any move. The ramp carries on from the velocities the move reached, so a command that interrupts
+    //it does not jerk the wheels
+    void cancelMove() {
+        leftMove.stop();
+        rightMove.stop();
+        settledOrder.store(appliedOrder, std::memory_order_release);
+    }
+};
+
+#endif
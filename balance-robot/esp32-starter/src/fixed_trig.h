@@ -0,0 +1,39 @@
+#ifndef FIXED_TRIG_H
+#define FIXED_TRIG_H
+
+#include <stdint.h>
+
+//Integer sine and cosine of binary angles, where 2^32 is one turn, so angles wrap around without any
+//reduction and can be accumulated forever without losing precision.
+//Results are in units of 2^-30, accurate to about 1.5e-5
+
+const int TRIG_SHIFT = 30;
+const int32_t TRIG_ONE = 1 << TRIG_SHIFT;
+const uint32_t BAM_QUARTER = 1u << 30;         //binary angle of π/2
+
+//sin(angle) in 2^-30
+inline int32_t sinBam(uint32_t angle) {
+    //Reflect into -π/2..π/2 and scale to -1..1 in 2^-30
+    int32_t s = static_cast<int32_t>(angle);
+    if (s > static_cast<int32_t>(BAM_QUARTER) || s < -static_cast<int32_t>(BAM_QUARTER))
+        s = static_cast<int32_t>(0x80000000u - angle);     //π - angle, which wraps to -π - angle when s < 0
+    int64_t z = s;
+
+    //sin(πz/2) = z(a + z^2(b + z^2(c + z^2 d))), Taylor coefficients with d adjusted so sin(π/2) = 1
+    const int64_t A = 1686629684;       //1.5707963
+    const int64_t B = -693598671;       //-0.6459641
+    const int64_t C = 85569278;         //0.0796926
+    const int64_t D = -4858467;         //-0.0045248
+    int64_t z2 = (z * z) >> TRIG_SHIFT;
+    int64_t t = C + ((z2 * D) >> TRIG_SHIFT);
+    t = B + ((z2 * t) >> TRIG_SHIFT);
+    t = A + ((z2 * t) >> TRIG_SHIFT);
+    return static_cast<int32_t>((z * t) >> TRIG_SHIFT);
+}
+
+//cos(angle) in 2^-30
+inline int32_t cosBam(uint32_t angle) {
+    return sinBam(angle + BAM_QUARTER);
+}
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Framing for binary messages on a byte stream such as a UART.
+//A frame is the payload followed by its CRC-16 (low byte first), COBS encoded so that it contains no zero bytes,
+//then a zero byte as the delimiter. A receiver that starts mid-stream or loses bytes resynchronises at the next
+//zero, and the CRC rejects damaged frames. Used by the firmware and the host tools, so it has no Arduino
+//dependencies
+
+const size_t FRAME_MAX_PAYLOAD = 250;               //largest payload, so a frame never needs a second COBS block
+const size_t FRAME_MAX_ENCODED = FRAME_MAX_PAYLOAD + 2 + 2 + 1;    //CRC, COBS overhead and delimiter
+
+//CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF), calculated without a table
+inline uint16_t crc16(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < length; i++) {
+        crc = static_cast<uint16_t>((crc >> 8) | (crc << 8));
+        crc ^= data[i];
+        crc ^= (crc & 0xFF) >> 4;
+        crc ^= static_cast<uint16_t>(crc << 12);
+        crc ^= static_cast<uint16_t>((crc & 0xFF) << 5);
+    }
+    return crc;
+}
+
+//Encode a payload of up to FRAME_MAX_PAYLOAD bytes into out, which must hold FRAME_MAX_ENCODED bytes.
+//Returns the frame length including the delimiter, or 0 if the payload is too long
+inline size_t encodeFrame(const uint8_t *payload, size_t length, uint8_t *out) {
+    if (length > FRAME_MAX_PAYLOAD)
+        return 0;
+
+    uint16_t crc = crc16(payload, length);
+    size_t codeIndex = 0;       //position of the code byte of the current block
+    size_t n = 1;
+    uint8_t code = 1;           //distance to the next zero
+
+    for (size_t i = 0; i < length + 2; i++) {
+        uint8_t b = i < length ? payload[i] : i == length ? static_cast<uint8_t>(crc) : static_cast<uint8_t>(crc >> 8);
+        if (b == 0) {
+            out[codeIndex] = code;
+            codeIndex = n++;
+            code = 1;
+        }
+        else {
+            out[n++] = b;
+            code++;
+        }
+    }
+    out[codeIndex] = code;
+    out[n++] = 0;
+    return n;
+}
+
+//Decoder for a stream of frames, fed one byte at a time so it can run in a receive loop or from a ring buffer
+class frame_decoder {
+
+public:
+
+    //Add a received byte. Returns true when it completes a valid frame, which is then available from
+    //data() and length() until the next call
+    bool push(uint8_t b) {
+        if (b == 0) {
+            bool valid = started && !overflow && remaining == 0 && count >= 2;
+            if (valid) {
+                uint16_t crc = buffer[count - 2] | (buffer[count - 1] << 8);
+                valid = crc16(buffer, count - 2) == crc;
+            }
+            if (started && !valid)
+                errors++;
+            frameLength = valid ? count - 2 : 0;
+            started = overflow = false;
+            count = remaining = 0;
+            return valid;
+        }
+
+        if (overflow)
+            return false;
+        if (remaining == 0) {
+            //Code byte: the previous block ended with a zero unless it was a full 254-byte block
+            if (started && lastCode != 0xFF)
+                append(0);
+            lastCode = b;
+            remaining = b - 1;
+            started = true;
+        }
+        else {
+            append(b);
+            remaining--;
+        }
+        return false;
+    }
+
+    //Payload of the last valid frame
+    const uint8_t *data() const {
+        return buffer;
+    }
+
+    size_t length() const {
+        return frameLength;
+    }
+
+    //Frames rejected because of a bad CRC, bad encoding or excessive length
+    uint32_t getErrors() const {
+        return errors;
+    }
+
+    private:
+
+    uint8_t buffer[FRAME_MAX_PAYLOAD + 2];
+    size_t count = 0;           //decoded bytes in the current frame
+    size_t frameLength = 0;     //payload length of the last valid frame
+    uint8_t remaining = 0;      //data bytes left in the current COBS block
+    uint8_t lastCode = 0;
+    bool started = false;       //a frame is in progress
+    bool overflow = false;      //the current frame is too long
+    uint32_t errors = 0;
+
+    void append(uint8_t b) {
+        if (count == sizeof(buffer))
+            overflow = true;
+        else
+            buffer[count++] = b;
+    }
+};
+
+#endif
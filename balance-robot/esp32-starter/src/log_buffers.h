@@ -0,0 +1,82 @@
+#ifndef LOG_BUFFERS_H
+#define LOG_BUFFERS_H
+
+#include <atomic>
+#include <stdint.h>
+
+//Lock-free double buffer of N items between one producer and one consumer that takes whole buffers, such as a
+//task writing them to flash. The producer fills one buffer an item at a time; when it is full it is handed to
+//the consumer and the producer carries on in the other. If the consumer still has the other buffer when that
+//fills too, items are dropped and counted until it is given back, so the producer never waits.
+//Each side must only be used from one context
+template <typename T, uint32_t N>
+class log_buffers {
+
+public:
+
+    //Add an item. Returns true when a full buffer is handed to the consumer. Producer only
+    bool add(const T& item) {
+        bool handed = false;
+        if (fill == N) {
+            if (!handOver()) {
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+            handed = true;
+        }
+        items[active][fill++] = item;
+        return (fill == N && handOver()) || handed;
+    }
+
+    //Hand a partly filled buffer to the consumer, to finish a log. Returns false if the consumer still has the
+    //other buffer; call again later. Returns true with nothing to hand over. Producer only
+    bool flush() {
+        return fill == 0 || handOver();
+    }
+
+    //Buffer handed over by the producer and its length, or nullptr. The buffer stays with the consumer until
+    //release(). Consumer only
+    const T *take(uint32_t& count) const {
+        int b = ready.load(std::memory_order_acquire);
+        if (b < 0)
+            return nullptr;
+        count = counts[b];
+        return items[b];
+    }
+
+    //Give the buffer from take() back to the producer. Consumer only
+    void release() {
+        ready.store(-1, std::memory_order_release);
+    }
+
+    //Discard the items that have not been handed over. Producer only
+    void clear() {
+        fill = 0;
+    }
+
+    //Items lost because both buffers were full
+    uint32_t getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    private:
+
+    T items[2][N];
+    uint32_t counts[2] = {};
+    int active = 0;                     //buffer being filled
+    uint32_t fill = 0;                  //items in the active buffer
+    std::atomic<int> ready{-1};         //buffer with the consumer, -1 for none
+    std::atomic<uint32_t> dropped{0};
+
+    bool handOver() {
+        if (ready.load(std::memory_order_acquire) >= 0)
+            return false;
+        counts[active] = fill;
+        ready.store(active, std::memory_order_release);
+        active ^= 1;
+        fill = 0;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef LOG_RECORDS_H
+#define LOG_RECORDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//Layout of the sensor log in the flash log partition, shared by the firmware (sensor_log.h) and the host
+//exporter (host/log_export). The partition starts with a log_header, followed by one log_record per control
+//period, back to back. Logging erases the partition first, so the log ends at the first record that is still
+//erased, with every byte 0xFF. Records are little-endian with no padding
+
+const uint32_t LOG_MAGIC = 0x474f4c42;     //"BLOG"
+const uint16_t LOG_VERSION = 1;
+
+//Start of a log, with the scales of the raw values
+struct log_header {
+    uint32_t magic;             //LOG_MAGIC
+    uint16_t version;           //LOG_VERSION
+    uint16_t recordSize;        //sizeof(log_record)
+    uint32_t period;            //control period (μs)
+    uint32_t start;             //time logging started (μs)
+    float accelScale;           //g per accelerometer LSB
+    float gyroScale;            //rad/s per gyro LSB
+    float stepAngle;            //wheel rad per microstep
+    int32_t speedScale;         //speeds are in microsteps/(speedScale * s)
+};
+static_assert(sizeof(log_header) == 32, "log_header must not be padded");
+
+//State of one control period
+struct log_record {
+    uint32_t time;              //time of the control update (μs)
+    int16_t accel[3];           //latest raw accelerometer sample
+    int16_t gyro[3];            //latest raw gyro sample
+    int32_t speed[2];           //motor speeds (microsteps/(speedScale * s))
+    int32_t position[2];        //motor positions (microsteps)
+    int32_t output;             //balance controller output, the mean wheel speed (microsteps/s)
+};
+static_assert(sizeof(log_record) == 36, "log_record must not be padded");
+
+//True if a header starts a log this code can read
+inline bool logHeaderValid(const log_header& h) {
+    return h.magic == LOG_MAGIC && h.version == LOG_VERSION && h.recordSize == sizeof(log_record);
+}
+
+//True if a record is still erased flash, the end of the log
+inline bool logRecordErased(const log_record& r) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&r);
+    for (size_t i = 0; i < sizeof(r); i++)
+        if (bytes[i] != 0xff)
+            return false;
+    return true;
+}
+
+#endif
@@ -1,9 +1,26 @@
 #include <Arduino.h>
-#include <SPI.h>
 #include <TimerInterrupt_Generic.h>
-#include <Adafruit_MPU6050.h>
-#include <Adafruit_Sensor.h>
+#include <mpu6050_fifo.h>
+#include <mcp3208.h>
+#include <tilt.h>
+#include <controller.h>
+#include <scheduler.h>
+#include <telemetry.h>
+#include <pose.h>
+#include <command_link.h>
+#include <remote_motion.h>
+#include <battery.h>
+#include <profiler.h>
+#include <sensor_log.h>
+#include <Preferences.h>
+#include <atomic>
+#ifdef STEP_MCPWM
+#include <step_mcpwm.h>
+#else
 #include <step.h>
+#include <differential_drive.h>
+#endif
+#include <step_gpio.h>
 
 // The Stepper pins
 const int STEPPER1_DIR_PIN  = 16;
@@ -12,135 +29,608 @@ const int STEPPER2_DIR_PIN  = 4;
 const int STEPPER2_STEP_PIN = 14;
 const int STEPPER_EN_PIN    = 15; 
 
+//Microstep mode pins for adaptive microstepping, in builds with ADAPTIVE_MICROSTEPS (see platformio.ini). The
+//drivers switch from 16 to 8 and 4 microsteps as the wheels speed up, for up to 4 times the top speed. The kit
+//sets the resolution with the configuration switch instead: disconnect MS1 and MS3 of each driver from the
+//switch, leave MS2 high and wire MS1 and MS3 to these pins. Levels are for the A4988, bit n for pin n; for the
+//DRV8825 wire MODE0-MODE2 and use levels {0b100, 0b011, 0b010}
+#ifdef ADAPTIVE_MICROSTEPS
+#ifdef STEP_MCPWM
+#error "Adaptive microstepping needs the stepper ISR, not STEP_MCPWM"
+#endif
+const step::microstep_pins STEPPER1_MODE_PINS = {{25, -1, 26}, {0b111, 0b011, 0b010}};
+const step::microstep_pins STEPPER2_MODE_PINS = {{27, -1, 33}, {0b111, 0b011, 0b010}};
+#endif
+
 //ADC pins
 const int ADC_CS_PIN        = 5;
 const int ADC_SCK_PIN       = 18;
 const int ADC_MISO_PIN      = 19;
 const int ADC_MOSI_PIN      = 23;
+const int ADC_SCAN_HZ       = 1000;   //Scans of all 8 channels per second
+const int ADC_DECIMATION    = 10;     //Scans averaged into each published reading
+const float ADC_REFERENCE   = 4.096;  //V
+
+//Battery monitoring through interface circuits from the J2 power monitoring connector to the ADC, see the README.
+//Set these to match your circuits. The motor current comes straight from the battery; the 5 V current is
+//converted to battery current from the power drawn through the converter
+const int BATTERY_VOLTAGE_CHANNEL = 0;
+const float BATTERY_DIVIDER = 3.0;        //Battery voltage over ADC input voltage
+const int MOTOR_CURRENT_CHANNEL = 1;
+const float MOTOR_CURRENT_GAIN = 1.0;     //V/A: 0.1 Ω sense resistor with a differential gain of 10
+const int LOGIC_CURRENT_CHANNEL = 2;
+const float LOGIC_CURRENT_GAIN = 0.1;     //V/A: 0.01 Ω sense resistor with a differential gain of 10
+const float CURRENT_ZERO_VOLTS = 1.25;    //Amplifier reference
+const float LOGIC_EFFICIENCY = 0.85;      //5 V converter
+const float BATTERY_CAPACITY = 2.0;       //Ah
+const int BATTERY_CELLS     = 6;          //7.2 V NiMH pack
+const float BATTERY_RESISTANCE = 0.15;    //Pack, fuse and wiring (Ω)
+const float BATTERY_MODEL_TIME_CONSTANT = 600;  //Charge count follows the voltage over longer times than this (s)
+const float BATTERY_SAVE_MAH = 20;        //Save the counters to flash after this much charge is drawn
+
+//IMU data ready interrupt, wired from the MPU6050 INT pin
+const int IMU_INT_PIN       = 35;
 
 // Diagnostic pin for oscilloscope
 const int TOGGLE_PIN        = 32;
 
-const int PRINT_INTERVAL    = 500;
-const int LOOP_INTERVAL     = 10;
+const int TELEMETRY_INTERVAL = 10;   //Telemetry flush interval (ms)
+const uint32_t TELEMETRY_BAUD = 921600;
+const uint32_t COMMAND_TIMEOUT_MS = 500;  //Stop if no command or heartbeat arrives for this long
+const int STATS_INTERVAL    = 5000;  //Task timing report interval (ms)
+const int BATTERY_INTERVAL  = 100;   //Battery report interval (ms)
+const int IMU_RATE_HZ       = 1000;
+const int CONTROL_RATE_HZ   = 1000;
 const int STEPPER_INTERVAL_US = 20;
+const uint32_t STEP_PULSE_NS = 1900;  //Minimum step pulse high time of the motor drivers (DRV8825 1.9 μs, A4988 1 μs)
+const uint32_t CPU_MHZ      = F_CPU / 1000000;  //CPU cycles per μs, for the profiler budgets
 
-const float kx = 20.0;
-const float VREF = 4.096;
+//Task placement: the stepper ISR, IMU reader and controller share core 1, where nothing else runs.
+//Telemetry and the ADC are on core 0
+const int CONTROL_CORE      = 1;
+const int COMMS_CORE        = 0;
+
+//Balance controller gains, in wheel rad/s/s per rad of tilt (P), per rad s (I) and per rad/s (D) for the tilt
+//loop and in rad of tilt per wheel rad/s (P) and per wheel rad (I) for the speed loop
+const float TILT_KP = 650.0;
+const float TILT_KI = 100.0;
+const float TILT_KD = 55.0;
+const float SPEED_KP = 0.0054;
+const float SPEED_KI = 0.0014;
+const float MAX_TILT_SETPOINT = 0.3;   //rad
+const float WHEEL_ACCEL = 300.0;       //rad/s/s
+#ifdef ADAPTIVE_MICROSTEPS
+const float SPEED_RANGE = 4.0;         //Adaptive microstepping reaches 4 times the top speed at the same pulse rate
+#else
+const float SPEED_RANGE = 1.0;
+#endif
+const float WHEEL_SPEED = 19.0 * SPEED_RANGE;  //rad/s, within the 10000 microsteps/s limit of the step generators
+                                               //(40000 with ADAPTIVE_MICROSTEPS)
+const float FALLEN_TILT = 0.8;         //Stop the motors beyond this tilt (rad)
+const float WHEEL_RADIUS = 0.045;      //m
+const float TRACK_WIDTH = 0.16;        //Distance between the wheel contact points (m), measure on your robot
+const float POSE_GYRO_TIME_CONSTANT = 2.0;  //Odometry heading follows the gyro over shorter times than this (s)
+
+//Tilt loop gain scale against wheel speed (rad/s), to make up for the falling torque of the motors
+const int GAIN_SCHEDULE_POINTS = 3;
+const float GAIN_SCHEDULE_SPEED[GAIN_SCHEDULE_POINTS] = {0.0, 10.0 * SPEED_RANGE, 19.0 * SPEED_RANGE};
+const float GAIN_SCHEDULE_SCALE[GAIN_SCHEDULE_POINTS] = {1.0, 1.15, 1.4};
 
 //Global objects
 ESP32Timer ITimer(3);
-Adafruit_MPU6050 mpu;         //Default pins for I2C are SCL: IO22, SDA: IO21
+ESP32Timer ControlTimer(2);
+mpu6050_fifo imu(IMU_INT_PIN);  //Default pins for I2C are SCL: IO22, SDA: IO21
+tilt_estimator tilt(1.0 / IMU_RATE_HZ, PI / 180 / mpu6050_fifo::GYRO_LSB_PER_DPS);    //Complementary filter, see setKalman()
+
+#ifdef STEP_MCPWM
+//Step pulses are generated by MCPWM0 timers 0 and 1 and counted by PCNT units 0 and 1
+step_mcpwm step1(MCPWM_UNIT_0, MCPWM_TIMER_0, PCNT_UNIT_0, STEPPER1_STEP_PIN, STEPPER1_DIR_PIN);
+step_mcpwm step2(MCPWM_UNIT_0, MCPWM_TIMER_1, PCNT_UNIT_1, STEPPER2_STEP_PIN, STEPPER2_DIR_PIN);
+#elif defined(ADAPTIVE_MICROSTEPS)
+step step1(STEPPER_INTERVAL_US, STEPPER1_MODE_PINS);   //DDA_MODE, step pins written by stepOutput
+step step2(STEPPER_INTERVAL_US, STEPPER2_MODE_PINS);
+#else
+step step1(STEPPER_INTERVAL_US);    //DDA_MODE, pins written by stepOutput
+step step2(STEPPER_INTERVAL_US);
+#endif
+#ifndef STEP_MCPWM
+differential_drive drive(step1, step2, WHEEL_RADIUS, TRACK_WIDTH);  //Ramps both motors together
+step_gpio<STEPPER1_STEP_PIN, STEPPER1_DIR_PIN, STEPPER2_STEP_PIN, STEPPER2_DIR_PIN>
+  stepOutput(step1, step2, STEP_PULSE_NS);    //Writes both motors' pins through the GPIO registers
+#endif
 
-step step1(STEPPER_INTERVAL_US,STEPPER1_STEP_PIN,STEPPER1_DIR_PIN );
-step step2(STEPPER_INTERVAL_US,STEPPER2_STEP_PIN,STEPPER2_DIR_PIN );
+pose_estimator odometry(WHEEL_RADIUS * step1.STEP_ANGLE, TRACK_WIDTH);   //Dead reckoning from the wheels and gyro
+balance_controller balance(1.0 / CONTROL_RATE_HZ, MAX_TILT_SETPOINT, WHEEL_ACCEL / step1.STEP_ANGLE,
+                           WHEEL_SPEED / step1.STEP_ANGLE);
 
+telemetry telem(UART_NUM_0);         //Binary telemetry on the USB serial port, see host/telemetry_decode
+command_link commands(UART_NUM_0);   //Commands from the Raspberry Pi on the same port, see host/robot_link.h
+remote_motion remote(WHEEL_RADIUS * step1.STEP_ANGLE, TRACK_WIDTH, 1.0 / CONTROL_RATE_HZ);
+mcp3208 adc(VSPI_HOST, ADC_SCK_PIN, ADC_MISO_PIN, ADC_MOSI_PIN, ADC_CS_PIN);   //Scans in the background
+battery_meter battery(ADC_REFERENCE / 4096 / (1 << mcp3208::OVERSAMPLE_SHIFT), BATTERY_CAPACITY, BATTERY_CELLS,
+                      BATTERY_RESISTANCE);   //Updated with every ADC block
+Preferences batteryStore;            //Battery counters in NVS, kept across resets
+std::atomic<bool> balancing{false};  //Robot is upright and under control, set by the control task
+sensor_log sensorLog;                //Control periods to the log partition in flash, see host/log_export
+
+//Profiled code sections, each with a budget of its period. Sent on a COMMAND_PROFILE request
+profile_section stepProfile("step", STEPPER_INTERVAL_US * CPU_MHZ);         //Stepper ISR
+profile_section imuProfile("imu", 1000000 / IMU_RATE_HZ * CPU_MHZ);        //MPU6050 FIFO drain over I2C
+profile_section tiltProfile("tilt", 1000000 / CONTROL_RATE_HZ * CPU_MHZ);  //Tilt estimator, each control period
+profile_section balanceProfile("balance", 1000000 / CONTROL_RATE_HZ * CPU_MHZ);    //Balance controller
+profile_section *const profiles[] = {&stepProfile, &imuProfile, &tiltProfile, &balanceProfile};
+
+void controlUpdate();
+void commsUpdate();
+periodic_task control("control", controlUpdate, 1000000 / CONTROL_RATE_HZ, periodic_task::TIMER_RELEASE,
+                      CONTROL_CORE, configMAX_PRIORITIES - 1);
+periodic_task comms("comms", commsUpdate, TELEMETRY_INTERVAL * 1000, periodic_task::TICK_RELEASE, COMMS_CORE, 1);
 
 //Interrupt Service Routine for motor update
 //Note: ESP32 doesn't support floating point calculations in an ISR
 bool TimerHandler(void * timerNo)
 {
   static bool toggle = false;
+  uint32_t start = profile_section::now();
 
-  //Update the stepper motors
-  step1.runStepper();
-  step2.runStepper();
+#ifndef STEP_MCPWM
+  //Update the stepper motors and write their pins
+  drive.runSteppers();
+  stepOutput.write();
+#endif
 
   //Indicate that the ISR is running
-  digitalWrite(TOGGLE_PIN,toggle);  
+  gpio_pin<TOGGLE_PIN>::write(toggle);
   toggle = !toggle;
+  stepProfile.finish(start);
 	return true;
 }
 
-uint16_t readADC(uint8_t channel) {
-  uint8_t TX0 = 0x06 | (channel >> 2);  // Command Byte 0 = Start bit + single-ended mode + MSB of channel
-  uint8_t TX1 = (channel & 0x03) << 6;  // Command Byte 1 = Remaining 2 bits of channel
-
-  digitalWrite(ADC_CS_PIN, LOW); 
-
-  SPI.transfer(TX0);                    // Send Command Byte 0
-  uint8_t RX0 = SPI.transfer(TX1);      // Send Command Byte 1 and receive high byte of result
-  uint8_t RX1 = SPI.transfer(0x00);     // Send dummy byte and receive low byte of result
-
-  digitalWrite(ADC_CS_PIN, HIGH); 
+//Interrupt Service Routine to release the control task every control period
+bool ControlTimerHandler(void * timerNo)
+{
+  control.release();
+  return true;
+}
 
-  uint16_t result = ((RX0 & 0x0F) << 8) | RX1; // Combine high and low byte into 12-bit result
-  return result;
+//Set the balance controller gains, converted from wheel radians to microsteps
+void applyGains(float tiltKp, float tiltKi, float tiltKd, float speedKp, float speedKi)
+{
+  balance.setTiltGains(tiltKp / step1.STEP_ANGLE, tiltKi / step1.STEP_ANGLE, tiltKd / step1.STEP_ANGLE);
+  balance.setSpeedGains(speedKp * step1.STEP_ANGLE, speedKi * step1.STEP_ANGLE);
 }
 
 void setup()
 {
-  Serial.begin(115200);
+  //Start telemetry first so that the setup messages are sent
+  telem.begin(TELEMETRY_BAUD);
   pinMode(TOGGLE_PIN,OUTPUT);
 
-  // Try to initialize Accelerometer/Gyroscope
-  if (!mpu.begin()) {
-    Serial.println("Failed to find MPU6050 chip");
+  // Try to initialize Accelerometer/Gyroscope and start sampling into the FIFO
+  imu.setProfile(&imuProfile);
+  if (!imu.begin(IMU_RATE_HZ, 400000, CONTROL_CORE)) {
+    telem.print("Failed to find MPU6050 chip");
     while (1) {
       delay(10);
     }
   }
-  Serial.println("MPU6050 Found!");
-
-  mpu.setAccelerometerRange(MPU6050_RANGE_2_G);
-  mpu.setGyroRange(MPU6050_RANGE_250_DEG);
-  mpu.setFilterBandwidth(MPU6050_BAND_44_HZ);
+  telem.print("MPU6050 Found!");
 
-  //Attach motor update ISR to timer to run every STEPPER_INTERVAL_US μs
+#ifdef STEP_MCPWM
+  //Set up the hardware step generators. The timer ISR is not needed
+  if (!step1.begin() || !step2.begin()) {
+    telem.print("Failed to start MCPWM stepper outputs");
+    while (1) delay(10);
+    }
+  telem.print("Initialised MCPWM for Stepper");
+#else
+  //Configure the step and direction pins, then attach motor update ISR to timer to run every STEPPER_INTERVAL_US μs
+  stepOutput.begin();
   if (!ITimer.attachInterruptInterval(STEPPER_INTERVAL_US, TimerHandler)) {
-    Serial.println("Failed to start stepper interrupt");
+    telem.print("Failed to start stepper interrupt");
     while (1) delay(10);
     }
-  Serial.println("Initialised Interrupt for Stepper");
+  telem.print("Initialised Interrupt for Stepper");
+#endif
+
+  //Set motor acceleration values. The controller ramps the speed itself, so this only has to be high enough
+  //to follow it
+#ifdef STEP_MCPWM
+  step1.setAccelerationRad(WHEEL_ACCEL);
+  step2.setAccelerationRad(WHEEL_ACCEL);
+#else
+  drive.setAcceleration(WHEEL_ACCEL * WHEEL_RADIUS, 2 * WHEEL_ACCEL * WHEEL_RADIUS / TRACK_WIDTH);
+#endif
 
-  //Set motor acceleration values
-  step1.setAccelerationRad(10.0);
-  step2.setAccelerationRad(10.0);
+  applyGains(TILT_KP, TILT_KI, TILT_KD, SPEED_KP, SPEED_KI);
+  int32_t scheduleSpeed[GAIN_SCHEDULE_POINTS];
+  for (int i = 0; i < GAIN_SCHEDULE_POINTS; i++)
+    scheduleSpeed[i] = GAIN_SCHEDULE_SPEED[i] / step1.STEP_ANGLE;
+  balance.setSchedule(scheduleSpeed, GAIN_SCHEDULE_SCALE, GAIN_SCHEDULE_POINTS);
+
+  //Start the odometry at the origin, with the gyro yaw rate fused into the heading
+  odometry.setGyro(PI / 180 / mpu6050_fifo::GYRO_LSB_PER_DPS, 1.0 / IMU_RATE_HZ, POSE_GYRO_TIME_CONSTANT,
+                   1.0 / CONTROL_RATE_HZ);
+  odometry.reset(step1.getPosition(), -step2.getPosition());
 
   //Enable the stepper motor drivers
   pinMode(STEPPER_EN_PIN,OUTPUT);
   digitalWrite(STEPPER_EN_PIN, false);
 
-  //Set up ADC and SPI
-  pinMode(ADC_CS_PIN, OUTPUT);
-  digitalWrite(ADC_CS_PIN, HIGH);
-  SPI.begin(ADC_SCK_PIN, ADC_MISO_PIN, ADC_MOSI_PIN, ADC_CS_PIN);
+  //Count the battery charge on every ADC block, continuing from the counters saved in flash
+  battery.setVoltage(BATTERY_VOLTAGE_CHANNEL, BATTERY_DIVIDER);
+  battery.addCurrent(MOTOR_CURRENT_CHANNEL, MOTOR_CURRENT_GAIN, CURRENT_ZERO_VOLTS);
+  battery.addCurrent(LOGIC_CURRENT_CHANNEL, LOGIC_CURRENT_GAIN, CURRENT_ZERO_VOLTS, 5.0, LOGIC_EFFICIENCY);
+  battery.setModelTimeConstant(BATTERY_MODEL_TIME_CONSTANT);
+  battery_counters saved;
+  if (batteryStore.begin("battery") && batteryStore.getBytes("counters", &saved, sizeof(saved)) == sizeof(saved))
+    battery.restore(saved);
+  adc.setHandler([](const adc_block& b, void *) { battery.update(b.time, b.value); });
+
+  //Start scanning the ADC on the comms core
+  if (!adc.begin(ADC_SCAN_HZ, ADC_DECIMATION, COMMS_CORE)) {
+    telem.print("Failed to start ADC");
+    while (1) delay(10);
+  }
+
+#ifdef STEP_MCPWM
+  //Write the sensor log from the comms core, below the comms task
+  if (!sensorLog.begin(COMMS_CORE)) {
+    telem.print("No log partition, sensor logging disabled");
+  }
+#else
+  //Each flash write would stall the stepper ISR, see sensor_log.h
+  telem.print("Sensor logging needs STEP_MCPWM, disabled");
+#endif
+
+  //Receive commands on the comms core
+  if (!commands.begin(COMMAND_TIMEOUT_MS, COMMS_CORE)) {
+    telem.print("Failed to start command link");
+    while (1) delay(10);
+  }
+
+  //Start the tasks, then release the controller from a hardware timer. setup() runs on core 1, so the timer
+  //interrupts are handled on core 1 as well
+  if (!control.start() || !comms.start()) {
+    telem.print("Failed to start tasks");
+    while (1) delay(10);
+  }
+  if (!ControlTimer.attachInterruptInterval(control.getPeriod(), ControlTimerHandler)) {
+    telem.print("Failed to start control interrupt");
+    while (1) delay(10);
+  }
+  telem.print("Initialised control task");
+}
+
+//Header of a sensor log, with the scales of the raw values
+log_header logHeader()
+{
+  log_header h;
+  h.magic = LOG_MAGIC;
+  h.version = LOG_VERSION;
+  h.recordSize = sizeof(log_record);
+  h.period = 1000000 / CONTROL_RATE_HZ;
+  h.start = micros();
+  h.accelScale = 1.0f / mpu6050_fifo::ACCEL_LSB_PER_G;
+  h.gyroScale = PI / 180 / mpu6050_fifo::GYRO_LSB_PER_DPS;
+  h.stepAngle = step1.STEP_ANGLE;
+  h.speedScale = step1.SPEED_SCALE;
+  return h;
+}
+
+//Apply the commands received since the last control period and acknowledge them
+void applyCommands()
+{
+  command c;
+  while (commands.read(c)) {
+    command_result result = COMMAND_OK;
+    switch (c.type) {
+    case COMMAND_VELOCITY:
+      remote.setVelocity(c.velocity.speed / 65536.0f, c.velocity.turn / 65536.0f);
+      break;
+    case COMMAND_MOVE:
+      remote.move(c.move.distance / 65536.0f, c.move.angle / 65536.0f, c.move.maxSpeed / 65536.0f,
+                  c.move.maxAccel / 65536.0f);
+      break;
+    case COMMAND_GAINS:
+      applyGains(c.gains.tiltKp, c.gains.tiltKi, c.gains.tiltKd, c.gains.speedKp, c.gains.speedKi);
+      break;
+    case COMMAND_STOP:
+      remote.stop();
+      break;
+    case COMMAND_PROFILE:
+      for (profile_section *p : profiles)
+        p->request();
+      break;
+    case COMMAND_LOG:
+      //Erasing the partition stalls both cores for seconds, so it is only done with the robot lying down. A log
+      //can then start at any time
+      if (c.log.action == LOG_STOP)
+        sensorLog.stop();
+      else if (c.log.action == LOG_START && !sensorLog.start(logHeader()))
+        result = COMMAND_BAD_VALUE;
+      else if (c.log.action == LOG_ERASE && (balancing || !sensorLog.erase()))
+        result = COMMAND_BAD_VALUE;
+      break;
+    default:
+      break;
+    }
+    commands.acknowledge(c, result);
+  }
 
+  //Stop if the Raspberry Pi or the link has gone quiet
+  if (commands.expired())
+    remote.stop();
+  remote.update();
+}
+
+//Control task, released every control period
+void controlUpdate()
+{
+  static bool tiltValid = false;        //tilt estimator has been initialised
+  static int16_t accel[3] = {};         //latest raw accelerometer sample
+  static int16_t gyro[3] = {};          //latest raw gyro sample
+
+  //Run the tilt estimator on every IMU sample that has arrived since the last period
+  //Sensor axes: y is upright, z points forwards and tilt is rotation about x
+  uint32_t start = profile_section::now();
+  imu_sample sample;
+  while (imu.read(sample)) {
+    if (!tiltValid) {
+      tilt.reset(sample.accel[2], sample.accel[1]);
+      tiltValid = true;
+    }
+    tilt.update(sample.accel[2], sample.accel[1], -sample.gyro[0]);
+    odometry.addYawRate(sample.gyro[1]);   //yaw about the upright axis, anticlockwise positive from above
+    memcpy(accel, sample.accel, sizeof(accel));
+    memcpy(gyro, sample.gyro, sizeof(gyro));
+  }
+  tiltProfile.finish(start);
+
+  //Fused tilt angle from the gyro and accelerometer
+  float tiltx = tilt.getAngleRad();
+
+  //Wheel positions, forwards positive. The motors face opposite ways
+  int32_t leftPosition = step1.getPosition();
+  int32_t rightPosition = -step2.getPosition();
+  int32_t position = (leftPosition + rightPosition) / 2;
+  odometry.update(leftPosition, rightPosition, micros());
+
+  //Follow the remote commands
+  applyCommands();
+  balance.setTarget(lroundf(remote.getSpeed()));
+
+  //Run the balance controller while the robot is upright, and start again from rest when it is stood up
+  int32_t speed = 0;
+  if (fabs(tiltx) < FALLEN_TILT) {
+    if (!balancing) {
+      balance.reset(position, 0);
+      balancing = true;
+    }
+    start = profile_section::now();
+    speed = balance.update(tilt.getAngle(), tilt.getRate(), position);
+    balanceProfile.finish(start);
+  }
+  else {
+    balancing = false;
+    remote.stop();
+  }
+  int32_t turn = lroundf(remote.getTurn());
+
+#ifdef STEP_MCPWM
+  //Command the wheels in microsteps/(SPEED_SCALE * s), with the turn added to the right wheel
+  step1.setTargetSpeed((speed - turn) * step1.SPEED_SCALE);
+  step2.setTargetSpeed(-(speed + turn) * step1.SPEED_SCALE);
+
+  //Ramp the speed and reprogram the step rate at the control loop rate
+  step1.update(control.getPeriod());
+  step2.update(control.getPeriod());
+#else
+  //Command the mean wheel speed and the turn in microsteps/s
+  drive.setVelocitySteps(speed, turn);
+#endif
+
+  //Queue the state of this period for the comms task to send
+  telemetry_control record;
+  record.time = micros();
+  record.tilt = tilt.getAngle();
+  record.tiltRate = tilt.getRate();
+  record.tiltSetpoint = balance.getTiltSetpoint();
+  record.speed[0] = step1.getSpeed();
+  record.speed[1] = step2.getSpeed();
+  record.position[0] = step1.getPosition();
+  record.position[1] = step2.getPosition();
+  memcpy(record.gyro, gyro, sizeof(gyro));
+  record.adc = adc.read().value[0];
+  telem.send(record);
+
+  //Log the raw inputs and the output of this period, if the log is running
+  log_record entry;
+  entry.time = record.time;
+  memcpy(entry.accel, accel, sizeof(accel));
+  memcpy(entry.gyro, gyro, sizeof(gyro));
+  memcpy(entry.speed, record.speed, sizeof(entry.speed));
+  memcpy(entry.position, record.position, sizeof(entry.position));
+  entry.output = speed;
+  sensorLog.add(entry);
+}
+
+//Send the timing statistics of a task and start a new measurement window
+void sendStats(periodic_task& task)
+{
+  task_stats stats = task.getStats();
+  uint32_t mhz = getCpuFrequencyMhz();
+  task.resetStats();
+
+  telemetry_task record = {};
+  strncpy(record.name, task.getName(), sizeof(record.name));
+  record.runs = stats.runs;
+  record.overruns = stats.overruns;
+  record.execMin = stats.execMin / mhz;
+  record.execAvg = stats.execAvg / mhz;
+  record.execMax = stats.execMax / mhz;
+  record.latencyMax = stats.latencyMax;
+  record.jitterMax = stats.jitterMax;
+  telem.write(TELEMETRY_TASK, &record, sizeof(record));
+}
+
+//Send the latest window of a profiled section
+void sendProfile(const profile_section& section)
+{
+  profile_stats stats = section.read();
+  uint32_t mhz = getCpuFrequencyMhz();
+
+  telemetry_profile record = {};
+  strncpy(record.name, section.getName(), sizeof(record.name));
+  record.count = stats.count;
+  record.overruns = stats.overruns;
+  record.budget = section.getBudget();
+  record.min = stats.count > 0 ? stats.min : 0;
+  record.avg = stats.count > 0 ? static_cast<uint32_t>(stats.total / stats.count) : 0;
+  record.max = stats.max;
+  record.load = stats.elapsed > 0 ? static_cast<uint32_t>((stats.total << 16) / stats.elapsed) : 0;
+  record.window = static_cast<uint32_t>(stats.elapsed / mhz / 1000);
+  record.cpuMhz = mhz;
+  memcpy(record.histogram, stats.histogram, sizeof(record.histogram));
+  telem.write(TELEMETRY_PROFILE, &record, sizeof(record));
+}
+
+//Send the battery status, and save the counters to flash when enough charge has been drawn since the last save.
+//Writing flash stalls both cores for a few ms, including the stepper ISR, so it waits until the robot is not
+//balancing, such as after it falls or is laid down
+void sendBattery()
+{
+  static bool saving = false;           //savedCharge is valid
+  static int64_t savedCharge = 0;       //pC
+
+  battery_status b = battery.read();
+  telemetry_battery record;
+  record.time = b.time;
+  record.voltage = b.voltage > 0 ? b.voltage : 0;
+  record.stateOfCharge = b.stateOfCharge < 65535 ? b.stateOfCharge : 65535;
+  record.current = b.current;
+  record.power = b.power;
+  record.charge = b.counters.charge / 3600000000LL;     //pC to μAh
+  record.energy = b.counters.energy / 1000000000LL;     //pJ to mJ
+  record.remainingEnergy = b.remainingEnergy;
+  record.flags = b.present ? BATTERY_PRESENT : 0;
+  telem.write(TELEMETRY_BATTERY, &record, sizeof(record));
+
+  if (!b.present)
+    return;
+  if (!saving) {
+    savedCharge = b.counters.charge;
+    saving = true;
+  }
+  if (!balancing && llabs(b.counters.charge - savedCharge) >= static_cast<int64_t>(BATTERY_SAVE_MAH * 3.6e12)) {
+    batteryStore.putBytes("counters", &b.counters, sizeof(b.counters));
+    savedCharge = b.counters.charge;
+  }
+}
+
+//Report the sensor log when it starts or stops
+void sendLogState()
+{
+  static sensor_log::log_state reported = sensor_log::IDLE;
+
+  sensor_log::log_state state = sensorLog.getState();
+  if (state == reported)
+    return;
+  reported = state;
+  char text[80];
+  switch (state) {
+  case sensor_log::ERASING:
+    snprintf(text, sizeof(text), "Log erasing %u KB", sensorLog.getCapacity() * sizeof(log_record) / 1024);
+    break;
+  case sensor_log::ERASED:
+    snprintf(text, sizeof(text), "Log erased, ready to start");
+    break;
+  case sensor_log::RECORDING:
+    snprintf(text, sizeof(text), "Log recording, room for %u records", sensorLog.getCapacity());
+    break;
+  case sensor_log::FULL:
+    snprintf(text, sizeof(text), "Log full: %u records, %u dropped", sensorLog.getRecords(), sensorLog.getDropped());
+    break;
+  case sensor_log::FAILED:
+    snprintf(text, sizeof(text), "Log flash write failed after %u records", sensorLog.getRecords());
+    break;
+  default:
+    snprintf(text, sizeof(text), "Log stopped: %u records, %u dropped", sensorLog.getRecords(),
+             sensorLog.getDropped());
+    break;
+  }
+  telem.print(text);
+}
+
+//Comms task, runs every TELEMETRY_INTERVAL ms
+void commsUpdate()
+{
+  static int statsTimer = 0;            //time since the last timing report (ms)
+  static int batteryTimer = 0;          //time since the last battery report (ms)
+  static uint32_t adcSequence = 0;      //last ADC block sent
+  static uint32_t poseSequence = 0;     //last pose sent
+  static uint32_t profileVersion[sizeof(profiles) / sizeof(profiles[0])] = {};    //last window sent
+
+  //Send the control records queued since the last run
+  telem.flush();
+
+  //Send each new set of averaged ADC readings
+  adc_block readings = adc.read();
+  if (readings.sequence != adcSequence) {
+    adcSequence = readings.sequence;
+    telemetry_adc record;
+    record.time = readings.time;
+    memcpy(record.value, readings.value, sizeof(record.value));
+    telem.write(TELEMETRY_ADC, &record, sizeof(record));
+  }
+
+  //Acknowledge the commands applied by the control task
+  telemetry_ack ack;
+  while (commands.readAck(ack))
+    telem.write(TELEMETRY_ACK, &ack, sizeof(ack));
+
+  //Send the latest pose
+  pose p = odometry.read();
+  if (p.sequence != poseSequence) {
+    poseSequence = p.sequence;
+    telemetry_pose record;
+    record.time = p.time;
+    record.x = p.x;
+    record.y = p.y;
+    record.heading = p.heading;
+    record.distance = p.distance;
+    telem.write(TELEMETRY_POSE, &record, sizeof(record));
+  }
+
+  //Send the profiler windows published since a COMMAND_PROFILE request
+  for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+    uint32_t version = profiles[i]->version();
+    if (version != profileVersion[i]) {
+      profileVersion[i] = version;
+      sendProfile(*profiles[i]);
+    }
+  }
+
+  sendLogState();
+
+  //Report the battery every BATTERY_INTERVAL ms
+  batteryTimer += TELEMETRY_INTERVAL;
+  if (batteryTimer >= BATTERY_INTERVAL) {
+    batteryTimer = 0;
+    sendBattery();
+  }
+
+  //Report the worst-case timing of each task every STATS_INTERVAL ms
+  statsTimer += TELEMETRY_INTERVAL;
+  if (statsTimer >= STATS_INTERVAL) {
+    statsTimer = 0;
+    sendStats(control);
+    sendStats(comms);
+  }
 }
 
 void loop()
 {
-  //Static variables are initialised once and then the value is remembered betweeen subsequent calls to this function
-  static unsigned long printTimer = 0;  //time of the next print
-  static unsigned long loopTimer = 0;   //time of the next control update
-  static float tiltx = 0.0;             //current tilt angle
-  
-  //Run the control loop every LOOP_INTERVAL ms
-  if (millis() > loopTimer) {
-    loopTimer += LOOP_INTERVAL;
-    
-    // Fetch data from MPU6050
-    sensors_event_t a, g, temp;
-    mpu.getEvent(&a, &g, &temp);
-
-    //Calculate Tilt using accelerometer and sin x = x approximation for a small tilt angle
-    tiltx = a.acceleration.z/9.67;
-
-    //Set target motor speed proportional to tilt angle
-    //Note: this is for demonstrating accelerometer and motors - it won't work as a balance controller
-    step1.setTargetSpeedRad(tiltx*kx);
-    step2.setTargetSpeedRad(-tiltx*kx);
-  }
-  
-  //Print updates every PRINT_INTERVAL ms
-  //Line format: X-axis tilt, Motor speed, A0 Voltage
-  if (millis() > printTimer) {
-    printTimer += PRINT_INTERVAL;
-    Serial.print(tiltx*1000);
-    Serial.print(' ');
-    Serial.print(step1.getSpeedRad());
-    Serial.print(' ');
-    Serial.print((readADC(0) * VREF)/4095.0);
-    Serial.println();
-  }
-}
\ No newline at end of file
+  //All work is done in the control and comms tasks
+  vTaskDelete(NULL);
+}
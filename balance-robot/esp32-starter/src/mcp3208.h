@@ -0,0 +1,193 @@
+#ifndef MCP3208_H
+#define MCP3208_H
+
+#include <Arduino.h>
+#include <driver/spi_master.h>
+#include <esp_timer.h>
+#include <seqlock.h>
+
+//Averaged readings of all ADC channels
+struct adc_block {
+    uint32_t time;              //time of the last scan in the average (μs, from micros())
+    uint32_t sequence;          //increments with every new block
+    uint16_t value[8];          //mean of each channel (2^-4 counts, full scale FULL_SCALE)
+};
+
+//Background scanner for the MCP3208 8-channel 12-bit ADC.
+//A task scans all 8 channels at a fixed rate by queueing one SPI transaction per channel at once. The SPI
+//master driver runs them back to back from its interrupt with DMA, toggling the hardware CS pin between them
+//as the ADC needs to start each conversion, and the task sleeps until the last one completes. Every
+//decimation scans the channel means are published through a seqlock, so any task can read the latest values
+//without waiting and without touching the bus.
+//The bus interrupt is allocated on the core that runs the task, so pin the task away from the control loop
+class mcp3208 {
+
+public:
+
+    static const int CHANNELS = 8;
+    static const int OVERSAMPLE_SHIFT = 4;          //published values have 4 fractional bits
+    static const uint16_t FULL_SCALE = 4095 << OVERSAMPLE_SHIFT;
+
+    //Function called by the scanner task with each new block
+    typedef void (*block_handler)(const adc_block& b, void *arg);
+
+    //Set the SPI host and pins. The ADC has its own SPI bus, so the bus is initialised here
+    mcp3208(spi_host_device_t h, int sck, int miso, int mosi, int cs) :
+        host(h), sckPin(sck), misoPin(miso), mosiPin(mosi), csPin(cs) {}
+
+    //Start scanning at scanHz, publishing the mean of every decimation scans. The SPI clock is up to 2 MHz with
+    //a 5 V supply and 1 MHz at 2.7 V. Call once from setup()
+    bool begin(uint32_t scanHz = 1000, uint32_t decimation = 10, int core = 0, uint32_t spiClock = 1000000) {
+        scanPeriod = 1000000 / scanHz;
+        scansPerBlock = decimation > 0 ? decimation : 1;
+        clock = spiClock;
+        starter = xTaskGetCurrentTaskHandle();
+        if (xTaskCreatePinnedToCore(taskEntry, "adc", 4096, this, configMAX_PRIORITIES - 3, &task, core) != pdPASS)
+            return false;
+
+        //Wait for the task to set up the bus on its own core
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+        return started;
+    }
+
+    //Call handler with every block from the scanner task after it is published, for processing that must see
+    //every block, such as integrating a current. Keep it short. Call before begin()
+    void setHandler(block_handler h, void *arg = nullptr) {
+        handler = h;
+        handlerArg = arg;
+    }
+
+    //Latest averaged readings. Do not call from ISR
+    adc_block read() const {
+        return block.read();
+    }
+
+    //Latest mean of one channel in counts. Do not call from ISR
+    float readCounts(int channel) const {
+        return static_cast<float>(block.read().value[channel]) / (1 << OVERSAMPLE_SHIFT);
+    }
+
+    //Scans that could not be completed because of an SPI error
+    uint32_t getErrors() const {
+        return errors;
+    }
+
+    private:
+
+    spi_host_device_t host;
+    int sckPin, misoPin, mosiPin, csPin;
+    uint32_t scanPeriod = 1000;     //μs
+    uint32_t scansPerBlock = 10;
+    uint32_t clock = 1000000;       //SPI clock (Hz)
+    spi_device_handle_t device = nullptr;
+    TaskHandle_t task = nullptr;
+    TaskHandle_t starter = nullptr;
+    esp_timer_handle_t timer = nullptr;
+    volatile bool started = false;
+    volatile uint32_t errors = 0;
+    block_handler handler = nullptr;
+    void *handlerArg = nullptr;
+    spi_transaction_t transactions[CHANNELS];
+    seqlock<adc_block> block;
+
+    static void taskEntry(void *arg) {
+        static_cast<mcp3208 *>(arg)->run();
+    }
+
+    //Periodic timer callback, runs in the esp_timer task
+    static void timerCallback(void *arg) {
+        xTaskNotifyGive(static_cast<mcp3208 *>(arg)->task);
+    }
+
+    bool setup() {
+        spi_bus_config_t bus = {};
+        bus.mosi_io_num = mosiPin;
+        bus.miso_io_num = misoPin;
+        bus.sclk_io_num = sckPin;
+        bus.quadwp_io_num = -1;
+        bus.quadhd_io_num = -1;
+        bus.max_transfer_sz = 32;
+        if (spi_bus_initialize(host, &bus, SPI_DMA_CH_AUTO) != ESP_OK)
+            return false;
+
+        spi_device_interface_config_t dev = {};
+        dev.mode = 0;
+        dev.clock_speed_hz = clock;
+        dev.spics_io_num = csPin;
+        dev.cs_ena_pretrans = 1;        //CS set-up time before the first clock edge
+        dev.queue_size = CHANNELS;
+        if (spi_bus_add_device(host, &dev, &device) != ESP_OK)
+            return false;
+
+        //The command for each channel is fixed: start bit, single-ended mode and the channel number, aligned so
+        //the 12-bit result ends in the third byte
+        for (int c = 0; c < CHANNELS; c++) {
+            spi_transaction_t &t = transactions[c];
+            memset(&t, 0, sizeof(t));
+            t.flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+            t.length = 24;
+            t.tx_data[0] = 0x06 | (c >> 2);
+            t.tx_data[1] = (c & 0x03) << 6;
+            t.tx_data[2] = 0x00;
+        }
+
+        esp_timer_create_args_t timerArgs = {};
+        timerArgs.callback = timerCallback;
+        timerArgs.arg = this;
+        timerArgs.name = "adc";
+        if (esp_timer_create(&timerArgs, &timer) != ESP_OK)
+            return false;
+        return esp_timer_start_periodic(timer, scanPeriod) == ESP_OK;
+    }
+
+    //Scanner task. Sleeps between scans and while the SPI driver runs them
+    void run() {
+        started = setup();
+        xTaskNotifyGive(starter);
+        if (!started)
+            vTaskDelete(nullptr);
+
+        uint32_t sum[CHANNELS] = {};
+        uint32_t scans = 0;
+        uint32_t sequence = 0;
+
+        while (true) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+            //Queue the whole scan, then collect the results as they complete
+            int queued = 0;
+            while (queued < CHANNELS && spi_device_queue_trans(device, &transactions[queued], 0) == ESP_OK)
+                queued++;
+            bool complete = queued == CHANNELS;
+            for (int i = 0; i < queued; i++) {
+                spi_transaction_t *t;
+                if (spi_device_get_trans_result(device, &t, portMAX_DELAY) != ESP_OK)
+                    complete = false;
+            }
+            if (!complete) {
+                errors++;
+                continue;
+            }
+
+            for (int c = 0; c < CHANNELS; c++)
+                sum[c] += ((transactions[c].rx_data[1] & 0x0F) << 8) | transactions[c].rx_data[2];
+
+            //Publish the means and start the next average
+            if (++scans == scansPerBlock) {
+                adc_block b;
+                b.time = micros();
+                b.sequence = ++sequence;
+                for (int c = 0; c < CHANNELS; c++) {
+                    b.value[c] = static_cast<uint16_t>(((sum[c] << OVERSAMPLE_SHIFT) + scans / 2) / scans);
+                    sum[c] = 0;
+                }
+                block.write(b);
+                scans = 0;
+                if (handler)
+                    handler(b, handlerArg);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <math.h>
+#include <stdint.h>
+
+//Position move for one stepper, precomputed by plan_moves() and executed by profile_runner in the ISR.
+//The move is seven segments of constant jerk: jerk up, constant acceleration, jerk down, cruise, then the same
+//in reverse to stop. A trapezoidal move is the special case where the jerk segments last one tick.
+//Velocities are in units of 2^-48 microsteps per tick, which leaves 18 bits more precision than the DDA velocity
+//in step.h, so rounding does not build up over a long move
+struct motion_profile {
+    static const int SEGMENTS = 7;
+    static const int VELOCITY_SHIFT = 18;   //profile velocity to DDA velocity
+    uint32_t ticks[SEGMENTS];               //length of each segment (ticks)
+    int64_t jerk[SEGMENTS];                 //acceleration change per tick (2^-48 microsteps/tick/tick/tick)
+    int32_t distance;                       //microsteps
+};
+
+//Plan moves of several steppers that start and finish together. The longest move runs at the limits and the
+//others use the same segment timing with scaled jerk, so they reach the same fractions of their distance at
+//the same tick. The jerk is calculated so that each move covers exactly its distance, so the steppers finish
+//on the target step. Limits are in microsteps/s, /s/s and /s/s/s, and maxJerk = 0 plans trapezoidal moves.
+//interval is the tick length (μs). Moves start from rest. Do not call from ISR
+inline void plan_moves(motion_profile *profiles, const int32_t *distances, int count, float maxSpeed,
+                       float maxAccel, float maxJerk, int interval) {
+    double dt = interval * 1e-6;
+    double longest = 0;
+    for (int i = 0; i < count; i++)
+        longest = fmax(longest, fabs(static_cast<double>(distances[i])));
+
+    //Times of the jerk, constant acceleration and cruise phases of the longest move at a peak speed v.
+    //Returns false if the acceleration and deceleration do not fit in the distance
+    double tj = 0, ta = 0, tv = 0;
+    auto phases = [&](double v) {
+        double a = maxAccel;
+        tj = maxJerk > 0 ? a / maxJerk : dt;
+        if (maxJerk > 0 && v < a * tj) {
+            tj = sqrt(v / maxJerk);
+            a = maxJerk * tj;
+        }
+        ta = fmax(0, v / a - tj);
+        double ramps = v * (2 * tj + ta);           //distance to accelerate and decelerate
+        tv = (longest - ramps) / v;
+        return ramps <= longest;
+    };
+
+    //Reduce the peak speed until the move fits
+    if (longest > 0 && !phases(maxSpeed)) {
+        double lo = 0, hi = maxSpeed;
+        for (int i = 0; i < 50; i++) {
+            double v = (lo + hi) / 2;
+            if (phases(v))
+                lo = v;
+            else
+                hi = v;
+        }
+        if (lo > 0)
+            phases(lo);
+        else
+            tj = ta = tv = 0;
+        tv = fmax(0, tv);
+    }
+    if (longest == 0)
+        tj = ta = tv = 0;
+
+    uint32_t n1 = longest > 0 ? static_cast<uint32_t>(fmax(1, lround(tj / dt))) : 0;
+    uint32_t n2 = static_cast<uint32_t>(lround(ta / dt));
+    uint32_t n3 = static_cast<uint32_t>(lround(tv / dt));
+    const uint32_t ticks[motion_profile::SEGMENTS] = {n1, n2, n1, n3, n1, n2, n1};
+    const int sign[motion_profile::SEGMENTS] = {1, 0, -1, 0, -1, 0, 1};
+
+    //Distance covered with a jerk of one unit, following the integer updates of profile_runner:
+    //each tick acceleration += jerk, velocity += acceleration, position += velocity
+    double a = 0, vel = 0, p = 0;
+    for (int s = 0; s < motion_profile::SEGMENTS; s++) {
+        double n = ticks[s], j = sign[s];
+        p += n * vel + a * n * (n + 1) / 2 + j * n * (n + 1) * (n + 2) / 6;
+        vel += n * a + j * n * (n + 1) / 2;
+        a += n * j;
+    }
+
+    for (int i = 0; i < count; i++) {
+        motion_profile &m = profiles[i];
+        double jerk = p > 0 ? ldexp(static_cast<double>(distances[i]), 30 + motion_profile::VELOCITY_SHIFT) / p : 0;
+        for (int s = 0; s < motion_profile::SEGMENTS; s++) {
+            m.ticks[s] = ticks[s];
+            m.jerk[s] = sign[s] * llround(jerk);
+        }
+        m.distance = distances[i];
+    }
+}
+
+//Executes a motion_profile one tick at a time. Uses only integer additions so it can run in the stepper ISR
+class profile_runner {
+
+public:
+
+    //Begin a move
+    void start(const motion_profile& p) {
+        profile = p;
+        segment = 0;
+        remaining = p.ticks[0];
+        accel = 0;
+        velocity = 0;
+        active = true;
+    }
+
+    //Abandon the move
+    void stop() {
+        active = false;
+    }
+
+    bool running() const {
+        return active;
+    }
+
+    //Advance one tick and return the DDA velocity for it (2^-30 microsteps per tick)
+    int32_t next() {
+        while (remaining == 0) {
+            if (++segment == motion_profile::SEGMENTS) {
+                active = false;
+                return 0;
+            }
+            remaining = profile.ticks[segment];
+        }
+        remaining--;
+        accel += profile.jerk[segment];
+        velocity += accel;
+        return static_cast<int32_t>(velocity >> motion_profile::VELOCITY_SHIFT);
+    }
+
+    private:
+
+    motion_profile profile = {};
+    int segment = 0;
+    uint32_t remaining = 0;     //ticks left in the current segment
+    int64_t accel = 0;          //2^-48 microsteps/tick/tick
+    int64_t velocity = 0;       //2^-48 microsteps/tick
+    bool active = false;
+};
+
+#endif
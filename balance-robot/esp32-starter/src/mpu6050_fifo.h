@@ -0,0 +1,223 @@
+#ifndef MPU6050_FIFO_H
+#define MPU6050_FIFO_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <spsc_queue.h>
+#include <profiler.h>
+
+//Raw IMU sample in sensor units
+struct imu_sample {
+    uint32_t time;          //time of the sample (μs, from micros())
+    int16_t accel[3];       //acceleration x, y, z (ACCEL_LSB_PER_G per g)
+    int16_t gyro[3];        //angular rate x, y, z (GYRO_LSB_PER_DPS per degree/s)
+};
+
+//Interrupt-driven MPU6050 driver.
+//The sensor samples into its internal FIFO at a fixed rate and pulses its INT pin when each sample is ready.
+//The pin interrupt wakes a dedicated task, which reads the FIFO level and drains all complete samples in
+//burst reads, timestamps them from the interrupt time and pushes them into a lock-free queue. The control
+//loop pops samples without touching I2C, so sensor latency is never in its critical path.
+//The MPU6050 INT pin must be wired to intPin
+class mpu6050_fifo {
+
+public:
+
+    static const int ACCEL_LSB_PER_G = 16384;   //±2 g range
+    static const int GYRO_LSB_PER_DPS = 131;    //±250 °/s range
+    static const int QUEUE_SIZE = 256;          //samples buffered for the control loop
+
+    mpu6050_fifo(int8_t ip, TwoWire& w = Wire, uint8_t a = 0x68) : intPin(ip), wire(w), address(a) {}
+
+    //Configure the sensor and start sampling at rateHz (4-1000 Hz) with the reader task pinned to core.
+    //The MPU6050 is specified for 400 kHz I2C; faster clocks shorten the bursts if the bus supports them.
+    //Call once from setup()
+    bool begin(int rateHz = 1000, uint32_t i2cClock = 400000, int core = 0) {
+        wire.begin();
+        wire.setClock(i2cClock);
+        samplePeriod = 1000000 / rateHz;
+
+        if (readRegister(WHO_AM_I) != 0x68)
+            return false;
+
+        writeRegister(PWR_MGMT_1, 0x80);            //device reset
+        delay(100);
+        writeRegister(PWR_MGMT_1, 0x01);            //wake, clock from X gyro PLL
+        writeRegister(CONFIG, DLPF_188HZ);          //1 kHz internal sample rate
+        writeRegister(SMPLRT_DIV, 1000 / rateHz - 1);
+        writeRegister(GYRO_CONFIG, 0x00);           //±250 °/s
+        writeRegister(ACCEL_CONFIG, 0x00);          //±2 g
+        writeRegister(INT_PIN_CFG, 0x00);           //active high push-pull pulse
+        writeRegister(FIFO_EN, FIFO_ACCEL_GYRO);
+        resetFifo();
+        writeRegister(INT_ENABLE, INT_DATA_RDY);
+
+        if (xTaskCreatePinnedToCore(taskEntry, "imu", 4096, this, configMAX_PRIORITIES - 2, &task, core) != pdPASS)
+            return false;
+
+        pinMode(intPin, INPUT);
+        attachInterruptArg(digitalPinToInterrupt(intPin), interruptHandler, this, RISING);
+        return true;
+    }
+
+    //Take the oldest sample. Returns false if none is waiting. Call from one task only
+    bool read(imu_sample& sample) {
+        return samples.pop(sample);
+    }
+
+    //Number of samples waiting
+    uint32_t available() const {
+        return samples.size();
+    }
+
+    //Samples lost because the control loop did not empty the queue in time
+    uint32_t getDropped() const {
+        return dropped;
+    }
+
+    //Times the sensor FIFO overflowed because the reader task did not run in time
+    uint32_t getOverflows() const {
+        return overflows;
+    }
+
+    //Record the cycles of each FIFO drain, including the I2C transfers, in a profiler. Call before begin()
+    void setProfile(profile_section *p) {
+        profile = p;
+    }
+
+    private:
+
+    //Register map (MPU-6000/6050 Register Map rev 4.2)
+    static const uint8_t SMPLRT_DIV = 0x19;
+    static const uint8_t CONFIG = 0x1A;
+    static const uint8_t GYRO_CONFIG = 0x1B;
+    static const uint8_t ACCEL_CONFIG = 0x1C;
+    static const uint8_t FIFO_EN = 0x23;
+    static const uint8_t INT_PIN_CFG = 0x37;
+    static const uint8_t INT_ENABLE = 0x38;
+    static const uint8_t INT_STATUS = 0x3A;
+    static const uint8_t USER_CTRL = 0x6A;
+    static const uint8_t PWR_MGMT_1 = 0x6B;
+    static const uint8_t FIFO_COUNT_H = 0x72;
+    static const uint8_t FIFO_R_W = 0x74;
+    static const uint8_t WHO_AM_I = 0x75;
+
+    static const uint8_t DLPF_188HZ = 0x01;
+    static const uint8_t FIFO_ACCEL_GYRO = 0x78;    //XG, YG, ZG and ACCEL
+    static const uint8_t INT_DATA_RDY = 0x01;
+    static const uint8_t INT_FIFO_OFLOW = 0x10;
+    static const uint8_t USER_CTRL_FIFO_EN = 0x40;
+    static const uint8_t USER_CTRL_FIFO_RESET = 0x04;
+
+    static const int SAMPLE_BYTES = 12;         //accel x, y, z then gyro x, y, z, big-endian
+    static const int BURST_SAMPLES = 10;        //samples per I2C read, within the Wire buffer
+    static const uint16_t FIFO_SIZE = 1024;
+
+    int8_t intPin;
+    TwoWire& wire;
+    uint8_t address;
+    uint32_t samplePeriod = 1000;       //time between samples (μs)
+    TaskHandle_t task = nullptr;
+    volatile uint32_t interruptTime = 0;    //time of the latest data ready pulse (μs)
+    volatile uint32_t dropped = 0;
+    volatile uint32_t overflows = 0;
+    profile_section *profile = nullptr;
+    spsc_queue<imu_sample, QUEUE_SIZE> samples;
+
+    //Data ready interrupt: note the time and wake the reader task
+    static void IRAM_ATTR interruptHandler(void *arg) {
+        mpu6050_fifo *m = static_cast<mpu6050_fifo *>(arg);
+        BaseType_t woken = pdFALSE;
+        m->interruptTime = micros();
+        vTaskNotifyGiveFromISR(m->task, &woken);
+        if (woken)
+            portYIELD_FROM_ISR();
+    }
+
+    static void taskEntry(void *arg) {
+        static_cast<mpu6050_fifo *>(arg)->run();
+    }
+
+    //Reader task. Drains the FIFO each time it is woken, or every 10 ms if interrupts stop
+    void run() {
+        while (true) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            uint32_t newest = interruptTime;
+            uint32_t start = profile_section::now();
+            drain(newest);
+            if (profile)
+                profile->finish(start);
+        }
+    }
+
+    //Read all complete samples from the sensor FIFO into the queue
+    void drain(uint32_t newest) {
+        if (readRegister(INT_STATUS) & INT_FIFO_OFLOW) {
+            overflows++;
+            resetFifo();
+            return;
+        }
+
+        int count = readFifoCount() / SAMPLE_BYTES;
+
+        //The newest complete sample in the FIFO belongs to the latest interrupt
+        for (int first = 0; first < count; first += BURST_SAMPLES) {
+            int n = count - first < BURST_SAMPLES ? count - first : BURST_SAMPLES;
+            uint8_t buffer[BURST_SAMPLES * SAMPLE_BYTES];
+            if (!readRegisters(FIFO_R_W, buffer, n * SAMPLE_BYTES))
+                break;
+
+            for (int i = 0; i < n; i++) {
+                const uint8_t *b = buffer + i * SAMPLE_BYTES;
+                imu_sample s;
+                s.time = newest - (count - 1 - first - i) * samplePeriod;
+                for (int axis = 0; axis < 3; axis++) {
+                    s.accel[axis] = static_cast<int16_t>((b[2 * axis] << 8) | b[2 * axis + 1]);
+                    s.gyro[axis] = static_cast<int16_t>((b[6 + 2 * axis] << 8) | b[7 + 2 * axis]);
+                }
+                if (!samples.push(s))
+                    dropped++;
+            }
+        }
+    }
+
+    void resetFifo() {
+        writeRegister(USER_CTRL, USER_CTRL_FIFO_RESET);
+        writeRegister(USER_CTRL, USER_CTRL_FIFO_EN);
+    }
+
+    uint16_t readFifoCount() {
+        uint8_t b[2];
+        if (!readRegisters(FIFO_COUNT_H, b, 2))
+            return 0;
+        uint16_t count = (b[0] << 8) | b[1];
+        return count > FIFO_SIZE ? 0 : count;
+    }
+
+    void writeRegister(uint8_t reg, uint8_t value) {
+        wire.beginTransmission(address);
+        wire.write(reg);
+        wire.write(value);
+        wire.endTransmission();
+    }
+
+    uint8_t readRegister(uint8_t reg) {
+        uint8_t value = 0;
+        readRegisters(reg, &value, 1);
+        return value;
+    }
+
+    bool readRegisters(uint8_t reg, uint8_t *data, int length) {
+        wire.beginTransmission(address);
+        wire.write(reg);
+        if (wire.endTransmission(false) != 0)
+            return false;
+        if (wire.requestFrom(address, static_cast<uint8_t>(length)) != length)
+            return false;
+        for (int i = 0; i < length; i++)
+            data[i] = wire.read();
+        return true;
+    }
+};
+
+#endif
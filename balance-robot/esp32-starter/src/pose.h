@@ -0,0 +1,152 @@
+#ifndef POSE_H
+#define POSE_H
+
+#include <math.h>
+#include <stdint.h>
+#include <seqlock.h>
+#include <fixed_trig.h>
+
+//Position and heading of the robot relative to where the estimator was reset
+struct pose {
+    uint32_t time;              //time of the update (μs)
+    uint32_t sequence;          //increments with every update
+    int32_t x;                  //along the starting heading (2^-16 m)
+    int32_t y;                  //to the left of the starting heading (2^-16 m)
+    uint32_t heading;           //anticlockwise from the starting heading (binary angle, 2^32 per turn)
+    int32_t distance;           //travel of the centre, forwards positive (2^-16 m)
+};
+
+//Dead-reckoning pose estimator for a two-wheeled robot, run at the control rate from the wheel positions.
+//
+//The heading from the wheels is proportional to the difference between the wheel positions, calculated from
+//the totals so it does not drift however long the robot runs. It is only wrong when a wheel slips, and then
+//by a fixed amount. Optionally, the gyro yaw rate provides the heading changes instead, blended with the
+//wheel heading by a complementary filter: the heading follows the gyro over short times, such as a wheel
+//slipping or the robot being knocked, and the wheels over long times, which removes gyro bias and drift.
+//
+//The centre travel in each update is projected along the mean of the old and new headings and summed. Angles
+//are binary angles and positions are integers, so update() uses only integer operations. The latest pose is
+//published through a seqlock and can be read from any task
+class pose_estimator {
+
+public:
+
+    static const int POSITION_SHIFT = 16;      //pose positions are in units of 2^-POSITION_SHIFT m
+    static const int GAIN_SHIFT = 30;          //filter gain in units of 2^-30
+
+    //Set the wheel travel per microstep and the distance between the wheels (m)
+    pose_estimator(float metresPerMicrostep, float trackWidth) {
+        headingPerMicrostep = llround(metresPerMicrostep / trackWidth / (2 * M_PI) * 4294967296.0 * 65536);
+        metresScale = llround(metresPerMicrostep * 4294967296.0);
+    }
+
+    //Fuse the gyro yaw rate with a time constant (s). The rate is in rad/s per LSB and each sample passed to
+    //addYawRate() covers samplePeriod (s). update() is called every updatePeriod (s)
+    void setGyro(float radPerLsb, float samplePeriod, float timeConstant, float updatePeriod) {
+        gyroScale = llround(radPerLsb * samplePeriod / (2 * M_PI) * 4294967296.0 * 65536);
+        gain = static_cast<int32_t>(lround(updatePeriod / (timeConstant + updatePeriod) * (1 << GAIN_SHIFT)));
+        gyro = true;
+    }
+
+    //Use the wheels alone for the heading
+    void clearGyro() {
+        gyro = false;
+        fusedQ = wheelQ;
+    }
+
+    //Add one gyro sample of the yaw rate, anticlockwise positive seen from above, in raw sensor units.
+    //Call from the task that calls update()
+    void addYawRate(int32_t rate) {
+        gyroQ += rate * gyroScale;
+    }
+
+    //Start again at the origin, facing along the x axis, from the current wheel positions (microsteps, forwards
+    //positive)
+    void reset(int32_t left, int32_t right) {
+        lastLeft = left;
+        lastRight = right;
+        startDifference = right - left;
+        wheelQ = fusedQ = 0;
+        gyroQ = 0;
+        xQ = yQ = travelQ = 0;
+        current.x = current.y = current.distance = 0;
+        current.heading = 0;
+        block.write(current);
+    }
+
+    //Add the wheel movement since the last update and publish the new pose. Wheel positions are in microsteps,
+    //forwards positive
+    void update(int32_t left, int32_t right, uint32_t time = 0) {
+        int32_t dl = left - lastLeft, dr = right - lastRight;
+        lastLeft = left;
+        lastRight = right;
+
+        //Headings are binary angles with 16 fractional bits, so the filter can make corrections smaller than
+        //one unit of the binary angle
+        wheelQ = static_cast<int64_t>(right - left - startDifference) * headingPerMicrostep;
+        if (gyro) {
+            fusedQ += gyroQ;
+            gyroQ = 0;
+            int32_t error = static_cast<int32_t>(static_cast<uint32_t>((wheelQ - fusedQ) >> 16));
+            fusedQ += (static_cast<int64_t>(error) * gain) >> (GAIN_SHIFT - 16);
+        }
+        else {
+            fusedQ = wheelQ;
+        }
+        uint32_t heading = static_cast<uint32_t>(fusedQ >> 16);
+
+        //Sum twice the centre travel along the mean heading, in 2^-16 microsteps
+        int32_t travel2 = dl + dr;
+        uint32_t mid = current.heading + static_cast<uint32_t>(static_cast<int32_t>(heading - current.heading) / 2);
+        xQ += (static_cast<int64_t>(travel2) * cosBam(mid)) >> (TRIG_SHIFT - 15);
+        yQ += (static_cast<int64_t>(travel2) * sinBam(mid)) >> (TRIG_SHIFT - 15);
+        travelQ += static_cast<int64_t>(travel2) << 15;
+
+        current.time = time;
+        current.sequence++;
+        current.heading = heading;
+        current.x = toMetres(xQ);
+        current.y = toMetres(yQ);
+        current.distance = toMetres(travelQ);
+        block.write(current);
+    }
+
+    //Latest pose. Safe from any task, do not call from ISR
+    pose read() const {
+        return block.read();
+    }
+
+    //Latest pose in m and rad (-π to π). Call from the task that calls update()
+    float getX() const { return current.x * (1.0f / (1 << POSITION_SHIFT)); }
+    float getY() const { return current.y * (1.0f / (1 << POSITION_SHIFT)); }
+    float getHeading() const { return static_cast<int32_t>(current.heading) * static_cast<float>(M_PI / 2147483648.0); }
+
+    //Heading from the wheels alone (binary angle)
+    uint32_t getWheelHeading() const {
+        return static_cast<uint32_t>(wheelQ >> 16);
+    }
+
+    private:
+
+    int64_t headingPerMicrostep;    //heading per microstep of wheel position difference (2^-16 binary angle)
+    int64_t metresScale;            //m per microstep (2^-32 m)
+    int64_t gyroScale = 0;          //heading per gyro LSB sample (2^-16 binary angle)
+    int32_t gain = 0;               //fraction of the heading error from the wheels corrected per update
+    bool gyro = false;
+
+    int32_t lastLeft = 0, lastRight = 0;
+    int32_t startDifference = 0;
+    int64_t wheelQ = 0;             //heading from the wheels (2^-16 binary angle)
+    int64_t fusedQ = 0;             //heading (2^-16 binary angle)
+    int64_t gyroQ = 0;              //gyro heading change since the last update (2^-16 binary angle)
+    int64_t xQ = 0, yQ = 0, travelQ = 0;    //2^-16 microsteps
+    pose current = {};
+    seqlock<pose> block;
+
+    //2^-16 microsteps to 2^-16 m
+    int32_t toMetres(int64_t q) const {
+        return static_cast<int32_t>((q * metresScale) >> 32);
+    }
+};
+
+#endif
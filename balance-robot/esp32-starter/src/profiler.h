@@ -0,0 +1,112 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include <seqlock.h>
+
+const int PROFILE_BUCKETS = 16;         //histogram bins
+const int PROFILE_BUCKET_SHIFT = 5;     //bin 0 is below 2^5 cycles, bin b is 2^(b+4) to 2^(b+5), the last is above
+
+//Cycle counts of a code section over one measurement window
+struct profile_stats {
+    uint32_t count;             //invocations
+    uint32_t overruns;          //invocations that took longer than the budget
+    uint32_t min;               //CPU cycles
+    uint32_t max;
+    uint64_t total;             //cycles in the section
+    uint64_t elapsed;           //cycles from the start of the first invocation to the end of the window
+    uint32_t histogram[PROFILE_BUCKETS];    //invocations by cycles, in powers of 2
+};
+
+//Profiler for one section of code that runs repeatedly, such as the stepper ISR or a step of the control task.
+//
+//The caller reads the CPU cycle counter (CCOUNT on the ESP32) before the section with now() and passes the
+//start and the cycles taken to record(). record() only adds and compares, with a count-leading-zeros for the
+//histogram bin, so it is cheap enough for the 20 μs stepper ISR. Elapsed time is summed from the differences
+//between invocation starts, so the 32-bit counter may wrap as long as the section runs at least once per wrap,
+//about 18 s at 240 MHz. Load, the share of the CPU taken by the section, is total over elapsed; for an ISR it
+//leaves out the interrupt entry and exit, which happen outside the handler.
+//
+//Statistics accumulate in the recording context. request() asks for a snapshot: the next record() publishes the
+//window through a seqlock and starts a new one. Only one context may call record()
+class profile_section {
+
+public:
+
+    //Name the section and set the cycles above which an invocation is an overrun
+    explicit profile_section(const char *n, uint32_t budgetCycles = UINT32_MAX) : name(n), budget(budgetCycles) {
+        clear();
+    }
+
+    //CPU cycle counter, for the start of a section
+    static uint32_t now() {
+        return ESP.getCycleCount();
+    }
+
+    //Add an invocation that started at start and took cycles
+    void record(uint32_t start, uint32_t cycles) {
+        if (started)
+            window.elapsed += start - lastStart;
+        lastStart = start;
+        started = true;
+
+        if (snapshotRequest) {
+            snapshotRequest = false;
+            snapshot.write(window);
+            clear();
+        }
+
+        window.count++;
+        window.total += cycles;
+        if (cycles < window.min) window.min = cycles;
+        if (cycles > window.max) window.max = cycles;
+        if (cycles > budget) window.overruns++;
+        int bin = (32 - PROFILE_BUCKET_SHIFT) - __builtin_clz(cycles | (1u << (PROFILE_BUCKET_SHIFT - 1)));
+        window.histogram[bin < PROFILE_BUCKETS ? bin : PROFILE_BUCKETS - 1]++;
+    }
+
+    //Add an invocation that started at start and ends now
+    void finish(uint32_t start) {
+        record(start, now() - start);
+    }
+
+    //Publish the current window at the next record() and start a new one. Safe from any task
+    void request() {
+        snapshotRequest = true;
+    }
+
+    //Latest published window. Do not call from ISR
+    profile_stats read() const {
+        return snapshot.read();
+    }
+
+    //Changes with every published window
+    uint32_t version() const {
+        return snapshot.version();
+    }
+
+    const char *getName() const {
+        return name;
+    }
+
+    uint32_t getBudget() const {
+        return budget;
+    }
+
+    private:
+
+    const char *name;
+    uint32_t budget;                    //cycles
+    profile_stats window;               //accumulating
+    uint32_t lastStart = 0;
+    bool started = false;               //lastStart is valid
+    volatile bool snapshotRequest = false;
+    seqlock<profile_stats> snapshot;
+
+    void clear() {
+        window = {};
+        window.min = UINT32_MAX;
+    }
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef REMOTE_MOTION_H
+#define REMOTE_MOTION_H
+
+#include <math.h>
+#include <stdint.h>
+
+//Speed and turn targets for the balancing robot from remote commands, updated at the control rate.
+//A velocity command is held until the next command. A move drives a distance while turning through an angle
+//along a trapezoidal speed profile calculated as it runs: the speed rises at the acceleration limit up to the
+//speed limit and falls so that it could always stop in the distance left, and the last period is shortened so
+//the targets add up to exactly the move. The limits apply to the faster wheel. The balance controller follows
+//the speed target and the drive adds the turn to the wheels
+class remote_motion {
+
+public:
+
+    //Set the wheel travel per microstep, the distance between the wheels (m) and the update period (s)
+    remote_motion(float metresPerMicrostep, float trackWidth, float updatePeriod) :
+        metresPerStep(metresPerMicrostep), turnPerRad(trackWidth / 2 / metresPerMicrostep), dt(updatePeriod) {}
+
+    //Drive at a linear speed (m/s) and turn rate (rad/s) until the next command, cancelling any move
+    void setVelocity(float linear, float angular) {
+        moving = finished = false;
+        speed = linear / metresPerStep;
+        turn = angular * turnPerRad;
+    }
+
+    //Stop and hold position
+    void stop() {
+        setVelocity(0, 0);
+    }
+
+    //Drive a distance (m) while turning through an angle (rad), with speed and acceleration limits in m/s and
+    //m/s/s, measured from where the robot is when the move starts. The profile starts from rest, so a move
+    //should follow a stop or an earlier move
+    void move(float distance, float angle, float maxSpeed, float maxAccel) {
+        float centre = distance / metresPerStep;
+        float half = angle * turnPerRad;
+        length = fabsf(centre) + fabsf(half);
+        if (length <= 0 || maxSpeed <= 0 || maxAccel <= 0) {
+            stop();
+            return;
+        }
+        centreRatio = centre / length;
+        turnRatio = half / length;
+        limitSpeed = maxSpeed / metresPerStep;
+        limitAccel = maxAccel / metresPerStep;
+        travelled = 0;
+        profileSpeed = 0;
+        moving = true;
+    }
+
+    //Advance one update period
+    void update() {
+        if (!moving) {
+            //Come to rest after the last period of a move
+            if (finished)
+                speed = turn = 0;
+            finished = false;
+            return;
+        }
+
+        //Speed along the path of the faster wheel (microsteps/s). The braking limit is the speed from which
+        //slowing by limitAccel * dt every period stops in the distance remaining
+        float remaining = length - travelled;
+        float half = limitAccel * dt / 2;
+        float v = fminf(profileSpeed + limitAccel * dt, limitSpeed);
+        v = fminf(v, sqrtf(half * half + 2 * limitAccel * remaining) - half);
+        if (v * dt >= remaining) {
+            v = remaining / dt;
+            moving = false;
+            finished = true;
+        }
+        profileSpeed = moving ? v : 0;
+        travelled += v * dt;
+        speed = v * centreRatio;
+        turn = v * turnRatio;
+    }
+
+    //Target speed of the centre (microsteps/s)
+    float getSpeed() const {
+        return speed;
+    }
+
+    //Half the target difference between the wheel speeds, right minus left (microsteps/s)
+    float getTurn() const {
+        return turn;
+    }
+
+    //True while a move is running
+    bool isMoving() const {
+        return moving;
+    }
+
+    private:
+
+    float metresPerStep;
+    float turnPerRad;               //half the wheel speed difference per rad/s of turn (microsteps/s)
+    float dt;                       //update period (s)
+    float speed = 0;                //centre speed target (microsteps/s)
+    float turn = 0;                 //turn target (microsteps/s)
+
+    //Move state, along the path of the faster wheel
+    bool moving = false;
+    bool finished = false;          //the last period of a move has been output
+    float length = 0;               //microsteps
+    float travelled = 0;            //microsteps
+    float profileSpeed = 0;         //microsteps/s
+    float limitSpeed = 0;
+    float limitAccel = 0;
+    float centreRatio = 0;          //centre and turn travel per microstep of the faster wheel
+    float turnRatio = 0;
+};
+
+#endif
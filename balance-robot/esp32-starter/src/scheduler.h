@@ -0,0 +1,143 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <seqlock.h>
+
+//Timing statistics of a periodic task since the last reset
+struct task_stats {
+    uint32_t runs;              //completed runs
+    uint32_t overruns;          //releases missed because the previous run had not finished
+    uint32_t execMin;           //execution time (CPU cycles)
+    uint32_t execMax;
+    uint32_t execAvg;
+    uint32_t latencyMax;        //release to start of run (μs)
+    uint32_t jitterMax;         //largest deviation of the start-to-start interval from the period (μs)
+};
+
+//FreeRTOS task that runs a function once per period and measures its timing.
+//In TIMER_RELEASE mode each run is released by calling release() from a hardware timer ISR, so the period comes
+//from the timer and is independent of the FreeRTOS tick. In TICK_RELEASE mode the task releases itself with
+//vTaskDelayUntil(), for lower-priority work with a period that is a multiple of the tick.
+//Both modes use absolute release times, so the schedule does not drift or break when a counter wraps.
+//Statistics are published through a seqlock and can be read from any task
+class periodic_task {
+
+public:
+
+    enum releaseMode { TIMER_RELEASE, TICK_RELEASE };
+
+    //Create a task that calls function every periodUs μs, pinned to core at the given FreeRTOS priority
+    periodic_task(const char *n, void (*f)(), uint32_t periodUs, releaseMode m, int c, UBaseType_t p,
+                  uint32_t stack = 4096) :
+        name(n), function(f), period(periodUs), mode(m), core(c), priority(p), stackSize(stack) {}
+
+    //Start the task. Call once from setup()
+    bool start() {
+        return xTaskCreatePinnedToCore(entry, name, stackSize, this, priority, &handle, core) == pdPASS;
+    }
+
+    //Release the next run. Call from the timer ISR in TIMER_RELEASE mode
+    void IRAM_ATTR release() {
+        BaseType_t woken = pdFALSE;
+        releaseTime = esp_timer_get_time();
+        vTaskNotifyGiveFromISR(handle, &woken);
+        if (woken)
+            portYIELD_FROM_ISR();
+    }
+
+    //Latest statistics. Do not call from ISR
+    task_stats getStats() const {
+        return statsBlock.read();
+    }
+
+    //Clear the statistics at the start of the next run
+    void resetStats() {
+        resetRequest = true;
+    }
+
+    uint32_t getPeriod() const {
+        return period;
+    }
+
+    const char *getName() const {
+        return name;
+    }
+
+    private:
+
+    const char *name;
+    void (*function)();
+    uint32_t period;            //release period (μs)
+    releaseMode mode;
+    int core;
+    UBaseType_t priority;
+    uint32_t stackSize;
+    TaskHandle_t handle = nullptr;
+    volatile int64_t releaseTime = 0;   //time of the latest timer release (μs)
+    volatile bool resetRequest = true;
+    seqlock<task_stats> statsBlock;
+
+    static void entry(void *arg) {
+        static_cast<periodic_task *>(arg)->run();
+    }
+
+    void run() {
+        task_stats stats = {};
+        uint64_t execTotal = 0;
+        int64_t lastStart = 0;
+        TickType_t lastWake = xTaskGetTickCount();
+        const TickType_t periodTicks = pdMS_TO_TICKS(period / 1000) > 0 ? pdMS_TO_TICKS(period / 1000) : 1;
+
+        while (true) {
+            //Wait for the release and work out when it happened
+            uint32_t releases = 1;
+            int64_t released;
+            if (mode == TIMER_RELEASE) {
+                releases = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                released = releaseTime;
+            }
+            else {
+                //Only the jitter is meaningful in this mode, latency is measured from the wake-up
+                vTaskDelayUntil(&lastWake, periodTicks);
+                released = esp_timer_get_time();
+            }
+
+            int64_t start = esp_timer_get_time();
+            uint32_t c0 = ESP.getCycleCount();
+            function();
+            uint32_t exec = ESP.getCycleCount() - c0;
+
+            if (resetRequest) {
+                resetRequest = false;
+                stats = {};
+                stats.execMin = UINT32_MAX;
+                execTotal = 0;
+                lastStart = 0;
+            }
+
+            //Update the statistics and publish them
+            stats.runs++;
+            stats.overruns += releases - 1;
+            if (exec < stats.execMin) stats.execMin = exec;
+            if (exec > stats.execMax) stats.execMax = exec;
+            execTotal += exec;
+            stats.execAvg = static_cast<uint32_t>(execTotal / stats.runs);
+
+            uint32_t latency = static_cast<uint32_t>(start - released);
+            if (latency > stats.latencyMax) stats.latencyMax = latency;
+
+            if (lastStart != 0) {
+                int64_t deviation = (start - lastStart) - static_cast<int64_t>(period) * releases;
+                uint32_t jitter = static_cast<uint32_t>(deviation < 0 ? -deviation : deviation);
+                if (jitter > stats.jitterMax) stats.jitterMax = jitter;
+            }
+            lastStart = start;
+
+            statsBlock.write(stats);
+        }
+    }
+};
+
+#endif
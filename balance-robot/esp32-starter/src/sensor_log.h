@@ -0,0 +1,186 @@
+#ifndef SENSOR_LOG_H
+#define SENSOR_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_partition.h>
+#include <log_buffers.h>
+#include <log_records.h>
+
+//Log of one record per control period to a data partition in flash, for traces too long or too fast for the
+//telemetry link. host/log_export converts a copy of the partition to CSV, see log_records.h for the layout.
+//
+//The control task adds each record to a double buffer (log_buffers.h), which never blocks. A low-priority
+//writer task on the other core programs each full buffer into the partition. The partition is written raw rather
+//than through LittleFS or SPIFFS: a file system erases each block as the file grows, and an erase stalls code
+//running from flash on both cores for tens of ms at a time, long enough to stop the control loop. Instead
+//erase() clears the whole partition ahead of time, which takes several seconds of such stalls, so erase with the
+//robot lying down. start() then only programs pages, so a log can start and run while the robot balances.
+//Programming each 256-byte page, about 140 a second at 1 kHz, still stalls both cores for about half a
+//millisecond. The stepper ISR runs from flash and would lose up to 25 ticks at each stall, so the firmware only
+//records in the esp32-mcpwm build (STEP_MCPWM), which generates the steps in hardware. Records that arrive while
+//both buffers are waiting for the flash are dropped and counted
+class sensor_log {
+
+public:
+
+    static const uint32_t BUFFER_RECORDS = 128;     //records per buffer, 4.5 KB
+
+    enum log_state : uint8_t {
+        IDLE,                   //not started, or stopped
+        ERASING,                //erasing the partition for a new log
+        ERASED,                 //ready for start()
+        RECORDING,
+        FULL,                   //the partition filled up, later records are discarded until stop()
+        FAILED,                 //a flash erase or write failed
+    };
+
+    explicit sensor_log(const char *label = "log") : partitionLabel(label) {}
+
+    //Find the log partition and start the writer task. Call once from setup()
+    bool begin(int core = 0, UBaseType_t priority = 1) {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+        if (partition == nullptr)
+            return false;
+        return xTaskCreatePinnedToCore(taskEntry, "log", 4096, this, priority, &task, core) == pdPASS;
+    }
+
+    //Erase the partition, which discards the last log. Returns false, and does nothing, while a log is running or
+    //the partition is erasing, or if begin() failed. Call from the task that calls add()
+    bool erase() {
+        if (recording || stopping || task == nullptr || eraseRequest.load() || state == ERASING)
+            return false;
+        eraseRequest.store(true);
+        xTaskNotifyGive(task);
+        return true;
+    }
+
+    //Start a new log with a header in the erased partition. Returns false, and does nothing, unless erase() has
+    //finished since the last log. Call from the task that calls add()
+    bool start(const log_header& h) {
+        if (recording || stopping || task == nullptr || state != ERASED)
+            return false;
+        header = h;
+        buffers.clear();
+        recording = true;
+        startRequest.store(true);
+        xTaskNotifyGive(task);
+        return true;
+    }
+
+    //Finish the log, writing the records still buffered. Call from the task that calls add()
+    void stop() {
+        if (recording) {
+            recording = false;
+            stopping = true;
+        }
+    }
+
+    //Add a record while recording. Never blocks. Call from one task only, every control period
+    void add(const log_record& r) {
+        if (stopping) {
+            //Hand over the last records once the writer has taken the buffer before
+            if (buffers.flush()) {
+                stopping = false;
+                endRequest.store(true);
+                xTaskNotifyGive(task);
+            }
+            return;
+        }
+        if (recording && state == RECORDING && buffers.add(r))
+            xTaskNotifyGive(task);
+    }
+
+    log_state getState() const {
+        return state;
+    }
+
+    //Records written to flash in the current or last log
+    uint32_t getRecords() const {
+        return written;
+    }
+
+    //Records lost because the flash fell behind, since begin()
+    uint32_t getDropped() const {
+        return buffers.getDropped();
+    }
+
+    //Records the partition holds
+    uint32_t getCapacity() const {
+        return partition != nullptr ? (partition->size - sizeof(log_header)) / sizeof(log_record) : 0;
+    }
+
+    private:
+
+    const char *partitionLabel;
+    const esp_partition_t *partition = nullptr;
+    TaskHandle_t task = nullptr;
+    log_buffers<log_record, BUFFER_RECORDS> buffers;
+    log_header header = {};
+
+    //Adding task
+    bool recording = false;
+    bool stopping = false;          //waiting to hand over the last buffer
+
+    //Adding task -> writer
+    std::atomic<bool> eraseRequest{false};
+    std::atomic<bool> startRequest{false};
+    std::atomic<bool> endRequest{false};
+
+    //Writer
+    volatile log_state state = IDLE;
+    volatile uint32_t written = 0;
+    uint32_t offset = 0;            //next byte in the partition
+
+    static void taskEntry(void *arg) {
+        static_cast<sensor_log *>(arg)->run();
+    }
+
+    //Program whole records into the partition, up to its end
+    void write(const log_record *records, uint32_t count) {
+        uint32_t space = (partition->size - offset) / sizeof(log_record);
+        uint32_t n = count < space ? count : space;
+        if (n > 0 && esp_partition_write(partition, offset, records, n * sizeof(log_record)) != ESP_OK) {
+            state = FAILED;
+            return;
+        }
+        offset += n * sizeof(log_record);
+        written = written + n;
+        if (n < count)
+            state = FULL;
+    }
+
+    //Writer task. Sleeps until the adding task hands over a buffer or asks to erase, start or end a log
+    void run() {
+        while (true) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+            //Write the buffers of the current log before ending it or starting another. The end request is read
+            //first: the last buffer is handed over before it is made
+            bool end = endRequest.exchange(false);
+            uint32_t count;
+            const log_record *records;
+            while ((records = buffers.take(count)) != nullptr) {
+                if (state == RECORDING)
+                    write(records, count);
+                buffers.release();
+            }
+            if (end && state == RECORDING)
+                state = IDLE;
+
+            if (eraseRequest.load()) {
+                state = ERASING;
+                state = esp_partition_erase_range(partition, 0, partition->size) == ESP_OK ? ERASED : FAILED;
+                eraseRequest.store(false);
+            }
+
+            if (startRequest.exchange(false)) {
+                written = 0;
+                offset = sizeof(log_header);
+                state = esp_partition_write(partition, 0, &header, sizeof(header)) == ESP_OK ? RECORDING : FAILED;
+            }
+        }
+    }
+};
+
+#endif
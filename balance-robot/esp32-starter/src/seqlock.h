@@ -0,0 +1,65 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+//Single-writer sequence lock for passing a small struct between the control loop and an ISR.
+//The writer makes the sequence number odd while it updates the data and even again when it has finished,
+//so a reader that sees an odd or changed sequence knows its copy may be torn and discards it.
+//The writer never waits, so either side can be the ISR. Only one context may write
+template <typename T>
+class seqlock {
+
+public:
+
+    //Publish a new value
+    void write(const T& value) {
+        uint32_t buffer[WORDS] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        uint32_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < WORDS; i++)
+            data[i].store(buffer[i], std::memory_order_relaxed);
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    //Make one attempt to read the value. Returns false, leaving value unchanged, if a write was in progress
+    bool tryRead(T& value) const {
+        uint32_t buffer[WORDS];
+        uint32_t s = sequence.load(std::memory_order_acquire);
+        if (s & 1)
+            return false;
+        for (int i = 0; i < WORDS; i++)
+            buffer[i] = data[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) != s)
+            return false;
+        memcpy(&value, buffer, sizeof(T));
+        return true;
+    }
+
+    //Read the value, retrying until no write overlaps. Do not call from an ISR that can interrupt the writer
+    T read() const {
+        T value;
+        while (!tryRead(value)) {}
+        return value;
+    }
+
+    //Sequence number, which changes with every write. Compare with a saved version to skip unchanged data
+    uint32_t version() const {
+        return sequence.load(std::memory_order_acquire);
+    }
+
+private:
+
+    static const int WORDS = (sizeof(T) + 3) / 4;
+
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint32_t> data[WORDS] = {};
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stdint.h>
+
+//Lock-free single-producer single-consumer queue with a fixed capacity of N items (a power of two).
+//The producer and consumer can be different tasks, cores or an ISR, but each side must only be used from
+//one context. Neither side ever blocks: push() fails when the queue is full and pop() fails when it is empty
+template <typename T, uint32_t N>
+class spsc_queue {
+
+    static_assert(N > 0 && (N & (N - 1)) == 0, "spsc_queue capacity must be a power of two");
+
+public:
+
+    //Add an item. Returns false if the queue is full. Producer only
+    bool push(const T& item) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+            return false;
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Remove the oldest item. Returns false if the queue is empty. Consumer only
+    bool pop(T& item) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t)
+            return false;
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Number of items waiting. Exact from the consumer side, a lower bound of free space from the producer side
+    uint32_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t capacity() const {
+        return N;
+    }
+
+private:
+
+    std::atomic<uint32_t> head{0};  //next slot to write, free-running
+    std::atomic<uint32_t> tail{0};  //next slot to read, free-running
+    T items[N];
+};
+
+#endif
@@ -1,28 +1,232 @@
+#ifndef STEP_H
+#define STEP_H
+
 #include <Arduino.h>
+#include <assert.h>
+#include <seqlock.h>
 
+//Targets are passed from the control loop to the ISR, and speed and position from the ISR back to the loop,
+//through seqlocks, so neither side ever sees a half-updated value and neither side waits for the other.
+//
+//With the driver's microstep mode pins wired to the ESP32, the stepper switches to 8 and then 4 microsteps per
+//physical step as it speeds up, so each pulse moves the motor further and the top speed is 4 times MAX_SPEED at
+//the same pulse rate. The position stays in 1/MICROSTEPS steps. The resolution only changes with the rotor on
+//a full step, where the driver's indexer is at the same current level for every resolution, and the fraction of
+//the step already covered is rescaled, so the motion is continuous. Position 0 must be a full step, as it is
+//when the driver comes out of reset
 class step {
 
 public:
 
-    const int MAX_SPEED = 10000;    //Maximum motor speed (steps/s)
+    //Stepping algorithm.
+    //PERIOD_MODE computes the time between steps with a division whenever the speed changes.
+    //DDA_MODE adds a velocity word to a phase accumulator every tick and steps when it overflows,
+    //so the ISR uses only additions and the long-run step rate exactly matches the target
+    enum stepMode { PERIOD_MODE, DDA_MODE };
+
+    const int MAX_SPEED = 10000;    //Maximum step pulse rate, and motor speed at full microstepping (steps/s)
     const int MAX_SPEED_INTERVAL_US = 1000; //Maximum interval between speed updates (μs)
     const int SPEED_SCALE = 2000;   //Integer speed units are in steps per SPEED_SCALE seconds
     const int MICROSTEPS = 16;      //Number of microsteps per physical step
     const int STEPS = 200;          //Number of physical steps per revolution
     const float STEP_ANGLE = (2.0 * PI)/(STEPS * MICROSTEPS);   //Angle per microstep (rad)
-    int32_t accel = 0;          //current acceleration (steps/s)
-    int32_t tSpeed = 0;         //current speed (steps/(SPEED_SCALE * s))
+    static const int MAX_MICROSTEP_SHIFT = 2;   //Coarsest adaptive resolution is MICROSTEPS >> 2
+
+    //DDA velocities are in units of 2^-30 microsteps per interval, which leaves room for 4 microsteps per pulse
+    static const int VELOCITY_BITS = 30;
+    static constexpr int64_t VELOCITY_ONE = 1LL << VELOCITY_BITS;   //one microstep per interval
+
+    //Driver pins that select the microstep resolution, for adaptive microstepping
+    struct microstep_pins {
+        int8_t pin[3];          //MS1-MS3 (A4988) or MODE0-MODE2 (DRV8825), -1 for a pin fixed by wiring
+        uint8_t levels[MAX_MICROSTEP_SHIFT + 1];    //pin levels for 16, 8 and 4 microsteps, bit n for pin[n]
+    };
+
+    //Motion targets, written by the control loop and applied by the ISR
+    struct command {
+        int32_t tSpeed;         //target speed (steps/(SPEED_SCALE * s))
+        int32_t accel;          //acceleration magnitude (steps/s/s)
+        int32_t tVelocity;      //target speed as a DDA velocity
+        int32_t accelVelocity;  //acceleration as a DDA velocity change per interval
+    };
 
-    //Initialise the stepper with interval and pin numbers
-    step(int i, int8_t sp, int8_t dp) : interval(i), stepPin(sp), dirPin(dp) {
+    //Motion state, published by the ISR
+    struct status {
+        int32_t speed;          //speed in PERIOD_MODE (steps/(SPEED_SCALE * s))
+        int32_t velocity;       //velocity in DDA_MODE
+        int32_t position;       //accumulated steps (steps)
+    };
+
+    //Initialise the stepper with interval, pin numbers and stepping algorithm
+    step(int i, int8_t sp, int8_t dp, stepMode m = PERIOD_MODE) : stepPin(sp), dirPin(dp), interval(i), mode(m) {
         pinMode(stepPin, OUTPUT);
         pinMode(dirPin, OUTPUT);
+        setLimits();
+    }
+
+    //Initialise the stepper as above, with adaptive microstepping through the driver's mode pins
+    step(int i, int8_t sp, int8_t dp, stepMode m, const microstep_pins& ms) : step(i, sp, dp, m) {
+        setModePins(ms);
+    }
+
+    //Initialise a DDA_MODE stepper that does not drive its own pins. After each tick the caller writes the
+    //outputs given by hasStepped() and isForward(), see step_gpio.h
+    explicit step(int i) : stepPin(NO_PIN), dirPin(NO_PIN), interval(i), mode(DDA_MODE) {
+        setLimits();
+    }
+
+    //Initialise a DDA_MODE stepper as above that writes its own mode pins for adaptive microstepping. The pins
+    //only change on the tick after a step, so the caller's step pulses always see a settled resolution
+    step(int i, const microstep_pins& ms) : step(i) {
+        setModePins(ms);
     }
 
     //Update the stepper motor, performing a step and updating the speed as necessary. Call every interval μs
     void runStepper(){
         //Note: ESP32 doesn't support floating point calculations in an ISR, so this function only uses integer operations
+
+        //Pick up a new command if one has been published since the last tick
+        uint32_t version = commandBlock.version();
+        if (version != appliedVersion && commandBlock.tryRead(active))
+            appliedVersion = version;
+
+        if (mode == DDA_MODE)
+            runDDA();
+        else
+            runPeriod();
+
+        statusBlock.write({speed, velocity, position});
+    }
+
+    //Update the stepper motor at a velocity given by the caller instead of the ramp, such as a motion_profile.
+    //With hold, the velocity is set but the motor only advances if it has to change direction, so it can wait
+    //for another motor that reverses this tick. DDA_MODE only. Call every interval μs from the ISR in place of
+    //runStepper()
+    void runStepperAt(int32_t v, bool hold = false) {
+        velocity = v;
+        if (hold && !reverses(v))
+            pulse = false;
+        else
+            advance();
+        statusBlock.write({speed, velocity, position});
+    }
+
+    //True if a velocity needs a change of direction, which takes a tick without stepping. Call from the ISR
+    bool reverses(int32_t v) const {
+        return v != 0 && (v > 0) != forward;
+    }
+
+    //Centre the fractional position within the current step, so that a move of a whole number of microsteps
+    //ends in the middle of its last step rather than on a boundary. Call from the ISR at the start of a move
+    void centrePhase() {
+        phase = 1u << 31;
+    }
+
+    //Build a command from a target speed in microsteps/(SPEED_SCALE * s) and an acceleration in microsteps/s/s.
+    //Do not call from ISR
+    command makeCommand(int32_t targetSpeed, int32_t targetAccel) const {
+        if (targetAccel < 0) targetAccel = -targetAccel;
+        int32_t v = speedToVelocity(targetSpeed);
+        if (v > maxVelocity) v = maxVelocity;
+        if (v < -maxVelocity) v = -maxVelocity;
+        return {targetSpeed, targetAccel, v, accelToVelocity(targetAccel)};
+    }
+
+    //Apply a command immediately. For use from the ISR that calls runStepper(), when commands for several motors
+    //are published together
+    void applyCommand(const command& c) {
+        active = c;
+    }
+
+    //Set acceleration in rad/s/s. Do not call from ISR
+    void setAccelerationRad(float accelRad){
+        setAcceleration(static_cast<int>(accelRad / STEP_ANGLE));
+    }
+
+    //Set acceleration in microsteps/s/s. Do not call from ISR
+    void setAcceleration(int newAccel){
+        pending = makeCommand(pending.tSpeed, newAccel);
+        commandBlock.write(pending);
+    }
     
+    //Set target speed in rad/s. Do not call from ISR
+    void setTargetSpeedRad(float speedRad){
+        setTargetSpeed(static_cast<int>(speedRad * SPEED_SCALE / STEP_ANGLE));
+    }
+    
+    // Set target speed in microsteps/(SPEED_SCALE * s). Do not call from ISR
+    void setTargetSpeed(int speed){
+        pending = makeCommand(speed, pending.accel);
+        commandBlock.write(pending);
+    }
+    
+    // Get position in microsteps. Do not call from ISR
+    int getPosition() {
+        return statusBlock.read().position;
+    }
+    
+    //Get position in rads. Do not call from ISR
+    float getPositionRad() {
+        return static_cast<float>(getPosition()) * STEP_ANGLE;
+    }
+    
+    //Get current speed in microsteps/(SPEED_SCALE * s). Do not call from ISR
+    float getSpeed() {
+        status s = statusBlock.read();
+        if (mode == DDA_MODE)
+            return static_cast<float>(s.velocity) * SPEED_SCALE * (1000000.0f / interval) / VELOCITY_ONE;
+        return s.speed;
+    }
+    
+    //Get current speed in rad/s. Do not call from ISR
+    float getSpeedRad() {
+        return getSpeed() * STEP_ANGLE / SPEED_SCALE;
+    }
+
+    //Maximum motor speed, 4 times MAX_SPEED with adaptive microstepping (microsteps/s)
+    int32_t getMaxSpeed() const {
+        return MAX_SPEED << maxShift;
+    }
+
+    //True if DDA_MODE can run at getMaxSpeed() with interval i: the top speed fits a 31-bit velocity, and the
+    //motor steps less than once per tick so the phase increment fits 32 bits. Below 100 μs, or 50 μs with adaptive
+    //microstepping
+    bool intervalFits(int i) const {
+        return static_cast<int64_t>(getMaxSpeed()) * i < 2000000 && static_cast<int64_t>(MAX_SPEED) * i < 1000000;
+    }
+
+    //Microsteps per physical step that the driver is set to. Call from the ISR
+    int getMicrosteps() const {
+        return MICROSTEPS >> shift;
+    }
+
+    //Interval between calls to runStepper (μs)
+    int getInterval() const {
+        return interval;
+    }
+
+    //True if the last tick made a step. DDA_MODE only. Call from the ISR
+    bool hasStepped() const {
+        return pulse;
+    }
+
+    //Direction pin state after the last tick. DDA_MODE only. Call from the ISR
+    bool isForward() const {
+        return forward;
+    }
+
+    private:
+
+    //Update the stepper motor in PERIOD_MODE
+    void runPeriod(){
+
+        //Change resolution. The step timer runs from the last step, so only the period scales
+        if (nextShift != shift) {
+            shift = nextShift;
+            writeModePins();
+            updatePeriod();
+        }
+
         //Increment speed calculation interval timer
         speedTimer += interval;
 
@@ -48,10 +252,14 @@ public:
                 digitalWrite(dirPin, speed > 0);
 
                 //Increment/decrement position counter
-                position += (speed > 0) ? 1 : -1;
+                position += (speed > 0) ? (1 << shift) : -(1 << shift);
 
                 //End pulse
                 digitalWrite(stepPin, LOW);
+
+                //Choose the resolution on a full step. It changes at the start of the next tick, after this pulse
+                if (maxShift != 0 && (position & (MICROSTEPS - 1)) == 0)
+                    nextShift = chooseShift(speed > 0 ? speed : -speed);
             }
 
         } else {
@@ -65,92 +273,199 @@ public:
 
     }
 
-    //Set acceleration in rad/s/s. Do not call from ISR
-    void setAccelerationRad(float accelRad){
-        accel = static_cast<int>(accelRad / STEP_ANGLE);
+    int32_t stepTimer = 0;      //time since last step (μs)
+    int32_t speedTimer = 0;     //time since last speed update (μs)
+    int32_t step_period = 0;    //current time between steps (μs)
+    int32_t position = 0;       //current accumulated steps (steps)
+    int8_t stepPin;             //output pin number for step
+    int8_t dirPin;              //output pin number for direction
+    static const int8_t NO_PIN = -1;    //pins written by the caller
+    int32_t speed = 0;          //current steps per SPEED_SCALE seconds (steps)
+    int32_t interval;           //interval between calls to runStepper (μs)
+    stepMode mode;              //stepping algorithm
+
+    command pending = {};       //last command published by the control loop
+    command active = {};        //command in use by the ISR
+    uint32_t appliedVersion = 0;    //command block version of the active command
+    seqlock<command> commandBlock;  //control loop -> ISR
+    seqlock<status> statusBlock;    //ISR -> control loop
+
+    //DDA state. Velocities are in units of 2^-30 microsteps per interval
+    uint32_t phase = 0;         //fractional position within the current physical step (2^-32 steps)
+    int32_t velocity = 0;       //current velocity
+    int32_t maxVelocity = 0;    //velocity at getMaxSpeed()
+    bool forward = false;       //direction pin state, low after reset
+    bool pulse = false;         //stepped in the last tick
+
+    //Adaptive microstepping. Each pulse moves 1 << shift microsteps
+    microstep_pins modePins = {};
+    uint8_t shift = 0;          //current resolution
+    uint8_t nextShift = 0;      //resolution from the start of the next tick
+    uint8_t maxShift = 0;       //coarsest resolution, 0 without mode pins
+    int32_t switchLevel = 0;    //speed or velocity above which to halve the resolution, at full microstepping
+
+    //Configure the mode pins and start at full microstepping. Constructors only
+    void setModePins(const microstep_pins& ms) {
+        modePins = ms;
+        maxShift = MAX_MICROSTEP_SHIFT;
+        for (int n = 0; n < 3; n++)
+            if (modePins.pin[n] != NO_PIN)
+                pinMode(modePins.pin[n], OUTPUT);
+        writeModePins();
+        setLimits();
     }
 
-    //Set acceleration in microsteps/s/s
-    void setAcceleration(int newAccel){
-        accel = newAccel;
+    //Speed limits for the available resolutions. Halve the resolution at 3/4 of the pulse rate limit and double
+    //it again below 1/4 of the new pulse rate limit, so the resolution does not chatter around one speed
+    void setLimits() {
+        //A longer interval would wrap the DDA velocity or phase increment
+        assert(mode != DDA_MODE || intervalFits(interval));
+        maxVelocity = speedToVelocity(getMaxSpeed() * SPEED_SCALE);
+        int32_t level = MAX_SPEED * SPEED_SCALE / 4 * 3;
+        switchLevel = mode == DDA_MODE ? speedToVelocity(level) : level;
     }
-    
-    //Set target speed in rad/s. Do not call from ISR
-    void setTargetSpeedRad(float speedRad){
-        tSpeed = static_cast<int>(speedRad * SPEED_SCALE / STEP_ANGLE);
+
+    //Resolution for a speed or velocity magnitude. Moves one level at a time
+    uint8_t chooseShift(int32_t magnitude) const {
+        int32_t level = switchLevel << shift;
+        if (shift < maxShift && magnitude > level)
+            return shift + 1;
+        if (shift > 0 && magnitude < level >> 2)
+            return shift - 1;
+        return shift;
     }
-    
-    // Set target speed in microsteps/(SPEED_SCALE * s)
-    void setTargetSpeed(int speed){
-        tSpeed = speed;
+
+    void writeModePins() {
+        for (int n = 0; n < 3; n++)
+            if (modePins.pin[n] != NO_PIN)
+                digitalWrite(modePins.pin[n], (modePins.levels[shift] >> n) & 1);
     }
-    
-    // Get position in microsteps
-    int getPosition() {
-        return position;
+
+    //Switch to nextShift, keeping the position within the step. The phase runs up from 0 through a step taken
+    //forwards and down from 2^32 through a step taken backwards, so the fraction covered doubles or halves from
+    //the end the last step was taken at
+    void changeResolution() {
+        if (nextShift > shift)
+            phase = forward ? phase >> 1 : (phase >> 1) | 0x80000000u;
+        else
+            phase <<= 1;
+        shift = nextShift;
+        writeModePins();
     }
-    
-    //Get position in rads. Do not call from ISR
-    float getPositionRad() {
-        return static_cast<float>(position) * STEP_ANGLE;
+
+    //Convert speed in microsteps/(SPEED_SCALE * s) to a DDA velocity, rounded to nearest
+    int32_t speedToVelocity(int32_t s) const {
+        const int64_t den = static_cast<int64_t>(SPEED_SCALE) * 1000000;
+        int64_t num = static_cast<int64_t>(s) * interval * VELOCITY_ONE;
+        return static_cast<int32_t>((num + (num < 0 ? -den : den) / 2) / den);
     }
-    
-    //Get current speed in microsteps/(SPEED_SCALE * s)
-    float getSpeed() {
-        return speed;
+
+    //Convert acceleration in microsteps/s/s to a DDA velocity change per interval, rounded to nearest
+    int32_t accelToVelocity(int32_t a) const {
+        const int64_t den = 1000000000000LL;
+        int64_t num = static_cast<int64_t>(a) * interval * interval * VELOCITY_ONE;
+        int64_t v = (num + den / 2) / den;
+        return static_cast<int32_t>(v < maxVelocity ? v : maxVelocity);
     }
-    
-    //Get current speed in rad/s. Do not call from ISR
-    float getSpeedRad() {
-        return static_cast<float>(speed) * STEP_ANGLE / SPEED_SCALE;
+
+    //Update the stepper motor in DDA mode. Uses only additions and comparisons
+    void runDDA() {
+
+        //Ramp velocity towards the target by one interval of acceleration
+        if (velocity < active.tVelocity) {
+            velocity += active.accelVelocity;
+            if (velocity > active.tVelocity) velocity = active.tVelocity;
+        }
+        else if (velocity > active.tVelocity) {
+            velocity -= active.accelVelocity;
+            if (velocity < active.tVelocity) velocity = active.tVelocity;
+        }
+
+        advance();
     }
 
-    private:
+    //Advance the DDA by one interval at the current velocity, stepping if a step boundary is crossed
+    void advance() {
+        pulse = false;
+        if (nextShift != shift)
+            changeResolution();
+        if (velocity == 0)
+            return;
 
-    int32_t stepTimer = 0;      //time since last step (μs)
-    int32_t speedTimer = 0;     //time since last speed update (μs)
-    int32_t step_period = 0;    //current time between steps (μs)
-    int32_t position = 0;       //current accumulated steps (steps)
-    int8_t stepPin;             //output pin number for step
-    int8_t dirPin;              //output pin number for direction
-    int32_t speed = 0;          //current steps per SPEED_SCALE seconds (steps)
-    int32_t interval;           //interval between calls to runStepper (μs)
+        //Change direction one interval before the next step so the driver sees the setup time
+        if ((velocity > 0) != forward) {
+            forward = velocity > 0;
+            if (dirPin != NO_PIN)
+                digitalWrite(dirPin, forward);
+            return;
+        }
+
+        //Advance the phase and step on overflow (or underflow when reversing)
+        uint32_t lastPhase = phase;
+        int phaseShift = 32 - VELOCITY_BITS - shift;
+        if (forward) {
+            phase += static_cast<uint32_t>(velocity) << phaseShift;
+            if (phase >= lastPhase)
+                return;
+            position += 1 << shift;
+        }
+        else {
+            phase -= static_cast<uint32_t>(-velocity) << phaseShift;
+            if (phase <= lastPhase)
+                return;
+            position -= 1 << shift;
+        }
+
+        pulse = true;
+        if (stepPin != NO_PIN) {
+            digitalWrite(stepPin, HIGH);
+            digitalWrite(stepPin, LOW);
+        }
+
+        //Choose the resolution on a full step. It changes at the start of the next tick, after this pulse
+        if (maxShift != 0 && (position & (MICROSTEPS - 1)) == 0)
+            nextShift = chooseShift(forward ? velocity : -velocity);
+    }
 
     //Update the motor speed and step interval
     void updateSpeed(){
 
-        if (accel < 0) accel = -accel;
-
         //Calculate change to speed
-        if (speed < tSpeed){
-            speed += accel * speedTimer / (1000000/SPEED_SCALE);
-            if (speed > tSpeed){
-                speed = tSpeed;
+        if (speed < active.tSpeed){
+            speed += active.accel * speedTimer / (1000000/SPEED_SCALE);
+            if (speed > active.tSpeed){
+                speed = active.tSpeed;
             }
-            if (speed > MAX_SPEED * SPEED_SCALE) {
-                speed = MAX_SPEED * SPEED_SCALE;
+            if (speed > getMaxSpeed() * SPEED_SCALE) {
+                speed = getMaxSpeed() * SPEED_SCALE;
             }
         }
         else {
-            speed -= accel * speedTimer / (1000000/SPEED_SCALE);
-            if (speed < tSpeed){
-                speed = tSpeed;
+            speed -= active.accel * speedTimer / (1000000/SPEED_SCALE);
+            if (speed < active.tSpeed){
+                speed = active.tSpeed;
             }
-            if (speed < -MAX_SPEED * SPEED_SCALE) {
-                speed = -MAX_SPEED * SPEED_SCALE;
+            if (speed < -getMaxSpeed() * SPEED_SCALE) {
+                speed = -getMaxSpeed() * SPEED_SCALE;
             }
         }
 
         //Reset speed calculation timer
         speedTimer = 0;
 
-        //Calculate step period
+        updatePeriod();
+    }
+
+    //Calculate the step period for the speed and resolution
+    void updatePeriod() {
         if (speed == 0)
             step_period = 0;
         else if (speed > 0)
-            step_period = 1000000 * SPEED_SCALE / speed;
+            step_period = (1000000 * SPEED_SCALE / speed) << shift;
         else
-            step_period = -1000000 * SPEED_SCALE / speed;
+            step_period = (-1000000 * SPEED_SCALE / speed) << shift;
     }
 
-};
\ No newline at end of file
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef STEP_GPIO_H
+#define STEP_GPIO_H
+
+#include <Arduino.h>
+#include <soc/gpio_reg.h>
+#include <step.h>
+
+//Direct register access to an output pin fixed at compile time. Each write is a single store to the GPIO set or
+//clear register, where digitalWrite() looks the pin up at run time. Does not configure the pin
+template <uint8_t PIN>
+struct gpio_pin {
+    static_assert(PIN < 34, "GPIO 34-39 are input only");
+    static constexpr uint32_t MASK = 1u << (PIN & 31);
+
+    static void set() {
+        REG_WRITE(PIN < 32 ? GPIO_OUT_W1TS_REG : GPIO_OUT1_W1TS_REG, MASK);
+    }
+
+    static void clear() {
+        REG_WRITE(PIN < 32 ? GPIO_OUT_W1TC_REG : GPIO_OUT1_W1TC_REG, MASK);
+    }
+
+    static void write(bool level) {
+        if (level)
+            set();
+        else
+            clear();
+    }
+};
+
+//Step and direction outputs of two steppers built with step(interval), written straight to the GPIO registers.
+//The pins are template parameters, so the register masks are constants. Call write() after both steppers have
+//run for the tick: direction changes are written in one store, then the step pins of both motors rise in one
+//store and fall in another.
+//The step pulse is held high for at least pulseNs, timed with the CPU cycle counter, to meet the minimum high
+//time of the driver. The stepper changes direction a tick before the next step, so the direction setup time
+//is one tick
+template <uint8_t LEFT_STEP, uint8_t LEFT_DIR, uint8_t RIGHT_STEP, uint8_t RIGHT_DIR>
+class step_gpio {
+
+    static_assert(LEFT_STEP < 32 && LEFT_DIR < 32 && RIGHT_STEP < 32 && RIGHT_DIR < 32,
+                  "step and direction pins must be GPIO 0-31 to share a register");
+
+public:
+
+    step_gpio(step& l, step& r, uint32_t pulse) : left(l), right(r), pulseNs(pulse) {}
+
+    //Configure the pins as outputs, low, and calculate the pulse length for the CPU clock. Call once from
+    //setup(), before the stepper interrupt starts
+    void begin() {
+        pinMode(LEFT_STEP, OUTPUT);
+        pinMode(LEFT_DIR, OUTPUT);
+        pinMode(RIGHT_STEP, OUTPUT);
+        pinMode(RIGHT_DIR, OUTPUT);
+        REG_WRITE(GPIO_OUT_W1TC_REG, STEP_MASK | DIR_MASK);
+        direction = 0;
+        pulseCycles = (pulseNs * getCpuFrequencyMhz() + 999) / 1000;
+    }
+
+    //Write the outputs of the last tick. Call from the ISR after both steppers have run
+    void write() {
+        uint32_t dir = (left.isForward() ? gpio_pin<LEFT_DIR>::MASK : 0) |
+                       (right.isForward() ? gpio_pin<RIGHT_DIR>::MASK : 0);
+        if (dir != direction) {
+            REG_WRITE(GPIO_OUT_W1TS_REG, dir & ~direction);
+            REG_WRITE(GPIO_OUT_W1TC_REG, direction & ~dir);
+            direction = dir;
+        }
+
+        uint32_t steps = (left.hasStepped() ? gpio_pin<LEFT_STEP>::MASK : 0) |
+                         (right.hasStepped() ? gpio_pin<RIGHT_STEP>::MASK : 0);
+        if (steps) {
+            REG_WRITE(GPIO_OUT_W1TS_REG, steps);
+            uint32_t start = ESP.getCycleCount();
+            while (ESP.getCycleCount() - start < pulseCycles) {}
+            REG_WRITE(GPIO_OUT_W1TC_REG, steps);
+        }
+    }
+
+    //Minimum step pulse length (CPU cycles)
+    uint32_t getPulseCycles() const {
+        return pulseCycles;
+    }
+
+    private:
+
+    static constexpr uint32_t STEP_MASK = gpio_pin<LEFT_STEP>::MASK | gpio_pin<RIGHT_STEP>::MASK;
+    static constexpr uint32_t DIR_MASK = gpio_pin<LEFT_DIR>::MASK | gpio_pin<RIGHT_DIR>::MASK;
+
+    step& left;
+    step& right;
+    uint32_t pulseNs;
+    uint32_t pulseCycles = 0;
+    uint32_t direction = 0;         //direction pins that are high
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef STEP_MCPWM_H
+#define STEP_MCPWM_H
+
+#include <Arduino.h>
+#include <driver/mcpwm.h>
+#include <driver/pcnt.h>
+#include <soc/mcpwm_struct.h>
+
+//Stepper backend that generates the step pulses in hardware instead of bit-banging them from a timer ISR.
+//An MCPWM timer outputs a square wave at the step rate, so pulse timing is set by the 1 MHz MCPWM timer clock
+//instead of the ISR interval. A PCNT unit counts the pulses on the same pin, using the direction pin as its
+//control input, so the position is exact even though the CPU never sees individual steps.
+//The counter resets to zero at +-PCNT_LIMIT, which keeps its value equal to the position modulo PCNT_LIMIT, so the
+//position is rebuilt from the count in software rather than from a limit interrupt that could arrive after a read.
+//The CPU only ramps the speed and reprograms the MCPWM frequency when update() is called from the control loop.
+//Each instance needs its own MCPWM timer and PCNT unit
+class step_mcpwm {
+
+public:
+
+    const int MAX_SPEED = 10000;    //Maximum motor speed (steps/s)
+    const int MIN_SPEED = 16;       //Lowest step rate the MCPWM timer can generate, slower speeds are output as stopped (steps/s)
+    const int SPEED_SCALE = 2000;   //Integer speed units are in steps per SPEED_SCALE seconds
+    const int MICROSTEPS = 16;      //Number of microsteps per physical step
+    const int STEPS = 200;          //Number of physical steps per revolution
+    const float STEP_ANGLE = (2.0 * PI)/(STEPS * MICROSTEPS);   //Angle per microstep (rad)
+    static const int16_t PCNT_LIMIT = 16384;    //Pulse counter resets at this count, a power of two
+    static const uint32_t FORCE_MARGIN = 2;     //Time the output must stay low after a forced stop (MCPWM ticks)
+    int32_t accel = 0;          //current acceleration (steps/s)
+    int32_t tSpeed = 0;         //current speed (steps/(SPEED_SCALE * s))
+
+    //Initialise the stepper with MCPWM timer, pulse counter and pin numbers. Call begin() before use
+    step_mcpwm(mcpwm_unit_t u, mcpwm_timer_t t, pcnt_unit_t p, int8_t sp, int8_t dp) :
+        unit(u), timer(t), counter(p), stepPin(sp), dirPin(dp) {}
+
+    //Configure the peripherals. Call once from setup()
+    bool begin() {
+        //MCPWMnA outputs are numbered in steps of two in mcpwm_io_signals_t
+        if (mcpwm_gpio_init(unit, static_cast<mcpwm_io_signals_t>(MCPWM0A + 2 * timer), stepPin) != ESP_OK)
+            return false;
+
+        mcpwm_config_t pwmConfig = {};
+        pwmConfig.frequency = MIN_SPEED;
+        pwmConfig.cmpr_a = 50.0;
+        pwmConfig.counter_mode = MCPWM_UP_COUNTER;
+        pwmConfig.duty_mode = MCPWM_DUTY_MODE_0;
+        if (mcpwm_init(unit, timer, &pwmConfig) != ESP_OK)
+            return false;
+        mcpwm_set_signal_low(unit, timer, MCPWM_GEN_A);
+
+        //Count rising edges on the step pin, up when the direction pin is high and down when it is low
+        pcnt_config_t pcntConfig = {};
+        pcntConfig.pulse_gpio_num = stepPin;
+        pcntConfig.ctrl_gpio_num = dirPin;
+        pcntConfig.lctrl_mode = PCNT_MODE_REVERSE;
+        pcntConfig.hctrl_mode = PCNT_MODE_KEEP;
+        pcntConfig.pos_mode = PCNT_COUNT_INC;
+        pcntConfig.neg_mode = PCNT_COUNT_DIS;
+        pcntConfig.counter_h_lim = PCNT_LIMIT;
+        pcntConfig.counter_l_lim = -PCNT_LIMIT;
+        pcntConfig.unit = counter;
+        pcntConfig.channel = PCNT_CHANNEL_0;
+        if (pcnt_unit_config(&pcntConfig) != ESP_OK)
+            return false;
+
+        //The pulse counter configures both pins as inputs, so enable the outputs again.
+        //Signal routing through the GPIO matrix is unaffected
+        gpio_set_direction(static_cast<gpio_num_t>(stepPin), GPIO_MODE_INPUT_OUTPUT);
+        gpio_set_direction(static_cast<gpio_num_t>(dirPin), GPIO_MODE_INPUT_OUTPUT);
+        digitalWrite(dirPin, HIGH);
+
+        //Enable the limit comparators that reset the counter. No interrupt is needed, see getPosition()
+        pcnt_event_enable(counter, PCNT_EVT_H_LIM);
+        pcnt_event_enable(counter, PCNT_EVT_L_LIM);
+
+        pcnt_counter_pause(counter);
+        pcnt_counter_clear(counter);
+        pcnt_counter_resume(counter);
+        return true;
+    }
+
+    //Ramp the speed towards the target and reprogram the step rate. Call at the control loop rate with the
+    //time since the previous call. Do not call from ISR
+    void update(uint32_t dt_us) {
+        int32_t a = accel < 0 ? -accel : accel;
+        int32_t dSpeed = static_cast<int32_t>(static_cast<int64_t>(a) * dt_us * SPEED_SCALE / 1000000);
+
+        if (speed < tSpeed) {
+            speed += dSpeed;
+            if (speed > tSpeed) speed = tSpeed;
+        }
+        else {
+            speed -= dSpeed;
+            if (speed < tSpeed) speed = tSpeed;
+        }
+        if (speed > MAX_SPEED * SPEED_SCALE) speed = MAX_SPEED * SPEED_SCALE;
+        if (speed < -MAX_SPEED * SPEED_SCALE) speed = -MAX_SPEED * SPEED_SCALE;
+
+        //Fold the count at least every PCNT_LIMIT/2 steps, 0.8 s at MAX_SPEED
+        base = getPosition();
+
+        uint32_t frequency = (speed > 0 ? speed : -speed) / SPEED_SCALE;
+        bool forward = speed > 0;
+
+        //Stop the output before reversing so that the direction never changes during a pulse
+        if (frequency < static_cast<uint32_t>(MIN_SPEED) || forward != direction) {
+            if (running) {
+                //Only stop in the low half of the period so the driver gets the whole of the pulse PCNT counted,
+                //otherwise keep stepping until the next update
+                if (!outputLow())
+                    return;
+                mcpwm_set_signal_low(unit, timer, MCPWM_GEN_A);
+                running = false;
+                stopTime = micros();
+            }
+            if (forward != direction) {
+                //Hold the old direction for a pulse period after the last pulse
+                if (outputFrequency > 0 && micros() - stopTime < 1000000 / outputFrequency)
+                    return;
+                digitalWrite(dirPin, forward);
+                direction = forward;
+            }
+            if (frequency < static_cast<uint32_t>(MIN_SPEED))
+                return;
+        }
+
+        //The new period starts at the end of the current one, so there is no glitch on the output.
+        //Reapply the duty so the compare value follows the new period
+        if (frequency != outputFrequency) {
+            mcpwm_set_frequency(unit, timer, frequency);
+            mcpwm_set_duty(unit, timer, MCPWM_GEN_A, 50.0);
+            outputFrequency = frequency;
+        }
+        if (!running) {
+            mcpwm_set_duty_type(unit, timer, MCPWM_GEN_A, MCPWM_DUTY_MODE_0);
+            running = true;
+        }
+    }
+
+    //Set acceleration in rad/s/s. Do not call from ISR
+    void setAccelerationRad(float accelRad){
+        accel = static_cast<int>(accelRad / STEP_ANGLE);
+    }
+
+    //Set acceleration in microsteps/s/s
+    void setAcceleration(int newAccel){
+        accel = newAccel;
+    }
+
+    //Set target speed in rad/s. Do not call from ISR
+    void setTargetSpeedRad(float speedRad){
+        tSpeed = static_cast<int>(speedRad * SPEED_SCALE / STEP_ANGLE);
+    }
+
+    // Set target speed in microsteps/(SPEED_SCALE * s)
+    void setTargetSpeed(int speed){
+        tSpeed = speed;
+    }
+
+    // Get position in microsteps
+    int getPosition() {
+        int32_t b = base;
+        int16_t count;
+        pcnt_get_counter_value(counter, &count);
+        //The count equals the position modulo PCNT_LIMIT, so add the difference from the last folded position,
+        //which is less than PCNT_LIMIT/2 steps away
+        int32_t d = static_cast<int32_t>((static_cast<uint32_t>(count) - b) & (PCNT_LIMIT - 1));
+        if (d >= PCNT_LIMIT / 2)
+            d -= PCNT_LIMIT;
+        return b + d;
+    }
+
+    //Get position in rads. Do not call from ISR
+    float getPositionRad() {
+        return static_cast<float>(getPosition()) * STEP_ANGLE;
+    }
+
+    //Get current speed in microsteps/(SPEED_SCALE * s)
+    float getSpeed() {
+        return speed;
+    }
+
+    //Get current speed in rad/s. Do not call from ISR
+    float getSpeedRad() {
+        return static_cast<float>(speed) * STEP_ANGLE / SPEED_SCALE;
+    }
+
+    private:
+
+    mcpwm_unit_t unit;          //MCPWM unit
+    mcpwm_timer_t timer;        //MCPWM timer within the unit, drives output A
+    pcnt_unit_t counter;        //pulse counter unit for position
+    int8_t stepPin;             //output pin number for step
+    int8_t dirPin;              //output pin number for direction
+    int32_t speed = 0;          //current steps per SPEED_SCALE seconds (steps)
+    uint32_t outputFrequency = 0;   //step rate programmed into the MCPWM timer (steps/s)
+    bool running = false;       //MCPWM output is generating pulses
+    bool direction = true;      //current level of the direction pin
+    uint32_t stopTime = 0;      //time the output was last stopped (us)
+    volatile int32_t base = 0;  //position at the last update(), for folding the pulse count (steps)
+
+    //True if the step output is in the low half of its period, with time to force it low before the next pulse.
+    //The output goes high at the start of the period and low at the compare value, half way
+    bool outputLow() {
+        mcpwm_dev_t &dev = unit == MCPWM_UNIT_0 ? MCPWM0 : MCPWM1;
+        uint32_t period = dev.timer[timer].period.period;
+        uint32_t count = dev.timer[timer].status.value;
+        return count > period / 2 && count + FORCE_MARGIN < period;
+    }
+
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef STEP_PAIR_H
+#define STEP_PAIR_H
+
+#include <atomic>
+#include <step.h>
+#include <seqlock.h>
+#include <motion_profile.h>
+
+//Two steppers that are commanded together, such as the wheels of the robot.
+//Targets for both motors are published in a single seqlock write and fetched once per tick, before either motor
+//runs, so the ISR never combines a new command for one wheel with an old command for the other.
+//Position moves are planned as a pair of motion profiles that finish on the same tick and executed by the ISR,
+//so they stop exactly on the target without polling. Moves need DDA_MODE. The most recent of a move or a speed
+//target takes effect, so setting a speed cancels a move
+class step_pair {
+
+public:
+
+    step_pair(step& l, step& r) : left(l), right(r) {}
+
+    //Set acceleration of both motors in rad/s/s. Takes effect with the next target speeds. Do not call from ISR
+    void setAccelerationRad(float accelRad) {
+        accel = static_cast<int32_t>(accelRad / left.STEP_ANGLE);
+    }
+
+    //Set acceleration of both motors in microsteps/s/s. Takes effect with the next target speeds
+    void setAcceleration(int32_t newAccel) {
+        accel = newAccel;
+    }
+
+    //Publish target speeds for both motors in rad/s. Do not call from ISR
+    void setTargetSpeedRad(float leftRad, float rightRad) {
+        float scale = left.SPEED_SCALE / left.STEP_ANGLE;
+        setTargetSpeed(static_cast<int32_t>(leftRad * scale), static_cast<int32_t>(rightRad * scale));
+    }
+
+    //Publish target speeds for both motors in microsteps/(SPEED_SCALE * s). Do not call from ISR
+    void setTargetSpeed(int32_t leftSpeed, int32_t rightSpeed) {
+        commands.write({left.makeCommand(leftSpeed, accel), right.makeCommand(rightSpeed, accel), ++order});
+    }
+
+    //Move each motor by a distance in microsteps, starting from rest, with a speed limit in microsteps/s and
+    //acceleration and jerk limits in microsteps/s/s and /s/s/s. maxJerk = 0 gives a trapezoidal speed profile.
+    //Both motors start and stop together. Do not call from ISR
+    void move(int32_t leftDistance, int32_t rightDistance, float maxSpeed, float maxAccel, float maxJerk = 0) {
+        move_pair m;
+        const int32_t distances[2] = {leftDistance, rightDistance};
+        plan_moves(m.profiles, distances, 2, maxSpeed, maxAccel, maxJerk, left.getInterval());
+        m.stop[0] = left.makeCommand(0, accel);
+        m.stop[1] = right.makeCommand(0, accel);
+        m.order = ++order;
+        lastMoveOrder = m.order;
+        moves.write(m);
+    }
+
+    //True from a call to move() until both motors have finished the move or it is cancelled
+    bool isMoving() const {
+        return settledOrder.load(std::memory_order_acquire) < lastMoveOrder;
+    }
+
+    //Apply the latest complete pair of commands and update both motors. Call every interval μs from the ISR
+    void runSteppers() {
+        uint32_t version = commands.version();
+        if (version != appliedVersion) {
+            pair p;
+            if (commands.tryRead(p)) {
+                appliedVersion = version;
+                if (p.order > appliedOrder) {
+                    left.applyCommand(p.left);
+                    right.applyCommand(p.right);
+                    appliedOrder = p.order;
+                    leftMove.stop();
+                    rightMove.stop();
+                    settledOrder.store(appliedOrder, std::memory_order_release);
+                }
+            }
+        }
+
+        version = moves.version();
+        if (version != appliedMoveVersion && moves.tryRead(nextMove)) {
+            appliedMoveVersion = version;
+            if (nextMove.order > appliedOrder) {
+                left.applyCommand(nextMove.stop[0]);
+                right.applyCommand(nextMove.stop[1]);
+                left.centrePhase();
+                right.centrePhase();
+                leftMove.start(nextMove.profiles[0]);
+                rightMove.start(nextMove.profiles[1]);
+                appliedOrder = nextMove.order;
+            }
+        }
+
+        if (leftMove.running()) {
+            left.runStepperAt(leftMove.next());
+            right.runStepperAt(rightMove.next());
+            if (!leftMove.running())
+                settledOrder.store(appliedOrder, std::memory_order_release);
+        }
+        else {
+            left.runStepper();
+            right.runStepper();
+        }
+    }
+
+    private:
+
+    struct pair {
+        step::command left;
+        step::command right;
+        uint32_t order;             //publish order of speed targets and moves
+    };
+
+    struct move_pair {
+        motion_profile profiles[2];
+        step::command stop[2];      //zero speed targets for when the move ends
+        uint32_t order;
+    };
+
+    step& left;
+    step& right;
+    int32_t accel = 0;              //acceleration for the next publish (steps/s/s)
+    uint32_t order = 0;             //publish counter
+    uint32_t lastMoveOrder = 0;     //order of the latest move
+    seqlock<pair> commands;         //control loop -> ISR
+    seqlock<move_pair> moves;       //control loop -> ISR
+    uint32_t appliedVersion = 0;    //version of the commands in use by the ISR
+    uint32_t appliedMoveVersion = 0;
+    uint32_t appliedOrder = 0;      //order of the target or move in use by the ISR
+    move_pair nextMove;             //ISR copy of the latest move
+    profile_runner leftMove;
+    profile_runner rightMove;
+    std::atomic<uint32_t> settledOrder{0};     //latest order at which no move was running, from the ISR
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include <driver/uart.h>
+#include <string.h>
+#include <frame.h>
+#include <spsc_queue.h>
+#include <telemetry_records.h>
+
+//Binary telemetry on a UART, framed with frame.h and decoded on the host by host/telemetry_decode.
+//The control task queues one record per period with send(), which copies it into a lock-free queue and never
+//blocks. A lower-priority task calls flush() to frame the queued records and hand them to the UART driver,
+//which copies them into its transmit ring buffer. The classic ESP32 UART has no DMA, so the driver's interrupt
+//refills the UART FIFO from the ring buffer on the CPU, but neither sender waits for the bytes to go out on the
+//wire. Only the task that calls flush() may call write() and print().
+//The UART is used exclusively by this class and command_link, which reads the commands arriving on the same port,
+//so Serial must not be started on it
+class telemetry {
+
+public:
+
+    static const uint32_t QUEUE_SIZE = 64;      //control records buffered between flushes
+    static const int TX_BUFFER_SIZE = 4096;     //UART driver transmit ring buffer (bytes)
+    static const int RX_BUFFER_SIZE = 256;      //UART driver receive buffer for commands (bytes), the driver minimum
+
+    telemetry(uart_port_t p = UART_NUM_0) : port(p) {}
+
+    //Install the UART driver. Pin numbers default to the pins already routed to the UART, which for UART0 are
+    //the USB serial bridge. Call once from setup()
+    bool begin(uint32_t baud, int txPin = UART_PIN_NO_CHANGE, int rxPin = UART_PIN_NO_CHANGE) {
+        uart_config_t config = {};
+        config.baud_rate = baud;
+        config.data_bits = UART_DATA_8_BITS;
+        config.parity = UART_PARITY_DISABLE;
+        config.stop_bits = UART_STOP_BITS_1;
+        config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+        config.source_clk = UART_SCLK_APB;
+        if (uart_driver_install(port, RX_BUFFER_SIZE, TX_BUFFER_SIZE, 0, nullptr, 0) != ESP_OK)
+            return false;
+        if (uart_param_config(port, &config) != ESP_OK)
+            return false;
+        return uart_set_pin(port, txPin, rxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) == ESP_OK;
+    }
+
+    //Queue a control record. Returns false and counts a drop if the queue is full. Call from one task only
+    bool send(const telemetry_control& record) {
+        if (records.push(record))
+            return true;
+        dropped++;
+        return false;
+    }
+
+    //Frame and transmit all queued records. Blocks only if the UART transmit buffer is full
+    void flush() {
+        telemetry_control record;
+        while (records.pop(record))
+            write(TELEMETRY_CONTROL, &record, sizeof(record));
+    }
+
+    //Frame and transmit one message
+    void write(telemetry_type type, const void *data, size_t length) {
+        uint8_t payload[FRAME_MAX_PAYLOAD];
+        uint8_t frame[FRAME_MAX_ENCODED];
+        if (length > FRAME_MAX_PAYLOAD - TELEMETRY_HEADER)
+            length = FRAME_MAX_PAYLOAD - TELEMETRY_HEADER;
+        payload[0] = type;
+        payload[1] = sequence++;
+        memcpy(payload + TELEMETRY_HEADER, data, length);
+        size_t n = encodeFrame(payload, length + TELEMETRY_HEADER, frame);
+        uart_write_bytes(port, reinterpret_cast<const char *>(frame), n);
+    }
+
+    //Transmit a text message
+    void print(const char *text) {
+        write(TELEMETRY_TEXT, text, strlen(text));
+    }
+
+    //Control records lost because the queue was full
+    uint32_t getDropped() const {
+        return dropped;
+    }
+
+    private:
+
+    uart_port_t port;
+    uint8_t sequence = 0;
+    volatile uint32_t dropped = 0;
+    spsc_queue<telemetry_control, QUEUE_SIZE> records;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef TELEMETRY_RECORDS_H
+#define TELEMETRY_RECORDS_H
+
+#include <stdint.h>
+
+//Telemetry message layouts, shared by the firmware and the host decoder.
+//Each frame payload is the message type, an 8-bit sequence number that increments with every frame so the
+//receiver can count lost frames, then the record. Records are little-endian with no padding
+
+enum telemetry_type : uint8_t {
+    TELEMETRY_CONTROL = 1,      //telemetry_control, once per control period
+    TELEMETRY_TASK = 2,         //telemetry_task, task timing statistics
+    TELEMETRY_TEXT = 3,         //text message without a terminator
+    TELEMETRY_ADC = 4,          //telemetry_adc, each new set of averaged ADC readings
+    TELEMETRY_POSE = 5,         //telemetry_pose, latest odometry every telemetry interval
+    TELEMETRY_ACK = 6,          //telemetry_ack, result of each command, see command.h
+    TELEMETRY_BATTERY = 7,      //telemetry_battery, battery readings and energy every BATTERY_INTERVAL ms
+    TELEMETRY_PROFILE = 8,      //telemetry_profile, each profiled code section after a COMMAND_PROFILE
+};
+
+const int TELEMETRY_HEADER = 2;     //type and sequence number
+
+//State of the control loop
+struct telemetry_control {
+    uint32_t time;              //time of the control update (μs)
+    int32_t tilt;               //tilt angle (2^-24 rad)
+    int32_t tiltRate;           //tilt rate (2^-24 rad/s)
+    int32_t tiltSetpoint;       //tilt setpoint from the speed loop (2^-24 rad)
+    int32_t speed[2];           //motor speeds (microsteps/(SPEED_SCALE * s))
+    int32_t position[2];        //motor positions (microsteps)
+    int16_t gyro[3];            //latest raw gyro sample
+    uint16_t adc;               //averaged ADC channel 0 (2^-4 counts)
+};
+static_assert(sizeof(telemetry_control) == 40, "telemetry_control must not be padded");
+
+//Timing statistics of one task, see task_stats
+struct telemetry_task {
+    char name[8];               //task name, zero padded
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t execMin;           //execution time (μs)
+    uint32_t execAvg;
+    uint32_t execMax;
+    uint32_t latencyMax;        //μs
+    uint32_t jitterMax;         //μs
+};
+static_assert(sizeof(telemetry_task) == 36, "telemetry_task must not be padded");
+
+//Averaged readings of all ADC channels, see adc_block
+struct telemetry_adc {
+    uint32_t time;              //time of the last scan in the average (μs)
+    uint16_t value[8];          //2^-4 counts
+};
+static_assert(sizeof(telemetry_adc) == 20, "telemetry_adc must not be padded");
+
+//Dead-reckoning pose of the robot, see pose.h
+struct telemetry_pose {
+    uint32_t time;              //time of the control update (μs)
+    int32_t x;                  //along the starting heading (2^-16 m)
+    int32_t y;                  //to the left of the starting heading (2^-16 m)
+    uint32_t heading;           //anticlockwise from the starting heading (binary angle, 2^32 per turn)
+    int32_t distance;           //travel of the centre, forwards positive (2^-16 m)
+};
+static_assert(sizeof(telemetry_pose) == 20, "telemetry_pose must not be padded");
+
+//Acknowledgement of a command
+struct telemetry_ack {
+    uint32_t time;              //time the command was applied or rejected (μs)
+    uint16_t sequence;          //sequence number of the command
+    uint8_t type;               //command_type
+    uint8_t result;             //command_result
+};
+static_assert(sizeof(telemetry_ack) == 8, "telemetry_ack must not be padded");
+
+//Battery readings and estimates, see battery.h
+struct telemetry_battery {
+    uint32_t time;              //time of the ADC readings (μs)
+    uint16_t voltage;           //mV
+    uint16_t stateOfCharge;     //remaining charge over capacity (2^-16, 65535 when full)
+    int32_t current;            //discharging positive (μA)
+    int32_t power;              //mW
+    int32_t charge;             //drawn since the counters were reset (μAh)
+    int32_t energy;             //drawn since the counters were reset (mJ)
+    int32_t remainingEnergy;    //mJ
+    uint32_t flags;             //BATTERY_PRESENT
+};
+static_assert(sizeof(telemetry_battery) == 32, "telemetry_battery must not be padded");
+
+const uint32_t BATTERY_PRESENT = 1;     //battery voltage is above the minimum and the counters are running
+
+//Cycle counts of a profiled code section since the previous request, see profiler.h
+struct telemetry_profile {
+    char name[8];               //section name, zero padded
+    uint32_t count;             //invocations
+    uint32_t overruns;          //invocations over the budget
+    uint32_t budget;            //CPU cycles
+    uint32_t min;               //CPU cycles
+    uint32_t avg;
+    uint32_t max;
+    uint32_t load;              //share of the CPU (2^-16)
+    uint32_t window;            //length of the measurement (ms)
+    uint32_t cpuMhz;            //CPU cycles per μs
+    uint32_t histogram[16];     //invocations below 32 cycles, then in each power of 2 up to 2^19, then above
+};
+static_assert(sizeof(telemetry_profile) == 108, "telemetry_profile must not be padded");
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef TILT_H
+#define TILT_H
+
+#include <math.h>
+#include <stdint.h>
+
+//Tilt estimator that fuses the gyroscope rate with the angle of the accelerometer vector.
+//
+//Each update integrates the bias-corrected gyro rate over one sample period, then corrects the angle and the
+//gyro bias by fixed gains times the difference from the accelerometer angle:
+//  angle += (gyro - bias) * dt
+//  error = accelAngle - angle
+//  angle += K0 * error
+//  bias  += K1 * error
+//With K1 = 0 this is the complementary filter in the README with C = 1 - K0. With K0 and K1 set to the
+//steady-state gains of a 2-state (angle, bias) Kalman filter it is that Kalman filter, because with a constant
+//sample period and noise model the Kalman gains converge to constants. The gains are calculated in floating
+//point when the filter is configured; update() uses only integer operations so it can run in a high-rate task.
+//
+//Angles are in units of 2^-24 rad (ANGLE_ONE per radian) and rates in 2^-24 rad/s
+class tilt_estimator {
+
+public:
+
+    static const int ANGLE_SHIFT = 24;
+    static const int32_t ANGLE_ONE = 1 << ANGLE_SHIFT;     //one radian
+    static const int GAIN_SHIFT = 30;                      //gains are in units of 2^-30
+
+    //Set the sample period (s) and the gyro scale (rad/s per LSB). Starts as a complementary filter with a
+    //0.5 s time constant
+    tilt_estimator(float samplePeriod, float gyroRadPerLsb) : dt(samplePeriod) {
+        gyroScale = static_cast<int32_t>(lround(gyroRadPerLsb * 4294967296.0));   //2^-32 rad/s per LSB
+        dtGain = static_cast<int32_t>(lround(samplePeriod * (1 << GAIN_SHIFT)));
+        setComplementary(0.5);
+    }
+
+    //Complementary filter with the given time constant (s). Gyro bias is not estimated
+    void setComplementary(float timeConstant) {
+        k0 = toGain(dt / (timeConstant + dt));
+        k1 = 0;
+        bias = 0;
+    }
+
+    //Steady-state Kalman filter for the angle and gyro bias.
+    //qAngle and qBias are the process noise densities of the angle (rad^2/s) and the bias (rad^2/s^3),
+    //rMeasure is the variance of the accelerometer angle (rad^2)
+    void setKalman(float qAngle, float qBias, float rMeasure) {
+        //Iterate the Riccati equation until the covariance converges
+        double p00 = 0, p01 = 0, p11 = 0, g0 = 0, g1 = 0;
+        for (int i = 0; i < 100000; i++) {
+            //Predict: F = [1 -dt; 0 1], Q = diag(qAngle, qBias) * dt
+            double a00 = p00 - dt * (p01 + p01) + dt * dt * p11 + qAngle * dt;
+            double a01 = p01 - dt * p11;
+            double a11 = p11 + qBias * dt;
+
+            //Update: H = [1 0]
+            double s = a00 + rMeasure;
+            double n0 = a00 / s;
+            double n1 = a01 / s;
+            p00 = a00 - n0 * a00;
+            p01 = a01 - n0 * a01;
+            p11 = a11 - n1 * a01;
+
+            if (fabs(n0 - g0) < 1e-12 && fabs(n1 - g1) < 1e-12)
+                break;
+            g0 = n0;
+            g1 = n1;
+        }
+        k0 = toGain(g0);
+        k1 = toGain(g1);
+    }
+
+    //Set the angle from the accelerometer alone, for the first sample
+    void reset(int16_t accelForward, int16_t accelUp) {
+        angle = atan2Angle(accelForward, accelUp);
+        rate = 0;
+    }
+
+    //Add one sample: the acceleration component along the direction of travel, the component along the
+    //upright axis of the robot and the gyro rate about the wheel axis, all in raw sensor units.
+    //Positive rate must increase the angle
+    void update(int16_t accelForward, int16_t accelUp, int16_t gyroRate) {
+        rate = static_cast<int32_t>((static_cast<int64_t>(gyroRate) * gyroScale) >> (32 - ANGLE_SHIFT)) - bias;
+        angle += static_cast<int32_t>((static_cast<int64_t>(rate) * dtGain) >> GAIN_SHIFT);
+
+        int32_t error = atan2Angle(accelForward, accelUp) - angle;
+        angle += static_cast<int32_t>((static_cast<int64_t>(error) * k0) >> GAIN_SHIFT);
+        bias += static_cast<int32_t>((static_cast<int64_t>(error) * k1) >> GAIN_SHIFT);
+    }
+
+    //Tilt angle in 2^-24 rad
+    int32_t getAngle() const {
+        return angle;
+    }
+
+    //Bias-corrected tilt rate in 2^-24 rad/s, for the derivative term of a controller
+    int32_t getRate() const {
+        return rate;
+    }
+
+    //Estimated gyro bias in 2^-24 rad/s
+    int32_t getBias() const {
+        return bias;
+    }
+
+    //Tilt angle in rad
+    float getAngleRad() const {
+        return static_cast<float>(angle) / ANGLE_ONE;
+    }
+
+    //Tilt rate in rad/s
+    float getRateRad() const {
+        return static_cast<float>(rate) / ANGLE_ONE;
+    }
+
+    //Angle of the vector (x, y) from the y axis in 2^-24 rad, to about 0.1°.
+    //Uses one division and the approximation atan(r) = πr/4 - r(r - 1)(0.2447 + 0.0663r) for 0 <= r <= 1
+    static int32_t atan2Angle(int32_t x, int32_t y) {
+        const int32_t QUARTER_PI = 25736;   //π/4 in 2^-15
+        const int32_t HALF_PI_ANGLE = static_cast<int32_t>(M_PI / 2 * ANGLE_ONE);
+        const int32_t PI_ANGLE = static_cast<int32_t>(M_PI * ANGLE_ONE);
+
+        int32_t ax = x < 0 ? -x : x;
+        int32_t ay = y < 0 ? -y : y;
+        if (ax == 0 && ay == 0)
+            return 0;
+
+        //Ratio of the smaller to the larger component in 2^-15
+        bool steep = ax > ay;
+        int32_t r = steep ? (ay << 15) / ax : (ax << 15) / ay;
+        int32_t poly = 8018 + ((2172 * r) >> 15);           //0.2447 + 0.0663r
+        int32_t a = ((QUARTER_PI * r) >> 15) - ((((r * (r - 32768)) >> 15) * poly) >> 15);
+        a <<= ANGLE_SHIFT - 15;
+
+        if (steep)
+            a = HALF_PI_ANGLE - a;
+        if (y < 0)
+            a = PI_ANGLE - a;
+        return x < 0 ? -a : a;
+    }
+
+    private:
+
+    float dt;                   //sample period (s)
+    int32_t gyroScale;          //gyro scale (2^-32 rad/s per LSB)
+    int32_t dtGain;             //sample period (2^-30 s)
+    int32_t k0 = 0;             //angle gain (2^-30)
+    int32_t k1 = 0;             //bias gain (2^-30 rad/s per rad of error)
+    int32_t angle = 0;          //tilt angle (2^-24 rad)
+    int32_t rate = 0;           //corrected tilt rate (2^-24 rad/s)
+    int32_t bias = 0;           //gyro bias (2^-24 rad/s)
+
+    static int32_t toGain(double g) {
+        return static_cast<int32_t>(lround(g * (1 << GAIN_SHIFT)));
+    }
+};
+
+#endif
@@ -0,0 +1,197 @@
+//Host tests of battery.h: charge and energy counted from a constant discharge, current through a converter,
+//the voltage model correcting a wrong starting charge, a new battery replacing the saved counters, running
+//without a battery, and remaining energy.
+//Run with: pio test -e native
+
+#include <battery.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+const double ADC_VOLTS = 4.096 / 4096 / 16;     //per unit of the averaged readings
+const double DIVIDER = 3.0;
+const double MOTOR_GAIN = 1.0;                  //V/A
+const double LOGIC_GAIN = 0.1;
+const double ZERO = 1.25;                       //V
+const double CAPACITY = 2.0;                    //Ah
+const int CELLS = 6;
+const double RESISTANCE = 0.15;                 //Ω
+const double BLOCK_HZ = 100;                    //ADC blocks per second
+const double PC_PER_MAH = 3.6e12;
+
+//Battery discharged at set currents, producing the ADC readings of its voltage and current
+struct battery_model {
+    battery_meter meter{static_cast<float>(ADC_VOLTS), static_cast<float>(CAPACITY), CELLS,
+                        static_cast<float>(RESISTANCE)};
+    double soc;                         //true state of charge
+    double motor = 0, logic = 0;        //A
+    double charge = 0, energy = 0;      //drawn (mAh, J)
+    uint32_t time = 0;                  //μs
+    bool connected = true;
+
+    explicit battery_model(double initialSoc, float timeConstant = 0) : soc(initialSoc) {
+        meter.setVoltage(0, DIVIDER);
+        meter.addCurrent(1, MOTOR_GAIN, ZERO);
+        meter.setModelTimeConstant(timeConstant);
+    }
+
+    //Open-circuit voltage of the pack
+    double openVoltage() const {
+        double position = std::min(std::max(soc, 0.0), 1.0) * (battery_meter::MODEL_POINTS - 1);
+        int i = std::min(static_cast<int>(position), battery_meter::MODEL_POINTS - 2);
+        double f = position - i;
+        return CELLS * (NIMH_CELL_VOLTS[i] + f * (NIMH_CELL_VOLTS[i + 1] - NIMH_CELL_VOLTS[i]));
+    }
+
+    double batteryCurrent() const {
+        return motor + logic;
+    }
+
+    double terminalVoltage() const {
+        return connected ? openVoltage() - batteryCurrent() * RESISTANCE : 0;
+    }
+
+    //Run for a time, one ADC block every 10 ms
+    void run(double seconds) {
+        for (long n = lround(seconds * BLOCK_HZ); n > 0; n--) {
+            double dt = 1 / BLOCK_HZ;
+            double v = terminalVoltage();
+            if (connected) {
+                soc -= batteryCurrent() * dt / 3600 / CAPACITY;
+                charge += batteryCurrent() * dt / 3.6;
+                energy += batteryCurrent() * v * dt;
+            }
+            time += 10000;
+            uint16_t values[8] = {};
+            values[0] = lround(v / DIVIDER / ADC_VOLTS);
+            values[1] = lround((ZERO + motor * MOTOR_GAIN) / ADC_VOLTS);
+            values[2] = lround((ZERO + logic * LOGIC_GAIN) / ADC_VOLTS);
+            meter.update(time, values);
+        }
+    }
+
+    double meterSoc() const {
+        return meter.read().stateOfCharge / 65536.0;
+    }
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+//Counting alone: a steady discharge must add up to the charge and energy drawn
+void test_count() {
+    battery_model b(0.9);
+    b.run(0.1);
+    double startSoc = b.meterSoc();
+    b.charge = b.energy = 0;
+    battery_counters start = b.meter.read().counters;
+    b.motor = 1.5;
+    b.run(600);
+    battery_status s = b.meter.read();
+    double charge = (s.counters.charge - start.charge) / PC_PER_MAH;
+    double energy = (s.counters.energy - start.energy) * 1e-12;
+    char msg[160];
+    snprintf(msg, sizeof(msg),
+             "charge %.3f mAh (true %.3f), energy %.2f J (true %.2f), %.1f%% to %.1f%%, %.3f V, %.0f mW", charge,
+             b.charge, energy, b.energy, startSoc * 100, b.meterSoc() * 100, s.voltage / 1000.0,
+             static_cast<double>(s.power));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(s.present);
+    TEST_ASSERT_FLOAT_WITHIN(b.charge * 1e-3, b.charge, charge);
+    TEST_ASSERT_FLOAT_WITHIN(b.energy * 1e-3, b.energy, energy);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 1.5, s.current * 1e-6);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, b.charge / 2000, startSoc - b.meterSoc());
+}
+
+//Current from the 5 V converter is converted to battery current from the power it delivers
+void test_converter() {
+    battery_model b(0.8);
+    b.meter.addCurrent(2, LOGIC_GAIN, ZERO, 5.0, 0.85);
+    b.logic = 1.0;
+    b.run(1);
+    battery_status s = b.meter.read();
+    double expected = 5.0 / 0.85 / (s.voltage / 1000.0);
+    TEST_ASSERT_FLOAT_WITHIN(5e-3, expected, s.current * 1e-6);
+}
+
+//A starting charge that is wrong by 25% is corrected towards the voltage over the time constant
+void test_model() {
+    battery_model b(0.5, 600);
+    battery_counters wrong = {0, 0, static_cast<int64_t>(0.75 * CAPACITY * 3.6e15)};
+    b.meter.restore(wrong);
+    b.motor = 0.5;
+    b.run(1200);
+    double error = b.meterSoc() - b.soc;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "state of charge %.3f, true %.3f after 1200 s", b.meterSoc(), b.soc);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_FLOAT_WITHIN(0.25 * exp(-2) + 0.02, 0, error);
+    TEST_ASSERT_GREATER_THAN(0, error);
+}
+
+//Counters saved for a nearly flat battery are discarded when a full one is connected
+void test_swap() {
+    battery_model b(1.0);
+    battery_counters old = {static_cast<int64_t>(1600 * PC_PER_MAH), 1000000000000000LL,
+                            static_cast<int64_t>(0.2 * CAPACITY * 3.6e15)};
+    b.meter.restore(old);
+    b.run(0.1);
+    battery_status s = b.meter.read();
+    TEST_ASSERT_TRUE(s.counters.charge == 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, 1.0, b.meterSoc());
+
+    //Counters that agree with the voltage are kept
+    battery_model c(0.6);
+    battery_counters close = {static_cast<int64_t>(800 * PC_PER_MAH), 0,
+                              static_cast<int64_t>(0.5 * CAPACITY * 3.6e15)};
+    c.meter.restore(close);
+    c.run(0.1);
+    TEST_ASSERT_TRUE(c.meter.read().counters.charge == close.charge);
+}
+
+//On the bypass supply the counters stop, and start again when the battery is connected
+void test_absent() {
+    battery_model b(0.7);
+    b.connected = false;
+    b.motor = 1;
+    b.run(10);
+    battery_status s = b.meter.read();
+    TEST_ASSERT_FALSE(s.present);
+    TEST_ASSERT_TRUE(s.counters.charge == 0);
+
+    b.connected = true;
+    b.run(10);
+    s = b.meter.read();
+    TEST_ASSERT_TRUE(s.present);
+    TEST_ASSERT_FLOAT_WITHIN(b.charge * 0.01, b.charge, s.counters.charge / PC_PER_MAH);
+}
+
+//Remaining energy is the charge left times the model voltage
+void test_remaining_energy() {
+    double full = 0;
+    for (int i = 1; i < battery_meter::MODEL_POINTS; i++)
+        full += CAPACITY * 3600 / 10 * CELLS * (NIMH_CELL_VOLTS[i - 1] + NIMH_CELL_VOLTS[i]) / 2;
+
+    battery_model b(1.0);
+    b.run(0.1);
+    TEST_ASSERT_FLOAT_WITHIN(full * 0.01, full, b.meter.read().remainingEnergy / 1000.0);
+    battery_model e(0.02);
+    e.run(0.1);
+    double lowVolts = CELLS * (NIMH_CELL_VOLTS[0] + 0.1 * (NIMH_CELL_VOLTS[1] - NIMH_CELL_VOLTS[0]));
+    double low = 0.02 * CAPACITY * 3600 * lowVolts;
+    TEST_ASSERT_FLOAT_WITHIN(full * 0.01, low, e.meter.read().remainingEnergy / 1000.0);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_count);
+    RUN_TEST(test_converter);
+    RUN_TEST(test_model);
+    RUN_TEST(test_swap);
+    RUN_TEST(test_absent);
+    RUN_TEST(test_remaining_energy);
+    return UNITY_END();
+}
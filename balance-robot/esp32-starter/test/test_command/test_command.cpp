@@ -0,0 +1,310 @@
+//Host tests of command.h, host/robot_link.h and remote_motion.h: round trips of each command type, rejection of
+//corrupted, malformed and out-of-range commands, duplicates and lost commands, resynchronisation after noise,
+//acknowledgements picked out of the telemetry stream, the move profile, and parsing time per frame, which is
+//reported but not tested.
+//Run with: pio test -e native
+
+#include <command.h>
+#include <cycle_count.h>
+#include <remote_motion.h>
+#include <robot_link.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+const float MICROSTEP = 0.045 * 2 * M_PI / 3200;    //wheel travel per microstep (m)
+const float TRACK_WIDTH = 0.16;             //m
+const float RATE_HZ = 1000;                 //control rate
+
+static std::vector<uint8_t> encode(const command& c) {
+    uint8_t frame[FRAME_MAX_ENCODED];
+    size_t n = encodeCommand(c, frame);
+    return std::vector<uint8_t>(frame, frame + n);
+}
+
+//Frame a raw payload, for commands that encodeCommand() would not produce
+static std::vector<uint8_t> encodeRaw(std::vector<uint8_t> payload) {
+    uint8_t frame[FRAME_MAX_ENCODED];
+    size_t n = encodeFrame(payload.data(), payload.size(), frame);
+    return std::vector<uint8_t>(frame, frame + n);
+}
+
+static command make(command_type type, uint16_t sequence) {
+    command c = {};
+    c.type = type;
+    c.sequence = sequence;
+    return c;
+}
+
+//Feed bytes to a parser and collect the results of the complete frames
+static std::vector<command_result> parse(command_parser& parser, const std::vector<uint8_t>& bytes) {
+    std::vector<command_result> results;
+    for (uint8_t b : bytes)
+        if (parser.push(b))
+            results.push_back(parser.result());
+    return results;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+//Every command type must arrive with its record intact
+void test_round_trip() {
+    command_parser parser;
+    command c = make(COMMAND_VELOCITY, 1);
+    c.velocity = {-32768, 1 << 20};
+    TEST_ASSERT_EQUAL(1, parse(parser, encode(c)).size());
+    TEST_ASSERT_EQUAL(COMMAND_OK, parser.result());
+    TEST_ASSERT_EQUAL(COMMAND_VELOCITY, parser.get().type);
+    TEST_ASSERT_EQUAL_INT32(-32768, parser.get().velocity.speed);
+    TEST_ASSERT_EQUAL_INT32(1 << 20, parser.get().velocity.turn);
+
+    c = make(COMMAND_MOVE, 2);
+    c.move = {65536, -102944, 19661, 32768};
+    parse(parser, encode(c));
+    TEST_ASSERT_EQUAL(COMMAND_OK, parser.result());
+    TEST_ASSERT_EQUAL_MEMORY(&c.move, &parser.get().move, sizeof(c.move));
+
+    c = make(COMMAND_GAINS, 3);
+    c.gains = {650, 100, 55, 0.0054f, 0.0014f};
+    parse(parser, encode(c));
+    TEST_ASSERT_EQUAL(COMMAND_OK, parser.result());
+    TEST_ASSERT_EQUAL_MEMORY(&c.gains, &parser.get().gains, sizeof(c.gains));
+
+    for (command_type type : {COMMAND_STOP, COMMAND_HEARTBEAT}) {
+        c = make(type, parser.get().sequence + 1);
+        parse(parser, encode(c));
+        TEST_ASSERT_EQUAL(COMMAND_OK, parser.result());
+        TEST_ASSERT_EQUAL(type, parser.get().type);
+        TEST_ASSERT_EQUAL_UINT16(c.sequence, parser.get().sequence);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, parser.getErrors());
+    TEST_ASSERT_EQUAL_UINT32(0, parser.getLost());
+}
+
+//Corrupted frames are dropped; unknown types, wrong lengths and out-of-range records are reported
+void test_rejected() {
+    command_parser parser;
+    command c = make(COMMAND_VELOCITY, 1);
+    c.velocity = {1000, 2000};
+    std::vector<uint8_t> frame = encode(c);
+    frame[4] ^= 0x10;
+    TEST_ASSERT_EQUAL(0, parse(parser, frame).size());
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getErrors());
+
+    TEST_ASSERT_EQUAL(COMMAND_BAD_TYPE, parse(parser, encodeRaw({9, 2, 0})).at(0));
+    TEST_ASSERT_EQUAL(COMMAND_BAD_LENGTH, parse(parser, encodeRaw({COMMAND_VELOCITY, 3, 0, 1, 2, 3, 4})).at(0));
+    TEST_ASSERT_EQUAL(COMMAND_BAD_LENGTH, parse(parser, encodeRaw({COMMAND_STOP, 4, 0, 0})).at(0));
+
+    c = make(COMMAND_MOVE, 5);
+    c.move = {65536, 0, 0, 65536};
+    TEST_ASSERT_EQUAL(COMMAND_BAD_VALUE, parse(parser, encode(c)).at(0));
+    c = make(COMMAND_GAINS, 6);
+    c.gains = {650, 100, NAN, 0, 0};
+    TEST_ASSERT_EQUAL(COMMAND_BAD_VALUE, parse(parser, encode(c)).at(0));
+    c.gains.tiltKd = -1;
+    c.sequence = 7;
+    TEST_ASSERT_EQUAL(COMMAND_BAD_VALUE, parse(parser, encode(c)).at(0));
+
+    //Gains too small for the controller's fixed point are rejected, but a loop may be switched off
+    c.gains = {1, 0, 0.001f, 0.0054f, 0.0014f};
+    c.sequence = 8;
+    TEST_ASSERT_EQUAL(COMMAND_BAD_VALUE, parse(parser, encode(c)).at(0));
+    c.gains = {0, 0, 0, 1e-7f, 0};
+    c.sequence = 9;
+    TEST_ASSERT_EQUAL(COMMAND_BAD_VALUE, parse(parser, encode(c)).at(0));
+    c.gains = {0, 10000, 0, 0, 0};
+    c.sequence = 10;
+    TEST_ASSERT_EQUAL(COMMAND_OK, parse(parser, encode(c)).at(0));
+
+    //Frames too short for a header are not commands
+    TEST_ASSERT_EQUAL(0, parse(parser, encodeRaw({COMMAND_STOP, 11})).size());
+}
+
+//A repeated sequence number is a duplicate; gaps count lost commands, across the wrap of the sequence number
+void test_sequence() {
+    command_parser parser;
+    command c = make(COMMAND_HEARTBEAT, 65533);
+    parse(parser, encode(c));
+    TEST_ASSERT_EQUAL(COMMAND_OK, parser.result());
+    parse(parser, encode(c));
+    TEST_ASSERT_EQUAL(COMMAND_DUPLICATE, parser.result());
+
+    c.sequence = 65535;
+    parse(parser, encode(c));
+    TEST_ASSERT_EQUAL(COMMAND_OK, parser.result());
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getLost());
+
+    c.sequence = 3;
+    parse(parser, encode(c));
+    TEST_ASSERT_EQUAL(COMMAND_OK, parser.result());
+    TEST_ASSERT_EQUAL_UINT32(4, parser.getLost());
+
+    //A retry of a command that was out of range is still a duplicate
+    c = make(COMMAND_MOVE, 4);
+    parse(parser, encode(c));
+    TEST_ASSERT_EQUAL(COMMAND_BAD_VALUE, parser.result());
+    parse(parser, encode(c));
+    TEST_ASSERT_EQUAL(COMMAND_DUPLICATE, parser.result());
+}
+
+//Commands following random noise on the line must be received once the noise ends with a delimiter
+void test_resync() {
+    command_parser parser;
+    uint32_t state = 99;
+    std::vector<uint8_t> bytes;
+    for (int i = 0; i < 1000; i++) {
+        state = state * 1664525u + 1013904223u;
+        bytes.push_back(state >> 24);
+    }
+    bytes.push_back(0);
+    for (uint16_t s = 1; s <= 10; s++) {
+        std::vector<uint8_t> frame = encode(make(COMMAND_HEARTBEAT, s));
+        bytes.insert(bytes.end(), frame.begin(), frame.end());
+    }
+    std::vector<command_result> results = parse(parser, bytes);
+    int ok = std::count(results.begin(), results.end(), COMMAND_OK);
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%d frames rejected in the noise", static_cast<int>(parser.getErrors()));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_GREATER_OR_EQUAL(10, ok);
+    TEST_ASSERT_EQUAL_UINT16(10, parser.get().sequence);
+}
+
+//Commands from robot_link must parse on the robot, and acknowledgements must be found among other records
+void test_host_link() {
+    int toRobot[2], fromRobot[2];
+    TEST_ASSERT_EQUAL(0, pipe(toRobot));
+    TEST_ASSERT_EQUAL(0, pipe(fromRobot));
+    robot_link sender(toRobot[1]);
+    robot_link receiver(fromRobot[0]);
+    int others = 0;
+    receiver.setHandler([&](uint8_t type, const uint8_t *, size_t) { others += type == TELEMETRY_POSE; });
+
+    int s1 = sender.velocity(0.25, -1.5);
+    int s2 = sender.move(1.0, M_PI / 2, 0.4, 0.8);
+    TEST_ASSERT_EQUAL(s1, sender.resend() - 1);
+    uint8_t bytes[256];
+    ssize_t n = read(toRobot[0], bytes, sizeof(bytes));
+    command_parser parser;
+    std::vector<command> received;
+    for (ssize_t i = 0; i < n; i++)
+        if (parser.push(bytes[i]))
+            received.push_back(parser.get());
+    TEST_ASSERT_EQUAL(3, received.size());
+    TEST_ASSERT_EQUAL(COMMAND_DUPLICATE, parser.result());
+    TEST_ASSERT_EQUAL_INT32(16384, received[0].velocity.speed);
+    TEST_ASSERT_EQUAL_INT32(-98304, received[0].velocity.turn);
+    TEST_ASSERT_EQUAL_UINT16(s2, received[1].sequence);
+    TEST_ASSERT_EQUAL_INT32(102944, received[1].move.angle);
+
+    //The robot sends a pose, an older acknowledgement and then the one being waited for
+    std::vector<uint8_t> stream;
+    uint8_t telemetrySequence = 0;
+    auto send = [&](uint8_t type, const void *record, size_t length) {
+        std::vector<uint8_t> payload = {type, telemetrySequence++};
+        payload.insert(payload.end(), static_cast<const uint8_t *>(record),
+                       static_cast<const uint8_t *>(record) + length);
+        std::vector<uint8_t> frame = encodeRaw(payload);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    };
+    telemetry_pose p = {};
+    telemetry_ack a1 = {100, static_cast<uint16_t>(s1), COMMAND_VELOCITY, COMMAND_OK};
+    telemetry_ack a2 = {200, static_cast<uint16_t>(s2), COMMAND_MOVE, COMMAND_OK};
+    send(TELEMETRY_POSE, &p, sizeof(p));
+    send(TELEMETRY_ACK, &a1, sizeof(a1));
+    send(TELEMETRY_ACK, &a2, sizeof(a2));
+    TEST_ASSERT_EQUAL(stream.size(), write(fromRobot[1], stream.data(), stream.size()));
+
+    telemetry_ack ack;
+    TEST_ASSERT_TRUE(receiver.waitAck(s2, ack, 100));
+    TEST_ASSERT_EQUAL_UINT32(200, ack.time);
+    TEST_ASSERT_EQUAL(COMMAND_MOVE, ack.type);
+    TEST_ASSERT_EQUAL(1, others);
+    TEST_ASSERT_FALSE(receiver.readAck(ack, 10));
+    for (int fd : {toRobot[0], toRobot[1], fromRobot[0], fromRobot[1]})
+        close(fd);
+}
+
+//A move must add up to its distance and angle, within the speed and acceleration limits of the faster wheel
+void test_remote_move() {
+    const float distance = 0.6, angle = -M_PI / 2, maxSpeed = 0.4, maxAccel = 1.5;
+    remote_motion remote(MICROSTEP, TRACK_WIDTH, 1 / RATE_HZ);
+    remote.move(distance, angle, maxSpeed, maxAccel);
+    double centre = 0, turn = 0, fastest = 0, lastWheel = 0, accel = 0;
+    int periods = 0;
+    while (remote.isMoving() && periods < 100000) {
+        remote.update();
+        centre += remote.getSpeed() / RATE_HZ;
+        turn += remote.getTurn() / RATE_HZ;
+        double wheel = fabs(remote.getSpeed()) + fabs(remote.getTurn());
+        fastest = std::max(fastest, wheel);
+        if (remote.isMoving())
+            accel = std::max(accel, fabs(wheel - lastWheel) * RATE_HZ);
+        lastWheel = wheel;
+        periods++;
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%.3f s: %.5f m, %.5f rad, fastest wheel %.4f m/s, largest acceleration %.3f m/s/s",
+             periods / RATE_HZ, centre * MICROSTEP, turn * MICROSTEP * 2 / TRACK_WIDTH, fastest * MICROSTEP,
+             accel * MICROSTEP);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_FALSE(remote.isMoving());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, distance, centre * MICROSTEP);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, angle, turn * MICROSTEP * 2 / TRACK_WIDTH);
+    TEST_ASSERT_LESS_OR_EQUAL(maxSpeed * 1.0001, fastest * MICROSTEP);
+    TEST_ASSERT_LESS_OR_EQUAL(maxAccel * 1.02, accel * MICROSTEP);    //braking starts part way through a period
+
+    //The move finishes at rest, and a velocity command cancels a move
+    remote.update();
+    TEST_ASSERT_EQUAL_FLOAT(0, remote.getSpeed());
+    remote.move(1, 0, 0.5, 1);
+    remote.update();
+    remote.setVelocity(0.1, 0);
+    remote.update();
+    TEST_ASSERT_FALSE(remote.isMoving());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0.1, remote.getSpeed() * MICROSTEP);
+}
+
+//Time to parse each frame of a stream of the largest commands
+void test_parse_cost() {
+    std::vector<std::vector<uint8_t>> frames;
+    size_t bytes = 0;
+    for (uint16_t s = 1; s <= 2000; s++) {
+        command c = make(COMMAND_GAINS, s);
+        c.gains = {650, 100, 55, 0.0054f, s * 1e-4f};
+        frames.push_back(encode(c));
+        bytes += frames.back().size();
+    }
+    command_parser parser;
+    int parsed = 0;
+    std::vector<uint32_t> samples;
+    samples.reserve(frames.size());
+    for (const std::vector<uint8_t>& frame : frames) {
+        uint64_t c0 = cycles();
+        for (uint8_t b : frame)
+            parsed += parser.push(b);
+        samples.push_back(static_cast<uint32_t>(cycles() - c0));
+    }
+    char name[48];
+    snprintf(name, sizeof(name), "push() per %d byte frame", static_cast<int>(bytes / frames.size()));
+    char msg[128];
+    summariseCycles(samples, name, msg, sizeof(msg));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(2000, parsed);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_rejected);
+    RUN_TEST(test_sequence);
+    RUN_TEST(test_resync);
+    RUN_TEST(test_host_link);
+    RUN_TEST(test_remote_move);
+    RUN_TEST(test_parse_cost);
+    return UNITY_END();
+}
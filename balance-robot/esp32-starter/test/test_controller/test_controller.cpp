@@ -0,0 +1,257 @@
+//Host tests of controller.h: the PID building block on its own, then the cascaded balance controller closing
+//the loop around a simulated robot (host/pendulum.h) that stands up, tracks a speed and holds position.
+//Run with: pio test -e native
+//
+//The simulated sensors add noise to the true tilt and rate, and the wheel position is quantised to microsteps
+//and the wheel acceleration limited, as on the robot
+
+#include <controller.h>
+#include <cycle_count.h>
+#include <pendulum.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+const float DT = 0.001;                             //1 kHz control rate
+const int SUBSTEPS = 10;                            //model steps per control period
+const double MICROSTEP = 0.045 * 2 * M_PI / 3200;   //wheel travel per microstep (m), 45 mm wheel radius
+const double ANGLE_ONE = 1 << 24;
+const int32_t MAX_ACCEL = 200000;                   //microsteps/s/s
+const int32_t MAX_SPEED = 10000;                     //microsteps/s
+
+//Deterministic Gaussian noise
+static double gaussian() {
+    static uint32_t state = 12345;
+    auto uniform = [] {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0 / 16777216.0) + 1e-9;
+    };
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+//Gains for the model: the inner loop places the tilt poles at about 12 rad/s, the outer loop settles the speed
+//in a few seconds
+static void configure(balance_controller &c) {
+    c.setTiltGains(30 / MICROSTEP, 5 / MICROSTEP, 2.5 / MICROSTEP);
+    c.setSpeedGains(0.12 * MICROSTEP, 0.03 * MICROSTEP);
+}
+
+//Simulated robot under closed loop control
+struct closed_loop {
+    pendulum body;
+    balance_controller control;
+    double wheelSpeed = 0;          //microsteps/s
+
+    closed_loop() : control(DT, 0.3, MAX_ACCEL, MAX_SPEED) {
+        configure(control);
+    }
+
+    //Run for the given time, returning false if the robot falls
+    bool run(double seconds) {
+        for (long n = 0; n < seconds / DT; n++) {
+            int32_t tilt = static_cast<int32_t>(lround((body.angle + 0.002 * gaussian()) * ANGLE_ONE));
+            int32_t rate = static_cast<int32_t>(lround((body.rate + 0.01 * gaussian()) * ANGLE_ONE));
+            int32_t position = static_cast<int32_t>(floor(body.position / MICROSTEP));
+            double command = control.update(tilt, rate, position);
+
+            //The stepper ramps towards the command at its acceleration limit
+            for (int s = 0; s < SUBSTEPS; s++) {
+                double dt = DT / SUBSTEPS;
+                double change = fmax(-MAX_ACCEL * dt, fmin(MAX_ACCEL * dt, command - wheelSpeed));
+                wheelSpeed += change;
+                body.update(change / dt * MICROSTEP, dt);
+                body.speed = wheelSpeed * MICROSTEP;
+            }
+            if (body.fallen())
+                return false;
+        }
+        return true;
+    }
+};
+
+void setUp() {}
+void tearDown() {}
+
+//The integrator must not wind up while the output is saturated, so the output leaves the limit as soon as the
+//error changes sign
+void test_pid_windup() {
+    pid p(DT, -1000, 1000);
+    p.setGains(1, 10, 0);
+    for (int n = 0; n < 10000; n++)
+        TEST_ASSERT_EQUAL_INT32(1000, p.update(5000));
+    TEST_ASSERT_LESS_OR_EQUAL(1000, p.getIntegral());
+
+    int n = 0;
+    while (p.update(-100) >= 1000 && n < 1000)
+        n++;
+    TEST_ASSERT_LESS_THAN(10, n);
+}
+
+//The integrator must stop when it would drive a saturated output further, but keep going when the proportional
+//term alone saturates the output in the other direction
+void test_pid_integral() {
+    pid p(DT, -1000, 1000);
+    p.setGains(0, 100, 0);
+    for (int n = 0; n < 1000; n++)
+        p.update(2);
+    TEST_ASSERT_INT32_WITHIN(2, 200, p.getIntegral());
+    TEST_ASSERT_INT32_WITHIN(2, 200, p.update(0));
+}
+
+//Tiny gains with a wide output range must not shift the range out of 64 bits, whether the range is set before
+//or after the gains, and the integrator must keep its value when the range changes
+void test_pid_small_gains() {
+    const int32_t LIMIT = 2000000000;
+    pid p(DT, -LIMIT, LIMIT);
+    p.setGains(1e-9, 1, 0);
+    for (int n = 0; n < 3000; n++)
+        p.update(1000000000);
+    TEST_ASSERT_EQUAL_INT32(LIMIT, p.update(1000000000));
+    TEST_ASSERT_EQUAL_INT32(LIMIT, p.getIntegral());
+    for (int n = 0; n < 6000; n++)
+        p.update(-1000000000);
+    TEST_ASSERT_EQUAL_INT32(-LIMIT, p.update(-1000000000));
+
+    pid q(DT, -100, 100);
+    q.setGains(1e-9, 1, 0);
+    for (int n = 0; n < 1000; n++)
+        q.update(50);
+    TEST_ASSERT_INT32_WITHIN(1, 50, q.getIntegral());
+    q.setLimits(-LIMIT, LIMIT);
+    TEST_ASSERT_INT32_WITHIN(1, 50, q.getIntegral());
+    for (int n = 0; n < 3000; n++)
+        q.update(1000000000);
+    TEST_ASSERT_EQUAL_INT32(LIMIT, q.update(1000000000));
+}
+
+//The filtered derivative of a noisy ramp must settle on kd * slope, with less noise than the unfiltered one
+void test_pid_derivative() {
+    double sd[2];
+    for (int f = 0; f < 2; f++) {
+        pid p(DT, -1000000, 1000000, f ? 0.02 : 0);
+        p.setGains(0, 0, 0.1);
+        double sum = 0, sum2 = 0;
+        int count = 0;
+        for (int n = 0; n < 3000; n++) {
+            int32_t error = static_cast<int32_t>(lround(10.0 * n + 20 * gaussian()));   //10000 units/s
+            int32_t out = p.update(error);
+            if (n >= 1000) {
+                sum += out;
+                sum2 += static_cast<double>(out) * out;
+                count++;
+            }
+        }
+        double mean = sum / count;
+        sd[f] = sqrt(sum2 / count - mean * mean);
+        TEST_ASSERT_FLOAT_WITHIN(f ? 20 : 100, 1000, mean);
+    }
+    char msg[64];
+    snprintf(msg, sizeof(msg), "derivative noise %.1f unfiltered, %.1f filtered", sd[0], sd[1]);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(sd[0] / 4, sd[1]);
+}
+
+//The gain scale is interpolated from the measured speed
+void test_schedule() {
+    balance_controller c(DT, 0.3, MAX_ACCEL, MAX_SPEED);
+    configure(c);
+    const int32_t speeds[] = {0, 10000, 20000};
+    const float factors[] = {1.0, 1.5, 2.0};
+    c.setSchedule(speeds, factors, 3);
+
+    int32_t position = 0;
+    for (int n = 0; n < 500; n++) {
+        position -= 15;                     //15000 microsteps/s backwards
+        c.update(0, 0, position);
+    }
+    TEST_ASSERT_INT32_WITHIN(100, -15000, c.getSpeed());
+    TEST_ASSERT_INT32_WITHIN(1000, static_cast<int32_t>(1.75 * 65536), c.getGainScale());
+
+    for (int n = 0; n < 500; n++) {
+        position -= 40;
+        c.update(0, 0, position);
+    }
+    TEST_ASSERT_EQUAL_INT32(2 * 65536, c.getGainScale());
+}
+
+//Released at 0.15 rad, the robot must stand up and come to rest
+void test_balance() {
+    closed_loop robot;
+    robot.body.angle = 0.15;
+    TEST_ASSERT_TRUE(robot.run(8));
+    char msg[96];
+    snprintf(msg, sizeof(msg), "after 8 s: tilt %.4f rad, speed %.4f m/s, travel %.3f m",
+             robot.body.angle, robot.body.speed, robot.body.position);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0, robot.body.angle);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, 0, robot.body.speed);
+}
+
+//The robot must follow a speed command with gain scheduling active
+void test_speed_tracking() {
+    closed_loop robot;
+    const int32_t speeds[] = {0, 20000};
+    const float factors[] = {1.0, 1.3};
+    robot.control.setSchedule(speeds, factors, 2);
+    const double target = 0.5;              //m/s
+    robot.control.setTarget(static_cast<int32_t>(target / MICROSTEP));
+    TEST_ASSERT_TRUE(robot.run(8));
+    TEST_ASSERT_FLOAT_WITHIN(0.05 * target, target, robot.body.speed);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0, robot.body.angle);
+
+    robot.control.setTarget(0);
+    TEST_ASSERT_TRUE(robot.run(8));
+    TEST_ASSERT_FLOAT_WITHIN(0.02, 0, robot.body.speed);
+}
+
+//With position hold, the robot must return to where it started after a push
+void test_position_hold() {
+    closed_loop robot;
+    robot.control.setPositionGain(0.5);
+    TEST_ASSERT_TRUE(robot.run(2));
+    robot.body.rate = 0.5;                  //push
+    TEST_ASSERT_TRUE(robot.run(15));
+    char msg[64];
+    snprintf(msg, sizeof(msg), "position error after push %.4f m", robot.body.position);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, 0, robot.body.position);
+}
+
+void test_update_cost() {
+    balance_controller c(DT, 0.3, MAX_ACCEL, MAX_SPEED);
+    configure(c);
+    const int32_t speeds[] = {0, 10000, 20000};
+    const float factors[] = {1.0, 1.5, 2.0};
+    c.setSchedule(speeds, factors, 3);
+    c.setPositionGain(0.5);
+    const int updates = 1000000;
+
+    int32_t sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    for (int n = 0; n < updates; n++)
+        sink += c.update((n & 1023) << 10, (n & 511) << 12, n >> 4);
+    uint64_t c1 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%.1f cycles, %.2f ns per update (%d)", static_cast<double>(c1 - c0) / updates,
+             std::chrono::duration<double, std::nano>(t1 - t0).count() / updates, sink);
+    TEST_MESSAGE(msg);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pid_windup);
+    RUN_TEST(test_pid_integral);
+    RUN_TEST(test_pid_small_gains);
+    RUN_TEST(test_pid_derivative);
+    RUN_TEST(test_schedule);
+    RUN_TEST(test_balance);
+    RUN_TEST(test_speed_tracking);
+    RUN_TEST(test_position_hold);
+    RUN_TEST(test_update_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,231 @@
+//Host tests of differential_drive.h: integer trig accuracy, wheels kept in step while driving straight, odometry
+//from pose.h on arcs and around a square of position moves, and ISR cost.
+//Run with: pio test -e native
+//DRIVE_MAX_CYCLES sets the limit on the 99.9th percentile of runSteppers() time
+
+#include <Arduino.h>
+#include <step.h>
+#include <cycle_count.h>
+#include <differential_drive.h>
+#include <fixed_trig.h>
+#include <pose.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#ifndef DRIVE_MAX_CYCLES
+#define DRIVE_MAX_CYCLES 400
+#endif
+
+HOST_ARDUINO_PINS
+
+const int INTERVAL_US = 20;
+const int TICKS_PER_SECOND = 1000000 / INTERVAL_US;
+const int ODOMETRY_TICKS = 50;              //odometry updated every 1 ms, as in the control task
+const int LEFT_STEP = 17, LEFT_DIR = 16, RIGHT_STEP = 14, RIGHT_DIR = 4;
+const float WHEEL_RADIUS = 0.045;           //m
+const float TRACK_WIDTH = 0.16;             //m
+
+//Robot with both steppers, the drive and wheel odometry
+struct robot {
+    step left{INTERVAL_US, LEFT_STEP, LEFT_DIR, step::DDA_MODE};
+    step right{INTERVAL_US, RIGHT_STEP, RIGHT_DIR, step::DDA_MODE};
+    differential_drive drive{left, right, WHEEL_RADIUS, TRACK_WIDTH};
+    pose_estimator odometry{drive.getMetresPerMicrostep(), TRACK_WIDTH};
+
+    robot() {
+        odometry.reset(drive.getLeftPosition(), drive.getRightPosition());
+    }
+
+    void updateOdometry() {
+        odometry.update(drive.getLeftPosition(), drive.getRightPosition());
+    }
+
+    //Run the ISR for a time, updating the odometry as the control task would
+    void run(float seconds) {
+        long ticks = lround(seconds * TICKS_PER_SECOND);
+        for (long t = 0; t < ticks; t++)
+            tick(t);
+    }
+
+    //Run until a move finishes
+    void finishMove() {
+        for (long t = 0; drive.isMoving() && t < 60L * TICKS_PER_SECOND; t++)
+            tick(t);
+        updateOdometry();
+    }
+
+    void tick(long t) {
+        drive.runSteppers();
+        if (t % ODOMETRY_TICKS == 0)
+            updateOdometry();
+    }
+};
+
+void setUp() {
+    for (int pin : {LEFT_STEP, LEFT_DIR, RIGHT_STEP, RIGHT_DIR})
+        hostPins[pin] = host_pin();
+}
+
+void tearDown() {}
+
+//sinBam and cosBam against the library functions over a sweep of whole turns, including the quadrant edges
+void test_trig() {
+    double worst = 0;
+    for (uint64_t a = 0; a < (1ull << 32); a += 0x10001) {
+        uint32_t angle = static_cast<uint32_t>(a);
+        double rad = angle * (2 * M_PI / 4294967296.0);
+        worst = std::max(worst, fabs(sinBam(angle) / static_cast<double>(TRIG_ONE) - sin(rad)));
+        worst = std::max(worst, fabs(cosBam(angle) / static_cast<double>(TRIG_ONE) - cos(rad)));
+    }
+    for (uint32_t angle : {0u, BAM_QUARTER, 2 * BAM_QUARTER, 3 * BAM_QUARTER, 0xFFFFFFFFu, BAM_QUARTER + 1,
+                           BAM_QUARTER - 1, 0x80000001u}) {
+        double rad = angle * (2 * M_PI / 4294967296.0);
+        worst = std::max(worst, fabs(sinBam(angle) / static_cast<double>(TRIG_ONE) - sin(rad)));
+    }
+    char msg[64];
+    snprintf(msg, sizeof(msg), "largest trig error %.2e", worst);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(2e-5, worst);
+    TEST_ASSERT_EQUAL_INT32(TRIG_ONE, sinBam(BAM_QUARTER));
+    TEST_ASSERT_EQUAL_INT32(-TRIG_ONE, sinBam(3 * BAM_QUARTER));
+}
+
+//Driving straight through a long series of speed changes, the wheels must stay in step so the heading and the
+//sideways position do not drift at all. A wheel may step one tick before the other when its phase lands
+//exactly on a step boundary
+void test_straight() {
+    robot r;
+    r.drive.setAcceleration(2, 20);
+    const float speeds[] = {0.3, 0.9, -0.2, 0.05, 1.2, -1.0, 0.45, 0};
+    int32_t maxDifference = 0;
+    for (int lap = 0; lap < 10; lap++) {
+        for (float v : speeds) {
+            r.drive.setVelocity(v, 0);
+            for (long t = 0; t < TICKS_PER_SECOND; t++) {
+                r.tick(t);
+                int32_t difference = r.left.getPosition() + r.right.getPosition();
+                maxDifference = std::max(maxDifference, abs(difference));
+            }
+        }
+    }
+    r.updateOdometry();
+    pose o = r.odometry.read();
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "after 80 s: x %.3f m, y %d, heading %u, wheel difference %d microsteps",
+             r.odometry.getX(), o.y, o.heading, maxDifference);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_OR_EQUAL(1, maxDifference);
+    TEST_ASSERT_EQUAL_INT32(0, r.left.getPosition() + r.right.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(0, o.heading);
+    TEST_ASSERT_EQUAL_INT32(0, o.y);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, r.left.getPosition() * r.drive.getMetresPerMicrostep(), r.odometry.getX());
+    TEST_ASSERT_EQUAL_INT32(o.x, o.distance);
+}
+
+//Constant speed and turn rate trace a circle. The odometry must agree with the geometry of the arc, including
+//after several full turns
+void test_arc() {
+    for (float omega : {1.0f, -2.5f}) {
+        robot r;
+        const float v = 0.4;
+        r.drive.setVelocity(v, omega);
+        r.run(10);
+        r.updateOdometry();
+
+        //The circle is fixed by the wheel positions, which the ISR ran exactly
+        double mps = r.drive.getMetresPerMicrostep();
+        double dl = r.left.getPosition() * mps, dr = -r.right.getPosition() * mps;
+        double heading = (dr - dl) / TRACK_WIDTH;
+        double radius = (dl + dr) / 2 / heading;
+        double x = radius * sin(heading), y = radius * (1 - cos(heading));
+        double wrapped = remainder(heading, 2 * M_PI);
+
+        char msg[160];
+        snprintf(msg, sizeof(msg), "turn %.1f rad/s: odometry %.4f, %.4f m, %.4f rad, arc %.4f, %.4f m, %.4f rad",
+                 omega, r.odometry.getX(), r.odometry.getY(), r.odometry.getHeading(), x, y, wrapped);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_FLOAT_WITHIN(1e-4, wrapped, r.odometry.getHeading());
+        TEST_ASSERT_FLOAT_WITHIN(2e-3, x, r.odometry.getX());
+        TEST_ASSERT_FLOAT_WITHIN(2e-3, y, r.odometry.getY());
+        TEST_ASSERT_FLOAT_WITHIN(0.01, v / omega, radius);
+    }
+}
+
+//Four sides and four quarter turns as position moves must bring the robot back to where it started
+void test_square() {
+    for (float jerk : {0.0f, 20.0f}) {
+        robot r;
+        for (int side = 0; side < 4; side++) {
+            r.drive.move(0.5, 0, 0.6, 1.5, jerk);
+            r.finishMove();
+            r.drive.move(0, M_PI / 2, 0.3, 1.5, jerk);
+            r.finishMove();
+        }
+        TEST_ASSERT_FALSE(r.drive.isMoving());
+
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s square: %.5f, %.5f m, %.5f rad", jerk > 0 ? "S-curve" : "trapezoid",
+                 r.odometry.getX(), r.odometry.getY(), r.odometry.getHeading());
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3, 0, r.odometry.getX());
+        TEST_ASSERT_FLOAT_WITHIN(1e-3, 0, r.odometry.getY());
+        TEST_ASSERT_FLOAT_WITHIN(2e-3, 0, r.odometry.getHeading());
+    }
+}
+
+//A velocity command during a move must cancel it and carry on from the move's speed without a jump
+void test_cancel() {
+    robot r;
+    r.drive.setAcceleration(1, 10);
+    r.drive.move(2, 0, 0.6, 1.5);
+    r.run(1);
+    TEST_ASSERT_TRUE(r.drive.isMoving());
+    float before = r.left.getSpeed();
+
+    r.drive.setVelocity(0, 0);
+    r.drive.runSteppers();
+    TEST_ASSERT_FALSE(r.drive.isMoving());
+    float after = r.left.getSpeed();
+    TEST_ASSERT_FLOAT_WITHIN(0.01 * fabsf(before), before, after);
+    r.run(1);
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, r.left.getSpeed());
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, r.right.getSpeed());
+}
+
+//Time per runSteppers() call while ramping velocity commands
+void test_isr_cost() {
+    robot r;
+    r.drive.setAcceleration(2, 20);
+    std::vector<uint32_t> samples;
+    samples.reserve(2000000);
+
+    for (int n = 0; n < 40; n++) {
+        r.drive.setVelocity(n & 1 ? -0.8 : 1.0, n & 2 ? 3 : -2);
+        for (int t = 0; t < TICKS_PER_SECOND; t++) {
+            uint64_t c0 = cycles();
+            r.drive.runSteppers();
+            samples.push_back(static_cast<uint32_t>(cycles() - c0));
+        }
+    }
+
+    char msg[128];
+    cycle_summary s = summariseCycles(samples, "runSteppers()", msg, sizeof(msg));
+    TEST_MESSAGE(msg);
+    if (s.max > 0)
+        TEST_ASSERT_LESS_THAN_MESSAGE(DRIVE_MAX_CYCLES, s.p999, msg);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_trig);
+    RUN_TEST(test_straight);
+    RUN_TEST(test_arc);
+    RUN_TEST(test_square);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_isr_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+//Host tests of frame.h: CRC check value, COBS round trips of random payloads, resynchronisation after
+//corrupted and truncated frames, and time per encoded byte.
+//Run with: pio test -e native
+
+#include <cycle_count.h>
+#include <frame.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static uint32_t state = 12345;
+static uint8_t randomByte() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 24;
+}
+
+//Random payload with plenty of zeros, which exercise the COBS blocks
+static std::vector<uint8_t> randomPayload(size_t length) {
+    std::vector<uint8_t> p(length);
+    for (uint8_t &b : p)
+        b = randomByte() < 64 ? 0 : randomByte();
+    return p;
+}
+
+static std::vector<uint8_t> encode(const std::vector<uint8_t> &payload) {
+    uint8_t frame[FRAME_MAX_ENCODED];
+    size_t n = encodeFrame(payload.data(), payload.size(), frame);
+    return std::vector<uint8_t>(frame, frame + n);
+}
+
+//Feed bytes to a decoder and collect the payloads of the valid frames
+static std::vector<std::vector<uint8_t>> decode(frame_decoder &d, const std::vector<uint8_t> &stream) {
+    std::vector<std::vector<uint8_t>> frames;
+    for (uint8_t b : stream)
+        if (d.push(b))
+            frames.emplace_back(d.data(), d.data() + d.length());
+    return frames;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_crc() {
+    const char *check = "123456789";
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(reinterpret_cast<const uint8_t *>(check), 9));
+}
+
+//Every length from empty to the maximum must survive a round trip, with no zeros before the delimiter
+void test_round_trip() {
+    for (size_t length = 0; length <= FRAME_MAX_PAYLOAD; length++) {
+        std::vector<uint8_t> payload = randomPayload(length);
+        std::vector<uint8_t> frame = encode(payload);
+        TEST_ASSERT_LESS_OR_EQUAL(FRAME_MAX_ENCODED, frame.size());
+        TEST_ASSERT_EQUAL_UINT8(0, frame.back());
+        for (size_t i = 0; i + 1 < frame.size(); i++)
+            TEST_ASSERT_NOT_EQUAL(0, frame[i]);
+
+        frame_decoder d;
+        std::vector<std::vector<uint8_t>> frames = decode(d, frame);
+        TEST_ASSERT_EQUAL(1, frames.size());
+        TEST_ASSERT_TRUE(frames[0] == payload);
+    }
+
+    uint8_t frame[FRAME_MAX_ENCODED];
+    uint8_t tooLong[FRAME_MAX_PAYLOAD + 1] = {};
+    TEST_ASSERT_EQUAL(0, encodeFrame(tooLong, sizeof(tooLong), frame));
+}
+
+//A damaged frame must be rejected without losing the next frame, and a receiver that starts mid-frame must
+//pick up from the next delimiter. A frame that loses its delimiter takes the following frame with it
+void test_resync() {
+    std::vector<uint8_t> a = randomPayload(40), b = randomPayload(40), c = randomPayload(40);
+    std::vector<uint8_t> fa = encode(a), fb = encode(b), fc = encode(c);
+
+    //Flip a bit in the middle frame
+    std::vector<uint8_t> stream(fa.begin() + 10, fa.end());
+    fb[20] ^= fb[20] == 0x01 ? 0x02 : 0x01;
+    stream.insert(stream.end(), fb.begin(), fb.end());
+    stream.insert(stream.end(), fa.begin(), fa.end());
+    //Drop the end of the next frame, including its delimiter
+    stream.insert(stream.end(), fa.begin(), fa.begin() + 15);
+    stream.insert(stream.end(), fc.begin(), fc.end());
+    stream.insert(stream.end(), fa.begin(), fa.end());
+
+    frame_decoder d;
+    std::vector<std::vector<uint8_t>> frames = decode(d, stream);
+    TEST_ASSERT_EQUAL(2, frames.size());
+    TEST_ASSERT_TRUE(frames[0] == a);
+    TEST_ASSERT_TRUE(frames[1] == a);
+    TEST_ASSERT_EQUAL_UINT32(3, d.getErrors());
+}
+
+//Random noise must not produce frames that pass the CRC more often than chance
+void test_noise() {
+    frame_decoder d;
+    int accepted = 0;
+    for (int i = 0; i < 1000000; i++)
+        if (d.push(randomByte() < 8 ? 0 : randomByte()) && d.length() > 0)
+            accepted++;
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%u frames rejected, %d accepted", d.getErrors(), accepted);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(5, accepted);
+}
+
+void test_cost() {
+    std::vector<uint8_t> payload = randomPayload(42);       //one control record with its header
+    uint8_t frame[FRAME_MAX_ENCODED];
+    frame_decoder d;
+    const int frames = 200000;
+    size_t n = 0, valid = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    for (int i = 0; i < frames; i++) {
+        payload[0] = i;
+        n = encodeFrame(payload.data(), payload.size(), frame);
+    }
+    uint64_t c1 = cycles();
+    for (int i = 0; i < frames; i++)
+        for (size_t j = 0; j < n; j++)
+            valid += d.push(frame[j]);
+    uint64_t c2 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%.1f cycles to encode, %.1f to decode a %zu byte frame (%.1f ns total)",
+             static_cast<double>(c1 - c0) / frames, static_cast<double>(c2 - c1) / frames, n,
+             std::chrono::duration<double, std::nano>(t1 - t0).count() / frames);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(frames, valid);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_crc);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_resync);
+    RUN_TEST(test_noise);
+    RUN_TEST(test_cost);
+    return UNITY_END();
+}
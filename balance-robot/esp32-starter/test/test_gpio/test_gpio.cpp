@@ -0,0 +1,139 @@
+//Host tests of step_gpio.h: pulses and direction on the pins match the step counts, both wheels step in the
+//same register write, every pulse meets the minimum high time and direction changes lead the next step.
+//Run with: pio test -e native
+
+#include <Arduino.h>
+#include <step.h>
+#include <step_gpio.h>
+#include <differential_drive.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+
+HOST_ARDUINO_PINS
+
+const int INTERVAL_US = 20;
+const int TICKS_PER_SECOND = 1000000 / INTERVAL_US;
+const int LEFT_STEP = 17, LEFT_DIR = 16, RIGHT_STEP = 14, RIGHT_DIR = 4;
+const uint32_t PULSE_NS = 1900;             //DRV8825 minimum high time
+
+typedef step_gpio<LEFT_STEP, LEFT_DIR, RIGHT_STEP, RIGHT_DIR> wheel_gpio;
+
+//Steppers, drive and outputs, with the position of each wheel counted from the pins
+struct robot {
+    step left{INTERVAL_US};
+    step right{INTERVAL_US};
+    differential_drive drive{left, right, 0.045, 0.16};
+    wheel_gpio output{left, right, PULSE_NS};
+    int32_t pinPosition[2] = {};
+    long ticks = 0;
+    long dirTick[2] = {-10, -10};           //tick of the last direction change
+    long minSetupTicks = 1000;              //fewest ticks from a direction change to the next step
+    uint32_t minHighCycles = UINT32_MAX;
+    long steps = 0, sharedWrites = 0;       //steps and steps of both wheels in the same write
+
+    robot() {
+        output.begin();
+    }
+
+    void run(float seconds) {
+        const uint8_t stepPins[2] = {LEFT_STEP, RIGHT_STEP}, dirPins[2] = {LEFT_DIR, RIGHT_DIR};
+        for (long end = ticks + lround(seconds * TICKS_PER_SECOND); ticks < end; ticks++) {
+            uint32_t rising[2] = {hostPins[LEFT_STEP].rising, hostPins[RIGHT_STEP].rising};
+            uint8_t dir[2] = {hostPins[LEFT_DIR].level, hostPins[RIGHT_DIR].level};
+            drive.runSteppers();
+            output.write();
+
+            bool stepped[2];
+            for (int m = 0; m < 2; m++) {
+                if (hostPins[dirPins[m]].level != dir[m])
+                    dirTick[m] = ticks;
+                stepped[m] = hostPins[stepPins[m]].rising != rising[m];
+                if (stepped[m]) {
+                    pinPosition[m] += hostPins[dirPins[m]].level ? 1 : -1;
+                    minSetupTicks = std::min(minSetupTicks, ticks - dirTick[m]);
+                    minHighCycles = std::min(minHighCycles, hostPins[stepPins[m]].highCycles);
+                    TEST_ASSERT_EQUAL_UINT8(LOW, hostPins[stepPins[m]].level);
+                    steps++;
+                }
+            }
+            if (stepped[0] && stepped[1] && hostPins[LEFT_STEP].riseCycle == hostPins[RIGHT_STEP].riseCycle)
+                sharedWrites++;
+        }
+    }
+};
+
+void setUp() {
+    for (int pin : {LEFT_STEP, LEFT_DIR, RIGHT_STEP, RIGHT_DIR})
+        hostPins[pin] = host_pin();
+    ESP.cycles = 0;
+}
+
+void tearDown() {}
+
+//Random speeds and turns in both directions: the pins must account for every step of both motors
+void test_positions() {
+    robot r;
+    r.drive.setAcceleration(3, 30);
+    srand(42);
+    for (int n = 0; n < 40; n++) {
+        r.drive.setVelocity((rand() % 2001 - 1000) / 1000.0f, (rand() % 2001 - 1000) / 200.0f);
+        r.run(0.25);
+    }
+    r.drive.setVelocity(0, 0);
+    r.run(1);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%ld steps, positions %d, %d, pins %d, %d", r.steps, r.left.getPosition(),
+             r.right.getPosition(), r.pinPosition[0], r.pinPosition[1]);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_GREATER_THAN(10000, r.steps);
+    TEST_ASSERT_EQUAL_INT32(r.left.getPosition(), r.pinPosition[0]);
+    TEST_ASSERT_EQUAL_INT32(r.right.getPosition(), r.pinPosition[1]);
+}
+
+//Every pulse must be high for at least the pulse time at the CPU clock, and each direction change must come at
+//least one tick before the next step
+void test_timing() {
+    robot r;
+    r.drive.setAcceleration(5, 50);
+    for (float v : {1.0f, -1.0f, 0.3f, -0.05f, 0.0f}) {
+        r.drive.setVelocity(v, v * 4);
+        r.run(0.5);
+    }
+
+    uint32_t required = (PULSE_NS * getCpuFrequencyMhz() + 999) / 1000;
+    char msg[128];
+    snprintf(msg, sizeof(msg), "shortest pulse %u cycles (need %u), shortest direction setup %ld ticks",
+             r.minHighCycles, required, r.minSetupTicks);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(required, r.output.getPulseCycles());
+    TEST_ASSERT_GREATER_OR_EQUAL(required, r.minHighCycles);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, r.minSetupTicks);
+}
+
+//Driving straight, the wheels step on the same ticks and both step pins must rise in the same register write
+void test_shared_write() {
+    robot r;
+    r.drive.setVelocity(0.8, 0);
+    r.run(2);
+    r.drive.setVelocity(-0.4, 0);
+    r.run(2);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%ld steps, %ld pairs in a shared write", r.steps, r.sharedWrites);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_GREATER_THAN(1000, r.steps);
+    TEST_ASSERT_EQUAL_INT32(r.steps / 2, r.sharedWrites);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_positions);
+    RUN_TEST(test_timing);
+    RUN_TEST(test_shared_write);
+    return UNITY_END();
+}
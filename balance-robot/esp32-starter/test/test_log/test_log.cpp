@@ -0,0 +1,173 @@
+//Host tests of the sensor log: log_buffers.h hand-over and drops, a producer and consumer on two threads, and the
+//end of a log image in log_records.h.
+//Run with: pio test -e native
+
+#include <log_buffers.h>
+#include <log_records.h>
+#include <unity.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+const uint32_t RECORDS = 8;
+typedef log_buffers<log_record, RECORDS> buffers_type;
+
+static log_record make(uint32_t n) {
+    log_record r = {};
+    r.time = n * 1000;
+    r.position[0] = n;
+    r.output = -static_cast<int32_t>(n);
+    return r;
+}
+
+//Take the buffer waiting for the consumer, if any, and append its records
+static void consume(buffers_type& b, std::vector<uint32_t>& received) {
+    uint32_t count;
+    const log_record *records = b.take(count);
+    if (records == nullptr)
+        return;
+    for (uint32_t i = 0; i < count; i++)
+        received.push_back(records[i].position[0]);
+    b.release();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+//A consumer that keeps up receives every record in order, the last ones with flush()
+void test_handover() {
+    static buffers_type b;
+    std::vector<uint32_t> received;
+    for (uint32_t n = 0; n < 30; n++) {
+        bool handed = b.add(make(n));
+        TEST_ASSERT_EQUAL((n + 1) % RECORDS == 0, handed);
+        consume(b, received);
+    }
+    TEST_ASSERT_TRUE(b.flush());
+    consume(b, received);
+    TEST_ASSERT_TRUE(b.flush());        //nothing left
+
+    TEST_ASSERT_EQUAL_UINT32(30, received.size());
+    for (uint32_t n = 0; n < received.size(); n++)
+        TEST_ASSERT_EQUAL_UINT32(n, received[n]);
+    TEST_ASSERT_EQUAL_UINT32(0, b.getDropped());
+}
+
+//While the consumer holds one buffer the producer fills the other, then drops records until it is released
+void test_drop() {
+    static buffers_type b;
+    std::vector<uint32_t> received;
+    uint32_t n = 0;
+    for (; n < RECORDS; n++)
+        b.add(make(n));
+    for (; n < 2 * RECORDS; n++)
+        TEST_ASSERT_FALSE(b.add(make(n)));
+    for (; n < 2 * RECORDS + 5; n++)
+        TEST_ASSERT_FALSE(b.add(make(n)));
+    TEST_ASSERT_EQUAL_UINT32(5, b.getDropped());
+    TEST_ASSERT_FALSE(b.flush());       //the consumer still has a buffer
+
+    //Releasing the first buffer lets the next record hand over the second
+    consume(b, received);
+    TEST_ASSERT_TRUE(b.add(make(n++)));
+    consume(b, received);
+    TEST_ASSERT_TRUE(b.flush());
+    consume(b, received);
+
+    TEST_ASSERT_EQUAL_UINT32(2 * RECORDS + 1, received.size());
+    for (uint32_t i = 0; i < 2 * RECORDS; i++)
+        TEST_ASSERT_EQUAL_UINT32(i, received[i]);
+    TEST_ASSERT_EQUAL_UINT32(2 * RECORDS + 5, received.back());
+}
+
+//A producer and a consumer on separate threads: every record arrives once and in order, or is counted as dropped
+void test_threads() {
+    static log_buffers<log_record, 64> b;
+    const uint32_t TOTAL = 2000000;
+    std::atomic<bool> done{false};
+    uint32_t received = 0, outOfOrder = 0;
+
+    std::thread consumer([&] {
+        int64_t last = -1;
+        while (true) {
+            bool finished = done.load();
+            uint32_t count;
+            const log_record *records;
+            while ((records = b.take(count)) != nullptr) {
+                for (uint32_t i = 0; i < count; i++) {
+                    int64_t n = records[i].position[0];
+                    if (n <= last || records[i].output != -n)
+                        outOfOrder++;
+                    last = n;
+                }
+                received += count;
+                b.release();
+            }
+            if (finished)
+                break;
+            std::this_thread::yield();
+        }
+    });
+
+    for (uint32_t n = 0; n < TOTAL; n++)
+        b.add(make(n));
+    while (!b.flush())
+        std::this_thread::yield();
+    done = true;
+    consumer.join();
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%u records received, %u dropped", received, b.getDropped());
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+    TEST_ASSERT_EQUAL_UINT32(TOTAL, received + b.getDropped());
+    TEST_ASSERT_TRUE(received > 0);
+}
+
+//A partition image ends at the first erased record, and only a matching header is accepted
+void test_image() {
+    const uint32_t WRITTEN = 100;
+    std::vector<uint8_t> image(sizeof(log_header) + 200 * sizeof(log_record), 0xff);
+    log_header h = {LOG_MAGIC, LOG_VERSION, sizeof(log_record), 1000, 5000, 1.0f / 16384, 1.3e-4f, 1.96e-3f, 2000};
+    memcpy(image.data(), &h, sizeof(h));
+    for (uint32_t n = 0; n < WRITTEN; n++) {
+        log_record r = make(n);
+        if (n == 50) {
+            memset(&r, 0xff, sizeof(r));        //all but one byte erased is still a record
+            reinterpret_cast<uint8_t *>(&r)[sizeof(r) - 1] = 0;
+        }
+        memcpy(image.data() + sizeof(h) + n * sizeof(log_record), &r, sizeof(r));
+    }
+
+    log_header read;
+    memcpy(&read, image.data(), sizeof(read));
+    TEST_ASSERT_TRUE(logHeaderValid(read));
+    uint32_t count = 0;
+    log_record r;
+    for (size_t offset = sizeof(h); offset + sizeof(r) <= image.size(); offset += sizeof(r)) {
+        memcpy(&r, image.data() + offset, sizeof(r));
+        if (logRecordErased(r))
+            break;
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(WRITTEN, count);
+
+    read.version = LOG_VERSION + 1;
+    TEST_ASSERT_FALSE(logHeaderValid(read));
+    log_header erased;
+    memset(&erased, 0xff, sizeof(erased));
+    TEST_ASSERT_FALSE(logHeaderValid(erased));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_handover);
+    RUN_TEST(test_drop);
+    RUN_TEST(test_threads);
+    RUN_TEST(test_image);
+    return UNITY_END();
+}
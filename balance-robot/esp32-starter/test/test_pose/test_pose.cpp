@@ -0,0 +1,143 @@
+//Host tests of pose.h: heading from the wheels over many turns, straight and curved paths, and gyro fusion through
+//a wheel slip and with gyro bias.
+//Run with: pio test -e native
+
+#include <pose.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdio>
+
+const float RATE_HZ = 1000;                 //control rate, and one gyro sample per update
+const float MICROSTEP = 0.045 * 2 * M_PI / 3200;    //wheel travel per microstep (m)
+const float TRACK_WIDTH = 0.16;             //m
+const float GYRO_RAD_PER_LSB = M_PI / 180 / 16.4;   //MPU6050 at 2000 degrees/s
+const float GYRO_TIME_CONSTANT = 2.0;       //s
+
+//Robot driven by wheel speeds, with the true heading kept separately so wheel slip can be simulated
+struct robot {
+    pose_estimator estimator{MICROSTEP, TRACK_WIDTH};
+    double left = 0, right = 0;             //wheel positions (microsteps)
+    double heading = 0;                     //true heading (rad)
+    double x = 0, y = 0;                    //true position (m)
+    double gyroBias = 0;                    //rad/s
+
+    robot(bool gyro) {
+        if (gyro)
+            estimator.setGyro(GYRO_RAD_PER_LSB, 1 / RATE_HZ, GYRO_TIME_CONSTANT, 1 / RATE_HZ);
+        estimator.reset(0, 0);
+    }
+
+    //Drive for a time with wheel speeds in microsteps/s
+    void drive(double leftSpeed, double rightSpeed, double seconds) {
+        for (long n = lround(seconds * RATE_HZ); n > 0; n--) {
+            double dl = leftSpeed / RATE_HZ, dr = rightSpeed / RATE_HZ;
+            double turn = (dr - dl) * MICROSTEP / TRACK_WIDTH;
+            double mid = heading + turn / 2;
+            x += (dl + dr) / 2 * MICROSTEP * cos(mid);
+            y += (dl + dr) / 2 * MICROSTEP * sin(mid);
+            heading += turn;
+            left += dl;
+            right += dr;
+            estimator.addYawRate(lround((turn * RATE_HZ + gyroBias) / GYRO_RAD_PER_LSB));
+            estimator.update(floor(left), floor(right));
+        }
+    }
+
+    //Heading error of the estimate (rad)
+    double headingError() const {
+        return remainder(estimator.getHeading() - heading, 2 * M_PI);
+    }
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+//Spinning on the spot for many turns: the heading must wrap around and stay within a microstep of the wheels
+void test_turns() {
+    robot r(false);
+    double worst = 0;
+    for (int i = 0; i < 100; i++) {
+        r.drive(-3000, 3000, 0.37);
+        worst = std::max(worst, fabs(r.headingError()));
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%.1f turns, largest heading error %.2e rad", r.heading / (2 * M_PI), worst);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_GREATER_THAN(15, r.heading / (2 * M_PI));
+    TEST_ASSERT_LESS_THAN(2 * MICROSTEP / TRACK_WIDTH, worst);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0, r.estimator.getX());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0, r.estimator.getY());
+}
+
+//A figure of eight of arcs and straights must be followed to within a few mm
+void test_path() {
+    robot r(false);
+    for (int lap = 0; lap < 3; lap++) {
+        r.drive(5000, 5000, 1);
+        r.drive(5000, 2500, 2.3);
+        r.drive(4000, 4000, 0.5);
+        r.drive(2500, 5000, 2.3);
+        r.drive(-3000, -3000, 0.7);
+    }
+    pose p = r.estimator.read();
+    char msg[128];
+    snprintf(msg, sizeof(msg), "estimate %.4f, %.4f m, %.4f rad, true %.4f, %.4f m, %.4f rad, distance %.3f m",
+             r.estimator.getX(), r.estimator.getY(), r.estimator.getHeading(), r.x, r.y,
+             remainder(r.heading, 2 * M_PI), p.distance / 65536.0);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_FLOAT_WITHIN(3e-3, r.x, r.estimator.getX());
+    TEST_ASSERT_FLOAT_WITHIN(3e-3, r.y, r.estimator.getY());
+    TEST_ASSERT_FLOAT_WITHIN(2 * MICROSTEP / TRACK_WIDTH, 0, r.headingError());
+    TEST_ASSERT_EQUAL_UINT32(r.estimator.getWheelHeading(), p.heading);
+    TEST_ASSERT_EQUAL_UINT32(lround(3 * 6.8 * RATE_HZ), p.sequence);
+}
+
+//A wheel slips by a centimetre while the robot stands still. Without the gyro the heading takes the whole error;
+//with it the error only builds up over the filter time constant
+void test_slip() {
+    const double slip = 0.01 / MICROSTEP;
+    const double wheelError = slip * MICROSTEP / TRACK_WIDTH;
+    double error[2];
+    for (bool gyro : {false, true}) {
+        robot r(gyro);
+        r.drive(0, 0, 0.1);
+        for (int n = 0; n < 20; n++) {
+            r.right += slip / 20;
+            r.drive(0, 0, 0.001);
+        }
+        r.drive(0, 0, 0.1);
+        error[gyro] = fabs(r.headingError());
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "heading error 0.1 s after a slip of %.3f rad: wheels %.4f rad, with gyro %.4f rad",
+             wheelError, error[0], error[1]);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, wheelError, error[0]);
+    TEST_ASSERT_LESS_THAN(0.1 * wheelError, error[1]);
+}
+
+//Gyro bias must not make the heading drift: the wheels hold it to bias times the time constant
+void test_gyro_bias() {
+    robot r(true);
+    r.gyroBias = 0.02;
+    double worst = 0;
+    for (int i = 0; i < 60; i++) {
+        r.drive(2000, i % 2 ? 3000 : -1000, 1);
+        worst = std::max(worst, fabs(r.headingError()));
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "bias %.3f rad/s: largest heading error %.4f rad after 60 s", r.gyroBias, worst);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(1.1 * r.gyroBias * GYRO_TIME_CONSTANT, worst);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_turns);
+    RUN_TEST(test_path);
+    RUN_TEST(test_slip);
+    RUN_TEST(test_gyro_bias);
+    return UNITY_END();
+}
@@ -0,0 +1,208 @@
+//Host tests of motion_profile.h through step_pair::move(): exact endpoints for trapezoidal and S-curve moves,
+//coordination of the two wheels, speed and acceleration limits, cancelling a move, and ISR cost.
+//Run with: pio test -e native
+//PROFILE_MAX_CYCLES sets the limit on the 99.9th percentile of runSteppers() time during a move
+
+#include <Arduino.h>
+#include <cycle_count.h>
+#include <step.h>
+#include <step_pair.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifndef PROFILE_MAX_CYCLES
+#define PROFILE_MAX_CYCLES 400
+#endif
+
+HOST_ARDUINO_PINS
+
+const int INTERVAL_US = 20;
+const int TICKS_PER_SECOND = 1000000 / INTERVAL_US;
+const int LEFT_STEP = 17, LEFT_DIR = 16, RIGHT_STEP = 14, RIGHT_DIR = 4;
+const float MAX_SPEED = 8000;           //microsteps/s
+const float MAX_ACCEL = 20000;          //microsteps/s/s
+const float MAX_JERK = 200000;          //microsteps/s/s/s
+
+struct move_result {
+    int32_t pinPosition[2];     //position counted from the step and direction pins
+    double tracking;            //largest deviation of the shorter move from the scaled longer one (microsteps)
+    long ticks;                 //ticks until isMoving() was false
+    float peakSpeed;            //microsteps/s
+    float peakAccel;            //microsteps/s/s
+};
+
+//Run a move to completion, counting pulses on the pins and tracking the speed of each motor
+static move_result runMove(step &left, step &right, step_pair &pair, int32_t dl, int32_t dr, float jerk) {
+    const uint8_t stepPins[2] = {LEFT_STEP, RIGHT_STEP}, dirPins[2] = {LEFT_DIR, RIGHT_DIR};
+    step *motors[2] = {&left, &right};
+    move_result r = {};
+    float lastSpeed[2] = {};
+    int32_t start[2] = {left.getPosition(), right.getPosition()};
+    int shorter = abs(dl) < abs(dr) ? 0 : 1;
+    int32_t dShort = shorter == 0 ? dl : dr, dLong = shorter == 0 ? dr : dl;
+
+    pair.move(dl, dr, MAX_SPEED, MAX_ACCEL, jerk);
+    long t = 0;
+    for (; pair.isMoving() && t < 60L * TICKS_PER_SECOND; t++) {
+        uint32_t rising[2] = {hostPins[LEFT_STEP].rising, hostPins[RIGHT_STEP].rising};
+        pair.runSteppers();
+        for (int m = 0; m < 2; m++) {
+            if (hostPins[stepPins[m]].rising != rising[m])
+                r.pinPosition[m] += hostPins[dirPins[m]].level ? 1 : -1;
+
+            //Speed and acceleration from the status published by the ISR, once per 1 ms
+            if (t % 50 == 0) {
+                float speed = motors[m]->getSpeed() / left.SPEED_SCALE;
+                r.peakSpeed = std::max(r.peakSpeed, fabsf(speed));
+                if (t > 0)
+                    r.peakAccel = std::max(r.peakAccel, fabsf(speed - lastSpeed[m]) * 1000);
+                lastSpeed[m] = speed;
+            }
+        }
+
+        //Both wheels follow the same profile shape, so the shorter move is the longer one scaled
+        if (dLong != 0) {
+            double progress = static_cast<double>(motors[1 - shorter]->getPosition() - start[1 - shorter]) / dLong;
+            double deviation = fabs(motors[shorter]->getPosition() - start[shorter] - progress * dShort);
+            r.tracking = std::max(r.tracking, deviation);
+        }
+    }
+    r.ticks = t;
+    return r;
+}
+
+void setUp() {
+    for (int pin : {LEFT_STEP, LEFT_DIR, RIGHT_STEP, RIGHT_DIR})
+        hostPins[pin] = host_pin();
+}
+
+void tearDown() {}
+
+//Every move must end exactly on its target, with the wheels in step all the way: the shorter move is never
+//more than a step away from the longer move scaled to its distance
+static void checkEndpoints(float jerk) {
+    const int32_t moves[][2] = {{0, 0}, {1, 1}, {1, -1}, {7, 3}, {100, 100}, {-250, 250}, {3200, 1600},
+                                {12345, -6789}, {50000, 50000}, {-80000, -20000}, {160000, 3}};
+    step left(INTERVAL_US, LEFT_STEP, LEFT_DIR, step::DDA_MODE);
+    step right(INTERVAL_US, RIGHT_STEP, RIGHT_DIR, step::DDA_MODE);
+    step_pair pair(left, right);
+    pair.setAcceleration(MAX_ACCEL);
+    int32_t expected[2] = {}, pins[2] = {};
+
+    for (const int32_t *m : moves) {
+        move_result r = runMove(left, right, pair, m[0], m[1], jerk);
+        expected[0] += m[0];
+        expected[1] += m[1];
+        pins[0] += r.pinPosition[0];
+        pins[1] += r.pinPosition[1];
+
+        char msg[128];
+        snprintf(msg, sizeof(msg), "move %d, %d: position %d, %d, tracking error %.2f", m[0], m[1],
+                 left.getPosition(), right.getPosition(), r.tracking);
+        TEST_ASSERT_FALSE(pair.isMoving());
+        TEST_ASSERT_INT32_WITHIN_MESSAGE(0, expected[0], left.getPosition(), msg);
+        TEST_ASSERT_INT32_WITHIN_MESSAGE(0, expected[1], right.getPosition(), msg);
+        TEST_ASSERT_INT32_WITHIN_MESSAGE(0, expected[0], pins[0], msg);
+        TEST_ASSERT_INT32_WITHIN_MESSAGE(0, expected[1], pins[1], msg);
+        TEST_ASSERT_LESS_THAN_MESSAGE(1.5, r.tracking, msg);
+    }
+}
+
+void test_endpoint_trapezoid() {
+    checkEndpoints(0);
+}
+
+void test_endpoint_scurve() {
+    checkEndpoints(MAX_JERK);
+}
+
+//A long move must reach the speed limit without exceeding the limits, and take the expected time
+void test_limits() {
+    for (float jerk : {0.0f, MAX_JERK}) {
+        setUp();
+        step left(INTERVAL_US, LEFT_STEP, LEFT_DIR, step::DDA_MODE);
+        step right(INTERVAL_US, RIGHT_STEP, RIGHT_DIR, step::DDA_MODE);
+        step_pair pair(left, right);
+        const int32_t distance = 40000;
+        move_result r = runMove(left, right, pair, distance, distance / 2, jerk);
+
+        //Trapezoid: d/v + v/a. S-curve adds a/j
+        double ideal = distance / MAX_SPEED + MAX_SPEED / MAX_ACCEL + (jerk > 0 ? MAX_ACCEL / jerk : 0);
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s: peak %.0f microsteps/s, %.0f microsteps/s/s, %.4f s (ideal %.4f s)",
+                 jerk > 0 ? "S-curve" : "trapezoid", r.peakSpeed, r.peakAccel,
+                 static_cast<double>(r.ticks) / TICKS_PER_SECOND, ideal);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_FLOAT_WITHIN(0.01 * MAX_SPEED, MAX_SPEED, r.peakSpeed);
+        TEST_ASSERT_LESS_THAN(1.02 * MAX_ACCEL, r.peakAccel);
+        TEST_ASSERT_FLOAT_WITHIN(0.002, ideal, static_cast<double>(r.ticks) / TICKS_PER_SECOND);
+    }
+}
+
+//A speed target published during a move must cancel it, and an older speed target must not
+void test_cancel() {
+    step left(INTERVAL_US, LEFT_STEP, LEFT_DIR, step::DDA_MODE);
+    step right(INTERVAL_US, RIGHT_STEP, RIGHT_DIR, step::DDA_MODE);
+    step_pair pair(left, right);
+    pair.setAcceleration(MAX_ACCEL);
+    pair.setTargetSpeed(1000 * left.SPEED_SCALE, 1000 * left.SPEED_SCALE);
+    pair.move(20000, 20000, MAX_SPEED, MAX_ACCEL);
+    for (int t = 0; t < TICKS_PER_SECOND; t++)
+        pair.runSteppers();
+    TEST_ASSERT_TRUE(pair.isMoving());
+    TEST_ASSERT_GREATER_THAN(4000, left.getSpeed() / left.SPEED_SCALE);
+
+    pair.setTargetSpeed(-500 * left.SPEED_SCALE, 0);
+    pair.runSteppers();
+    TEST_ASSERT_FALSE(pair.isMoving());
+    for (int t = 0; t < TICKS_PER_SECOND; t++)
+        pair.runSteppers();
+    TEST_ASSERT_FLOAT_WITHIN(1, -500, left.getSpeed() / left.SPEED_SCALE);
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, right.getSpeed() / right.SPEED_SCALE);
+}
+
+//Time per runSteppers() call during moves, including the calls that pick up a new move
+void test_isr_cost() {
+    step left(INTERVAL_US, LEFT_STEP, LEFT_DIR, step::DDA_MODE);
+    step right(INTERVAL_US, RIGHT_STEP, RIGHT_DIR, step::DDA_MODE);
+    step_pair pair(left, right);
+    std::vector<uint32_t> samples;
+    samples.reserve(4000000);
+    uint32_t pickup = 0;
+
+    for (int n = 0; n < 20; n++) {
+        pair.move(n & 1 ? -4000 : 6000, 3000, MAX_SPEED, MAX_ACCEL, n & 2 ? MAX_JERK : 0);
+        bool first = true;
+        while (pair.isMoving()) {
+            uint64_t c0 = cycles();
+            pair.runSteppers();
+            uint32_t c = static_cast<uint32_t>(cycles() - c0);
+            samples.push_back(c);
+            if (first)
+                pickup = std::max(pickup, c);
+            first = false;
+        }
+    }
+
+    char msg[128];
+    cycle_summary s = summariseCycles(samples, "runSteppers() during moves", msg, sizeof(msg));
+    size_t n = strlen(msg);
+    snprintf(msg + n, sizeof(msg) - n, ", move pickup %u cycles", pickup);
+    TEST_MESSAGE(msg);
+    if (s.max > 0)
+        TEST_ASSERT_LESS_THAN_MESSAGE(PROFILE_MAX_CYCLES, s.p999, msg);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_endpoint_trapezoid);
+    RUN_TEST(test_endpoint_scurve);
+    RUN_TEST(test_limits);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_isr_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,125 @@
+//Host tests of profiler.h: statistics and histogram of a window, load from the invocation starts, a window across
+//the wrap of the cycle counter, snapshots starting new windows, and record() cost, which is reported but not tested.
+//Run with: pio test -e native
+
+#include <Arduino.h>
+#include <cycle_count.h>
+#include <profiler.h>
+#include <unity.h>
+
+#include <cstdio>
+#include <vector>
+
+HOST_ARDUINO_PINS
+
+const uint32_t PERIOD = 4800;       //20 μs at 240 MHz
+
+void setUp() {}
+
+void tearDown() {}
+
+//Close the window with one more invocation and return it
+static profile_stats snapshot(profile_section& p, uint32_t start) {
+    p.request();
+    p.record(start, 0);
+    return p.read();
+}
+
+//Count, min, max, total, overruns and histogram bins of known invocations
+void test_stats() {
+    profile_section p("test", 1000);
+    const uint32_t times[] = {10, 31, 32, 100, 1000, 1001, 5000, 1u << 20};
+    uint32_t start = 0;
+    for (uint32_t t : times) {
+        p.record(start, t);
+        start += PERIOD;
+    }
+    profile_stats s = snapshot(p, start);
+    TEST_ASSERT_EQUAL_UINT32(8, s.count);
+    TEST_ASSERT_EQUAL_UINT32(10, s.min);
+    TEST_ASSERT_EQUAL_UINT32(1u << 20, s.max);
+    TEST_ASSERT_TRUE(s.total == 10 + 31 + 32 + 100 + 1000 + 1001 + 5000 + (1u << 20));
+    TEST_ASSERT_EQUAL_UINT32(3, s.overruns);
+    TEST_ASSERT_EQUAL_UINT32(2, s.histogram[0]);        //below 32
+    TEST_ASSERT_EQUAL_UINT32(1, s.histogram[1]);        //32 to 63
+    TEST_ASSERT_EQUAL_UINT32(1, s.histogram[2]);        //64 to 127
+    TEST_ASSERT_EQUAL_UINT32(2, s.histogram[5]);        //512 to 1023
+    TEST_ASSERT_EQUAL_UINT32(1, s.histogram[8]);        //4096 to 8191
+    TEST_ASSERT_EQUAL_UINT32(1, s.histogram[PROFILE_BUCKETS - 1]);
+    uint32_t sum = 0;
+    for (uint32_t h : s.histogram)
+        sum += h;
+    TEST_ASSERT_EQUAL_UINT32(s.count, sum);
+}
+
+//A section taking a quarter of its period has a load of a quarter, across the wrap of the counter
+void test_load_wrap() {
+    profile_section p("test");
+    uint32_t start = UINT32_MAX - 100 * PERIOD;
+    for (int n = 0; n < 1000; n++) {
+        p.record(start, PERIOD / 4);
+        start += PERIOD;
+    }
+    profile_stats s = snapshot(p, start);
+    TEST_ASSERT_EQUAL_UINT32(1000, s.count);
+    TEST_ASSERT_TRUE(s.elapsed == 1000ULL * PERIOD);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.25, static_cast<double>(s.total) / s.elapsed);
+    TEST_ASSERT_EQUAL_UINT32(0, s.overruns);
+}
+
+//Each snapshot starts a new window, holding only the invocations since the previous one
+void test_windows() {
+    profile_section p("test");
+    uint32_t version = p.version();
+    uint32_t start = 0;
+    for (int n = 0; n < 10; n++, start += PERIOD)
+        p.record(start, 500);
+    profile_stats first = snapshot(p, start);
+    TEST_ASSERT_NOT_EQUAL(version, p.version());
+    version = p.version();
+
+    //Nothing is published until the next request
+    start += PERIOD;
+    for (int n = 0; n < 5; n++, start += PERIOD)
+        p.record(start, 200);
+    TEST_ASSERT_EQUAL_UINT32(version, p.version());
+
+    profile_stats second = snapshot(p, start);
+    TEST_ASSERT_EQUAL_UINT32(10, first.count);
+    TEST_ASSERT_EQUAL_UINT32(500, first.min);
+    TEST_ASSERT_EQUAL_UINT32(6, second.count);      //the invocation that closed the first window, then 5
+    TEST_ASSERT_EQUAL_UINT32(0, second.min);
+    TEST_ASSERT_EQUAL_UINT32(200, second.max);
+    TEST_ASSERT_TRUE(second.elapsed == 6ULL * PERIOD);
+}
+
+//Time per record(), as added to every run of the stepper ISR. Timed in batches, as one call takes less time
+//than reading the counter
+void test_record_cost() {
+    profile_section p("test", PERIOD);
+    const int BATCHES = 10000, BATCH = 100;
+    uint32_t start = 0;
+    std::vector<uint32_t> samples;
+    samples.reserve(BATCHES);
+    for (int n = 0; n < BATCHES * BATCH; n += BATCH) {
+        uint64_t c0 = cycles();
+        for (int k = n; k < n + BATCH; k++) {
+            p.record(start, (k * 2654435761u) >> 20);
+            start += PERIOD;
+        }
+        samples.push_back(static_cast<uint32_t>(cycles() - c0));
+    }
+    char msg[128];
+    summariseCycles(samples, "100 record() calls", msg, sizeof(msg));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(BATCHES * BATCH, snapshot(p, start).count);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_stats);
+    RUN_TEST(test_load_wrap);
+    RUN_TEST(test_windows);
+    RUN_TEST(test_record_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,116 @@
+//Host tests of the robot simulation (host/robot_sim.h), which runs the firmware's stepping, tilt estimation and
+//control code against a model of the robot: it stands up from a tilt and holds position at the default gains and
+//control rate, follows a target speed, goes faster with adaptive microstepping, falls when the control rate is
+//too low, stalls a motor that is too weak for the acceleration, and runs much faster than real time.
+//Run with: pio test -e native
+//SIM_MIN_SPEEDUP sets the limit on simulated time over run time
+
+#include <Arduino.h>
+#include <robot_sim.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+
+#ifndef SIM_MIN_SPEEDUP
+#define SIM_MIN_SPEEDUP 200
+#endif
+
+HOST_ARDUINO_PINS
+
+void setUp() {}
+
+void tearDown() {}
+
+//From 0.1 rad the robot stands up and stays within a few mrad of upright, near where it started
+void test_balance() {
+    sim_config c;
+    robot_sim sim(c);
+    sim.body.angle = 0.1;
+    bool balanced = sim.run(10);
+    const sim_result& r = sim.getResult();
+    char msg[128];
+    snprintf(msg, sizeof(msg), "rms tilt %.2f mrad, max %.2f mrad, position %.3f m", r.rmsTilt * 1000,
+             r.maxTilt * 1000, r.position);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(balanced);
+    TEST_ASSERT_EQUAL_UINT32(0, r.slips);
+    TEST_ASSERT_LESS_THAN(0.005, r.rmsTilt);
+    TEST_ASSERT_LESS_THAN(0.03, r.maxTilt);
+    TEST_ASSERT_FLOAT_WITHIN(0.5, 0, r.position);
+    TEST_ASSERT_FLOAT_WITHIN(0.005, sim.body.angle, sim.getTiltEstimate());
+}
+
+//A target speed is reached by leaning into it
+void test_speed() {
+    sim_config c;
+    robot_sim sim(c);
+    TEST_ASSERT_TRUE(sim.run(2));
+    sim.setTarget(0.3);
+    TEST_ASSERT_TRUE(sim.run(8));
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 0.3, sim.getResult().speed);
+    TEST_ASSERT_GREATER_THAN(1.0, sim.getResult().position);
+}
+
+//Adaptive microstepping raises the speed limit of 0.86 m/s at 16 microsteps, so 2 m/s can be held
+void test_adaptive_speed() {
+    sim_config c;
+    c.speedRange = 4;
+    robot_sim sim(c);
+    TEST_ASSERT_TRUE(sim.run(2));
+    sim.setTarget(2.0);
+    bool balanced = sim.run(8);
+    char msg[96];
+    snprintf(msg, sizeof(msg), "speed %.3f m/s, rms tilt %.2f mrad", sim.getResult().speed,
+             sim.getResult().rmsTilt * 1000);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(balanced);
+    TEST_ASSERT_EQUAL_UINT32(0, sim.getResult().slips);
+    TEST_ASSERT_FLOAT_WITHIN(0.3, 2.0, sim.getResult().speed);
+}
+
+//At 5 Hz the control period is too long to catch the fall
+void test_slow_control() {
+    sim_config c;
+    c.controlHz = 5;
+    robot_sim sim(c);
+    sim.body.angle = 0.1;
+    TEST_ASSERT_FALSE(sim.run(10));
+    TEST_ASSERT_EQUAL_UINT32(0, sim.getResult().slips);
+    TEST_ASSERT_LESS_THAN(2.0, sim.getResult().fallTime);
+}
+
+//A motor without the torque for the acceleration limit loses steps
+void test_stall() {
+    sim_config c;
+    c.holdingTorque = 0.15;
+    robot_sim sim(c);
+    sim.body.angle = 0.3;
+    TEST_ASSERT_FALSE(sim.run(10));
+    TEST_ASSERT_GREATER_THAN(0, sim.getResult().slips);
+}
+
+//Simulated time over run time, with the steppers at their 20 μs interval
+void test_speedup() {
+    sim_config c;
+    robot_sim sim(c);
+    sim.body.angle = 0.05;
+    auto t0 = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(sim.run(20));
+    double speedup = 20 / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%.0fx real time", speedup);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_GREATER_THAN(SIM_MIN_SPEEDUP, speedup);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_balance);
+    RUN_TEST(test_speed);
+    RUN_TEST(test_adaptive_speed);
+    RUN_TEST(test_slow_control);
+    RUN_TEST(test_stall);
+    RUN_TEST(test_speedup);
+    return UNITY_END();
+}
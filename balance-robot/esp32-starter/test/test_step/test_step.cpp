@@ -0,0 +1,320 @@
+//Host tests of step.h: achieved step rate, acceleration profile, position tracking, adaptive microstepping and
+//ISR cost.
+//Run with: pio test -e native
+//STEP_MAX_NS_PER_CALL sets the runStepper() time limit for the cost test
+
+#include <Arduino.h>
+#include <step.h>
+#include <step_pair.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <initializer_list>
+#include <thread>
+
+#ifndef STEP_MAX_NS_PER_CALL
+#define STEP_MAX_NS_PER_CALL 100
+#endif
+
+HOST_ARDUINO_PINS
+
+const int INTERVAL_US = 20;
+const int TICKS_PER_SECOND = 1000000 / INTERVAL_US;
+const int STEP_PIN = 17;
+const int DIR_PIN = 16;
+
+//Run a stepper for a number of ticks, checking that every pulse on the step pin was counted in the
+//direction shown on the direction pin at the rising edge
+static void run(step &s, long ticks, int32_t &pinPosition) {
+    for (long t = 0; t < ticks; t++) {
+        uint32_t rising = hostPins[STEP_PIN].rising;
+        s.runStepper();
+        if (hostPins[STEP_PIN].rising != rising)
+            pinPosition += hostPins[DIR_PIN].level ? 1 : -1;
+    }
+}
+
+void setUp() {
+    hostPins[STEP_PIN] = host_pin();
+    hostPins[DIR_PIN] = host_pin();
+}
+
+void tearDown() {}
+
+//Steps in 10 s at constant speed must match the ideal count
+static void checkRate(step::stepMode mode, int32_t tolerancePpm) {
+    const int32_t ACCEL = 1000000;      //steps/s/s, reaches speed within 8 ms
+    for (int rate : {25, 400, 1234, 3000, 7777, -5000}) {
+        setUp();
+        step s(INTERVAL_US, STEP_PIN, DIR_PIN, mode);
+        s.setAcceleration(ACCEL);
+        s.setTargetSpeed(rate * s.SPEED_SCALE);
+        int32_t pinPosition = 0;
+        run(s, 10L * TICKS_PER_SECOND, pinPosition);
+
+        //Allow for the steps lost during the initial ramp, v^2/2a
+        int32_t ideal = rate * 10;
+        int32_t tolerance = 2 + rate * rate / (2 * ACCEL)
+            + static_cast<int32_t>((ideal < 0 ? -ideal : ideal) * static_cast<int64_t>(tolerancePpm) / 1000000);
+        char msg[64];
+        snprintf(msg, sizeof(msg), "%d steps/s", rate);
+        TEST_ASSERT_INT32_WITHIN_MESSAGE(tolerance, ideal, s.getPosition(), msg);
+    }
+}
+
+void test_rate_dda() {
+    checkRate(step::DDA_MODE, 0);
+}
+
+void test_rate_period() {
+    //PERIOD_MODE truncates the step period and starts the step timer late, so it runs fast by up to 0.5%
+    checkRate(step::PERIOD_MODE, 5000);
+}
+
+//Speed must follow v = a.t up to the target and position must follow the integral of the speed
+static void checkRamp(step::stepMode mode) {
+    step s(INTERVAL_US, STEP_PIN, DIR_PIN, mode);
+    const int32_t accel = 5000;         //steps/s/s
+    const int32_t target = 4000;        //steps/s
+    s.setAcceleration(accel);
+    s.setTargetSpeed(target * s.SPEED_SCALE);
+
+    int32_t pinPosition = 0;
+    for (int ms = 10; ms <= 1500; ms += 10) {
+        run(s, TICKS_PER_SECOND / 100, pinPosition);
+        float t = ms / 1000.0f;
+        float tRamp = static_cast<float>(target) / accel;
+        float v = t < tRamp ? accel * t : target;
+        float x = t < tRamp ? 0.5f * accel * t * t : 0.5f * accel * tRamp * tRamp + target * (t - tRamp);
+
+        //MAX_SPEED_INTERVAL_US limits PERIOD_MODE speed updates to once per ms at low speed
+        TEST_ASSERT_FLOAT_WITHIN(accel * 0.0011f, v, s.getSpeed() / s.SPEED_SCALE);
+        TEST_ASSERT_FLOAT_WITHIN(2.0f + x * 0.005f, x, static_cast<float>(s.getPosition()));
+    }
+}
+
+void test_ramp_dda() {
+    checkRamp(step::DDA_MODE);
+}
+
+void test_ramp_period() {
+    checkRamp(step::PERIOD_MODE);
+}
+
+//Reverse repeatedly and check the position counter against the pulses seen by the driver
+void test_position_dda() {
+    step s(INTERVAL_US, STEP_PIN, DIR_PIN, step::DDA_MODE);
+    s.setAccelerationRad(40.0);
+    int32_t pinPosition = 0;
+    for (int i = 0; i < 20; i++) {
+        s.setTargetSpeedRad(i % 2 ? -15.0f : 12.0f);
+        run(s, TICKS_PER_SECOND / 2, pinPosition);
+        TEST_ASSERT_EQUAL_INT32(pinPosition, s.getPosition());
+    }
+    s.setTargetSpeed(0);
+    run(s, TICKS_PER_SECOND, pinPosition);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, s.getSpeed());
+    TEST_ASSERT_EQUAL_INT32(pinPosition, s.getPosition());
+}
+
+//Targets published through step_pair reach both motors on the same tick
+void test_pair_publish() {
+    const int LEFT_STEP = 17, LEFT_DIR = 16, RIGHT_STEP = 14, RIGHT_DIR = 4;
+    step left(INTERVAL_US, LEFT_STEP, LEFT_DIR, step::DDA_MODE);
+    step right(INTERVAL_US, RIGHT_STEP, RIGHT_DIR, step::DDA_MODE);
+    step_pair pair(left, right);
+    pair.setAcceleration(20000);
+
+    for (int i = 0; i < 10; i++) {
+        pair.setTargetSpeed((i - 5) * 1000 * left.SPEED_SCALE, (5 - i) * 1000 * left.SPEED_SCALE);
+        for (int t = 0; t < TICKS_PER_SECOND / 10; t++) {
+            pair.runSteppers();
+            TEST_ASSERT_EQUAL_FLOAT(left.getSpeed(), -right.getSpeed());
+        }
+    }
+    TEST_ASSERT_INT32_WITHIN(1, left.getPosition(), -right.getPosition());
+}
+
+//A reader racing a writer on another thread must only see complete values
+void test_seqlock_torn() {
+    struct sample { int32_t a, b, c, d; };
+    const long MIN_READS = 10000;
+    seqlock<sample> lock;
+    std::atomic<bool> enough{false}, done{false};
+    int32_t written = 0;
+
+    //Keep writing until the reader has raced enough writes, however the threads are scheduled
+    std::thread writer([&] {
+        int32_t i = 1;
+        for (; i <= 2000000 || !enough; i++)
+            lock.write({i, -i, i * 3, ~i});
+        written = i - 1;
+        done = true;
+    });
+
+    long reads = 0, torn = 0;
+    int32_t last = 0;
+    while (!done) {
+        sample s;
+        if (!lock.tryRead(s) || s.a == 0)     //nothing written yet
+            continue;
+        if (++reads == MIN_READS)
+            enough = true;
+        if (s.b != -s.a || s.c != s.a * 3 || s.d != ~s.a || s.a < last)
+            torn++;
+        last = s.a;
+    }
+    writer.join();
+
+    TEST_ASSERT_EQUAL_INT32(0, torn);
+    TEST_ASSERT_EQUAL_INT32(written, lock.read().a);
+    TEST_ASSERT_TRUE(reads >= MIN_READS);
+}
+
+//Driver with its microstep resolution set by the A4988 mode pins, counting its position in 1/16 steps
+struct microstep_driver {
+    static constexpr int8_t MS1 = 25, MS2 = 26, MS3 = 27;
+    static constexpr step::microstep_pins PINS = {{MS1, MS2, MS3}, {0b111, 0b011, 0b010}};
+
+    int32_t position = 0;       //1/16 steps
+    int shift = 0;              //resolution at the last pulse, 16 >> shift
+    bool misaligned = false;    //resolution changed away from a full step
+    uint32_t pulses = 0;
+
+    //Count a pulse if the step pin rose since the last tick
+    void update(uint32_t &rising) {
+        if (hostPins[STEP_PIN].rising == rising)
+            return;
+        rising = hostPins[STEP_PIN].rising;
+        uint8_t levels = hostPins[MS1].level | hostPins[MS2].level << 1 | hostPins[MS3].level << 2;
+        int s = 0;
+        while (s < step::MAX_MICROSTEP_SHIFT && PINS.levels[s] != levels)
+            s++;
+        TEST_ASSERT_EQUAL_UINT8(PINS.levels[s], levels);
+        if (s != shift && position % 16 != 0)
+            misaligned = true;
+        shift = s;
+        position += hostPins[DIR_PIN].level ? 1 << s : -(1 << s);
+        pulses++;
+    }
+};
+
+constexpr step::microstep_pins microstep_driver::PINS;
+
+//Accelerate to 3.8 times MAX_SPEED, reverse and stop. The driver must follow the step position at every tick,
+//change resolution only on full steps and never see more than MAX_SPEED pulses/s
+static void checkMicrosteps(step::stepMode mode) {
+    for (int pin : {STEP_PIN, DIR_PIN, 25, 26, 27})
+        hostPins[pin] = host_pin();
+    step s(INTERVAL_US, STEP_PIN, DIR_PIN, mode, microstep_driver::PINS);
+    microstep_driver driver;
+    uint32_t rising = 0;
+    const int32_t top = s.MAX_SPEED * 38 / 10;
+    TEST_ASSERT_EQUAL_INT32(4 * s.MAX_SPEED, s.getMaxSpeed());
+    s.setAcceleration(20000);
+
+    int32_t reached = 0, maxPulses = 0;
+    for (int32_t target : {top, -top, 0}) {
+        s.setTargetSpeed(target * s.SPEED_SCALE);
+        for (int ms = 0; ms < 5000; ms += 10) {
+            uint32_t pulses = driver.pulses;
+            for (int t = 0; t < TICKS_PER_SECOND / 100; t++) {
+                s.runStepper();
+                driver.update(rising);
+                TEST_ASSERT_EQUAL_INT32(driver.position, s.getPosition());
+            }
+            maxPulses = std::max<int32_t>(maxPulses, driver.pulses - pulses);
+            reached = std::max<int32_t>(reached, static_cast<int32_t>(s.getSpeed() / s.SPEED_SCALE));
+        }
+    }
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%s: top %d microsteps/s, %d pulses/s", mode == step::PERIOD_MODE ? "PERIOD_MODE" :
+             "DDA_MODE", reached, maxPulses * 100);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_FALSE(driver.misaligned);
+    TEST_ASSERT_EQUAL_INT32(top, reached);
+    TEST_ASSERT_LESS_OR_EQUAL(s.MAX_SPEED / 100 + 1, maxPulses);
+    TEST_ASSERT_EQUAL_INT(0, driver.shift);
+    TEST_ASSERT_EQUAL_INT(s.MICROSTEPS, s.getMicrosteps());
+}
+
+void test_microsteps_dda() {
+    checkMicrosteps(step::DDA_MODE);
+}
+
+void test_microsteps_period() {
+    checkMicrosteps(step::PERIOD_MODE);
+}
+
+//At constant speed on 4 microsteps the long-run step rate still matches the target exactly
+void test_microsteps_rate() {
+    step s(INTERVAL_US, STEP_PIN, DIR_PIN, step::DDA_MODE, microstep_driver::PINS);
+    const int32_t rate = 37777;
+    s.setAcceleration(1000000);
+    s.setTargetSpeed(rate * s.SPEED_SCALE);
+    int32_t pinPosition = 0;
+    run(s, TICKS_PER_SECOND, pinPosition);
+    TEST_ASSERT_EQUAL_INT(4, s.getMicrosteps());
+    int32_t start = s.getPosition();
+    run(s, 10L * TICKS_PER_SECOND, pinPosition);
+    TEST_ASSERT_INT32_WITHIN(4, rate * 10, s.getPosition() - start);
+}
+
+//The DDA top speed limits the interval to under 100 μs, or 50 μs with the mode pins
+void test_interval_limits() {
+    step full(INTERVAL_US, STEP_PIN, DIR_PIN, step::DDA_MODE);
+    TEST_ASSERT_TRUE(full.intervalFits(99));
+    TEST_ASSERT_FALSE(full.intervalFits(100));
+    step adaptive(INTERVAL_US, STEP_PIN, DIR_PIN, step::DDA_MODE, microstep_driver::PINS);
+    TEST_ASSERT_TRUE(adaptive.intervalFits(49));
+    TEST_ASSERT_FALSE(adaptive.intervalFits(50));
+    TEST_ASSERT_FALSE(adaptive.intervalFits(1000));
+}
+
+//Time runStepper() with a command from the control loop every 10 ms
+static double nsPerCall(step::stepMode mode) {
+    step s(INTERVAL_US, STEP_PIN, DIR_PIN, mode);
+    s.setAccelerationRad(50.0);
+    const long ticks = 20000000;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (long t = 0; t < ticks; t++) {
+        if (t % 500 == 0)
+            s.setTargetSpeed(((t / 500) % 200 - 100) * (s.MAX_SPEED / 100) * s.SPEED_SCALE);
+        s.runStepper();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / ticks;
+}
+
+void test_isr_cost() {
+    char msg[96];
+    for (step::stepMode mode : {step::PERIOD_MODE, step::DDA_MODE}) {
+        double ns = nsPerCall(mode);
+        snprintf(msg, sizeof(msg), "%s: %.2f ns per runStepper() call",
+                 mode == step::PERIOD_MODE ? "PERIOD_MODE" : "DDA_MODE", ns);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_LESS_THAN_MESSAGE(STEP_MAX_NS_PER_CALL, static_cast<int>(ns), msg);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_rate_dda);
+    RUN_TEST(test_rate_period);
+    RUN_TEST(test_ramp_dda);
+    RUN_TEST(test_ramp_period);
+    RUN_TEST(test_position_dda);
+    RUN_TEST(test_microsteps_dda);
+    RUN_TEST(test_microsteps_period);
+    RUN_TEST(test_microsteps_rate);
+    RUN_TEST(test_interval_limits);
+    RUN_TEST(test_pair_publish);
+    RUN_TEST(test_seqlock_torn);
+    RUN_TEST(test_isr_cost);
+    return UNITY_END();
+}
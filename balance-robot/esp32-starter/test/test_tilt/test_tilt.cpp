@@ -0,0 +1,186 @@
+//Host tests of tilt.h: accuracy of the integer atan2, tracking of a simulated IMU log against the true tilt,
+//agreement with a floating point reference, and time per update.
+//Run with: pio test -e native
+//
+//The IMU log is generated from a known tilt trajectory with the disturbances seen on the robot: forward
+//acceleration from the wheels, accelerometer noise, gyro noise and a constant gyro bias
+
+#include <cycle_count.h>
+#include <tilt.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+const float DT = 0.001;                         //1 kHz sample rate
+const double G = 9.80665;
+const double ACCEL_LSB = 16384 / G;             //LSB per m/s/s at ±2 g
+const double GYRO_LSB = 131 * 180 / M_PI;       //LSB per rad/s at ±250 °/s
+const double GYRO_BIAS = 2.0 * M_PI / 180;      //rad/s
+
+struct log_entry {
+    int16_t accelForward;
+    int16_t accelUp;
+    int16_t gyro;
+    double angle;               //true tilt (rad)
+};
+
+//Deterministic Gaussian noise
+static double gaussian() {
+    static uint32_t state = 12345;
+    auto uniform = [] {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0 / 16777216.0) + 1e-9;
+    };
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+static int16_t toRaw(double v) {
+    v = round(v);
+    return static_cast<int16_t>(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+//Tilt oscillating up to ±0.3 rad with a forward acceleration of up to 1 m/s/s as the robot corrects it.
+//The acceleration alone puts up to 6° of error on the accelerometer angle
+static std::vector<log_entry> makeLog(double seconds) {
+    std::vector<log_entry> log;
+    for (long n = 0; n < seconds / DT; n++) {
+        double t = n * DT;
+        double angle = 0.2 * sin(2 * M_PI * 0.7 * t) + 0.1 * sin(2 * M_PI * 2.3 * t + 1);
+        double rate = 0.2 * 2 * M_PI * 0.7 * cos(2 * M_PI * 0.7 * t) + 0.1 * 2 * M_PI * 2.3 * cos(2 * M_PI * 2.3 * t + 1);
+        double forward = 1.0 * sin(2 * M_PI * 0.7 * t + 0.5);
+
+        log_entry e;
+        e.accelForward = toRaw((G * sin(angle) + forward * cos(angle)) * ACCEL_LSB + 40 * gaussian());
+        e.accelUp = toRaw((G * cos(angle) - forward * sin(angle)) * ACCEL_LSB + 40 * gaussian());
+        e.gyro = toRaw((rate + GYRO_BIAS) * GYRO_LSB + 5 * gaussian());
+        e.angle = angle;
+        log.push_back(e);
+    }
+    return log;
+}
+
+//Run the estimator over the log and return the RMS angle error, skipping the first settleSeconds
+static double rmsError(tilt_estimator &t, const std::vector<log_entry> &log, double settleSeconds) {
+    t.reset(log[0].accelForward, log[0].accelUp);
+    double sum = 0;
+    long n = 0;
+    for (size_t i = 0; i < log.size(); i++) {
+        t.update(log[i].accelForward, log[i].accelUp, log[i].gyro);
+        if (i * DT >= settleSeconds) {
+            double e = t.getAngleRad() - log[i].angle;
+            sum += e * e;
+            n++;
+        }
+    }
+    return sqrt(sum / n);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_atan2() {
+    double worst = 0;
+    for (int i = 0; i < 100000; i++) {
+        double a = -M_PI + 2 * M_PI * i / 100000;
+        int32_t x = static_cast<int32_t>(round(16384 * sin(a)));
+        int32_t y = static_cast<int32_t>(round(16384 * cos(a)));
+        double got = static_cast<double>(tilt_estimator::atan2Angle(x, y)) / tilt_estimator::ANGLE_ONE;
+        double e = fabs(remainder(got - atan2(x, y), 2 * M_PI));
+        if (e > worst) worst = e;
+    }
+    char msg[64];
+    snprintf(msg, sizeof(msg), "atan2 worst error %.4f deg", worst * 180 / M_PI);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(0.1 * M_PI / 180, worst);
+}
+
+//RMS error of the accelerometer angle alone
+static double accelOnlyError(const std::vector<log_entry> &log) {
+    double sum = 0;
+    for (const log_entry &e : log) {
+        double d = atan2(e.accelForward, e.accelUp) - e.angle;
+        sum += d * d;
+    }
+    return sqrt(sum / log.size());
+}
+
+//The complementary filter trades acceleration error against an offset of bias * time constant
+void test_complementary() {
+    std::vector<log_entry> log = makeLog(60);
+    tilt_estimator t(DT, 1 / GYRO_LSB);
+    t.setComplementary(0.5);
+    double rms = rmsError(t, log, 10);
+    char msg[96];
+    snprintf(msg, sizeof(msg), "complementary RMS error %.3f deg, accelerometer alone %.3f deg",
+             rms * 180 / M_PI, accelOnlyError(log) * 180 / M_PI);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(2.5 * M_PI / 180, rms);
+    TEST_ASSERT_LESS_THAN(0.5 * accelOnlyError(log), rms);
+}
+
+//The Kalman filter estimates the bias, so it removes the offset
+void test_kalman() {
+    std::vector<log_entry> log = makeLog(60);
+    tilt_estimator t(DT, 1 / GYRO_LSB);
+    t.setKalman(0.0001, 0.00001, 3);
+    double rms = rmsError(t, log, 20);
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Kalman RMS error %.3f deg", rms * 180 / M_PI);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(0.5 * M_PI / 180, rms);
+    TEST_ASSERT_FLOAT_WITHIN(0.2 * M_PI / 180, GYRO_BIAS, static_cast<double>(t.getBias()) / tilt_estimator::ANGLE_ONE);
+}
+
+//The integer filter must track a double precision implementation of the same equations, to within the
+//error of the atan2 approximation
+void test_fixed_point() {
+    std::vector<log_entry> log = makeLog(30);
+    tilt_estimator t(DT, 1 / GYRO_LSB);
+    t.setComplementary(0.5);
+    double tau = 0.5, k0 = DT / (tau + DT);
+
+    t.reset(log[0].accelForward, log[0].accelUp);
+    double angle = atan2(log[0].accelForward, log[0].accelUp);
+    double worst = 0;
+    for (const log_entry &e : log) {
+        t.update(e.accelForward, e.accelUp, e.gyro);
+        angle += e.gyro / GYRO_LSB * DT;
+        angle += k0 * (atan2(e.accelForward, e.accelUp) - angle);
+        worst = fmax(worst, fabs(t.getAngleRad() - angle));
+    }
+    TEST_ASSERT_LESS_THAN(0.1 * M_PI / 180, worst);
+}
+
+void test_update_cost() {
+    std::vector<log_entry> log = makeLog(10);
+    tilt_estimator t(DT, 1 / GYRO_LSB);
+    t.setKalman(0.0001, 0.00001, 3);
+    const int passes = 200;
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    for (int p = 0; p < passes; p++)
+        for (const log_entry &e : log)
+            t.update(e.accelForward, e.accelUp, e.gyro);
+    uint64_t c1 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+
+    double updates = static_cast<double>(passes) * log.size();
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%.1f cycles, %.2f ns per update (angle %f)",
+             (c1 - c0) / updates, std::chrono::duration<double, std::nano>(t1 - t0).count() / updates, t.getAngleRad());
+    TEST_MESSAGE(msg);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_atan2);
+    RUN_TEST(test_complementary);
+    RUN_TEST(test_kalman);
+    RUN_TEST(test_fixed_point);
+    RUN_TEST(test_update_cost);
+    return UNITY_END();
+}
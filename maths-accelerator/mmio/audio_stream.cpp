@@ -0,0 +1,115 @@
+// Interrupt-driven PCM playback through audio_stream_v1_0 and an AXI DMA
+
+#include "audio_stream.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace overlay {
+
+const int IRQ_TIMEOUT_MS = 100;
+
+AudioStream::AudioStream(const std::string& dmaUio, uint32_t streamBase, ContigBuffer& dmaBuffer,
+                         size_t periodSamples, size_t ringSamples) :
+    dmaRegion(dmaUio, sizeof(AxiDmaRegs)),
+    streamRegion(streamBase, sizeof(AudioStreamRegs)),
+    dma(dmaRegion.regs<AxiDmaRegs>()),
+    regs(streamRegion.regs<AudioStreamRegs>()),
+    buffer(dmaBuffer),
+    period(periodSamples),
+    ring(ringSamples) {
+
+    if (2 * period * sizeof(int16_t) > buffer.length())
+        throw std::invalid_argument("DMA buffer too small for two periods");
+    if (period > regs->depth / 2)
+        throw std::invalid_argument("Period larger than half the audio FIFO");
+
+    uioFd = open(dmaUio.c_str(), O_RDWR);
+    if (uioFd < 0)
+        throw std::system_error(errno, std::generic_category(), "open " + dmaUio);
+}
+
+AudioStream::~AudioStream() {
+    stop();
+    if (uioFd >= 0)
+        close(uioFd);
+}
+
+void AudioStream::start() {
+    if (running.exchange(true))
+        return;
+
+    dma->mm2s_dmacr = DMACR_RESET;
+    while (dma->mm2s_dmacr & DMACR_RESET) {}
+    dma->mm2s_dmacr = DMACR_RS | DMACR_IOC_IRQ_EN;
+
+    //Prime the hardware FIFO with one period before enabling the modulator
+    regs->ctrl = 0;
+    regs->clear = 1;
+    half = 0;
+    submitPeriod();
+    regs->ctrl = AUDIO_STREAM_CTRL_PLAY;
+
+    refillThread = std::thread(&AudioStream::refillLoop, this);
+}
+
+void AudioStream::stop() {
+    if (!running.exchange(false))
+        return;
+    refillThread.join();
+    regs->ctrl = AUDIO_STREAM_CTRL_FLUSH;
+    regs->ctrl = 0;
+    dma->mm2s_dmacr = DMACR_RESET;
+}
+
+//Copy the next period from the ring into the free half of the DMA buffer and send it
+void AudioStream::submitPeriod() {
+    const size_t bytes = period * sizeof(int16_t);
+    int16_t* dst = reinterpret_cast<int16_t*>(buffer.data() + half * bytes);
+    size_t n = ring.read(dst, period);
+    if (n < period) {
+        std::memset(dst + n, 0, (period - n) * sizeof(int16_t));
+        underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    dma->mm2s_sa = buffer.physAddr() + static_cast<uint32_t>(half * bytes);
+    dma->mm2s_length = static_cast<uint32_t>(bytes);
+    half ^= 1;
+}
+
+//Block until the DMA completion interrupt or a timeout, so that stop() is noticed.
+//Returns false on timeout
+bool AudioStream::waitInterrupt() {
+    uint32_t enable = 1;
+    if (::write(uioFd, &enable, sizeof(enable)) != sizeof(enable))
+        return false;
+
+    pollfd pfd = {uioFd, POLLIN, 0};
+    if (poll(&pfd, 1, IRQ_TIMEOUT_MS) <= 0)
+        return false;
+
+    uint32_t count;
+    return ::read(uioFd, &count, sizeof(count)) == sizeof(count);
+}
+
+void AudioStream::refillLoop() {
+    //The DMA transfer completes when its last sample enters the FIFO, so there
+    //is up to a full FIFO of playback time to submit the next period
+    while (running.load(std::memory_order_relaxed)) {
+        if (dma->mm2s_dmasr & DMASR_IDLE) {
+            dma->mm2s_dmasr = DMASR_IOC_IRQ;
+            submitPeriod();
+        }
+        else {
+            waitInterrupt();
+        }
+    }
+}
+
+}
@@ -0,0 +1,73 @@
+// Interrupt-driven PCM playback through audio_stream_v1_0 and an AXI DMA
+//
+// The application writes samples into a ring buffer at any time. A refill thread
+// sleeps on the DMA completion interrupt (through UIO) and, each time a period
+// has been delivered to the hardware FIFO, copies the next period from the ring
+// into the other half of a double-buffered DMA area and starts the transfer.
+// The CPU therefore touches each sample once and is otherwise idle.
+
+#ifndef OVERLAY_AUDIO_STREAM_HPP
+#define OVERLAY_AUDIO_STREAM_HPP
+
+#include "mmio.hpp"
+#include "overlay_regs.hpp"
+#include "ring_buffer.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace overlay {
+
+class AudioStream {
+
+public:
+
+    static const uint32_t SAMPLE_RATE = 31250;      //2 MHz PDM clock / 64
+
+    //dmaUio is the UIO device of the AXI DMA (its interrupt must be the MM2S
+    //introut). periodSamples is the size of each DMA transfer and must not
+    //exceed half of the hardware FIFO
+    AudioStream(const std::string& dmaUio, uint32_t streamBase, ContigBuffer& dmaBuffer,
+                size_t periodSamples = 256, size_t ringSamples = 16384);
+    ~AudioStream();
+
+    AudioStream(const AudioStream&) = delete;
+    AudioStream& operator=(const AudioStream&) = delete;
+
+    //Queue samples for playback. Never blocks; returns the number accepted
+    size_t write(const int16_t* samples, size_t count) { return ring.write(samples, count); }
+
+    //Space in the ring buffer (samples)
+    size_t space() const { return ring.space(); }
+
+    void start();
+    void stop();
+
+    //Periods padded with silence because the ring ran dry
+    uint32_t ringUnderruns() const { return underruns.load(std::memory_order_relaxed); }
+
+private:
+
+    void refillLoop();
+    void submitPeriod();
+    bool waitInterrupt();
+
+    MmioRegion dmaRegion;
+    MmioRegion streamRegion;
+    volatile AxiDmaRegs* dma;
+    volatile AudioStreamRegs* regs;
+    ContigBuffer& buffer;
+    int uioFd = -1;
+    const size_t period;
+    unsigned half = 0;                      //DMA buffer half to fill next
+    RingBuffer<int16_t> ring;
+    std::atomic<bool> running{false};
+    std::atomic<uint32_t> underruns{0};
+    std::thread refillThread;
+};
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+// Play a tone through audio_stream_v1_0 and report the CPU time used
+//
+// Usage: sudo ./bench_audio /dev/uioN <audio_stream base address> [seconds]
+
+#include "audio_stream.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace overlay;
+
+const double TONE_HZ = 440.0;
+const size_t CHUNK = 1024;
+
+static double cpuSeconds() {
+    rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    return r.ru_utime.tv_sec + r.ru_stime.tv_sec + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) * 1e-6;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s /dev/uioN <audio_stream base> [seconds]\n", argv[0]);
+        return 1;
+    }
+    const double seconds = argc > 3 ? std::atof(argv[3]) : 10.0;
+
+    try {
+        ContigBuffer dmaBuffer;
+        AudioStream audio(argv[1], static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 0)), dmaBuffer);
+
+        std::vector<int16_t> chunk(CHUNK);
+        size_t phase = 0;
+        const size_t total = static_cast<size_t>(seconds * AudioStream::SAMPLE_RATE);
+        size_t sent = 0;
+        auto writeChunk = [&] {
+            for (auto& s : chunk)
+                s = static_cast<int16_t>(16000 * std::sin(2 * M_PI * TONE_HZ * phase++ / AudioStream::SAMPLE_RATE));
+            sent += audio.write(chunk.data(), CHUNK);
+        };
+
+        // Fill the ring before starting, so start-up is not counted as underruns
+        while (sent < total && audio.space() >= CHUNK)
+            writeChunk();
+
+        double cpu0 = cpuSeconds();
+        auto t0 = std::chrono::steady_clock::now();
+        audio.start();
+        while (sent < total) {
+            if (audio.space() < CHUNK) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            writeChunk();
+        }
+        audio.stop();
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double cpu = cpuSeconds() - cpu0;
+
+        std::printf("%zu samples in %.2f s, CPU %.3f s (%.1f%% of one core), %u ring underruns\n",
+                    sent, wall, cpu, 100.0 * cpu / wall, audio.ringUnderruns());
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "bench_audio: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
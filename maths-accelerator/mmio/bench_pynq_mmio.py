@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Time the pynq Python path for the operations measured by bench_mmio.
+
+Run on the Pynq with the overlay bitstream path as the argument.
+"""
+
+import sys
+import time
+
+from pynq import Overlay, MMIO
+from pynq.lib.video import VideoMode
+
+ITERATIONS = 10000
+
+
+def ns_per(start, end, n):
+    return (end - start) * 1e9 / n
+
+
+def main(bitfile):
+    overlay = Overlay(bitfile)
+    pixgen = overlay.pixel_generator_0
+
+    mmio = MMIO(0x40030000, 0x20)
+    t0 = time.perf_counter()
+    for i in range(ITERATIONS):
+        mmio.write(0, i)
+    t1 = time.perf_counter()
+    print(f'MMIO.write:                   {ns_per(t0, t1, ITERATIONS):8.1f} ns')
+
+    t0 = time.perf_counter()
+    for i in range(ITERATIONS):
+        mmio.read(0)
+    t1 = time.perf_counter()
+    print(f'MMIO.read:                    {ns_per(t0, t1, ITERATIONS):8.1f} ns')
+
+    t0 = time.perf_counter()
+    for i in range(ITERATIONS):
+        pixgen.register_map.gp0 = i
+    t1 = time.perf_counter()
+    print(f'register_map.gp0 write:       {ns_per(t0, t1, ITERATIONS):8.1f} ns')
+
+    vdma = overlay.video.axi_vdma_0.readchannel
+    vdma.mode = VideoMode(640, 480, 24)
+    vdma.start()
+    t0 = time.perf_counter()
+    for i in range(ITERATIONS // 100):
+        vdma.readframe()
+    t1 = time.perf_counter()
+    print(f'readframe:                    {ns_per(t0, t1, ITERATIONS // 100):8.1f} ns')
+    vdma.stop()
+
+
+if __name__ == '__main__':
+    main(sys.argv[1] if len(sys.argv) > 1 else '/home/xilinx/elec50015.bit')
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""Generate a typed C++ register struct from a Vitis HLS s_axilite map.
+
+Vitis HLS writes the register map of each s_axilite bundle to
+<solution>/impl/misc/drivers/<ip>_v1_0/src/x<ip>_hw.h as a list of
+X<IP>_<BUNDLE>_ADDR_<PORT>_DATA / _BITS_<PORT>_DATA defines. This script turns
+those into a packed struct of volatile 32-bit registers that can be overlaid on
+an MmioRegion, e.g.
+
+    python3 gen_regs.py ColorConvertRegs \\
+        ../overlay/ip/hls/color_convert_2/solution1/impl/misc/drivers/color_convert_2_v1_0/src/xcolor_convert_2_hw.h
+"""
+
+import re
+import sys
+
+ADDR_RE = re.compile(r'#define\s+X\w+?_(\w+?)_ADDR_(\w+)_DATA\s+0x([0-9a-fA-F]+)')
+BITS_RE = re.compile(r'#define\s+X\w+?_(\w+?)_BITS_(\w+)_DATA\s+(\d+)')
+
+
+def parse(path):
+    regs = {}
+    bits = {}
+    with open(path) as f:
+        for line in f:
+            m = ADDR_RE.match(line)
+            if m:
+                regs[m.group(2).lower()] = int(m.group(3), 16)
+                continue
+            m = BITS_RE.match(line)
+            if m:
+                bits[m.group(2).lower()] = int(m.group(3))
+    if not regs:
+        sys.exit(f'{path}: no s_axilite data registers found')
+    return sorted(regs.items(), key=lambda r: r[1]), bits
+
+
+def emit(name, regs, bits, source):
+    out = [f'//Generated by gen_regs.py from {source}. Do not edit',
+           f'struct {name} {{']
+    offset = 0
+    pad = 0
+    for reg, addr in regs:
+        if addr > offset:
+            out.append(f'    uint32_t reserved{pad}[{(addr - offset) // 4}];')
+            pad += 1
+        width = bits.get(reg, 32)
+        out.append(f'    uint32_t {reg};{" " * max(1, 16 - len(reg))}//{width} bits')
+        offset = addr + 4
+    out.append('};')
+    for reg, addr in regs:
+        out.append(f'static_assert(offsetof({name}, {reg}) == 0x{addr:02x}, "{name} layout");')
+    return '\n'.join(out)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    regs, bits = parse(sys.argv[2])
+    print(emit(sys.argv[1], regs, bits, sys.argv[2].split('/')[-1]))
@@ -0,0 +1,139 @@
+// Userspace MMIO and contiguous buffer access for the maths accelerator overlay
+
+#include "mmio.hpp"
+
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace overlay {
+
+namespace {
+
+[[noreturn]] void throwErrno(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+//Read a single number from a sysfs attribute such as phys_addr or size
+uint64_t readSysfs(const std::string& path) {
+    std::ifstream f(path);
+    uint64_t value = 0;
+    if (!(f >> std::hex >> value))
+        throw std::runtime_error("Unable to read " + path);
+    return value;
+}
+
+}
+
+MmioRegion::MmioRegion(uint32_t base, size_t size) : phys(base), size(size) {
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t pageOffset = base & (page - 1);
+    mapFile("/dev/mem", static_cast<off_t>(base - pageOffset), pageOffset);
+}
+
+MmioRegion::MmioRegion(const std::string& uioDevice, size_t size) : size(size) {
+    //UIO maps are selected by mmap offset: map N is at N * page size. Map 0 is the register window
+    mapFile(uioDevice.c_str(), 0, 0);
+}
+
+void MmioRegion::mapFile(const char* path, off_t offset, size_t pageOffset) {
+    int fd = open(path, O_RDWR | O_SYNC);
+    if (fd < 0)
+        throwErrno(std::string("open ") + path);
+
+    mapSize = size + pageOffset;
+    mapBase = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    int mapErrno = errno;
+    close(fd);      //the mapping holds its own reference to the device
+    if (mapBase == MAP_FAILED) {
+        mapBase = nullptr;
+        errno = mapErrno;
+        throwErrno(std::string("mmap ") + path);
+    }
+    virt = static_cast<volatile uint8_t*>(mapBase) + pageOffset;
+}
+
+MmioRegion::~MmioRegion() {
+    release();
+}
+
+MmioRegion::MmioRegion(MmioRegion&& other) noexcept {
+    *this = std::move(other);
+}
+
+MmioRegion& MmioRegion::operator=(MmioRegion&& other) noexcept {
+    if (this != &other) {
+        release();
+        virt = std::exchange(other.virt, nullptr);
+        mapBase = std::exchange(other.mapBase, nullptr);
+        mapSize = std::exchange(other.mapSize, 0);
+        phys = other.phys;
+        size = other.size;
+    }
+    return *this;
+}
+
+void MmioRegion::release() {
+    if (mapBase)
+        munmap(mapBase, mapSize);
+    mapBase = nullptr;
+    virt = nullptr;
+}
+
+ContigBuffer::ContigBuffer(const std::string& name) {
+    const std::string sysfs = "/sys/class/u-dma-buf/" + name + "/";
+    phys = static_cast<uint32_t>(readSysfs(sysfs + "phys_addr"));
+    {
+        std::ifstream f(sysfs + "size");
+        if (!(f >> size))
+            throw std::runtime_error("Unable to read " + sysfs + "size");
+    }
+
+    //With O_SYNC, u-dma-buf maps the pages write-combined (sync_mode), so CPU
+    //writes reach DDR without explicit cache maintenance before a VDMA read
+    fd = open(("/dev/" + name).c_str(), O_RDWR | O_SYNC);
+    if (fd < 0)
+        throwErrno("open /dev/" + name);
+
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        int mapErrno = errno;
+        close(fd);
+        errno = mapErrno;
+        throwErrno("mmap /dev/" + name);
+    }
+    virt = static_cast<uint8_t*>(p);
+}
+
+ContigBuffer::~ContigBuffer() {
+    if (virt)
+        munmap(virt, size);
+    if (fd >= 0)
+        close(fd);
+}
+
+size_t ContigBuffer::alignedFrame(size_t frameBytes) {
+    return (frameBytes + 0xFFF) & ~static_cast<size_t>(0xFFF);
+}
+
+uint8_t* ContigBuffer::frame(unsigned n, size_t frameBytes) const {
+    size_t offset = n * alignedFrame(frameBytes);
+    if (offset + frameBytes > size)
+        throw std::out_of_range("Frame does not fit in contiguous buffer");
+    return virt + offset;
+}
+
+uint32_t ContigBuffer::framePhys(unsigned n, size_t frameBytes) const {
+    size_t offset = n * alignedFrame(frameBytes);
+    if (offset + frameBytes > size)
+        throw std::out_of_range("Frame does not fit in contiguous buffer");
+    return phys + static_cast<uint32_t>(offset);
+}
+
+}
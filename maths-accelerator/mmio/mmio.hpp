@@ -0,0 +1,103 @@
+// Userspace MMIO and contiguous buffer access for the maths accelerator overlay
+//
+// Maps AXI-Lite register windows directly into the process through /dev/mem or
+// a UIO device, so that a register access is a single load or store rather than
+// a call into the Python pynq library. Frame buffers are allocated from the
+// u-dma-buf driver so that the CPU and the VDMA share the same physical pages.
+
+#ifndef OVERLAY_MMIO_HPP
+#define OVERLAY_MMIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+namespace overlay {
+
+//A mapped window of physical address space
+class MmioRegion {
+
+public:
+
+    //Map size bytes of physical address space starting at base through /dev/mem
+    MmioRegion(uint32_t base, size_t size);
+
+    //Map the first memory region of a UIO device, e.g. "/dev/uio4"
+    MmioRegion(const std::string& uioDevice, size_t size);
+
+    ~MmioRegion();
+
+    MmioRegion(const MmioRegion&) = delete;
+    MmioRegion& operator=(const MmioRegion&) = delete;
+    MmioRegion(MmioRegion&& other) noexcept;
+    MmioRegion& operator=(MmioRegion&& other) noexcept;
+
+    //Get a typed view of the register map. The struct layout must match the hardware
+    template <typename Regs>
+    volatile Regs* regs() const {
+        static_assert(sizeof(Regs) <= 0x10000, "Register map larger than an AXI-Lite segment");
+        return reinterpret_cast<volatile Regs*>(virt);
+    }
+
+    //Raw 32-bit access at a byte offset
+    void write32(size_t offset, uint32_t value) const {
+        *reinterpret_cast<volatile uint32_t*>(virt + offset) = value;
+    }
+
+    uint32_t read32(size_t offset) const {
+        return *reinterpret_cast<volatile uint32_t*>(virt + offset);
+    }
+
+    uint32_t physAddr() const { return phys; }
+    size_t length() const { return size; }
+
+private:
+
+    void mapFile(const char* path, off_t offset, size_t pageOffset);
+    void release();
+
+    volatile uint8_t* virt = nullptr;   //user virtual address of the register window
+    void* mapBase = nullptr;            //page-aligned base returned by mmap
+    size_t mapSize = 0;                 //page-aligned length of the mapping
+    uint32_t phys = 0;                  //physical address of the window (0 for UIO)
+    size_t size = 0;                    //length of the register window (bytes)
+};
+
+//Physically contiguous, cache-coherent buffer allocated from a u-dma-buf device.
+//The VDMA writes frames straight into these pages, so handing a frame to the
+//CPU or to the HDMI output is just passing the physical address.
+class ContigBuffer {
+
+public:
+
+    //Open /dev/<name> (e.g. "udmabuf0"). The buffer size is fixed by the driver
+    explicit ContigBuffer(const std::string& name = "udmabuf0");
+
+    ~ContigBuffer();
+
+    ContigBuffer(const ContigBuffer&) = delete;
+    ContigBuffer& operator=(const ContigBuffer&) = delete;
+
+    uint8_t* data() const { return virt; }
+    uint32_t physAddr() const { return phys; }
+    size_t length() const { return size; }
+
+    //Carve out the nth of count equally sized, 4 KiB aligned frames
+    uint8_t* frame(unsigned n, size_t frameBytes) const;
+    uint32_t framePhys(unsigned n, size_t frameBytes) const;
+
+private:
+
+    static size_t alignedFrame(size_t frameBytes);
+
+    int fd = -1;
+    uint8_t* virt = nullptr;
+    uint32_t phys = 0;
+    size_t size = 0;
+};
+
+}
+
+#endif
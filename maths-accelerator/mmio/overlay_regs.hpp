@@ -0,0 +1,161 @@
+// Typed register maps for the blocks of the maths accelerator overlay
+//
+// Each struct is laid over an MmioRegion with MmioRegion::regs<T>(), so that a
+// field access compiles to a single volatile load or store. Base addresses are
+// those assigned in overlay/base.tcl.
+
+#ifndef OVERLAY_REGS_HPP
+#define OVERLAY_REGS_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace overlay {
+
+//Physical base addresses from the address map in base.tcl
+const uint32_t PIXEL_GENERATOR_BASEADDR     = 0x40030000;
+const uint32_t IMGEN_VDMA_BASEADDR          = 0x43010000;   //video/axi_vdma_0, pixel generator -> memory
+const uint32_t HDMI_VDMA_BASEADDR           = 0x43000000;   //video/axi_vdma, memory -> HDMI out
+const uint32_t HDMI_IN_COLOR_CONVERT_BASEADDR  = 0x43C50000;
+const uint32_t HDMI_OUT_COLOR_CONVERT_BASEADDR = 0x43C60000;
+const size_t   AXI_LITE_SEGMENT             = 0x10000;
+
+//pixel_generator.v: REG_FILE_SIZE 32-bit words, regfile[n] at byte offset 4n
+struct PixelGeneratorRegs {
+    uint32_t regfile[8];
+};
+static_assert(sizeof(PixelGeneratorRegs) == 8 * 4, "PixelGeneratorRegs layout");
+
+//Generated by gen_regs.py from xcolor_convert_2_hw.h. Do not edit
+struct ColorConvertRegs {
+    uint32_t reserved0[4];
+    uint32_t c1_c1;           //10 bits
+    uint32_t reserved1[1];
+    uint32_t c1_c2;           //10 bits
+    uint32_t reserved2[1];
+    uint32_t c1_c3;           //10 bits
+    uint32_t reserved3[1];
+    uint32_t c2_c1;           //10 bits
+    uint32_t reserved4[1];
+    uint32_t c2_c2;           //10 bits
+    uint32_t reserved5[1];
+    uint32_t c2_c3;           //10 bits
+    uint32_t reserved6[1];
+    uint32_t c3_c1;           //10 bits
+    uint32_t reserved7[1];
+    uint32_t c3_c2;           //10 bits
+    uint32_t reserved8[1];
+    uint32_t c3_c3;           //10 bits
+    uint32_t reserved9[1];
+    uint32_t bias_c1;         //10 bits
+    uint32_t reserved10[1];
+    uint32_t bias_c2;         //10 bits
+    uint32_t reserved11[1];
+    uint32_t bias_c3;         //10 bits
+};
+static_assert(offsetof(ColorConvertRegs, c1_c1) == 0x10, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, c1_c2) == 0x18, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, c1_c3) == 0x20, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, c2_c1) == 0x28, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, c2_c2) == 0x30, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, c2_c3) == 0x38, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, c3_c1) == 0x40, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, c3_c2) == 0x48, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, c3_c3) == 0x50, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, bias_c1) == 0x58, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, bias_c2) == 0x60, "ColorConvertRegs layout");
+static_assert(offsetof(ColorConvertRegs, bias_c3) == 0x68, "ColorConvertRegs layout");
+
+//Convert a colour conversion coefficient to the ap_fixed<10,2> register format
+inline uint32_t toCoeff(float c) {
+    long raw = std::lround(c * 256.0f);
+    if (raw > 511) raw = 511;
+    if (raw < -512) raw = -512;
+    return static_cast<uint32_t>(raw) & 0x3FF;
+}
+
+//AXI VDMA (PG020) register map, direct register mode
+struct VdmaRegs {
+    uint32_t mm2s_vdmacr;           //0x00
+    uint32_t mm2s_vdmasr;           //0x04
+    uint32_t reserved0[8];
+    uint32_t park_ptr_reg;          //0x28
+    uint32_t vdma_version;          //0x2C
+    uint32_t s2mm_vdmacr;           //0x30
+    uint32_t s2mm_vdmasr;           //0x34
+    uint32_t reserved1[1];
+    uint32_t s2mm_irq_mask;         //0x3C
+    uint32_t reserved2[1];
+    uint32_t s2mm_reg_index;        //0x44
+    uint32_t reserved3[2];
+    uint32_t mm2s_vsize;            //0x50
+    uint32_t mm2s_hsize;            //0x54
+    uint32_t mm2s_frmdly_stride;    //0x58
+    uint32_t mm2s_start_address[16];    //0x5C
+    uint32_t reserved4[1];
+    uint32_t s2mm_vsize;            //0xA0
+    uint32_t s2mm_hsize;            //0xA4
+    uint32_t s2mm_frmdly_stride;    //0xA8
+    uint32_t s2mm_start_address[16];    //0xAC
+};
+static_assert(offsetof(VdmaRegs, park_ptr_reg) == 0x28, "VdmaRegs layout");
+static_assert(offsetof(VdmaRegs, s2mm_vdmacr) == 0x30, "VdmaRegs layout");
+static_assert(offsetof(VdmaRegs, mm2s_vsize) == 0x50, "VdmaRegs layout");
+static_assert(offsetof(VdmaRegs, mm2s_start_address) == 0x5C, "VdmaRegs layout");
+static_assert(offsetof(VdmaRegs, s2mm_vsize) == 0xA0, "VdmaRegs layout");
+static_assert(offsetof(VdmaRegs, s2mm_start_address) == 0xAC, "VdmaRegs layout");
+
+//VDMACR bits
+const uint32_t VDMACR_RS            = 1u << 0;  //run/stop
+const uint32_t VDMACR_CIRCULAR_PARK = 1u << 1;  //1 = circular through frame stores, 0 = park
+const uint32_t VDMACR_RESET         = 1u << 2;
+//PARK_PTR_REG fields
+inline uint32_t parkReadFrame(uint32_t park)  { return park & 0x1F; }
+inline uint32_t parkWriteStore(uint32_t park) { return (park >> 24) & 0x1F; }
+
+//AXI DMA (PG021) register map, simple (direct register) mode
+struct AxiDmaRegs {
+    uint32_t mm2s_dmacr;            //0x00
+    uint32_t mm2s_dmasr;            //0x04
+    uint32_t reserved0[4];
+    uint32_t mm2s_sa;               //0x18
+    uint32_t mm2s_sa_msb;           //0x1C
+    uint32_t reserved1[2];
+    uint32_t mm2s_length;           //0x28, writing starts the transfer
+    uint32_t reserved2[1];
+    uint32_t s2mm_dmacr;            //0x30
+    uint32_t s2mm_dmasr;            //0x34
+    uint32_t reserved3[4];
+    uint32_t s2mm_da;               //0x48
+    uint32_t s2mm_da_msb;           //0x4C
+    uint32_t reserved4[2];
+    uint32_t s2mm_length;           //0x58
+};
+static_assert(offsetof(AxiDmaRegs, mm2s_length) == 0x28, "AxiDmaRegs layout");
+static_assert(offsetof(AxiDmaRegs, s2mm_length) == 0x58, "AxiDmaRegs layout");
+
+const uint32_t DMACR_RS         = 1u << 0;
+const uint32_t DMACR_RESET      = 1u << 2;
+const uint32_t DMACR_IOC_IRQ_EN = 1u << 12;
+const uint32_t DMASR_HALTED     = 1u << 0;
+const uint32_t DMASR_IDLE       = 1u << 1;
+const uint32_t DMASR_IOC_IRQ    = 1u << 12;
+
+//audio_stream_v1_0.v, the streaming variant of audio_direct
+struct AudioStreamRegs {
+    uint32_t ctrl;                  //0x00
+    uint32_t status;                //0x04
+    uint32_t clear;                 //0x08
+    uint32_t depth;                 //0x0C
+};
+
+const uint32_t AUDIO_STREAM_CTRL_PLAY      = 1u << 0;
+const uint32_t AUDIO_STREAM_CTRL_RECORD    = 1u << 1;
+const uint32_t AUDIO_STREAM_CTRL_IRQ       = 1u << 2;
+const uint32_t AUDIO_STREAM_CTRL_FLUSH     = 1u << 3;
+const uint32_t AUDIO_STREAM_STATUS_UNDERRUN = 1u << 17;
+
+}
+
+#endif
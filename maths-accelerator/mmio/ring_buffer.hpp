@@ -0,0 +1,79 @@
+// Single-producer, single-consumer lock-free ring buffer
+//
+// One thread calls write() and another calls read(); neither blocks. The
+// capacity is rounded up to a power of two so that indices wrap with a mask.
+
+#ifndef OVERLAY_RING_BUFFER_HPP
+#define OVERLAY_RING_BUFFER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace overlay {
+
+template <typename T>
+class RingBuffer {
+
+    static_assert(std::is_trivially_copyable<T>::value, "RingBuffer elements are copied with memcpy");
+
+public:
+
+    explicit RingBuffer(size_t minCapacity) : capacity(roundUp(minCapacity)), mask(capacity - 1),
+        buffer(new T[capacity]) {}
+
+    //Number of elements available to read
+    size_t available() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+    }
+
+    //Number of elements that can be written without overwriting unread data
+    size_t space() const {
+        return capacity - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+    }
+
+    //Copy up to count elements in. Returns the number written. Producer only
+    size_t write(const T* data, size_t count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        count = std::min(count, space());
+        size_t first = std::min(count, capacity - (h & mask));
+        std::memcpy(&buffer[h & mask], data, first * sizeof(T));
+        std::memcpy(&buffer[0], data + first, (count - first) * sizeof(T));
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    //Copy up to count elements out. Returns the number read. Consumer only
+    size_t read(T* data, size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        count = std::min(count, available());
+        size_t first = std::min(count, capacity - (t & mask));
+        std::memcpy(data, &buffer[t & mask], first * sizeof(T));
+        std::memcpy(data + first, &buffer[0], (count - first) * sizeof(T));
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t size() const { return capacity; }
+
+private:
+
+    static size_t roundUp(size_t n) {
+        size_t c = 1;
+        while (c < n) c <<= 1;
+        return c;
+    }
+
+    const size_t capacity;
+    const size_t mask;
+    std::unique_ptr<T[]> buffer;
+    alignas(64) std::atomic<size_t> head{0};    //written by the producer
+    alignas(64) std::atomic<size_t> tail{0};    //written by the consumer
+};
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ *
+ * @file io_switch_bench.c
+ *
+ * Count the AXI transactions needed to reconfigure the IO switch with the
+ * per-pin read-modify-write path and with the shadow-register API, on the
+ * host register model. Kept out of the driver sources so that applications
+ * linking the driver do not carry it. The driver must be built with
+ * -DIO_SWITCH_STATS, as the Makefile here does.
+ *
+ *****************************************************************************/
+#include "xio_switch.h"
+
+#ifdef IO_SWITCH_STATS
+
+#define BENCH_PINS 8
+
+// Pin maps for an SPI + UART peripheral set and its reverse
+static const u8 spi_uart_map[BENCH_PINS] = {
+    UART0_RX, UART0_TX, GPIO, GPIO, SS0, MOSI0, MISO0, SPICLK0
+};
+static const u8 gpio_map[BENCH_PINS] = {
+    GPIO, GPIO, GPIO, GPIO, GPIO, GPIO, GPIO, GPIO
+};
+
+// set_pin() as it was before the shadow registers: one read and one write
+// per pin
+static void rmw_set_pin(int pin_number, u8 pin_type) {
+    u32 value;
+    int word = pin_number/4;
+    int shift = (pin_number%4)*8;
+
+    io_switch_stats.reads++;
+    value = Xil_In32(SWITCH_BASEADDR+4*word);
+    value = (value & ~(0xFFu<<shift)) | ((u32)pin_type<<shift);
+    io_switch_stats.writes++;
+    Xil_Out32(SWITCH_BASEADDR+4*word, value);
+}
+
+static void report(const char *name) {
+    xil_printf("%-28s %2d reads %2d writes\r\n", name,
+               io_switch_stats.reads, io_switch_stats.writes);
+    io_switch_stats.reads = 0;
+    io_switch_stats.writes = 0;
+}
+
+void io_switch_bench(void) {
+    int i;
+
+    init_io_switch();
+    report("init_io_switch");
+
+    for (i=0; i<BENCH_PINS; i++)
+        rmw_set_pin(i, spi_uart_map[i]);
+    report("read-modify-write per pin");
+
+    // The per-pin path bypasses the shadow registers
+    sync_io_switch();
+    report("sync_io_switch");
+
+    for (i=0; i<BENCH_PINS; i++)
+        set_pin(i, gpio_map[i]);
+    report("set_pin per pin");
+
+    for (i=0; i<BENCH_PINS; i++)
+        stage_pin(i, spi_uart_map[i]);
+    commit_io_switch();
+    report("stage_pin + commit");
+
+    apply_pin_map(gpio_map, BENCH_PINS);
+    report("apply_pin_map");
+
+    apply_pin_map(gpio_map, BENCH_PINS);
+    report("apply_pin_map (no change)");
+}
+
+#endif
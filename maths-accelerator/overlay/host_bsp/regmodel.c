@@ -0,0 +1,129 @@
+/******************************************************************************
+ *
+ * @file regmodel.c
+ *
+ * In-memory register model for running the IP drivers on a host PC.
+ *
+ *****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "regmodel.h"
+#include "xil_io.h"
+
+static struct regmodel_region regions[REGMODEL_MAX_REGIONS];
+static int num_regions;
+static FILE *log_file;
+
+struct xil_io_backend xil_io_current = {
+    regmodel_read32, regmodel_write32, NULL
+};
+
+void xil_io_set_backend(const struct xil_io_backend *backend) {
+    static const struct xil_io_backend model = {
+        regmodel_read32, regmodel_write32, NULL
+    };
+    xil_io_current = backend ? *backend : model;
+}
+
+struct regmodel_region *regmodel_add(const char *name, UINTPTR base, u32 size) {
+    struct regmodel_region *r;
+    int i;
+
+    if (num_regions == REGMODEL_MAX_REGIONS || size == 0)
+        return NULL;
+    for (i=0; i<num_regions; i++)
+        if (base < regions[i].base + regions[i].size && regions[i].base < base + size)
+            return NULL;
+
+    r = &regions[num_regions++];
+    memset(r, 0, sizeof(*r));
+    r->name = name;
+    r->base = base;
+    r->size = size;
+    r->regs = calloc(size/4, sizeof(u32));
+    r->read_ns = REGMODEL_DEFAULT_READ_NS;
+    r->write_ns = REGMODEL_DEFAULT_WRITE_NS;
+    return r;
+}
+
+void regmodel_reset(void) {
+    int i;
+    for (i=0; i<num_regions; i++)
+        free(regions[i].regs);
+    num_regions = 0;
+}
+
+void regmodel_set_log(FILE *f) {
+    log_file = f;
+}
+
+static struct regmodel_region *find(UINTPTR addr, const char *op) {
+    int i;
+    for (i=0; i<num_regions; i++)
+        if (addr >= regions[i].base && addr < regions[i].base + regions[i].size)
+            return &regions[i];
+    fprintf(stderr, "regmodel: %s of unmapped address 0x%08lx\n", op, (unsigned long)addr);
+    abort();
+}
+
+u32 regmodel_read32(void *ctx, UINTPTR addr) {
+    struct regmodel_region *r = find(addr, "read");
+    u32 offset = (u32)(addr - r->base);
+    u32 value;
+
+    (void)ctx;
+    value = r->read_hook ? r->read_hook(r, offset) : r->regs[offset/4];
+    r->stats.reads++;
+    r->stats.latency_ns += r->read_ns;
+    if (log_file)
+        fprintf(log_file, "R %-16s +0x%02x -> 0x%08x\n", r->name, offset, value);
+    return value;
+}
+
+void regmodel_write32(void *ctx, UINTPTR addr, u32 value) {
+    struct regmodel_region *r = find(addr, "write");
+    u32 offset = (u32)(addr - r->base);
+
+    (void)ctx;
+    if (r->write_hook)
+        r->write_hook(r, offset, value);
+    else
+        r->regs[offset/4] = value;
+    r->stats.writes++;
+    r->stats.latency_ns += r->write_ns;
+    if (log_file)
+        fprintf(log_file, "W %-16s +0x%02x <- 0x%08x\n", r->name, offset, value);
+}
+
+void regmodel_total(struct regmodel_stats *out) {
+    int i;
+    memset(out, 0, sizeof(*out));
+    for (i=0; i<num_regions; i++) {
+        out->reads += regions[i].stats.reads;
+        out->writes += regions[i].stats.writes;
+        out->latency_ns += regions[i].stats.latency_ns;
+    }
+}
+
+void regmodel_clear_stats(void) {
+    int i;
+    for (i=0; i<num_regions; i++)
+        memset(&regions[i].stats, 0, sizeof(regions[i].stats));
+}
+
+void regmodel_report(FILE *f) {
+    struct regmodel_stats total;
+    int i;
+
+    fprintf(f, "%-18s %10s %10s %12s\n", "region", "reads", "writes", "bus time");
+    for (i=0; i<num_regions; i++)
+        fprintf(f, "%-18s %10llu %10llu %9llu ns\n", regions[i].name,
+                (unsigned long long)regions[i].stats.reads,
+                (unsigned long long)regions[i].stats.writes,
+                (unsigned long long)regions[i].stats.latency_ns);
+    regmodel_total(&total);
+    fprintf(f, "%-18s %10llu %10llu %9llu ns\n", "total",
+            (unsigned long long)total.reads, (unsigned long long)total.writes,
+            (unsigned long long)total.latency_ns);
+}
@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ * @file regmodel.h
+ *
+ * In-memory register model for running the IP drivers on a host PC.
+ *
+ * Each device is a region of 32-bit registers. By default a region behaves
+ * like the AXI-Lite slave registers generated by the Vivado IP packager
+ * (reads return the last value written); read and write hooks can be
+ * attached to model device behaviour. Every access is counted, optionally
+ * logged, and charged a per-region latency so that the register traffic of
+ * a driver can be measured before it is run on the board.
+ *
+ *****************************************************************************/
+#ifndef REGMODEL_H
+#define REGMODEL_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include "xil_types.h"
+
+#define REGMODEL_MAX_REGIONS 16
+
+// Default per-access latencies, typical of an AXI-Lite slave on the Zynq-7000
+// GP port at 100 MHz. Set read_ns/write_ns per region to match the hardware
+#define REGMODEL_DEFAULT_READ_NS  200
+#define REGMODEL_DEFAULT_WRITE_NS 60
+
+struct regmodel_region;
+
+typedef u32  (*regmodel_read_hook)(struct regmodel_region *r, u32 offset);
+typedef void (*regmodel_write_hook)(struct regmodel_region *r, u32 offset, u32 value);
+
+struct regmodel_stats {
+    u64 reads;
+    u64 writes;
+    u64 latency_ns;     // total modelled bus time
+};
+
+struct regmodel_region {
+    const char *name;
+    UINTPTR base;
+    u32 size;                   // bytes
+    u32 *regs;                  // register storage, size/4 words
+    u32 read_ns;
+    u32 write_ns;
+    regmodel_read_hook read_hook;   // NULL: return stored value
+    regmodel_write_hook write_hook; // NULL: store value
+    void *ctx;                  // for use by hooks
+    struct regmodel_stats stats;
+};
+
+// Add a region of size bytes at base with default latencies. Returns NULL if
+// the region overlaps another or the table is full
+struct regmodel_region *regmodel_add(const char *name, UINTPTR base, u32 size);
+
+// Remove all regions and reset the statistics
+void regmodel_reset(void);
+
+// Log every access to f, or stop logging with NULL
+void regmodel_set_log(FILE *f);
+
+// Statistics for all regions, and clear them
+void regmodel_total(struct regmodel_stats *out);
+void regmodel_clear_stats(void);
+
+// Print a table of accesses and latency per region
+void regmodel_report(FILE *f);
+
+// Access functions, installed as the default Xil_In32/Xil_Out32 backend.
+// An access outside every region aborts with a message, like a bus error
+u32  regmodel_read32(void *ctx, UINTPTR addr);
+void regmodel_write32(void *ctx, UINTPTR addr, u32 value);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // REGMODEL_H
@@ -0,0 +1,70 @@
+/******************************************************************************
+ *
+ * @file run_selftests.c
+ *
+ * Run the IP driver self tests and the io_switch configuration API on the
+ * host register model, and report the register traffic of each.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "regmodel.h"
+#include "xparameters.h"
+#include "xstatus.h"
+
+#include "io_switch.h"
+#include "xio_switch.h"
+#include "boolean_generator.h"
+#include "gclk_generator.h"
+#include "audio_direct.h"
+
+#ifdef IO_SWITCH_STATS
+void io_switch_bench(void);     // io_switch_bench.c
+#endif
+
+struct selftest {
+    const char *name;
+    UINTPTR base;
+    u32 size;           // 2^C_S_AXI_ADDR_WIDTH bytes
+    XStatus (*run)(void *baseaddr_p);
+};
+
+static const struct selftest selftests[] = {
+    { "io_switch",         XPAR_IO_SWITCH_0_S_AXI_BASEADDR,         64,  IO_SWITCH_Reg_SelfTest },
+    { "boolean_generator", XPAR_BOOLEAN_GENERATOR_0_S_AXI_BASEADDR, 256, BOOLEAN_GENERATOR_Reg_SelfTest },
+    { "gclk_generator",    XPAR_GCLK_GENERATOR_0_S_AXI_BASEADDR,    16,  GCLK_GENERATOR_Reg_SelfTest },
+    { "audio_direct",      XPAR_AUDIO_DIRECT_0_S_AXI_BASEADDR,      32,  AUDIO_DIRECT_Reg_SelfTest },
+};
+#define NUM_SELFTESTS (sizeof(selftests)/sizeof(selftests[0]))
+
+int main(int argc, char *argv[]) {
+    unsigned i;
+    int failures = 0;
+
+    if (argc > 1 && strcmp(argv[1], "-v") == 0)
+        regmodel_set_log(stdout);
+
+    for (i=0; i<NUM_SELFTESTS; i++)
+        regmodel_add(selftests[i].name, selftests[i].base, selftests[i].size);
+
+    for (i=0; i<NUM_SELFTESTS; i++) {
+        if (selftests[i].run((void *)selftests[i].base) != XST_SUCCESS) {
+            printf("%s: self test FAILED\n", selftests[i].name);
+            failures++;
+        }
+    }
+    printf("\nSelf tests\n");
+    regmodel_report(stdout);
+
+    regmodel_clear_stats();
+#ifdef IO_SWITCH_STATS
+    io_switch_bench();
+#else
+    init_io_switch();
+#endif
+    printf("\nio_switch configuration\n");
+    regmodel_report(stdout);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,44 @@
+/******************************************************************************
+ *
+ * @file xil_io.h
+ *
+ * Host build of the standalone BSP register access functions. Every
+ * Xil_In32()/Xil_Out32() made by a driver, including those made through the
+ * <IP>_mReadReg/<IP>_mWriteReg macros, is passed to the register access
+ * backend installed with xil_io_set_backend(). The default backend is the
+ * in-memory register model in regmodel.c.
+ *
+ *****************************************************************************/
+#ifndef XIL_IO_H
+#define XIL_IO_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "xil_types.h"
+#include "xil_printf.h"
+
+// Register access backend
+struct xil_io_backend {
+    u32  (*read32)(void *ctx, UINTPTR addr);
+    void (*write32)(void *ctx, UINTPTR addr, u32 value);
+    void *ctx;
+};
+
+// Install a backend. Passing NULL restores the register model
+void xil_io_set_backend(const struct xil_io_backend *backend);
+
+extern struct xil_io_backend xil_io_current;
+
+static inline u32 Xil_In32(UINTPTR Addr) {
+    return xil_io_current.read32(xil_io_current.ctx, Addr);
+}
+
+static inline void Xil_Out32(UINTPTR Addr, u32 Value) {
+    xil_io_current.write32(xil_io_current.ctx, Addr, Value);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // XIL_IO_H
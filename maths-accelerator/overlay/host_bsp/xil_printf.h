@@ -0,0 +1,15 @@
+/******************************************************************************
+ *
+ * @file xil_printf.h
+ *
+ * Host build of xil_printf, forwarded to the C library.
+ *
+ *****************************************************************************/
+#ifndef XIL_PRINTF_H
+#define XIL_PRINTF_H
+
+#include <stdio.h>
+
+#define xil_printf printf
+
+#endif // XIL_PRINTF_H
@@ -0,0 +1,34 @@
+/******************************************************************************
+ *
+ * @file xil_types.h
+ *
+ * Host build of the standalone BSP basic types, so that the IP drivers can
+ * be compiled and run on a Linux PC against the register model in
+ * regmodel.h.
+ *
+ *****************************************************************************/
+#ifndef XIL_TYPES_H
+#define XIL_TYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t   u8;
+typedef uint16_t  u16;
+typedef uint32_t  u32;
+typedef uint64_t  u64;
+typedef int8_t    s8;
+typedef int16_t   s16;
+typedef int32_t   s32;
+typedef int64_t   s64;
+typedef uintptr_t UINTPTR;
+typedef intptr_t  INTPTR;
+
+#ifndef TRUE
+#define TRUE  1U
+#endif
+#ifndef FALSE
+#define FALSE 0U
+#endif
+
+#endif // XIL_TYPES_H
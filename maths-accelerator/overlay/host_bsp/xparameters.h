@@ -0,0 +1,20 @@
+/******************************************************************************
+ *
+ * @file xparameters.h
+ *
+ * Host build of the generated hardware parameters. The base addresses are
+ * arbitrary, non-overlapping windows in the register model; the widths
+ * match the Arduino IOP configuration of the base overlay.
+ *
+ *****************************************************************************/
+#ifndef XPARAMETERS_H
+#define XPARAMETERS_H
+
+#define XPAR_IO_SWITCH_0_S_AXI_BASEADDR         0x44A00000
+#define XPAR_IO_SWITCH_0_IO_SWITCH_WIDTH        20
+
+#define XPAR_BOOLEAN_GENERATOR_0_S_AXI_BASEADDR 0x44A10000
+#define XPAR_AUDIO_DIRECT_0_S_AXI_BASEADDR      0x44A20000
+#define XPAR_GCLK_GENERATOR_0_S_AXI_BASEADDR    0x44A30000
+
+#endif // XPARAMETERS_H
@@ -0,0 +1,18 @@
+/******************************************************************************
+ *
+ * @file xstatus.h
+ *
+ * Host build of the standalone BSP status codes used by the IP drivers.
+ *
+ *****************************************************************************/
+#ifndef XSTATUS_H
+#define XSTATUS_H
+
+#include "xil_types.h"
+
+typedef s32 XStatus;
+
+#define XST_SUCCESS 0L
+#define XST_FAILURE 1L
+
+#endif // XSTATUS_H
@@ -2,5 +2,34 @@
 
 /***************************** Include Files *******************************/
 #include "audio_direct.h"
+#include "xil_io.h"
 
 /************************** Function Definitions ***************************/
+void AUDIO_STREAM_Start(UINTPTR BaseAddress, u32 Flags)
+{
+	AUDIO_DIRECT_mWriteReg(BaseAddress, AUDIO_STREAM_CLEAR_OFFSET, 1);
+	AUDIO_DIRECT_mWriteReg(BaseAddress, AUDIO_STREAM_CTRL_OFFSET,
+		Flags & ~AUDIO_STREAM_CTRL_FLUSH);
+}
+
+void AUDIO_STREAM_Stop(UINTPTR BaseAddress)
+{
+	AUDIO_DIRECT_mWriteReg(BaseAddress, AUDIO_STREAM_CTRL_OFFSET, AUDIO_STREAM_CTRL_FLUSH);
+	AUDIO_DIRECT_mWriteReg(BaseAddress, AUDIO_STREAM_CTRL_OFFSET, 0);
+}
+
+u32 AUDIO_STREAM_GetStatus(UINTPTR BaseAddress)
+{
+	u32 status = AUDIO_DIRECT_mReadReg(BaseAddress, AUDIO_STREAM_STATUS_OFFSET);
+	if (status & (AUDIO_STREAM_STATUS_UNDERRUN | AUDIO_STREAM_STATUS_OVERFLOW))
+		AUDIO_DIRECT_mWriteReg(BaseAddress, AUDIO_STREAM_CLEAR_OFFSET, 1);
+	return status;
+}
+
+u32 AUDIO_STREAM_GetSpace(UINTPTR BaseAddress)
+{
+	u32 depth = AUDIO_DIRECT_mReadReg(BaseAddress, AUDIO_STREAM_DEPTH_OFFSET);
+	u32 level = AUDIO_DIRECT_mReadReg(BaseAddress, AUDIO_STREAM_STATUS_OFFSET)
+		& AUDIO_STREAM_STATUS_LEVEL_MASK;
+	return depth - level;
+}
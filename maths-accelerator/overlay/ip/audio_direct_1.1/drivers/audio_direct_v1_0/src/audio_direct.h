@@ -14,6 +14,26 @@
 #define AUDIO_DIRECT_S_AXI_SLV_REG4_OFFSET 16
 #define AUDIO_DIRECT_S_AXI_SLV_REG5_OFFSET 20
 
+/* Streaming variant (audio_stream_v1_0): samples move through AXI DMA and the
+ * AXI-Lite port carries only control and status */
+#define AUDIO_STREAM_CTRL_OFFSET   0
+#define AUDIO_STREAM_STATUS_OFFSET 4
+#define AUDIO_STREAM_CLEAR_OFFSET  8
+#define AUDIO_STREAM_DEPTH_OFFSET  12
+
+#define AUDIO_STREAM_CTRL_PLAY     0x1
+#define AUDIO_STREAM_CTRL_RECORD   0x2
+#define AUDIO_STREAM_CTRL_IRQ      0x4
+#define AUDIO_STREAM_CTRL_FLUSH    0x8
+
+#define AUDIO_STREAM_STATUS_LEVEL_MASK 0xFFFF
+#define AUDIO_STREAM_STATUS_HALF_EMPTY 0x10000
+#define AUDIO_STREAM_STATUS_UNDERRUN   0x20000
+#define AUDIO_STREAM_STATUS_OVERFLOW   0x40000
+
+/* Playback sample rate: 2 MHz PDM clock / 64 bits per sample */
+#define AUDIO_STREAM_SAMPLE_RATE   31250
+
 
 /**************************** Type Definitions *****************************/
 /**
@@ -78,4 +98,52 @@
  */
 XStatus AUDIO_DIRECT_Reg_SelfTest(void * baseaddr_p);
 
+/**
+ *
+ * Start the streaming engine. The playback FIFO keeps any samples already
+ * delivered by the DMA, so prime it before starting to avoid an underrun.
+ *
+ * @param   BaseAddress is the base address of the audio_stream instance.
+ * @param   Flags is a combination of AUDIO_STREAM_CTRL_PLAY,
+ *          AUDIO_STREAM_CTRL_RECORD and AUDIO_STREAM_CTRL_IRQ.
+ *
+ * @return  None.
+ *
+ */
+void AUDIO_STREAM_Start(UINTPTR BaseAddress, u32 Flags);
+
+/**
+ *
+ * Stop playback and recording and discard samples left in the playback FIFO.
+ *
+ * @param   BaseAddress is the base address of the audio_stream instance.
+ *
+ * @return  None.
+ *
+ */
+void AUDIO_STREAM_Stop(UINTPTR BaseAddress);
+
+/**
+ *
+ * Read the status register and clear the underrun and overflow flags.
+ *
+ * @param   BaseAddress is the base address of the audio_stream instance.
+ *
+ * @return  The status before clearing, see AUDIO_STREAM_STATUS_*.
+ *
+ */
+u32 AUDIO_STREAM_GetStatus(UINTPTR BaseAddress);
+
+/**
+ *
+ * Get the number of samples that can be sent to the playback FIFO without
+ * stalling the DMA.
+ *
+ * @param   BaseAddress is the base address of the audio_stream instance.
+ *
+ * @return  Free space in samples.
+ *
+ */
+u32 AUDIO_STREAM_GetSpace(UINTPTR BaseAddress);
+
 #endif // AUDIO_DIRECT_H
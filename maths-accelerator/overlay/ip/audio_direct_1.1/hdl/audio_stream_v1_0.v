@@ -0,0 +1,171 @@
+`timescale 1 ns / 1 ps
+//////////////////////////////////////////////////////////////////////////////////
+// Module Name: audio_stream_v1_0
+// Project Name: PYNQ
+//
+// Streaming variant of audio_direct: an AXI DMA feeds playback samples through
+// s_axis and receives microphone data on m_axis, and the AXI-Lite port only
+// carries control and status. Register map (see audio_direct.h):
+//   0x00 CTRL   bit 0 play enable, bit 1 record enable, bit 2 interrupt enable,
+//               bit 3 flush playback FIFO
+//   0x04 STATUS [15:0] playback FIFO level, bit 16 half empty, bit 17 underrun,
+//               bit 18 record overflow (read only)
+//   0x08 CLEAR  write 1 to bit 0 to clear the underrun and overflow flags
+//   0x0C DEPTH  playback FIFO depth in samples (read only)
+//////////////////////////////////////////////////////////////////////////////////
+
+	module audio_stream_v1_0 #
+	(
+		parameter integer FIFO_AWIDTH = 10,
+		parameter integer C_S_AXI_DATA_WIDTH	= 32,
+		parameter integer C_S_AXI_ADDR_WIDTH	= 4
+	)
+	(
+		// Audio pins
+        input wire  audio_in,
+        output wire audio_out,
+        output wire audio_shutdown,
+        output wire pdm_clk,
+        output wire irq,
+
+		// Playback stream from the DMA
+		input wire [15:0] s_axis_tdata,
+		input wire  s_axis_tvalid,
+		output wire s_axis_tready,
+
+		// Capture stream to the DMA
+		output wire [15:0] m_axis_tdata,
+		output wire m_axis_tvalid,
+		output wire m_axis_tlast,
+		input wire  m_axis_tready,
+
+		// Ports of Axi Slave Bus Interface S_AXI
+		input wire  s_axi_aclk,
+		input wire  s_axi_aresetn,
+		input wire [C_S_AXI_ADDR_WIDTH-1 : 0] s_axi_awaddr,
+		input wire  s_axi_awvalid,
+		output wire  s_axi_awready,
+		input wire [C_S_AXI_DATA_WIDTH-1 : 0] s_axi_wdata,
+		input wire  s_axi_wvalid,
+		output wire  s_axi_wready,
+		output wire [1 : 0] s_axi_bresp,
+		output wire  s_axi_bvalid,
+		input wire  s_axi_bready,
+		input wire [C_S_AXI_ADDR_WIDTH-1 : 0] s_axi_araddr,
+		input wire  s_axi_arvalid,
+		output wire  s_axi_arready,
+		output wire [C_S_AXI_DATA_WIDTH-1 : 0] s_axi_rdata,
+		output wire [1 : 0] s_axi_rresp,
+		output wire  s_axi_rvalid,
+		input wire  s_axi_rready
+	);
+
+localparam AXI_OK = 2'b00;
+
+localparam REG_CTRL   = 2'd0;
+localparam REG_STATUS = 2'd1;
+localparam REG_CLEAR  = 2'd2;
+localparam REG_DEPTH  = 2'd3;
+
+reg [3:0]   ctrl = 0;
+reg         clear_flags = 0;
+reg [31:0]  read_data;
+reg         rvalid = 0, bvalid = 0;
+reg [1:0]   write_addr;
+reg [31:0]  write_data;
+reg         have_waddr = 0, have_wdata = 0;
+
+wire [FIFO_AWIDTH:0] play_level;
+wire        play_half_empty, play_underrun, rec_overflow;
+
+//Write channel: accept address and data in either order, then respond
+always @(posedge s_axi_aclk) begin
+    clear_flags <= 0;
+    if (!s_axi_aresetn) begin
+        ctrl <= 0;
+        have_waddr <= 0;
+        have_wdata <= 0;
+        bvalid <= 0;
+    end
+    else begin
+        if (s_axi_awvalid & s_axi_awready) begin
+            write_addr <= s_axi_awaddr[3:2];
+            have_waddr <= 1;
+        end
+        if (s_axi_wvalid & s_axi_wready) begin
+            write_data <= s_axi_wdata;
+            have_wdata <= 1;
+        end
+        if (have_waddr & have_wdata & !bvalid) begin
+            case (write_addr)
+                REG_CTRL:  ctrl <= write_data[3:0];
+                REG_CLEAR: clear_flags <= write_data[0];
+                default: ;
+            endcase
+            have_waddr <= 0;
+            have_wdata <= 0;
+            bvalid <= 1;
+        end
+        if (bvalid & s_axi_bready)
+            bvalid <= 0;
+    end
+end
+
+assign s_axi_awready = !have_waddr & !bvalid;
+assign s_axi_wready = !have_wdata & !bvalid;
+assign s_axi_bvalid = bvalid;
+assign s_axi_bresp = AXI_OK;
+
+//Read channel
+always @(posedge s_axi_aclk) begin
+    if (!s_axi_aresetn) begin
+        rvalid <= 0;
+    end
+    else if (s_axi_arvalid & s_axi_arready) begin
+        case (s_axi_araddr[3:2])
+            REG_CTRL:   read_data <= {28'd0, ctrl};
+            REG_STATUS: read_data <= {13'd0, rec_overflow, play_underrun, play_half_empty, {(15-FIFO_AWIDTH){1'b0}}, play_level};
+            REG_DEPTH:  read_data <= 1 << FIFO_AWIDTH;
+            default:    read_data <= 0;
+        endcase
+        rvalid <= 1;
+    end
+    else if (rvalid & s_axi_rready) begin
+        rvalid <= 0;
+    end
+end
+
+assign s_axi_arready = !rvalid;
+assign s_axi_rvalid = rvalid;
+assign s_axi_rdata = read_data;
+assign s_axi_rresp = AXI_OK;
+
+audio_stream #(
+    .FIFO_AWIDTH(FIFO_AWIDTH)
+) audio_stream_inst (
+    .clk(s_axi_aclk),
+    .resetn(s_axi_aresetn),
+    .en_play(ctrl[0]),
+    .en_rec(ctrl[1]),
+    .flush(ctrl[3]),
+    .s_axis_tdata(s_axis_tdata),
+    .s_axis_tvalid(s_axis_tvalid),
+    .s_axis_tready(s_axis_tready),
+    .m_axis_tdata(m_axis_tdata),
+    .m_axis_tvalid(m_axis_tvalid),
+    .m_axis_tlast(m_axis_tlast),
+    .m_axis_tready(m_axis_tready),
+    .pdm_m_clk_o(pdm_clk),
+    .pdm_m_data_i(audio_in),
+    .pwm_audio_o(audio_out),
+    .pwm_audio_shutdown(audio_shutdown),
+    .play_level(play_level),
+    .play_half_empty(play_half_empty),
+    .play_underrun(play_underrun),
+    .rec_overflow(rec_overflow),
+    .clear_flags(clear_flags)
+);
+
+assign irq = ctrl[2] & ctrl[0] & play_half_empty;
+
+	endmodule
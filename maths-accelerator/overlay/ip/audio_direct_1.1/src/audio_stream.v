@@ -0,0 +1,188 @@
+`timescale 1ns / 1ps
+//////////////////////////////////////////////////////////////////////////////////
+// Module Name: audio_stream
+// Project Name: PYNQ
+//
+// AXI-Stream audio engine for the audio_direct block. Playback samples arrive on
+// s_axis from an AXI DMA as 16-bit signed PCM, are buffered in a sample FIFO and
+// converted to PDM by a first-order delta-sigma modulator. Capture streams the raw
+// 16-bit PDM words from the microphone (the same format as the register path)
+// out on m_axis in packets of REC_PACKET words.
+//
+// The FIFO is split into two halves: while one half is played the DMA refills
+// the other. play_half_empty is raised when the level falls below half, which
+// gives software one half-FIFO of playback time to start the next transfer.
+// Samples written before en_play is set are kept, so the FIFO can be primed;
+// flush discards them.
+//////////////////////////////////////////////////////////////////////////////////
+
+
+module audio_stream #(
+    parameter FIFO_AWIDTH = 10,     // 2^FIFO_AWIDTH samples, two halves
+    parameter CLK_DIV     = 25,     // clk/(2*CLK_DIV) = 2 MHz PDM clock at 100 MHz
+    parameter OSR         = 64,     // PDM bits per PCM sample: fs = 31.25 kHz
+    parameter REC_PACKET  = 256     // capture words per tlast
+    )(
+    input wire          clk,
+    input wire          resetn,
+    input wire          en_play,
+    input wire          en_rec,
+    input wire          flush,
+
+    // Playback stream
+    input wire [15:0]   s_axis_tdata,
+    input wire          s_axis_tvalid,
+    output wire         s_axis_tready,
+
+    // Capture stream
+    output reg [15:0]   m_axis_tdata,
+    output reg          m_axis_tvalid,
+    output reg          m_axis_tlast,
+    input wire          m_axis_tready,
+
+    // Audio pins
+    output wire         pdm_m_clk_o,
+    input wire          pdm_m_data_i,
+    output reg          pwm_audio_o,
+    output wire         pwm_audio_shutdown,
+
+    // Status
+    output wire [FIFO_AWIDTH:0] play_level,
+    output wire         play_half_empty,
+    output reg          play_underrun,
+    output reg          rec_overflow,
+    input wire          clear_flags
+    );
+
+localparam FIFO_DEPTH = 1 << FIFO_AWIDTH;
+
+//////////////////////////////////////////////////////////////////////////////////
+// Playback sample FIFO
+reg [15:0]              fifo [FIFO_DEPTH-1:0];
+reg [FIFO_AWIDTH:0]     wr_ptr = 0, rd_ptr = 0;
+reg [15:0]              fifo_out;
+wire                    fifo_full  = (wr_ptr - rd_ptr) == FIFO_DEPTH;
+wire                    fifo_empty = (wr_ptr == rd_ptr);
+reg                     pop;
+
+assign play_level = wr_ptr - rd_ptr;
+assign play_half_empty = play_level < (FIFO_DEPTH/2);
+assign s_axis_tready = resetn & ~fifo_full;
+
+always @(posedge clk) begin
+    if (!resetn) begin
+        wr_ptr <= 0;
+    end
+    else if (s_axis_tvalid & s_axis_tready) begin
+        fifo[wr_ptr[FIFO_AWIDTH-1:0]] <= s_axis_tdata;
+        wr_ptr <= wr_ptr + 1;
+    end
+end
+
+always @(posedge clk) begin
+    fifo_out <= fifo[rd_ptr[FIFO_AWIDTH-1:0]];
+    if (!resetn | flush) begin
+        rd_ptr <= wr_ptr;
+    end
+    else if (pop & ~fifo_empty) begin
+        rd_ptr <= rd_ptr + 1;
+    end
+end
+
+//////////////////////////////////////////////////////////////////////////////////
+// PDM bit clock for playback
+integer cnt_clk = 0;
+reg     pdm_tick = 0;
+
+always @(posedge clk) begin
+    if (cnt_clk == 2*CLK_DIV-1) begin
+        cnt_clk <= 0;
+        pdm_tick <= 1;
+    end
+    else begin
+        cnt_clk <= cnt_clk + 1;
+        pdm_tick <= 0;
+    end
+end
+
+//////////////////////////////////////////////////////////////////////////////////
+// Delta-sigma modulator: accumulate the offset-binary sample and output the carry
+integer     cnt_osr = 0;
+reg [15:0]  sample = 16'h8000;
+reg [16:0]  acc = 0;
+
+always @(posedge clk) begin
+    pop <= 0;
+    if (!resetn | !en_play) begin
+        cnt_osr <= 0;
+        sample <= 16'h8000;
+        acc <= 0;
+        pwm_audio_o <= 0;
+    end
+    else if (pdm_tick) begin
+        acc <= {1'b0, acc[15:0]} + {1'b0, sample};
+        pwm_audio_o <= acc[16];
+        if (cnt_osr == OSR-1) begin
+            cnt_osr <= 0;
+            //Load the next sample; on underrun play silence
+            sample <= fifo_empty ? 16'h8000 : {~fifo_out[15], fifo_out[14:0]};
+            pop <= 1;
+        end
+        else begin
+            cnt_osr <= cnt_osr + 1;
+        end
+    end
+end
+
+always @(posedge clk) begin
+    if (!resetn | clear_flags)
+        play_underrun <= 0;
+    else if (en_play & pdm_tick & (cnt_osr == OSR-1) & fifo_empty)
+        play_underrun <= 1;
+end
+
+assign pwm_audio_shutdown = en_play;    // amplifier shutdown is active low
+
+//////////////////////////////////////////////////////////////////////////////////
+// Capture: raw PDM words from the deserialiser
+wire        des_done;
+wire [15:0] des_dout;
+integer     rec_count = 0;
+
+PdmDes pdm_des_inst (
+    .clk(clk),
+    .en(en_rec),
+    .done(des_done),
+    .dout(des_dout),
+    .pdm_m_clk_o(pdm_m_clk_o),
+    .pdm_m_data_i(pdm_m_data_i)
+);
+
+always @(posedge clk) begin
+    if (!resetn | !en_rec) begin
+        m_axis_tvalid <= 0;
+        m_axis_tlast <= 0;
+        rec_count <= 0;
+    end
+    else begin
+        if (m_axis_tvalid & m_axis_tready)
+            m_axis_tvalid <= 0;
+        if (des_done) begin
+            //A word is produced every 8 us, so one register stage is enough
+            //unless the DMA has stalled
+            m_axis_tdata <= des_dout;
+            m_axis_tvalid <= 1;
+            m_axis_tlast <= (rec_count == REC_PACKET-1);
+            rec_count <= (rec_count == REC_PACKET-1) ? 0 : rec_count + 1;
+        end
+    end
+end
+
+always @(posedge clk) begin
+    if (!resetn | clear_flags)
+        rec_overflow <= 0;
+    else if (des_done & m_axis_tvalid & ~m_axis_tready)
+        rec_overflow <= 1;
+end
+
+endmodule
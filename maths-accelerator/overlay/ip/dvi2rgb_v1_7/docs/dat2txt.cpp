@@ -1,69 +1,287 @@
 /*
-Simple program to convert a dat file created with phoenix edid designer to 
-a .txt file that can be used to define the contents of an EEPROM implemented in HDL
+Convert EDID images to files that define the contents of an EEPROM implemented in HDL
+
+Input files are either .dat files created with Phoenix EDID Designer (a header
+followed by lines of "AA | 16 hex bytes") or raw binary EDID dumps. Each file is
+parsed into 128-byte EDID blocks, which are validated:
+  - block 0 must start with the EDID header 00 FF FF FF FF FF FF 00
+  - every block must have a zero checksum (bytes sum to 0 mod 256)
+  - the number of blocks must match the extension count in byte 126 of block 0
+
+Output formats:
+  txt   one 8-bit binary word per line, read by EEPROM_8b.vhd (kInitFileName)
+  coe   Xilinx memory coefficient file for the Block Memory Generator
+  mem   one hex byte per line, for $readmemh
+
+Usage:
+  dat2txt [-f txt|coe|mem] [-x ext] [-o outdir] file.dat [file.dat ...]
+
+Each output is written next to its input (or in outdir) with the extension of
+the format, or ext if given. For example, to regenerate the EEPROM contents in
+src/:
+  dat2txt -x data -o ../src *.dat
+
+EEPROM_8b is instantiated with kAddrBits = 7 (128 bytes), so images with
+extension blocks need kAddrBits increased to hold them.
 */
 
 #include <iostream>
 #include <fstream>
-#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
 #include <cstdlib>
-#include <bitset>
+#include <cstring>
 using namespace std;
 
-#define INPUT_DAT_LOC "C:\\Change_me.dat"
-#define OUTPUT_TXT_LOC "C:\\Change_me.txt"
+#define EDID_BLOCK_SIZE 128
+#define EDID_EXT_COUNT 126
 
-#define MAX_LINE_CNT 256
+static const unsigned char edidHeader[8] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
 
-int main( int argc, char* argv[] )
+enum Format { FMT_TXT, FMT_COE, FMT_MEM };
+
+static void usage(const char *prog)
 {
-	char lineBuf[MAX_LINE_CNT];
-	char *token; 
-	long int value;
-	ifstream input_dat;
-	ofstream output_txt;
-	output_txt.open (OUTPUT_TXT_LOC);
-	input_dat.open (INPUT_DAT_LOC);
-
-	if (output_txt.fail()) 
-	{	
-		printf("\nfail\n");
-		return 1;
+	cerr << "usage: " << prog << " [-f txt|coe|mem] [-x ext] [-o outdir] file.dat [file.dat ...]\n";
+}
+
+static bool readFile(const string &path, string &contents)
+{
+	ifstream in(path.c_str(), ios::in | ios::binary);
+	if (in.fail())
+		return false;
+	ostringstream ss;
+	ss << in.rdbuf();
+	contents = ss.str();
+	return true;
+}
+
+//Parse a Phoenix .dat file: every line of the form "AA | XX XX ..." holds data bytes
+static bool parseDat(const string &text, vector<unsigned char> &bytes, string &error)
+{
+	istringstream in(text);
+	string line;
+	int lineNo = 0;
+
+	while (getline(in, line))
+	{
+		lineNo++;
+		size_t bar = line.find('|');
+		if (bar == string::npos)
+			continue;   //header and ruler lines
+
+		char *end;
+		unsigned long addr = strtoul(line.c_str(), &end, 16);
+		if (end == line.c_str() || addr != bytes.size())
+		{
+			error = "line " + to_string(lineNo) + ": unexpected address";
+			return false;
+		}
+
+		const char *p = line.c_str() + bar + 1;
+		while (true)
+		{
+			while (*p == ' ' || *p == '\t' || *p == '\r')
+				p++;
+			if (*p == '\0')
+				break;
+			unsigned long value = strtoul(p, &end, 16);
+			if (end == p || value > 0xFF)
+			{
+				error = "line " + to_string(lineNo) + ": bad byte value";
+				return false;
+			}
+			bytes.push_back(static_cast<unsigned char>(value));
+			p = end;
+		}
 	}
-	if (input_dat.fail())
-	{	
-		printf("\nfail\n");
-		return 1;
+	return true;
+}
+
+static bool validate(const vector<unsigned char> &bytes, string &error)
+{
+	if (bytes.empty() || bytes.size() % EDID_BLOCK_SIZE != 0)
+	{
+		error = to_string(bytes.size()) + " bytes is not a whole number of 128-byte EDID blocks";
+		return false;
+	}
+	if (memcmp(bytes.data(), edidHeader, sizeof(edidHeader)) != 0)
+	{
+		error = "missing EDID header";
+		return false;
+	}
+
+	size_t blocks = bytes.size() / EDID_BLOCK_SIZE;
+	if (bytes[EDID_EXT_COUNT] + 1u != blocks)
+	{
+		error = "extension count " + to_string(bytes[EDID_EXT_COUNT]) + " does not match "
+			+ to_string(blocks - 1) + " extension blocks";
+		return false;
+	}
+
+	for (size_t b = 0; b < blocks; b++)
+	{
+		unsigned char sum = 0;
+		for (int i = 0; i < EDID_BLOCK_SIZE; i++)
+			sum += bytes[b * EDID_BLOCK_SIZE + i];
+		if (sum != 0)
+		{
+			char expected[8];
+			snprintf(expected, sizeof(expected), "%02X", (bytes[b * EDID_BLOCK_SIZE + 127] - sum) & 0xFF);
+			error = "block " + to_string(b) + " checksum is wrong, byte 127 should be " + expected;
+			return false;
+		}
 	}
-	
-	//Skip header
-	input_dat.getline(lineBuf, MAX_LINE_CNT);
-	input_dat.getline(lineBuf, MAX_LINE_CNT);
-	input_dat.getline(lineBuf, MAX_LINE_CNT);
+	return true;
+}
 
-	for( int j=0 ; j < 8 ; j++)
+//Format the whole image into one string so it can be written in a single call
+static string format(const vector<unsigned char> &bytes, Format fmt)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	string out;
+
+	switch (fmt)
 	{
+	case FMT_TXT:
+		out.reserve(bytes.size() * 9);
+		for (unsigned char v : bytes)
+		{
+			for (int bit = 7; bit >= 0; bit--)
+				out += (v >> bit) & 1 ? '1' : '0';
+			out += '\n';
+		}
+		break;
+
+	case FMT_COE:
+		out = "memory_initialization_radix=16;\nmemory_initialization_vector=\n";
+		for (size_t i = 0; i < bytes.size(); i++)
+		{
+			out += hex[bytes[i] >> 4];
+			out += hex[bytes[i] & 0xF];
+			out += (i + 1 == bytes.size()) ? ";\n" : ",\n";
+		}
+		break;
+
+	case FMT_MEM:
+		out.reserve(bytes.size() * 3);
+		for (unsigned char v : bytes)
+		{
+			out += hex[v >> 4];
+			out += hex[v & 0xF];
+			out += '\n';
+		}
+		break;
+	}
+	return out;
+}
+
+static string outputPath(const string &input, const string &outDir, const string &ext)
+{
+	size_t slash = input.find_last_of("/\\");
+	string dir = (slash == string::npos) ? "" : input.substr(0, slash + 1);
+	string name = (slash == string::npos) ? input : input.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	if (dot != string::npos)
+		name = name.substr(0, dot);
+
+	if (!outDir.empty())
+		dir = outDir + "/";
+	return dir + name + "." + ext;
+}
 
-		input_dat.getline(lineBuf, MAX_LINE_CNT);
+int main( int argc, char* argv[] )
+{
+	Format fmt = FMT_TXT;
+	string ext, outDir;
+	vector<string> inputs;
 
-		//Discard address and "|" 
-		token = strtok(lineBuf, " \n\r");
-		token = strtok(NULL, " \n\r");
-		for (int i=0 ; i < 16 ; i++)
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if ((arg == "-f" || arg == "-x" || arg == "-o") && i + 1 < argc)
 		{
-			token = strtok(NULL, " \n\r");
-			if (token == NULL)
+			string value = argv[++i];
+			if (arg == "-x")
+				ext = value;
+			else if (arg == "-o")
+				outDir = value;
+			else if (value == "txt")
+				fmt = FMT_TXT;
+			else if (value == "coe")
+				fmt = FMT_COE;
+			else if (value == "mem")
+				fmt = FMT_MEM;
+			else
 			{
-				printf("error\n");
+				usage(argv[0]);
 				return 1;
 			}
-			value = strtol(token, NULL, 16);
-			output_txt << std::bitset<8>(value) << '\n';
 		}
+		else if (arg[0] == '-')
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		else
+			inputs.push_back(arg);
+	}
+	if (inputs.empty())
+	{
+		usage(argv[0]);
+		return 1;
 	}
+	if (ext.empty())
+		ext = (fmt == FMT_TXT) ? "txt" : (fmt == FMT_COE) ? "coe" : "mem";
+
+	int failures = 0;
+	for (const string &input : inputs)
+	{
+		string contents, error;
+		vector<unsigned char> bytes;
+
+		if (!readFile(input, contents))
+		{
+			cerr << input << ": cannot open\n";
+			failures++;
+			continue;
+		}
+
+		//Binary dumps start with the EDID header; anything else is parsed as a .dat file
+		bool binary = contents.size() >= sizeof(edidHeader)
+			&& memcmp(contents.data(), edidHeader, sizeof(edidHeader)) == 0;
+		if (binary)
+			bytes.assign(contents.begin(), contents.end());
+		else if (!parseDat(contents, bytes, error))
+		{
+			cerr << input << ": " << error << "\n";
+			failures++;
+			continue;
+		}
+
+		if (!validate(bytes, error))
+		{
+			cerr << input << ": " << error << "\n";
+			failures++;
+			continue;
+		}
 
-	output_txt.close();
-	input_dat.close();
+		string output = outputPath(input, outDir, ext);
+		string text = format(bytes, fmt);
+		ofstream out(output.c_str(), ios::out | ios::binary);
+		out.write(text.data(), text.size());
+		out.close();
+		if (out.fail())
+		{
+			cerr << output << ": write failed\n";
+			failures++;
+			continue;
+		}
+		cout << input << " -> " << output << " (" << bytes.size() / EDID_BLOCK_SIZE << " block"
+			<< (bytes.size() > EDID_BLOCK_SIZE ? "s" : "") << ")\n";
+	}
 
-	return 0;
+	return failures ? 1 : 0;
 }
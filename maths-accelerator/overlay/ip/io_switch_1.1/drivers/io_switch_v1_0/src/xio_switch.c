@@ -52,44 +52,60 @@
 // Byte array for pins. Elements include pin type defined in io_switch.h
 char pins[XPAR_IO_SWITCH_0_IO_SWITCH_WIDTH]; 
 
+// Shadow copy of the switch configuration words and a bit mask of the
+// words that differ from the hardware. The shadow is only trusted after
+// init_io_switch() or sync_io_switch(); the first change staged before
+// then loads it from the hardware.
+static u32 shadow[IO_SWITCH_NUM_WORDS];
+static u32 dirty;
+_Static_assert(IO_SWITCH_NUM_WORDS <= 32, "dirty has one bit per configuration word");
+static int shadow_valid;
+
+#ifdef IO_SWITCH_STATS
+struct io_switch_stats io_switch_stats;
+#define SWITCH_IN32(addr)        (io_switch_stats.reads++, Xil_In32(addr))
+#define SWITCH_OUT32(addr, data) do { io_switch_stats.writes++; \
+                                      Xil_Out32((addr), (data)); } while (0)
+#else
+#define SWITCH_IN32(addr)        Xil_In32(addr)
+#define SWITCH_OUT32(addr, data) Xil_Out32((addr), (data))
+#endif
+
+// Load the shadow from the hardware if it is not trusted yet. Nothing is
+// staged while it is invalid, so no staged word is overwritten
+static void validate_shadow(void) {
+    if (!shadow_valid)
+        sync_io_switch();
+}
+
+// Stage one byte of the configuration word array
+static void stage_byte(int pin_number, u8 pin_type) {
+    int word = pin_number/4;
+    int shift = (pin_number%4)*8;
+    u32 value = (shadow[word] & ~(0xFFu<<shift)) | ((u32)pin_type<<shift);
+
+    if (value != shadow[word]) {
+        shadow[word] = value;
+        dirty |= 1u<<word;
+    }
+}
+
 // Basic API for configuring the switch. 
 // Function: Configure pins with desired functionality
 // Input: Number of pins to be configured and pins array pre-loaded before 
 //        calling this function
 // Output: None
 void config_io_switch(int num_of_pins) {
-    int i,j,num_words,num_bytes;
-    u32 switchConfigValue;
-
-    num_words=num_of_pins/4;
-    num_bytes=num_of_pins%4;
-    for (i=0, j=0; j<num_words; i=i+4, j++) {
-        switchConfigValue = (pins[i+3]<<24)|(pins[i+2]<<16)| \
-        (pins[i+1]<<8)|(pins[i]);
-        Xil_Out32(SWITCH_BASEADDR+i, switchConfigValue);
-    }
-    if(num_bytes) {
-        switchConfigValue=0;
-        for (j=0; j<num_bytes; j++)
-            switchConfigValue = switchConfigValue | \
-            (pins[num_words*4+j] << j*8);
-        Xil_Out32(SWITCH_BASEADDR+num_words*4, switchConfigValue);
-    }
+    stage_pin_map((const u8 *)pins, num_of_pins);
+    commit_io_switch();
 }
 
 // Basic API for setting a pin to the desired functionality
 // Input: pin number and pin type 
 // Output: None
 void set_pin(int pin_number, u8 pin_type) {
-    int numWordstoPass, byteNumber;
-    u32 switchConfigValue;
-
-    numWordstoPass=pin_number/4;
-    byteNumber=pin_number%4;
-    switchConfigValue=Xil_In32(SWITCH_BASEADDR+4*numWordstoPass);
-    switchConfigValue = (switchConfigValue & (~(0xFF<<(byteNumber*8)))) | \
-    (pin_type<<(byteNumber*8));
-    Xil_Out32(SWITCH_BASEADDR+numWordstoPass*4, switchConfigValue);
+    stage_pin(pin_number, pin_type);
+    commit_io_switch();
 }
 
 // Basic API for setting all pins to GPIO
@@ -99,7 +115,78 @@ void init_io_switch(void) {
     int i;
     for(i=0; i<XPAR_IO_SWITCH_0_IO_SWITCH_WIDTH; i++)
         pins[i]=GPIO;
-    config_io_switch(XPAR_IO_SWITCH_0_IO_SWITCH_WIDTH); // All GPIO
+    // Write every word without reading the hardware first
+    for (i=0; i<IO_SWITCH_NUM_WORDS; i++) {
+        shadow[i] = GPIO*0x01010101u;
+        dirty |= 1u<<i;
+    }
+    shadow_valid = 1;
+    commit_io_switch(); // All GPIO
+}
+
+// Load the shadow registers from the hardware, e.g. after another
+// processor has configured the switch
+// Input: None
+// Output: None
+void sync_io_switch(void) {
+    int i;
+    for (i=0; i<IO_SWITCH_NUM_WORDS; i++)
+        shadow[i] = SWITCH_IN32(SWITCH_BASEADDR+4*i);
+    dirty = 0;
+    shadow_valid = 1;
+}
+
+// Stage a pin change without touching the hardware
+// Input: pin number and pin type
+// Output: None
+void stage_pin(int pin_number, u8 pin_type) {
+    validate_shadow();
+    stage_byte(pin_number, pin_type);
+}
+
+// Stage a pin map without touching the hardware. As in config_io_switch(),
+// the remaining pins of the last word are set to GPIO
+// Input: pin type array and number of pins in it
+// Output: None
+void stage_pin_map(const u8 *map, int num_of_pins) {
+    int i;
+    validate_shadow();
+    for (i=0; i<(num_of_pins+3)/4*4; i++)
+        stage_byte(i, i<num_of_pins ? map[i] : GPIO);
+}
+
+// Write the staged configuration words that differ from the hardware.
+// Words are written in ascending order in one pass, with no reads
+// Input: None
+// Output: Number of AXI writes performed
+int commit_io_switch(void) {
+    int i, writes = 0;
+    for (i=0; i<IO_SWITCH_NUM_WORDS; i++) {
+        if (dirty & (1u<<i)) {
+            SWITCH_OUT32(SWITCH_BASEADDR+4*i, shadow[i]);
+            writes++;
+        }
+    }
+    dirty = 0;
+    return writes;
+}
+
+// Discard staged changes that have not been committed
+// Input: None
+// Output: None
+void discard_io_switch(void) {
+    if (dirty) {
+        shadow_valid = 0;
+        sync_io_switch();
+    }
+}
+
+// Stage and commit a complete pin map in one pass
+// Input: pin type array and number of pins in it
+// Output: Number of AXI writes performed
+int apply_pin_map(const u8 *map, int num_of_pins) {
+    stage_pin_map(map, num_of_pins);
+    return commit_io_switch();
 }
 
 /************************** Function Definitions ***************************/
@@ -105,11 +105,32 @@ enum io_configuration {
 
 #define SWITCH_BASEADDR XPAR_IO_SWITCH_0_S_AXI_BASEADDR
 
+// Number of 32-bit configuration words, four pins per word
+#define IO_SWITCH_NUM_WORDS ((XPAR_IO_SWITCH_0_IO_SWITCH_WIDTH+3)/4)
+
+#ifdef IO_SWITCH_STATS
+// AXI transaction counters, enabled by compiling with -DIO_SWITCH_STATS
+struct io_switch_stats {
+    u32 reads;
+    u32 writes;
+};
+extern struct io_switch_stats io_switch_stats;
+#endif
+
 // Functions defined in xio_switch.c					
 void config_io_switch(int num_of_pins);
 void set_pin(int pin_number, u8 pin_type);
 void init_io_switch(void);
 
+// Shadow-register API: stage any number of pin changes, then write only
+// the configuration words that changed with commit_io_switch()
+void sync_io_switch(void);
+void stage_pin(int pin_number, u8 pin_type);
+void stage_pin_map(const u8 *map, int num_of_pins);
+int commit_io_switch(void);
+void discard_io_switch(void);
+int apply_pin_map(const u8 *map, int num_of_pins);
+
 #ifdef __cplusplus 
 }
 #endif